@@ -1,3 +1,8 @@
+/* CPU affinity (cpu_set_t) needs the GNU extensions, which have to be requested before any system header. */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 
@@ -13,11 +18,549 @@
 #endif
 #endif
 
+#if !defined(_WIN32)
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#endif
+
+/* Winsock has to come before windows.h, which miniaudio.h pulls in. */
+#if !defined(MA_WRAPPER_NO_NETWORK)
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <unistd.h>
+#endif
+#endif
+
+/*
+Real-time safety audit. Building with MA_RT_AUDIT sends miniaudio's allocator, the lock and wait primitives behind its
+mutexes, events and semaphores, sleeps, stdio file calls and POSIX read()/write() through checks that record a
+violation, with a backtrace, whenever one of them runs on a thread that is inside a data callback. For debug and CI
+builds only. The redirections are macros, so they have to be in place before miniaudio.h and after the system headers
+that declare the originals. The one sanctioned syscall is the readiness post, a single non-blocking write() per
+watermark crossing, which calls the original directly and is not reported. tests/rt_audit_test.c exercises this mode.
+*/
+#if defined(MA_RT_AUDIT)
+#include <stdio.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+void* ma_rt_audit_malloc(size_t sz);
+void* ma_rt_audit_realloc(void* p, size_t sz);
+void  ma_rt_audit_free(void* p);
+FILE* ma_rt_audit_fopen(const char* pFilePath, const char* pMode);
+size_t ma_rt_audit_fread(void* pBuffer, size_t size, size_t count, FILE* pFile);
+size_t ma_rt_audit_fwrite(const void* pBuffer, size_t size, size_t count, FILE* pFile);
+int ma_rt_audit_fflush(FILE* pFile);
+
+#define MA_MALLOC(sz)                   ma_rt_audit_malloc(sz)
+#define MA_REALLOC(p, sz)               ma_rt_audit_realloc(p, sz)
+#define MA_FREE(p)                      ma_rt_audit_free(p)
+#define fopen(path, mode)               ma_rt_audit_fopen(path, mode)
+#define fread(p, size, count, file)     ma_rt_audit_fread(p, size, count, file)
+#define fwrite(p, size, count, file)    ma_rt_audit_fwrite(p, size, count, file)
+#define fflush(file)                    ma_rt_audit_fflush(file)
+
+#if defined(_WIN32)
+DWORD ma_rt_audit_WaitForSingleObject(HANDLE handle, DWORD milliseconds);
+void ma_rt_audit_Sleep(DWORD milliseconds);
+
+#define WaitForSingleObject(handle, ms) ma_rt_audit_WaitForSingleObject(handle, ms)
+#define Sleep(ms)                       ma_rt_audit_Sleep(ms)
+#else
+int ma_rt_audit_pthread_mutex_lock(pthread_mutex_t* pMutex);
+int ma_rt_audit_pthread_cond_wait(pthread_cond_t* pCond, pthread_mutex_t* pMutex);
+int ma_rt_audit_nanosleep(const struct timespec* pDuration, struct timespec* pRemaining);
+int ma_rt_audit_usleep(useconds_t microseconds);
+ssize_t ma_rt_audit_read(int fd, void* pBuffer, size_t size);
+ssize_t ma_rt_audit_write(int fd, const void* pBuffer, size_t size);
+
+#define pthread_mutex_lock(m)           ma_rt_audit_pthread_mutex_lock(m)
+#define pthread_cond_wait(c, m)         ma_rt_audit_pthread_cond_wait(c, m)
+#define nanosleep(d, r)                 ma_rt_audit_nanosleep(d, r)
+#define usleep(us)                      ma_rt_audit_usleep(us)
+#define read(fd, p, size)               ma_rt_audit_read(fd, p, size)
+#define write(fd, p, size)              ma_rt_audit_write(fd, p, size)
+#endif
+#endif
+
 #define MINIAUDIO_IMPLEMENTATION
 #define MA_NO_ENGINE
 #define MA_NO_RESOURCE_MANAGER
 #include "miniaudio.h"
 
+typedef enum
+{
+    ma_rt_violation_allocation = 0,
+    ma_rt_violation_lock,               /* Blocking mutex, condition variable or kernel wait. */
+    ma_rt_violation_sleep,
+    ma_rt_violation_file_io
+} ma_rt_violation_type;
+
+#define MA_RT_AUDIT_MAX_RECORDS         64
+#define MA_RT_AUDIT_MAX_BACKTRACE       16
+
+typedef struct
+{
+    ma_rt_violation_type type;
+    ma_uint32 backtraceSize;
+    const char* pFunction;              /* Name of the call that was intercepted. Static storage. */
+    void* pBacktrace[MA_RT_AUDIT_MAX_BACKTRACE];
+} ma_rt_violation;
+
+#if defined(MA_RT_AUDIT)
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#endif
+
+#if defined(_MSC_VER)
+#define MA_RT_AUDIT_THREAD_LOCAL __declspec(thread)
+#else
+#define MA_RT_AUDIT_THREAD_LOCAL __thread
+#endif
+
+static MA_RT_AUDIT_THREAD_LOCAL ma_uint32 g_maRtAuditCallbackDepth;
+static MA_RT_AUDIT_THREAD_LOCAL ma_bool32 g_maRtAuditIsRecording;
+static ma_rt_violation g_maRtAuditRecords[MA_RT_AUDIT_MAX_RECORDS];
+static MA_ATOMIC(4, ma_uint32) g_maRtAuditRecordCount;
+static MA_ATOMIC(8, ma_uint64) g_maRtAuditViolationCounts[ma_rt_violation_file_io + 1];
+
+static void ma_rt_audit_check(ma_rt_violation_type type, const char* pFunction)
+{
+    /* Capturing a backtrace can itself allocate the first time, which must not be reported again. */
+    if (g_maRtAuditCallbackDepth == 0 || g_maRtAuditIsRecording) {
+        return;
+    }
+
+    g_maRtAuditIsRecording = MA_TRUE;
+
+    ma_atomic_fetch_add_64(&g_maRtAuditViolationCounts[type], 1);
+
+    const ma_uint32 iRecord = ma_atomic_fetch_add_32(&g_maRtAuditRecordCount, 1);
+    if (iRecord < MA_RT_AUDIT_MAX_RECORDS) {
+        ma_rt_violation* pRecord = &g_maRtAuditRecords[iRecord];
+        pRecord->type = type;
+        pRecord->pFunction = pFunction;
+    #if defined(_WIN32)
+        pRecord->backtraceSize = CaptureStackBackTrace(1, MA_RT_AUDIT_MAX_BACKTRACE, pRecord->pBacktrace, NULL);
+    #elif defined(__GLIBC__) || defined(__APPLE__)
+        pRecord->backtraceSize = (ma_uint32)backtrace(pRecord->pBacktrace, MA_RT_AUDIT_MAX_BACKTRACE);
+    #else
+        pRecord->backtraceSize = 0;
+    #endif
+    }
+
+    g_maRtAuditIsRecording = MA_FALSE;
+}
+
+static void ma_rt_audit_enter_callback(void)
+{
+    g_maRtAuditCallbackDepth += 1;
+}
+
+static void ma_rt_audit_leave_callback(void)
+{
+    g_maRtAuditCallbackDepth -= 1;
+}
+
+/* The parentheses around each original name keep the redirection macros from expanding into recursion. */
+void* ma_rt_audit_malloc(size_t sz)
+{
+    ma_rt_audit_check(ma_rt_violation_allocation, "malloc");
+    return (malloc)(sz);
+}
+
+void* ma_rt_audit_realloc(void* p, size_t sz)
+{
+    ma_rt_audit_check(ma_rt_violation_allocation, "realloc");
+    return (realloc)(p, sz);
+}
+
+void ma_rt_audit_free(void* p)
+{
+    ma_rt_audit_check(ma_rt_violation_allocation, "free");
+    (free)(p);
+}
+
+FILE* ma_rt_audit_fopen(const char* pFilePath, const char* pMode)
+{
+    ma_rt_audit_check(ma_rt_violation_file_io, "fopen");
+    return (fopen)(pFilePath, pMode);
+}
+
+size_t ma_rt_audit_fread(void* pBuffer, size_t size, size_t count, FILE* pFile)
+{
+    ma_rt_audit_check(ma_rt_violation_file_io, "fread");
+    return (fread)(pBuffer, size, count, pFile);
+}
+
+size_t ma_rt_audit_fwrite(const void* pBuffer, size_t size, size_t count, FILE* pFile)
+{
+    ma_rt_audit_check(ma_rt_violation_file_io, "fwrite");
+    return (fwrite)(pBuffer, size, count, pFile);
+}
+
+int ma_rt_audit_fflush(FILE* pFile)
+{
+    ma_rt_audit_check(ma_rt_violation_file_io, "fflush");
+    return (fflush)(pFile);
+}
+
+#if defined(_WIN32)
+DWORD ma_rt_audit_WaitForSingleObject(HANDLE handle, DWORD milliseconds)
+{
+    /* A zero timeout only polls and never blocks. */
+    if (milliseconds != 0) {
+        ma_rt_audit_check(ma_rt_violation_lock, "WaitForSingleObject");
+    }
+
+    return (WaitForSingleObject)(handle, milliseconds);
+}
+
+void ma_rt_audit_Sleep(DWORD milliseconds)
+{
+    ma_rt_audit_check(ma_rt_violation_sleep, "Sleep");
+    (Sleep)(milliseconds);
+}
+#else
+int ma_rt_audit_pthread_mutex_lock(pthread_mutex_t* pMutex)
+{
+    ma_rt_audit_check(ma_rt_violation_lock, "pthread_mutex_lock");
+    return (pthread_mutex_lock)(pMutex);
+}
+
+int ma_rt_audit_pthread_cond_wait(pthread_cond_t* pCond, pthread_mutex_t* pMutex)
+{
+    ma_rt_audit_check(ma_rt_violation_lock, "pthread_cond_wait");
+    return (pthread_cond_wait)(pCond, pMutex);
+}
+
+int ma_rt_audit_nanosleep(const struct timespec* pDuration, struct timespec* pRemaining)
+{
+    ma_rt_audit_check(ma_rt_violation_sleep, "nanosleep");
+    return (nanosleep)(pDuration, pRemaining);
+}
+
+int ma_rt_audit_usleep(useconds_t microseconds)
+{
+    ma_rt_audit_check(ma_rt_violation_sleep, "usleep");
+    return (usleep)(microseconds);
+}
+
+ssize_t ma_rt_audit_read(int fd, void* pBuffer, size_t size)
+{
+    ma_rt_audit_check(ma_rt_violation_file_io, "read");
+    return (read)(fd, pBuffer, size);
+}
+
+ssize_t ma_rt_audit_write(int fd, const void* pBuffer, size_t size)
+{
+    ma_rt_audit_check(ma_rt_violation_file_io, "write");
+    return (write)(fd, pBuffer, size);
+}
+#endif
+
+#define MA_RT_AUDIT_ENTER_CALLBACK()    ma_rt_audit_enter_callback()
+#define MA_RT_AUDIT_LEAVE_CALLBACK()    ma_rt_audit_leave_callback()
+#else
+#define MA_RT_AUDIT_ENTER_CALLBACK()
+#define MA_RT_AUDIT_LEAVE_CALLBACK()
+#endif
+
+typedef enum
+{
+    ma_stream_state_stopped = 0,
+    ma_stream_state_started = 1,
+    ma_stream_state_buffering = 2   /* Playback only: running, but holding the ring back until it reaches the prefill. */
+} ma_stream_state;
+
+/*
+Read-only status block published by every instance. The native side only ever updates it with atomic operations, so the
+managed side can poll it directly through the pointer returned by ma_*_get_status() without any native calls. The
+pointer is stable for the lifetime of the instance. ringFillInFrames is a snapshot; framesWritten - framesRead is exact.
+*/
+typedef struct
+{
+    MA_ATOMIC(8, ma_uint64) deviceFrames;                   /* Frames exchanged with the device by the data callback. */
+    MA_ATOMIC(8, ma_uint64) framesWritten;                  /* Frames committed to the ring. */
+    MA_ATOMIC(8, ma_uint64) framesRead;                     /* Frames consumed from the ring. */
+    MA_ATOMIC(8, ma_uint64) xrunFrames;                     /* Capture: frames dropped because the ring was full. Playback: silence frames emitted because it was empty. */
+    MA_ATOMIC(8, ma_uint64) lastCallbackTimeInNanoseconds;  /* Monotonic clock. */
+    MA_ATOMIC(4, ma_uint32) ringFillInFrames;
+    MA_ATOMIC(4, ma_uint32) bufferSizeInFrames;
+    MA_ATOMIC(4, ma_uint32) state;                          /* ma_stream_state */
+    MA_ATOMIC(4, ma_uint32) overrunCount;
+    MA_ATOMIC(4, ma_uint32) underrunCount;
+    ma_uint32 reserved;
+} ma_stream_status;
+
+/* Defined with the capture processing stages; instances only hold pointers to them. */
+typedef struct ma_echo_canceller ma_echo_canceller;
+typedef struct ma_speaker_concealer ma_speaker_concealer;
+typedef struct ma_shared_ring ma_shared_ring;
+
+#ifndef MA_LEVEL_METER_MAX_CHANNELS
+#define MA_LEVEL_METER_MAX_CHANNELS 8
+#endif
+
+#define MA_LEVEL_METER_CLIP_THRESHOLD 0.99f
+
+/* Linear amplitudes. peak falls back at the configured decay rate; heldPeak stays put for the hold time before decaying. */
+typedef struct
+{
+    MA_ATOMIC(4, float) peak;
+    MA_ATOMIC(4, float) heldPeak;
+    MA_ATOMIC(4, float) rms;
+    MA_ATOMIC(4, ma_uint32) clipCount;  /* Samples at or above MA_LEVEL_METER_CLIP_THRESHOLD since the instance was created. */
+} ma_level_meter_channel;
+
+/*
+Per-channel levels updated by the data callback after every period. Like the status block it is embedded in the
+instance and only written with atomic stores, so meters can be polled straight through the pointer returned by
+ma_*_get_meter(). Channels beyond MA_LEVEL_METER_MAX_CHANNELS are not metered.
+*/
+typedef struct
+{
+    ma_level_meter_channel channels[MA_LEVEL_METER_MAX_CHANNELS];
+    MA_ATOMIC(4, ma_uint32) channelCount;
+    MA_ATOMIC(4, float) decayDbPerSecond;
+    MA_ATOMIC(4, float) holdTimeInSeconds;
+    MA_ATOMIC(4, float) rmsWindowInSeconds;
+    ma_uint32 sampleRate;
+    float meanSquare[MA_LEVEL_METER_MAX_CHANNELS];              /* Callback-private from here on. */
+    float holdRemainingInSeconds[MA_LEVEL_METER_MAX_CHANNELS];
+} ma_level_meter;
+
+#ifndef MA_FILTER_CHAIN_MAX_STAGES
+#define MA_FILTER_CHAIN_MAX_STAGES 8
+#endif
+
+#ifndef MA_FILTER_CHAIN_UPDATE_QUEUE_SIZE
+#define MA_FILTER_CHAIN_UPDATE_QUEUE_SIZE 32
+#endif
+
+typedef enum
+{
+    ma_filter_type_highpass = 0,    /* Butterworth, even order only. A second order high-pass around 20 Hz doubles as DC removal. */
+    ma_filter_type_lowpass = 1,     /* Butterworth. */
+    ma_filter_type_bandpass = 2,    /* Order must be even. */
+    ma_filter_type_notch = 3,
+    ma_filter_type_peak = 4,
+    ma_filter_type_low_shelf = 5,
+    ma_filter_type_high_shelf = 6
+} ma_filter_type;
+
+typedef struct
+{
+    ma_filter_type type;
+    ma_uint32 order;                /* High-pass, low-pass and band-pass only. */
+    double frequency;
+    double q;                       /* Shelf slope for the shelving filters. */
+    double gainDB;                  /* Peak and shelving filters only. */
+} ma_filter_stage_config;
+
+typedef struct
+{
+    ma_filter_stage_config config;
+    union
+    {
+        ma_hpf hpf;
+        ma_lpf lpf;
+        ma_bpf bpf;
+        ma_notch2 notch;
+        ma_peak2 peak;
+        ma_loshelf2 lowShelf;
+        ma_hishelf2 highShelf;
+    } filter;
+} ma_filter_stage;
+
+typedef struct
+{
+    ma_uint32 stageIndex;
+    ma_filter_stage_config config;
+} ma_filter_stage_update;
+
+/*
+A chain of miniaudio filters run in place by a data callback, always in f32. Every stage's heap comes from the chain's
+own allocation. Parameter changes are posted to a single-producer queue and applied with the filters' reinit functions
+at the start of the next callback, which keeps filter state and never allocates.
+*/
+typedef struct
+{
+    ma_uint32 channels;
+    ma_uint32 sampleRate;
+    ma_uint32 stageCount;
+    ma_filter_stage stages[MA_FILTER_CHAIN_MAX_STAGES];
+    ma_filter_stage_update updates[MA_FILTER_CHAIN_UPDATE_QUEUE_SIZE];
+    MA_ATOMIC(4, ma_uint32) updateWriteIndex;
+    MA_ATOMIC(4, ma_uint32) updateReadIndex;
+} ma_filter_chain;
+
+#ifndef MA_MICROPHONE_MAX_TAPS
+#define MA_MICROPHONE_MAX_TAPS 8
+#endif
+
+/*
+A tap is an additional single-consumer ring fed by the capture callback alongside the main ring. Native consumers
+(recorders, analysers, ...) drain their own tap so they never compete with ma_microphone_read() for the main ring.
+*/
+typedef struct
+{
+    ma_pcm_rb ringBuffer;
+    MA_ATOMIC(8, ma_uint64) droppedFrames;
+} ma_microphone_tap;
+
+/*
+Readiness notification for event loops. The fd becomes readable when the ring crosses the watermark: capture data at or
+above it for a microphone, queued playback below it for a speaker. Only the data callback posts, at most once per
+crossing, and only the consumer's acknowledge rearms it.
+*/
+typedef struct
+{
+    int fd;                                     /* Handed to the caller for polling. -1 while disabled. */
+    int writeFd;                                /* Same as fd for an eventfd, the write end of the pipe otherwise. */
+    MA_ATOMIC(4, ma_uint32) watermarkInFrames;  /* 0 while disabled. */
+    MA_ATOMIC(4, ma_bool32) isSignaled;
+} ma_readiness_event;
+
+typedef struct
+{
+    float thresholdDb;                  /* A frame is speech when its energy exceeds the tracked noise floor by this much. */
+    float minEnergyDb;                  /* Frames quieter than this are never speech. */
+    float zeroCrossingRate;             /* Crossings per sample above which a frame within half the threshold counts as unvoiced speech. */
+    ma_uint32 frameSizeInMilliseconds;  /* Analysis frame. */
+    ma_uint32 hangoverInMilliseconds;   /* How long speech is held after the last speech frame. */
+    ma_uint32 preRollInMilliseconds;    /* Audio preceding an onset that is delivered with the segment in gated mode. */
+    ma_bool32 gated;                    /* When set, the main ring only receives speech segments and their pre-roll. */
+} ma_microphone_vad_config;
+
+/* Published VAD state. Lives in the microphone so its address is stable; updated with atomic stores once per analysis frame. */
+typedef struct
+{
+    MA_ATOMIC(8, ma_uint64) speechFrames;
+    MA_ATOMIC(4, ma_bool32) isSpeech;
+    MA_ATOMIC(4, ma_uint32) segmentCount;
+    MA_ATOMIC(4, float) energyDb;
+    MA_ATOMIC(4, float) noiseFloorDb;
+    MA_ATOMIC(4, float) zeroCrossingRate;
+    ma_uint32 reserved;
+} ma_microphone_vad_state;
+
+/* Detector instance. Only the data callback touches it while it is published. */
+typedef struct
+{
+    ma_microphone_vad_config config;
+    ma_uint32 frameSizeInFrames;
+    ma_uint32 hangoverInAnalysisFrames;
+    ma_uint32 hangoverRemaining;
+    ma_uint32 frameCursor;
+    float sumOfSquares;
+    ma_uint32 zeroCrossings;
+    float lastSample;
+    float noiseFloorDb;
+    ma_bool32 hasNoiseFloor;
+    ma_bool32 isSpeech;
+    ma_bool32 isPreRollPending;
+    void* pPreRoll;                     /* Circular buffer in the microphone's format. */
+    ma_uint32 preRollSizeInFrames;
+    ma_uint32 preRollWritePos;
+    ma_uint32 preRollFrameCount;
+} ma_microphone_vad;
+
+typedef struct
+{
+    float targetLevelDb;                /* RMS level the AGC steers towards, in dBFS. */
+    float maxGainDb;
+    float minGainDb;
+    ma_uint32 attackInMilliseconds;     /* Envelope rise time; governs how quickly gain is pulled down on loud input. */
+    ma_uint32 releaseInMilliseconds;    /* Envelope fall time; governs how quickly gain recovers. */
+    ma_uint32 smoothingInMilliseconds;  /* Gain ramp applied by ma_gainer on every change. */
+    ma_bool32 gateEnabled;
+    float gateThresholdDb;              /* The gate closes when the envelope stays below this for the hold time. */
+    ma_uint32 gateHoldInMilliseconds;
+    float gateRangeDb;                  /* Attenuation while the gate is closed. */
+} ma_microphone_agc_config;
+
+/* Published AGC state, embedded in the microphone like the VAD state. */
+typedef struct
+{
+    MA_ATOMIC(4, float) levelDb;
+    MA_ATOMIC(4, float) gainDb;
+    MA_ATOMIC(4, ma_bool32) isGateOpen;
+    ma_uint32 reserved;
+} ma_microphone_agc_state;
+
+typedef struct
+{
+    ma_microphone_agc_config config;
+    ma_gainer gainer;
+    ma_uint32 blockSizeInFrames;
+    ma_uint32 gateHoldInBlocks;
+    ma_uint32 gateHoldRemaining;
+    ma_bool32 isGateOpen;
+    float attackCoefficient;
+    float releaseCoefficient;
+    float envelopeDb;
+    float gainDb;
+} ma_microphone_agc;
+
+typedef enum
+{
+    ma_thread_scheduling_default = 0,       /* Whatever the backend gives the thread. */
+    ma_thread_scheduling_fifo,              /* SCHED_FIFO; time-critical priority on Windows. */
+    ma_thread_scheduling_round_robin        /* SCHED_RR; time-critical priority on Windows. */
+} ma_thread_scheduling;
+
+/*
+Settings for the thread that runs the data callback. priority and stackSizeInBytes go to the context and apply to the
+threads miniaudio creates itself. Scheduling and affinity are applied from inside the first data callback, so they also
+reach threads owned by the backend; real-time policies usually need elevated rights (CAP_SYS_NICE or an rtkit/limits
+grant on Linux).
+*/
+typedef struct
+{
+    ma_thread_priority priority;            /* 0 (ma_thread_priority_highest) is miniaudio's default. */
+    size_t stackSizeInBytes;                /* 0 for the default. */
+    ma_thread_scheduling scheduling;
+    ma_int32 realtimePriority;              /* For FIFO and round robin. 0 picks the middle of the range the OS allows. */
+    ma_uint64 cpuAffinityMask;              /* Bit n allows CPU n. 0 leaves affinity alone. */
+} ma_callback_thread_config;
+
+/* Outcome of a ma_callback_thread_config, filled in by the callback thread itself. */
+typedef struct
+{
+    MA_ATOMIC(4, ma_bool32) isApplied;      /* Set once the first data callback has run. The other fields are valid from then on. */
+    ma_result schedulingResult;             /* MA_ACCESS_DENIED when the OS refused the policy for lack of privileges. */
+    ma_result affinityResult;
+    ma_int32 policy;                        /* Policy and priority the thread runs with afterwards, as reported by the OS. */
+    ma_int32 priority;
+    ma_uint64 cpuAffinityMask;              /* Effective affinity afterwards, for the first 64 CPUs. 0 if unknown. */
+} ma_callback_thread_report;
+
 typedef struct
 {
     ma_context context;
@@ -29,8 +572,61 @@ typedef struct
     ma_uint32 bufferSizeInFrames;
     ma_uint32 bytesPerFrame;
     ma_bool32 isStarted;
+    ma_allocation_callbacks allocationCallbacks;
+    ma_stream_status status;
+    ma_level_meter meter;
+    MA_ATOMIC(4, ma_uint32) callbackSequence;  /* Odd while the data callback is running. */
+    ma_microphone_tap* pTaps[MA_MICROPHONE_MAX_TAPS];
+    ma_microphone_vad* pVad;
+    ma_microphone_vad_state vadState;
+    ma_microphone_agc* pAgc;
+    ma_microphone_agc_state agcState;
+    ma_echo_canceller* pEchoCanceller;
+    ma_shared_ring* pSharedRing;
+    ma_filter_chain* pFilters;
+    ma_spinlock filterLock;                     /* Serializes filter chain replacement against parameter updates. */
+    ma_callback_thread_config threadConfig;
+    ma_callback_thread_report threadReport;     /* Written once by the callback thread, published through threadReport.isApplied. */
+    MA_ATOMIC(4, ma_bool32) needsThreadSetup;
+    ma_readiness_event readiness;
 } ma_microphone;
 
+#ifndef MA_SPEAKER_MAX_VOICES
+#define MA_SPEAKER_MAX_VOICES 32
+#endif
+
+typedef enum
+{
+    ma_speaker_fade_request_none = 0,
+    ma_speaker_fade_request_stop = 1,
+    ma_speaker_fade_request_flush = 2,
+    ma_speaker_fade_request_done = 3        /* Set by the callback once a stop fade has reached silence. */
+} ma_speaker_fade_request;
+
+typedef enum
+{
+    ma_speaker_voice_state_free = 0,
+    ma_speaker_voice_state_setup = 1,       /* Claimed by a trigger, not yet visible to the callback. */
+    ma_speaker_voice_state_playing = 2,     /* Owned by the callback. */
+    ma_speaker_voice_state_finished = 3     /* Played out, waiting for its owner to reclaim it. */
+} ma_speaker_voice_state;
+
+/*
+A voice plays a block of frames already in the speaker's format, mixed on top of the ring output. Voices are
+handed between the triggering thread and the callback purely through their state, so triggering is lock-free.
+*/
+typedef struct
+{
+    MA_ATOMIC(4, ma_uint32) state;  /* ma_speaker_voice_state */
+    const void* pFrames;
+    ma_uint64 frameCount;
+    ma_uint64 cursor;
+    float volume;
+    void* pOwner;
+    ma_bool32 isScheduled;
+    ma_uint64 startFrame;           /* Device frame index of the first frame when isScheduled is set. */
+} ma_speaker_voice;
+
 typedef struct
 {
     ma_context context;
@@ -42,499 +638,7784 @@ typedef struct
     ma_uint32 bufferSizeInFrames;
     ma_uint32 bytesPerFrame;
     ma_bool32 isStarted;
+    ma_allocation_callbacks allocationCallbacks;
+    ma_stream_status status;
+    ma_level_meter meter;
+    MA_ATOMIC(4, ma_bool32) hasNativeProducer;  /* Set while a native source or a managed write owns the ring's write side. */
+    MA_ATOMIC(4, ma_uint32) callbackSequence;   /* Odd while the data callback is running. */
+    ma_speaker_voice voices[MA_SPEAKER_MAX_VOICES];
+    ma_echo_canceller* pEchoCanceller;
+    ma_filter_chain* pFilters;
+    ma_spinlock filterLock;                     /* Serializes filter chain replacement against parameter updates. */
+    ma_callback_thread_config threadConfig;
+    ma_callback_thread_report threadReport;     /* Written once by the callback thread, published through threadReport.isApplied. */
+    MA_ATOMIC(4, ma_bool32) needsThreadSetup;
+    MA_ATOMIC(4, ma_uint32) prefillInFrames;    /* Ring fill required before output starts. 0 starts immediately. */
+    MA_ATOMIC(4, ma_bool32) pauseWhenDrained;   /* Return to buffering after an underrun instead of playing through it. */
+    MA_ATOMIC(4, ma_bool32) isBuffering;
+    MA_ATOMIC(4, ma_bool32) isAwaitingFirstFrame;
+    MA_ATOMIC(4, ma_uint32) rebufferCount;
+    MA_ATOMIC(8, ma_uint64) startTimeInNanoseconds;
+    MA_ATOMIC(8, ma_uint64) startupLatencyInNanoseconds;
+    MA_ATOMIC(8, ma_uint64) startupLatencyInFrames;
+    ma_uint64 framesBeforeFirstFrame;           /* Callback-owned; reset by ma_speaker_start() while the device is stopped. */
+    MA_ATOMIC(8, ma_uint64) scheduledCount;
+    MA_ATOMIC(8, ma_uint64) scheduledStartedCount;
+    MA_ATOMIC(8, ma_uint64) scheduledLateCount;
+    MA_ATOMIC(8, ma_uint64) maxLatenessInFrames;
+    MA_ATOMIC(8, ma_uint64) minLeadInFrames;    /* Starts at ~0 so the first started buffer sets it. */
+    MA_ATOMIC(4, ma_uint32) fadeLengthInFrames; /* 0 disables fades. */
+    MA_ATOMIC(4, ma_uint32) fadeOutRequest;     /* ma_speaker_fade_request */
+    float ringGain;                             /* Callback-owned from here down. Gain of ring audio, ramped up after a start or gap. */
+    float tailGain;                             /* Gain of the held last ring frame that decays into a gap. */
+    float outputGain;                           /* Gain of the whole output, ramped down for stop and flush. */
+    ma_uint8 lastRingFrame[MA_MAX_CHANNELS * sizeof(float)];
+    ma_speaker_concealer* pConcealer;           /* Optional. Created at init and owned by the callback. */
+    ma_readiness_event readiness;
 } ma_speaker;
 
-static ma_result ma_init_context_for_platform(ma_context* pContext)
+typedef struct
+{
+    ma_uint64 startupLatencyInNanoseconds;  /* From ma_speaker_start() to the callback that first output ring audio. Excludes the device's own latency. */
+    ma_uint64 startupLatencyInFrames;       /* Device frames of silence output before that callback. */
+    ma_uint32 rebufferCount;                /* Times playback returned to buffering after draining. */
+    ma_bool32 isBuffering;
+    ma_bool32 hasStarted;                   /* Ring audio has been output since the last ma_speaker_start(). */
+} ma_speaker_startup_stats;
+
+typedef struct
+{
+    ma_uint32 sampleRate;
+    ma_uint32 channels;
+    ma_format format;
+    ma_uint32 bufferSizeInFrames;
+    void* pPreallocatedBuffer;      /* Optional caller-owned ring storage of bufferSizeInFrames frames. Requires an explicit bufferSizeInFrames and must outlive the instance. */
+    const ma_filter_stage_config* pFilters;     /* Optional filter chain run in the data callback. Copied at init. */
+    ma_uint32 filterCount;
+    ma_callback_thread_config thread;
+    ma_bool32 isHeadless;           /* Run on the null backend: a timer-driven device with no hardware, for tests and CI. */
+    ma_allocation_callbacks allocationCallbacks;
+} ma_microphone_config;
+
+typedef struct
+{
+    ma_uint32 sampleRate;
+    ma_uint32 channels;
+    ma_format format;
+    ma_uint32 bufferSizeInFrames;
+    void* pPreallocatedBuffer;      /* Optional caller-owned ring storage of bufferSizeInFrames frames. Requires an explicit bufferSizeInFrames and must outlive the instance. */
+    const ma_filter_stage_config* pFilters;     /* Optional filter chain run in the data callback. Copied at init. */
+    ma_uint32 filterCount;
+    ma_callback_thread_config thread;
+    ma_bool32 isHeadless;           /* Run on the null backend: a timer-driven device with no hardware, for tests and CI. */
+    ma_uint32 prefillInFrames;      /* When non-zero, ma_speaker_start() arms the device and output starts once the ring holds this many frames. */
+    ma_bool32 pauseWhenDrained;     /* With a prefill, an underrun returns to buffering until the prefill is reached again. */
+    ma_uint32 fadeLengthInMilliseconds;     /* Length of the ramps on start, stop, flush and underrun boundaries. 0 switches abruptly. */
+    ma_bool32 concealUnderruns;     /* Fill underruns by repeating recent audio and fading to comfort noise instead of silence. */
+    ma_allocation_callbacks allocationCallbacks;
+} ma_speaker_config;
+
+/* Batch descriptors let a managed pump service many streams with a single native call. */
+typedef struct
+{
+    ma_microphone* pMicrophone;
+    void* pFramesOut;
+    ma_uint32 frameCount;
+    ma_uint32 framesRead;           /* Set on return. */
+} ma_microphone_read_batch_item;
+
+typedef struct
+{
+    ma_speaker* pSpeaker;
+    const void* pFrames;
+    ma_uint32 frameCount;
+    ma_uint32 framesWritten;        /* Set on return. */
+} ma_speaker_write_batch_item;
+
+static ma_result ma_init_context_for_platform(const ma_allocation_callbacks* pAllocationCallbacks, const ma_callback_thread_config* pThreadConfig, ma_bool32 isHeadless, ma_context* pContext)
 {
+    ma_context_config contextConfig = ma_context_config_init();
+    contextConfig.allocationCallbacks = *pAllocationCallbacks;
+    contextConfig.threadPriority = pThreadConfig->priority;
+    contextConfig.threadStackSize = pThreadConfig->stackSizeInBytes;
+
+    if (isHeadless) {
+        const ma_backend backends[] = {
+            ma_backend_null
+        };
+        return ma_context_init(backends, (ma_uint32)ma_countof(backends), &contextConfig, pContext);
+    }
+
 #if defined(_WIN32)
     const ma_backend backends[] = {
         ma_backend_wasapi,
         ma_backend_dsound,
         ma_backend_winmm
     };
-    return ma_context_init(backends, (ma_uint32)ma_countof(backends), NULL, pContext);
+    return ma_context_init(backends, (ma_uint32)ma_countof(backends), &contextConfig, pContext);
 #elif defined(__linux__)
     const ma_backend backends[] = {
         ma_backend_pulseaudio,
         ma_backend_alsa,
         ma_backend_jack
     };
-    return ma_context_init(backends, (ma_uint32)ma_countof(backends), NULL, pContext);
+    return ma_context_init(backends, (ma_uint32)ma_countof(backends), &contextConfig, pContext);
 #elif defined(__APPLE__) && !TARGET_OS_IPHONE
     const ma_backend backends[] = {
         ma_backend_coreaudio
     };
-    return ma_context_init(backends, (ma_uint32)ma_countof(backends), NULL, pContext);
+    return ma_context_init(backends, (ma_uint32)ma_countof(backends), &contextConfig, pContext);
 #elif defined(__APPLE__) && TARGET_OS_IPHONE
     const ma_backend backends[] = {
         ma_backend_coreaudio
     };
-    return ma_context_init(backends, (ma_uint32)ma_countof(backends), NULL, pContext);
+    return ma_context_init(backends, (ma_uint32)ma_countof(backends), &contextConfig, pContext);
 #elif defined(__ANDROID__)
     const ma_backend backends[] = {
         ma_backend_aaudio,
         ma_backend_opensl,
         ma_backend_null
     };
-    return ma_context_init(backends, (ma_uint32)ma_countof(backends), NULL, pContext);
+    return ma_context_init(backends, (ma_uint32)ma_countof(backends), &contextConfig, pContext);
 #else
-    return ma_context_init(NULL, 0, NULL, pContext);
+    return ma_context_init(NULL, 0, &contextConfig, pContext);
 #endif
 }
 
-static ma_uint32 ma_calculate_default_buffer_size(ma_uint32 sampleRate, ma_uint32 periodSizeInFrames)
+/* Runs on the data callback thread, once. Everything it learns goes into pReport; isApplied is published last. */
+static void ma_apply_callback_thread_config(const ma_callback_thread_config* pConfig, ma_callback_thread_report* pReport)
 {
-    if (periodSizeInFrames != 0) {
-        return periodSizeInFrames * 4;
+    ma_result schedulingResult = MA_SUCCESS;
+    ma_result affinityResult = MA_SUCCESS;
+
+#if defined(_WIN32)
+    HANDLE thread = GetCurrentThread();
+
+    if (pConfig->scheduling != ma_thread_scheduling_default) {
+        schedulingResult = SetThreadPriority(thread, THREAD_PRIORITY_TIME_CRITICAL) ? MA_SUCCESS : MA_ACCESS_DENIED;
     }
 
-    if (sampleRate == 0) {
-        sampleRate = 48000;
+    if (pConfig->cpuAffinityMask != 0) {
+        if (SetThreadAffinityMask(thread, (DWORD_PTR)pConfig->cpuAffinityMask) != 0) {
+            pReport->cpuAffinityMask = pConfig->cpuAffinityMask;
+        } else {
+            affinityResult = MA_INVALID_ARGS;
+        }
     }
 
-    return ma_clamp(sampleRate / 20, 1024U, sampleRate);
-}
+    pReport->policy = (pConfig->scheduling != ma_thread_scheduling_default && schedulingResult == MA_SUCCESS) ? (ma_int32)pConfig->scheduling : (ma_int32)ma_thread_scheduling_default;
+    pReport->priority = GetThreadPriority(thread);
+#else
+    if (pConfig->scheduling != ma_thread_scheduling_default) {
+        const int policy = (pConfig->scheduling == ma_thread_scheduling_fifo) ? SCHED_FIFO : SCHED_RR;
+        const int priorityMin = sched_get_priority_min(policy);
+        const int priorityMax = sched_get_priority_max(policy);
 
-static void ma_microphone_data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
-{
-    (void)pOutput;
+        struct sched_param param;
+        ma_zero_memory_64(&param, (ma_uint64)sizeof(param));
+        param.sched_priority = (pConfig->realtimePriority == 0) ? (priorityMin + priorityMax) / 2 : ma_clamp(pConfig->realtimePriority, priorityMin, priorityMax);
 
-    ma_microphone* pMicrophone = (ma_microphone*)pDevice->pUserData;
-    if (pMicrophone == NULL || pInput == NULL || frameCount == 0) {
-        return;
+        const int error = pthread_setschedparam(pthread_self(), policy, &param);
+        schedulingResult = (error == EPERM) ? MA_ACCESS_DENIED : ma_result_from_errno(error);
     }
 
-    const ma_uint32 bytesPerFrame = pMicrophone->bytesPerFrame;
-    const ma_uint8* pInputBytes = (const ma_uint8*)pInput;
-    ma_uint32 framesProcessed = 0;
+    #if defined(__linux__)
+    {
+        cpu_set_t cpus;
 
-    while (framesProcessed < frameCount) {
-        ma_uint32 framesToWrite = frameCount - framesProcessed;
-        void* pWritePtr = NULL;
+        if (pConfig->cpuAffinityMask != 0) {
+            CPU_ZERO(&cpus);
+            for (int iCpu = 0; iCpu < 64 && iCpu < CPU_SETSIZE; ++iCpu) {
+                if ((pConfig->cpuAffinityMask >> iCpu) & 1) {
+                    CPU_SET(iCpu, &cpus);
+                }
+            }
 
-        if (ma_pcm_rb_acquire_write(&pMicrophone->ringBuffer, &framesToWrite, &pWritePtr) != MA_SUCCESS || framesToWrite == 0) {
-            /* Buffer is full, drop the remainder to avoid blocking the callback. */
-            break;
+            /* A pid of 0 is the calling thread, which is what makes this work on threads the backend owns. */
+            affinityResult = (sched_setaffinity(0, sizeof(cpus), &cpus) == 0) ? MA_SUCCESS : ma_result_from_errno(errno);
+        }
+
+        if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+            for (int iCpu = 0; iCpu < 64 && iCpu < CPU_SETSIZE; ++iCpu) {
+                if (CPU_ISSET(iCpu, &cpus)) {
+                    pReport->cpuAffinityMask |= (ma_uint64)1 << iCpu;
+                }
+            }
+        }
+    }
+    #else
+    {
+        /* macOS only has affinity hints and the BSDs each do it differently. */
+        if (pConfig->cpuAffinityMask != 0) {
+            affinityResult = MA_NOT_IMPLEMENTED;
         }
+    }
+    #endif
 
-        ma_copy_memory_64(pWritePtr, pInputBytes + (framesProcessed * bytesPerFrame), (ma_uint64)framesToWrite * bytesPerFrame);
-        ma_pcm_rb_commit_write(&pMicrophone->ringBuffer, framesToWrite);
-        framesProcessed += framesToWrite;
+    int policy = 0;
+    struct sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+        pReport->policy = (policy == SCHED_FIFO) ? (ma_int32)ma_thread_scheduling_fifo : ((policy == SCHED_RR) ? (ma_int32)ma_thread_scheduling_round_robin : (ma_int32)ma_thread_scheduling_default);
+        pReport->priority = param.sched_priority;
     }
+#endif
+
+    pReport->schedulingResult = schedulingResult;
+    pReport->affinityResult = affinityResult;
+    ma_atomic_store_explicit_32(&pReport->isApplied, MA_TRUE, ma_atomic_memory_order_release);
 }
 
-static void ma_speaker_data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
+static ma_uint32 ma_calculate_default_buffer_size(ma_uint32 sampleRate, ma_uint32 periodSizeInFrames)
 {
-    (void)pInput;
+    if (periodSizeInFrames != 0) {
+        return periodSizeInFrames * 4;
+    }
 
-    ma_speaker* pSpeaker = (ma_speaker*)pDevice->pUserData;
-    if (pSpeaker == NULL || pOutput == NULL || frameCount == 0) {
-        return;
+    if (sampleRate == 0) {
+        sampleRate = 48000;
     }
 
-    ma_uint8* pOutputBytes = (ma_uint8*)pOutput;
-    const ma_uint32 bytesPerFrame = pSpeaker->bytesPerFrame;
-    ma_uint32 framesProcessed = 0;
+    return ma_clamp(sampleRate / 20, 1024U, sampleRate);
+}
 
-    while (framesProcessed < frameCount) {
-        ma_uint32 framesToRead = frameCount - framesProcessed;
+/*
+The instance and its ring storage live in one aligned block. The device period is not known until the device has been
+initialized, so when no explicit size is given the block reserves the period-independent default and the ring falls
+back to its own allocation if the device asks for more.
+*/
+static ma_uint32 ma_calculate_reserved_buffer_size(ma_uint32 sampleRate, ma_uint32 bufferSizeInFrames)
+{
+    if (bufferSizeInFrames != 0) {
+        return bufferSizeInFrames;
+    }
+
+    return ma_calculate_default_buffer_size(sampleRate, 0);
+}
+
+static size_t ma_calculate_instance_heap_size(size_t instanceSizeInBytes, ma_format format, ma_uint32 channels, ma_uint32 ringSizeInFrames)
+{
+    return ma_align(instanceSizeInBytes, MA_SIMD_ALIGNMENT) + ma_align((size_t)ringSizeInFrames * ma_get_bytes_per_frame(format, channels), MA_SIMD_ALIGNMENT);
+}
+
+static ma_uint64 ma_get_monotonic_time_in_nanoseconds(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (!QueryPerformanceFrequency(&frequency) || !QueryPerformanceCounter(&counter)) {
+        return 0;
+    }
+
+    return ((ma_uint64)(counter.QuadPart / frequency.QuadPart) * 1000000000) + ((ma_uint64)(counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((ma_uint64)now.tv_sec * 1000000000) + (ma_uint64)now.tv_nsec;
+#endif
+}
+
+static void ma_stream_status_init(ma_stream_status* pStatus, ma_uint32 bufferSizeInFrames)
+{
+    ma_zero_memory_64(pStatus, (ma_uint64)sizeof(*pStatus));
+    ma_atomic_store_explicit_32(&pStatus->bufferSizeInFrames, bufferSizeInFrames, ma_atomic_memory_order_release);
+}
+
+static void ma_stream_status_set_state(ma_stream_status* pStatus, ma_stream_state state)
+{
+    ma_atomic_store_explicit_32(&pStatus->state, (ma_uint32)state, ma_atomic_memory_order_release);
+}
+
+static void ma_stream_status_on_write(ma_stream_status* pStatus, ma_pcm_rb* pRB, ma_uint32 frameCount)
+{
+    ma_atomic_fetch_add_explicit_64(&pStatus->framesWritten, frameCount, ma_atomic_memory_order_release);
+    ma_atomic_store_explicit_32(&pStatus->ringFillInFrames, ma_pcm_rb_available_read(pRB), ma_atomic_memory_order_release);
+}
+
+static void ma_stream_status_on_read(ma_stream_status* pStatus, ma_pcm_rb* pRB, ma_uint32 frameCount)
+{
+    ma_atomic_fetch_add_explicit_64(&pStatus->framesRead, frameCount, ma_atomic_memory_order_release);
+    ma_atomic_store_explicit_32(&pStatus->ringFillInFrames, ma_pcm_rb_available_read(pRB), ma_atomic_memory_order_release);
+}
+
+static void ma_stream_status_on_callback(ma_stream_status* pStatus, ma_uint32 frameCount, ma_uint32 xrunFrameCount, ma_bool32 isCapture)
+{
+    ma_atomic_fetch_add_explicit_64(&pStatus->deviceFrames, frameCount, ma_atomic_memory_order_release);
+    ma_atomic_store_explicit_64(&pStatus->lastCallbackTimeInNanoseconds, ma_get_monotonic_time_in_nanoseconds(), ma_atomic_memory_order_release);
+
+    if (xrunFrameCount > 0) {
+        ma_atomic_fetch_add_explicit_64(&pStatus->xrunFrames, xrunFrameCount, ma_atomic_memory_order_release);
+
+        if (isCapture) {
+            ma_atomic_fetch_add_explicit_32(&pStatus->overrunCount, 1, ma_atomic_memory_order_release);
+        } else {
+            ma_atomic_fetch_add_explicit_32(&pStatus->underrunCount, 1, ma_atomic_memory_order_release);
+        }
+    }
+}
+
+static ma_result ma_readiness_event_open(ma_readiness_event* pEvent)
+{
+#if defined(_WIN32)
+    (void)pEvent;
+    return MA_NOT_IMPLEMENTED;
+#elif defined(__linux__)
+    pEvent->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pEvent->fd < 0) {
+        return ma_result_from_errno(errno);
+    }
+
+    pEvent->writeFd = pEvent->fd;
+    return MA_SUCCESS;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return ma_result_from_errno(errno);
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    pEvent->fd = fds[0];
+    pEvent->writeFd = fds[1];
+    return MA_SUCCESS;
+#endif
+}
+
+static void ma_readiness_event_close(ma_readiness_event* pEvent)
+{
+#if !defined(_WIN32)
+    if (pEvent->writeFd >= 0 && pEvent->writeFd != pEvent->fd) {
+        close(pEvent->writeFd);
+    }
+    if (pEvent->fd >= 0) {
+        close(pEvent->fd);
+    }
+#endif
+
+    pEvent->fd = -1;
+    pEvent->writeFd = -1;
+}
+
+static ma_bool32 ma_readiness_event_is_ready(ma_uint32 watermarkInFrames, ma_pcm_rb* pRB, ma_bool32 isCapture)
+{
+    const ma_uint32 framesQueued = ma_pcm_rb_available_read(pRB);
+    return isCapture ? (framesQueued >= watermarkInFrames) : (framesQueued < watermarkInFrames);
+}
+
+/* Safe from the data callback: one non-blocking write, and only on the transition into the ready state. */
+static void ma_readiness_event_update(ma_readiness_event* pEvent, ma_pcm_rb* pRB, ma_bool32 isCapture)
+{
+    const ma_uint32 watermarkInFrames = ma_atomic_load_explicit_32(&pEvent->watermarkInFrames, ma_atomic_memory_order_acquire);
+    if (watermarkInFrames == 0 || !ma_readiness_event_is_ready(watermarkInFrames, pRB, isCapture)) {
+        return;
+    }
+
+    if (ma_atomic_load_32(&pEvent->isSignaled) || ma_atomic_exchange_32(&pEvent->isSignaled, MA_TRUE)) {
+        return;
+    }
+
+#if !defined(_WIN32)
+    /*
+    A full pipe or saturated counter is already readable, so a failed write loses nothing. This is the one syscall the
+    callback is allowed, so it bypasses the MA_RT_AUDIT hook.
+    */
+    const ma_uint64 one = 1;
+    const ssize_t bytesWritten = (write)(pEvent->writeFd, &one, (pEvent->writeFd == pEvent->fd) ? sizeof(one) : 1);
+    (void)bytesWritten;
+#endif
+}
+
+/*
+The only place the signal is rearmed. Draining first means a post from the callback either lands before the drain and is
+consumed, or sees the flag cleared below and posts again. The flag is cleared even when the ring is still ready so the
+update that follows posts immediately instead of leaving an empty fd behind a set flag.
+*/
+static void ma_readiness_event_acknowledge(ma_readiness_event* pEvent, ma_pcm_rb* pRB, ma_bool32 isCapture)
+{
+#if !defined(_WIN32)
+    if (pEvent->fd < 0) {
+        return;
+    }
+
+    ma_uint64 counter[8];
+    while (read(pEvent->fd, counter, sizeof(counter)) > 0) {
+        /* An eventfd is drained by one read; a pipe may need several. */
+    }
+
+    ma_atomic_store_32(&pEvent->isSignaled, MA_FALSE);
+    ma_readiness_event_update(pEvent, pRB, isCapture);
+#else
+    (void)pEvent;
+    (void)pRB;
+    (void)isCapture;
+#endif
+}
+
+static ma_uint32 ma_pcm_rb_write_frames(ma_pcm_rb* pRB, const void* pFrames, ma_uint32 frameCount)
+{
+    const ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(pRB->format, pRB->channels);
+    ma_uint32 framesWrittenTotal = 0;
+
+    while (framesWrittenTotal < frameCount) {
+        ma_uint32 framesToWrite = frameCount - framesWrittenTotal;
+        void* pWritePtr = NULL;
+
+        if (ma_pcm_rb_acquire_write(pRB, &framesToWrite, &pWritePtr) != MA_SUCCESS || framesToWrite == 0) {
+            break;
+        }
+
+        ma_copy_memory_64(pWritePtr, ma_offset_ptr(pFrames, framesWrittenTotal * bytesPerFrame), (ma_uint64)framesToWrite * bytesPerFrame);
+        ma_pcm_rb_commit_write(pRB, framesToWrite);
+        framesWrittenTotal += framesToWrite;
+    }
+
+    return framesWrittenTotal;
+}
+
+static ma_uint32 ma_pcm_rb_read_frames(ma_pcm_rb* pRB, void* pFrames, ma_uint32 frameCount)
+{
+    const ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(pRB->format, pRB->channels);
+    ma_uint32 framesReadTotal = 0;
+
+    while (framesReadTotal < frameCount) {
+        ma_uint32 framesToRead = frameCount - framesReadTotal;
         void* pReadPtr = NULL;
 
-        if (ma_pcm_rb_acquire_read(&pSpeaker->ringBuffer, &framesToRead, &pReadPtr) != MA_SUCCESS || framesToRead == 0) {
-            ma_silence_pcm_frames(pOutputBytes + (framesProcessed * bytesPerFrame), frameCount - framesProcessed, pSpeaker->format, pSpeaker->channels);
+        if (ma_pcm_rb_acquire_read(pRB, &framesToRead, &pReadPtr) != MA_SUCCESS || framesToRead == 0) {
+            break;
+        }
+
+        ma_copy_memory_64(ma_offset_ptr(pFrames, framesReadTotal * bytesPerFrame), pReadPtr, (ma_uint64)framesToRead * bytesPerFrame);
+        ma_pcm_rb_commit_read(pRB, framesToRead);
+        framesReadTotal += framesToRead;
+    }
+
+    return framesReadTotal;
+}
+
+/*
+Planar <-> interleaved copies used by the planar read/write paths. These run directly against the ring buffer so each
+sample is touched once. Stereo f32 is the common case and gets a vectorized kernel; everything else goes through
+miniaudio's generic routines.
+*/
+#if defined(MA_SUPPORT_SSE2)
+static void ma_deinterleave_f32_stereo__sse2(const float* pSrc, float* pDstL, float* pDstR, ma_uint32 frameCount)
+{
+    ma_uint32 iFrame = 0;
+
+    for (; iFrame + 4 <= frameCount; iFrame += 4) {
+        __m128 a = _mm_loadu_ps(pSrc + iFrame*2 + 0);
+        __m128 b = _mm_loadu_ps(pSrc + iFrame*2 + 4);
+        _mm_storeu_ps(pDstL + iFrame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(pDstR + iFrame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+
+    for (; iFrame < frameCount; ++iFrame) {
+        pDstL[iFrame] = pSrc[iFrame*2 + 0];
+        pDstR[iFrame] = pSrc[iFrame*2 + 1];
+    }
+}
+
+static void ma_interleave_f32_stereo__sse2(const float* pSrcL, const float* pSrcR, float* pDst, ma_uint32 frameCount)
+{
+    ma_uint32 iFrame = 0;
+
+    for (; iFrame + 4 <= frameCount; iFrame += 4) {
+        __m128 l = _mm_loadu_ps(pSrcL + iFrame);
+        __m128 r = _mm_loadu_ps(pSrcR + iFrame);
+        _mm_storeu_ps(pDst + iFrame*2 + 0, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(pDst + iFrame*2 + 4, _mm_unpackhi_ps(l, r));
+    }
+
+    for (; iFrame < frameCount; ++iFrame) {
+        pDst[iFrame*2 + 0] = pSrcL[iFrame];
+        pDst[iFrame*2 + 1] = pSrcR[iFrame];
+    }
+}
+#endif
+
+#if defined(MA_SUPPORT_NEON)
+static void ma_deinterleave_f32_stereo__neon(const float* pSrc, float* pDstL, float* pDstR, ma_uint32 frameCount)
+{
+    ma_uint32 iFrame = 0;
+
+    for (; iFrame + 4 <= frameCount; iFrame += 4) {
+        float32x4x2_t lr = vld2q_f32(pSrc + iFrame*2);
+        vst1q_f32(pDstL + iFrame, lr.val[0]);
+        vst1q_f32(pDstR + iFrame, lr.val[1]);
+    }
+
+    for (; iFrame < frameCount; ++iFrame) {
+        pDstL[iFrame] = pSrc[iFrame*2 + 0];
+        pDstR[iFrame] = pSrc[iFrame*2 + 1];
+    }
+}
+
+static void ma_interleave_f32_stereo__neon(const float* pSrcL, const float* pSrcR, float* pDst, ma_uint32 frameCount)
+{
+    ma_uint32 iFrame = 0;
+
+    for (; iFrame + 4 <= frameCount; iFrame += 4) {
+        float32x4x2_t lr;
+        lr.val[0] = vld1q_f32(pSrcL + iFrame);
+        lr.val[1] = vld1q_f32(pSrcR + iFrame);
+        vst2q_f32(pDst + iFrame*2, lr);
+    }
+
+    for (; iFrame < frameCount; ++iFrame) {
+        pDst[iFrame*2 + 0] = pSrcL[iFrame];
+        pDst[iFrame*2 + 1] = pSrcR[iFrame];
+    }
+}
+#endif
+
+static void ma_deinterleave_pcm_frames_at(ma_format format, ma_uint32 channels, ma_uint32 frameCount, const void* pInterleavedFrames, void** ppPlanarFrames, ma_uint32 planarOffsetInFrames)
+{
+    const ma_uint32 bytesPerSample = ma_get_bytes_per_sample(format);
+
+    if (channels == 1) {
+        ma_copy_memory_64(ma_offset_ptr(ppPlanarFrames[0], planarOffsetInFrames * bytesPerSample), pInterleavedFrames, (ma_uint64)frameCount * bytesPerSample);
+        return;
+    }
+
+    if (format == ma_format_f32 && channels == 2) {
+        float* pDstL = (float*)ppPlanarFrames[0] + planarOffsetInFrames;
+        float* pDstR = (float*)ppPlanarFrames[1] + planarOffsetInFrames;
+
+    #if defined(MA_SUPPORT_SSE2)
+        if (ma_has_sse2()) {
+            ma_deinterleave_f32_stereo__sse2((const float*)pInterleavedFrames, pDstL, pDstR, frameCount);
+            return;
+        }
+    #elif defined(MA_SUPPORT_NEON)
+        if (ma_has_neon()) {
+            ma_deinterleave_f32_stereo__neon((const float*)pInterleavedFrames, pDstL, pDstR, frameCount);
+            return;
+        }
+    #endif
+    }
+
+    void* ppOffsetFrames[MA_MAX_CHANNELS];
+    for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+        ppOffsetFrames[iChannel] = ma_offset_ptr(ppPlanarFrames[iChannel], planarOffsetInFrames * bytesPerSample);
+    }
+
+    ma_deinterleave_pcm_frames(format, channels, frameCount, pInterleavedFrames, ppOffsetFrames);
+}
+
+static void ma_interleave_pcm_frames_at(ma_format format, ma_uint32 channels, ma_uint32 frameCount, const void** ppPlanarFrames, ma_uint32 planarOffsetInFrames, void* pInterleavedFrames)
+{
+    const ma_uint32 bytesPerSample = ma_get_bytes_per_sample(format);
+
+    if (channels == 1) {
+        ma_copy_memory_64(pInterleavedFrames, ma_offset_ptr(ppPlanarFrames[0], planarOffsetInFrames * bytesPerSample), (ma_uint64)frameCount * bytesPerSample);
+        return;
+    }
+
+    if (format == ma_format_f32 && channels == 2) {
+        const float* pSrcL = (const float*)ppPlanarFrames[0] + planarOffsetInFrames;
+        const float* pSrcR = (const float*)ppPlanarFrames[1] + planarOffsetInFrames;
+
+    #if defined(MA_SUPPORT_SSE2)
+        if (ma_has_sse2()) {
+            ma_interleave_f32_stereo__sse2(pSrcL, pSrcR, (float*)pInterleavedFrames, frameCount);
+            return;
+        }
+    #elif defined(MA_SUPPORT_NEON)
+        if (ma_has_neon()) {
+            ma_interleave_f32_stereo__neon(pSrcL, pSrcR, (float*)pInterleavedFrames, frameCount);
+            return;
+        }
+    #endif
+    }
+
+    const void* ppOffsetFrames[MA_MAX_CHANNELS];
+    for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+        ppOffsetFrames[iChannel] = ma_offset_ptr(ppPlanarFrames[iChannel], planarOffsetInFrames * bytesPerSample);
+    }
+
+    ma_interleave_pcm_frames(format, channels, frameCount, ppOffsetFrames, pInterleavedFrames);
+}
+
+static ma_result ma_microphone_tap_init(ma_microphone* pMicrophone, ma_uint32 bufferSizeInFrames, ma_microphone_tap* pTap)
+{
+    ma_zero_memory_64(pTap, (ma_uint64)sizeof(*pTap));
+    return ma_pcm_rb_init(pMicrophone->format, pMicrophone->channels, bufferSizeInFrames, NULL, &pMicrophone->allocationCallbacks, &pTap->ringBuffer);
+}
+
+static void ma_microphone_tap_uninit(ma_microphone_tap* pTap)
+{
+    ma_pcm_rb_uninit(&pTap->ringBuffer);
+}
+
+static ma_result ma_microphone_attach_tap(ma_microphone* pMicrophone, ma_microphone_tap* pTap)
+{
+    for (ma_uint32 iTap = 0; iTap < MA_MICROPHONE_MAX_TAPS; ++iTap) {
+        ma_microphone_tap* pExpected = NULL;
+        if (ma_atomic_compare_exchange_strong_ptr(&pMicrophone->pTaps[iTap], &pExpected, pTap)) {
+            return MA_SUCCESS;
+        }
+    }
+
+    return MA_OUT_OF_RANGE;
+}
+
+/* Waits until any data callback that could still be looking at state that has just been unpublished has returned. */
+static void ma_microphone_wait_for_callback(ma_microphone* pMicrophone)
+{
+    const ma_uint32 sequence = ma_atomic_load_32(&pMicrophone->callbackSequence);
+    if ((sequence & 1) == 0) {
+        return;
+    }
+
+    while (ma_atomic_load_32(&pMicrophone->callbackSequence) == sequence) {
+        ma_yield();
+    }
+}
+
+static void ma_microphone_detach_tap(ma_microphone* pMicrophone, ma_microphone_tap* pTap)
+{
+    for (ma_uint32 iTap = 0; iTap < MA_MICROPHONE_MAX_TAPS; ++iTap) {
+        ma_microphone_tap* pExpected = pTap;
+        if (ma_atomic_compare_exchange_strong_ptr(&pMicrophone->pTaps[iTap], &pExpected, NULL)) {
             break;
         }
+    }
+
+    ma_microphone_wait_for_callback(pMicrophone);
+}
+
+/*
+Exclusive ownership of the write side of the ring. Native producers hold it for as long as they run; the managed writes
+take it for the duration of each call, so whichever side comes second is refused instead of racing the other.
+*/
+static ma_result ma_speaker_claim_producer(ma_speaker* pSpeaker)
+{
+    ma_bool32 expected = MA_FALSE;
+    if (!ma_atomic_compare_exchange_strong_32(&pSpeaker->hasNativeProducer, &expected, MA_TRUE)) {
+        return MA_BUSY;
+    }
+
+    return MA_SUCCESS;
+}
+
+static void ma_speaker_release_producer(ma_speaker* pSpeaker)
+{
+    ma_atomic_store_32(&pSpeaker->hasNativeProducer, MA_FALSE);
+}
+
+static void ma_speaker_wait_for_callback(ma_speaker* pSpeaker)
+{
+    const ma_uint32 sequence = ma_atomic_load_32(&pSpeaker->callbackSequence);
+    if ((sequence & 1) == 0) {
+        return;
+    }
+
+    while (ma_atomic_load_32(&pSpeaker->callbackSequence) == sequence) {
+        ma_yield();
+    }
+}
+
+static ma_result ma_speaker_start_voice_ex(ma_speaker* pSpeaker, const void* pFrames, ma_uint64 frameCount, float volume, void* pOwner, ma_bool32 isScheduled, ma_uint64 startFrame)
+{
+    for (ma_uint32 iVoice = 0; iVoice < MA_SPEAKER_MAX_VOICES; ++iVoice) {
+        ma_speaker_voice* pVoice = &pSpeaker->voices[iVoice];
+        ma_uint32 expected = ma_speaker_voice_state_free;
+
+        if (ma_atomic_compare_exchange_strong_32(&pVoice->state, &expected, ma_speaker_voice_state_setup)) {
+            pVoice->pFrames = pFrames;
+            pVoice->frameCount = frameCount;
+            pVoice->cursor = 0;
+            pVoice->volume = volume;
+            pVoice->pOwner = pOwner;
+            pVoice->isScheduled = isScheduled;
+            pVoice->startFrame = startFrame;
+            ma_atomic_store_explicit_32(&pVoice->state, ma_speaker_voice_state_playing, ma_atomic_memory_order_release);
+            return MA_SUCCESS;
+        }
+    }
+
+    return MA_OUT_OF_RANGE;
+}
+
+static ma_result ma_speaker_start_voice(ma_speaker* pSpeaker, const void* pFrames, ma_uint64 frameCount, float volume, void* pOwner)
+{
+    return ma_speaker_start_voice_ex(pSpeaker, pFrames, frameCount, volume, pOwner, MA_FALSE, 0);
+}
+
+/* Mixes with saturation in the speaker's format. Non-f32 formats round-trip through a small f32 scratch on the stack. */
+static void ma_mix_pcm_frames_in_format(void* pDst, const void* pSrc, ma_uint32 frameCount, ma_format format, ma_uint32 channels, float volume)
+{
+    if (format == ma_format_f32) {
+        ma_mix_pcm_frames_f32((float*)pDst, (const float*)pSrc, frameCount, channels, volume);
+        return;
+    }
+
+    float dstF32[1024];
+    float srcF32[1024];
+    const ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(format, channels);
+    const ma_uint32 chunkSizeInFrames = ma_countof(dstF32) / channels;
+    ma_uint32 framesMixed = 0;
+
+    while (framesMixed < frameCount) {
+        const ma_uint32 framesToMix = ma_min(frameCount - framesMixed, chunkSizeInFrames);
+        void* pDstChunk = ma_offset_ptr(pDst, framesMixed * bytesPerFrame);
+
+        ma_pcm_convert(dstF32, ma_format_f32, pDstChunk, format, (ma_uint64)framesToMix * channels, ma_dither_mode_none);
+        ma_pcm_convert(srcF32, ma_format_f32, ma_offset_ptr(pSrc, framesMixed * bytesPerFrame), format, (ma_uint64)framesToMix * channels, ma_dither_mode_none);
+        ma_mix_pcm_frames_f32(dstF32, srcF32, framesToMix, channels, volume);
+        ma_pcm_convert(pDstChunk, format, dstF32, ma_format_f32, (ma_uint64)framesToMix * channels, ma_dither_mode_none);
+
+        framesMixed += framesToMix;
+    }
+}
+
+/* Scales frames by a gain that moves by gainStep per frame, starting at gainBeg. Returns the gain after the last frame. */
+static float ma_apply_gain_ramp_pcm_frames(void* pFrames, ma_uint32 frameCount, ma_format format, ma_uint32 channels, float gainBeg, float gainStep)
+{
+    if (format == ma_format_f32) {
+        float* pFramesF32 = (float*)pFrames;
+        for (ma_uint32 iFrame = 0; iFrame < frameCount; ++iFrame) {
+            const float gain = gainBeg + (gainStep * iFrame);
+            for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+                pFramesF32[iFrame*channels + iChannel] *= gain;
+            }
+        }
+
+        return gainBeg + (gainStep * frameCount);
+    }
+
+    float gain = gainBeg;
+
+    float framesF32[1024];
+    const ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(format, channels);
+    const ma_uint32 chunkSizeInFrames = ma_countof(framesF32) / channels;
+    ma_uint32 framesRamped = 0;
+
+    while (framesRamped < frameCount) {
+        const ma_uint32 framesToRamp = ma_min(frameCount - framesRamped, chunkSizeInFrames);
+        void* pChunk = ma_offset_ptr(pFrames, framesRamped * bytesPerFrame);
+
+        ma_pcm_convert(framesF32, ma_format_f32, pChunk, format, (ma_uint64)framesToRamp * channels, ma_dither_mode_none);
+        gain = ma_apply_gain_ramp_pcm_frames(framesF32, framesToRamp, ma_format_f32, channels, gain, gainStep);
+        ma_pcm_convert(pChunk, format, framesF32, ma_format_f32, (ma_uint64)framesToRamp * channels, ma_dither_mode_none);
+
+        framesRamped += framesToRamp;
+    }
+
+    return gain;
+}
+
+/*
+Smooths the boundaries of the ring audio in the first framesFromRing frames of the output. Ring audio after a start or
+a gap is ramped in, and a gap is entered by holding the last ring frame and ramping it down instead of dropping to zero.
+*/
+static void ma_speaker_apply_ring_fades(ma_speaker* pSpeaker, void* pOutput, ma_uint32 framesFromRing, ma_uint32 frameCount, ma_uint32 fadeLengthInFrames)
+{
+    const float gainStep = 1.0f / fadeLengthInFrames;
+    const ma_uint32 bytesPerFrame = pSpeaker->bytesPerFrame;
+
+    if (framesFromRing > 0) {
+        if (pSpeaker->ringGain < 1) {
+            const ma_uint32 framesToRamp = ma_min(framesFromRing, (ma_uint32)((1 - pSpeaker->ringGain) * fadeLengthInFrames) + 1);
+            const float gain = ma_apply_gain_ramp_pcm_frames(pOutput, framesToRamp, pSpeaker->format, pSpeaker->channels, pSpeaker->ringGain, gainStep);
+            pSpeaker->ringGain = ma_min(1.0f, gain);
+        }
 
-        ma_copy_memory_64(pOutputBytes + (framesProcessed * bytesPerFrame), pReadPtr, (ma_uint64)framesToRead * bytesPerFrame);
-        ma_pcm_rb_commit_read(&pSpeaker->ringBuffer, framesToRead);
-        framesProcessed += framesToRead;
+        ma_copy_memory_64(pSpeaker->lastRingFrame, ma_offset_ptr(pOutput, (framesFromRing - 1) * bytesPerFrame), bytesPerFrame);
+        pSpeaker->tailGain = 1;
     }
+
+    if (framesFromRing < frameCount) {
+        if (pSpeaker->tailGain > 0) {
+            const ma_uint32 framesToRamp = ma_min(frameCount - framesFromRing, (ma_uint32)(pSpeaker->tailGain * fadeLengthInFrames));
+            void* pTail = ma_offset_ptr(pOutput, framesFromRing * bytesPerFrame);
+
+            for (ma_uint32 iFrame = 0; iFrame < framesToRamp; ++iFrame) {
+                ma_copy_memory_64(ma_offset_ptr(pTail, iFrame * bytesPerFrame), pSpeaker->lastRingFrame, bytesPerFrame);
+            }
+
+            const float gain = ma_apply_gain_ramp_pcm_frames(pTail, framesToRamp, pSpeaker->format, pSpeaker->channels, pSpeaker->tailGain - gainStep, -gainStep);
+            pSpeaker->tailGain = ma_max(0.0f, gain);
+            if (framesToRamp < frameCount - framesFromRing) {
+                pSpeaker->tailGain = 0;
+            }
+        }
+
+        pSpeaker->ringGain = 0;
+    }
+}
+
+/* Ramps the whole output to silence for a pending stop or flush, and completes the request once it gets there. */
+static void ma_speaker_apply_fade_out(ma_speaker* pSpeaker, void* pOutput, ma_uint32 frameCount, ma_uint32 fadeLengthInFrames, ma_uint32 request)
+{
+    const ma_uint32 framesToRamp = ma_min(frameCount, (ma_uint32)(pSpeaker->outputGain * fadeLengthInFrames));
+
+    const float gainStep = 1.0f / fadeLengthInFrames;
+    const float gain = ma_apply_gain_ramp_pcm_frames(pOutput, framesToRamp, pSpeaker->format, pSpeaker->channels, pSpeaker->outputGain - gainStep, -gainStep);
+
+    pSpeaker->outputGain = ma_max(0.0f, gain);
+    if (framesToRamp < frameCount) {
+        ma_silence_pcm_frames(ma_offset_ptr(pOutput, framesToRamp * pSpeaker->bytesPerFrame), frameCount - framesToRamp, pSpeaker->format, pSpeaker->channels);
+        pSpeaker->outputGain = 0;
+    }
+
+    if (pSpeaker->outputGain > 0) {
+        return;
+    }
+
+    if (request == ma_speaker_fade_request_flush) {
+        /* The callback is the reader, so it can discard everything queued without racing the writer. */
+        const ma_uint32 discardedFrames = ma_pcm_rb_available_read(&pSpeaker->ringBuffer);
+        ma_pcm_rb_seek_read(&pSpeaker->ringBuffer, discardedFrames);
+        ma_stream_status_on_read(&pSpeaker->status, &pSpeaker->ringBuffer, discardedFrames);
+
+        pSpeaker->ringGain = 0;
+        pSpeaker->tailGain = 0;
+        pSpeaker->outputGain = 1;
+        ma_atomic_store_explicit_32(&pSpeaker->fadeOutRequest, ma_speaker_fade_request_none, ma_atomic_memory_order_release);
+    } else {
+        ma_atomic_store_explicit_32(&pSpeaker->fadeOutRequest, ma_speaker_fade_request_done, ma_atomic_memory_order_release);
+    }
+
+}
+
+/*
+Underrun concealment. The concealer keeps a short f32 history of what the ring played. When the ring runs dry it
+finds the dominant period of the most recent audio and repeats it, overlap-added at the loop point, fading into
+comfort noise at the tracked noise floor if the gap lasts. Ring audio that returns is crossfaded back in. It is
+owned by the data callback; ma_speaker_start() resets it while the device is stopped.
+*/
+struct ma_speaker_concealer
+{
+    ma_uint32 channels;
+    ma_uint32 minPeriodInFrames;
+    ma_uint32 maxPeriodInFrames;
+    ma_uint32 windowInFrames;           /* Correlation window for the period search. */
+    ma_uint32 decimation;               /* Coarse search runs at roughly 8 kHz. */
+    ma_uint32 holdInFrames;             /* Repetition stays at full level this long... */
+    ma_uint32 fadeInFrames;             /* ...then crossfades to comfort noise over this long. */
+    ma_uint32 spliceInFrames;
+    ma_uint32 maxGapInFrames;           /* Comfort noise fades to silence by this point and the gap is left alone. */
+    ma_uint32 historyCapacityInFrames;
+    ma_uint32 historyWritePos;
+    ma_uint32 historyFrameCount;
+    float* pHistory;                    /* Circular, interleaved. */
+    float* pPeriod;                     /* The repeated period, interleaved. */
+    float* pMono;                       /* Decimated mono scratch for the coarse search. */
+    ma_bool32 isConcealing;
+    ma_bool32 isGapUnconcealable;       /* Set when a gap starts without usable history; cleared when audio returns. */
+    ma_uint32 periodInFrames;
+    ma_uint32 periodCursor;
+    ma_uint32 gapFrames;
+    ma_uint32 spliceRemaining;
+    float envelope;                     /* Smoothed mono power of ring audio. */
+    float noiseFloor;                   /* Slow-rising minimum of the envelope. */
+    float noiseFloorRise;               /* Per-frame growth of the floor, about 6 dB per second. */
+    ma_lcg lcg;
+    MA_ATOMIC(4, ma_bool32) isResetPending;     /* Set by ma_speaker_flush() when it discards the ring itself. */
+    MA_ATOMIC(8, ma_uint64) concealedFrames;
+    MA_ATOMIC(4, ma_uint32) concealmentCount;
+};
+
+typedef struct
+{
+    ma_uint64 concealedFrames;
+    ma_uint32 concealmentCount;         /* Gaps that were concealed. */
+} ma_speaker_concealment_stats;
+
+static ma_result ma_speaker_concealer_create(ma_uint32 channels, ma_uint32 sampleRate, const ma_allocation_callbacks* pAllocationCallbacks, ma_speaker_concealer** ppConcealer)
+{
+    const ma_uint32 maxPeriodInFrames = ma_max(sampleRate / 50, 4);
+    const ma_uint32 windowInFrames = ma_max(sampleRate / 100, 4);
+    const ma_uint32 decimation = ma_max(sampleRate / 8000, 1);
+    const ma_uint32 historyCapacityInFrames = maxPeriodInFrames + windowInFrames;
+    const size_t historySizeInBytes = ma_align((size_t)historyCapacityInFrames * channels * sizeof(float), MA_SIMD_ALIGNMENT);
+    const size_t periodSizeInBytes = ma_align((size_t)maxPeriodInFrames * channels * sizeof(float), MA_SIMD_ALIGNMENT);
+    const size_t monoSizeInBytes = ma_align(((size_t)historyCapacityInFrames / decimation + 1) * sizeof(float), MA_SIMD_ALIGNMENT);
+    const size_t headerSizeInBytes = ma_align(sizeof(ma_speaker_concealer), MA_SIMD_ALIGNMENT);
+
+    ma_speaker_concealer* pConcealer = (ma_speaker_concealer*)ma_aligned_malloc(headerSizeInBytes + historySizeInBytes + periodSizeInBytes + monoSizeInBytes, MA_SIMD_ALIGNMENT, pAllocationCallbacks);
+    if (pConcealer == NULL) {
+        return MA_OUT_OF_MEMORY;
+    }
+
+    ma_zero_memory_64(pConcealer, (ma_uint64)sizeof(*pConcealer));
+    pConcealer->channels = channels;
+    pConcealer->minPeriodInFrames = ma_max(sampleRate / 400, 2);
+    pConcealer->maxPeriodInFrames = maxPeriodInFrames;
+    pConcealer->windowInFrames = windowInFrames;
+    pConcealer->decimation = decimation;
+    pConcealer->holdInFrames = sampleRate / 100;
+    pConcealer->fadeInFrames = ma_max(sampleRate / 20, 1);
+    pConcealer->spliceInFrames = ma_max(sampleRate / 250, 1);
+    pConcealer->maxGapInFrames = ma_max(sampleRate, pConcealer->holdInFrames + 2*pConcealer->fadeInFrames);
+    pConcealer->noiseFloorRise = 1.0f + (1.4f / sampleRate);
+    pConcealer->historyCapacityInFrames = historyCapacityInFrames;
+    pConcealer->pHistory = (float*)ma_offset_ptr(pConcealer, headerSizeInBytes);
+    pConcealer->pPeriod = (float*)ma_offset_ptr(pConcealer->pHistory, historySizeInBytes);
+    pConcealer->pMono = (float*)ma_offset_ptr(pConcealer->pPeriod, periodSizeInBytes);
+    ma_lcg_seed(&pConcealer->lcg, (ma_int32)(ma_get_monotonic_time_in_nanoseconds() & 0x7FFFFFFF));
+
+    *ppConcealer = pConcealer;
+
+    return MA_SUCCESS;
+}
+
+static void ma_speaker_concealer_reset(ma_speaker_concealer* pConcealer)
+{
+    pConcealer->historyWritePos = 0;
+    pConcealer->historyFrameCount = 0;
+    pConcealer->isConcealing = MA_FALSE;
+    pConcealer->isGapUnconcealable = MA_FALSE;
+    pConcealer->spliceRemaining = 0;
+    pConcealer->envelope = 0;
+    pConcealer->noiseFloor = -1;
+}
+
+/* Returns the history frame framesBack frames before the most recent one, which is framesBack = 0. */
+static const float* ma_speaker_concealer_history(const ma_speaker_concealer* pConcealer, ma_uint32 framesBack)
+{
+    const ma_uint32 index = (pConcealer->historyWritePos + pConcealer->historyCapacityInFrames - 1 - framesBack) % pConcealer->historyCapacityInFrames;
+    return pConcealer->pHistory + (index * pConcealer->channels);
+}
+
+static float ma_speaker_concealer_history_mono(const ma_speaker_concealer* pConcealer, ma_uint32 framesBack)
+{
+    const float* pFrame = ma_speaker_concealer_history(pConcealer, framesBack);
+    float sum = 0;
+
+    for (ma_uint32 iChannel = 0; iChannel < pConcealer->channels; ++iChannel) {
+        sum += pFrame[iChannel];
+    }
+
+    return sum / pConcealer->channels;
+}
+
+static void ma_speaker_concealer_push(ma_speaker_concealer* pConcealer, const float* pFrame, ma_bool32 isFromRing)
+{
+    ma_copy_memory_64(pConcealer->pHistory + (pConcealer->historyWritePos * pConcealer->channels), pFrame, (ma_uint64)pConcealer->channels * sizeof(float));
+    pConcealer->historyWritePos = (pConcealer->historyWritePos + 1) % pConcealer->historyCapacityInFrames;
+    pConcealer->historyFrameCount = ma_min(pConcealer->historyFrameCount + 1, pConcealer->historyCapacityInFrames);
+
+    if (isFromRing) {
+        /* Envelope over roughly 10 ms; the floor follows drops immediately and rises at about 6 dB per second. */
+        const float mono = ma_speaker_concealer_history_mono(pConcealer, 0);
+        pConcealer->envelope += (mono*mono - pConcealer->envelope) * (1.0f / pConcealer->holdInFrames);
+
+        if (pConcealer->noiseFloor < 0 || pConcealer->envelope < pConcealer->noiseFloor) {
+            pConcealer->noiseFloor = pConcealer->envelope;
+        } else {
+            pConcealer->noiseFloor *= pConcealer->noiseFloorRise;
+        }
+    }
+}
+
+/* Normalized cross-correlation between the latest window and the window periodInFrames earlier, on decimated mono. */
+static float ma_speaker_concealer_score(const float* pMono, ma_uint32 monoCount, ma_uint32 windowCount, ma_uint32 period)
+{
+    float correlation = 0;
+    float energy = 0;
+
+    for (ma_uint32 i = monoCount - windowCount; i < monoCount; ++i) {
+        correlation += pMono[i] * pMono[i - period];
+        energy += pMono[i - period] * pMono[i - period];
+    }
+
+    return (energy > 0) ? correlation / sqrtf(energy) : 0;
+}
+
+/* Picks the repetition period and builds the looped period buffer. Fails when there is no usable history. */
+static ma_bool32 ma_speaker_concealer_begin(ma_speaker_concealer* pConcealer)
+{
+    if (pConcealer->historyFrameCount < pConcealer->historyCapacityInFrames) {
+        return MA_FALSE;
+    }
+
+    /* Coarse search on a box-filtered, decimated mono copy of the whole history, oldest first. */
+    const ma_uint32 decimation = pConcealer->decimation;
+    const ma_uint32 monoCount = pConcealer->historyCapacityInFrames / decimation;
+    float windowEnergy = 0;
+
+    for (ma_uint32 i = 0; i < monoCount; ++i) {
+        float sum = 0;
+        for (ma_uint32 j = 0; j < decimation; ++j) {
+            sum += ma_speaker_concealer_history_mono(pConcealer, (monoCount - 1 - i) * decimation + (decimation - 1 - j));
+        }
+        pConcealer->pMono[i] = sum / decimation;
+    }
+
+    const ma_uint32 windowCount = pConcealer->windowInFrames / decimation;
+    for (ma_uint32 i = monoCount - windowCount; i < monoCount; ++i) {
+        windowEnergy += pConcealer->pMono[i] * pConcealer->pMono[i];
+    }
+
+    if (windowEnergy < 1e-9f * windowCount) {
+        return MA_FALSE;
+    }
+
+    ma_uint32 bestPeriod = pConcealer->minPeriodInFrames;
+    float bestScore = -1e30f;
+    const ma_uint32 maxCoarse = ma_min(pConcealer->maxPeriodInFrames / decimation, monoCount - windowCount);
+
+    for (ma_uint32 period = ma_max(pConcealer->minPeriodInFrames / decimation, 1); period <= maxCoarse; ++period) {
+        const float score = ma_speaker_concealer_score(pConcealer->pMono, monoCount, windowCount, period);
+        if (score > bestScore) {
+            bestScore = score;
+            bestPeriod = period * decimation;
+        }
+    }
+
+    /* Refine at the full rate around the coarse pick. */
+    if (decimation > 1) {
+        const ma_uint32 periodBeg = ma_max(bestPeriod - ma_min(bestPeriod, decimation), pConcealer->minPeriodInFrames);
+        const ma_uint32 periodEnd = ma_min(bestPeriod + decimation, pConcealer->maxPeriodInFrames);
+        const ma_uint32 coarsePeriod = bestPeriod;
+        bestScore = -1e30f;
+
+        for (ma_uint32 period = periodBeg; period <= periodEnd; ++period) {
+            float correlation = 0;
+            float energy = 0;
+
+            for (ma_uint32 i = 0; i < pConcealer->windowInFrames; ++i) {
+                const float x = ma_speaker_concealer_history_mono(pConcealer, i);
+                const float y = ma_speaker_concealer_history_mono(pConcealer, i + period);
+                correlation += x * y;
+                energy += y * y;
+            }
+
+            const float score = (energy > 0) ? correlation / sqrtf(energy) : 0;
+            if (score > bestScore) {
+                bestScore = score;
+                bestPeriod = period;
+            }
+        }
+
+        if (bestScore <= -1e30f) {
+            bestPeriod = coarsePeriod;
+        }
+    }
+
+    /*
+    The loop replays the last period. Its final quarter is overlap-added with the quarter before the period so the jump
+    from its end back to its start follows the signal instead of stepping.
+    */
+    const ma_uint32 channels = pConcealer->channels;
+    const ma_uint32 overlapInFrames = bestPeriod / 4;
+
+    for (ma_uint32 iFrame = 0; iFrame < bestPeriod; ++iFrame) {
+        const float* pRecent = ma_speaker_concealer_history(pConcealer, bestPeriod - 1 - iFrame);
+        float* pOut = pConcealer->pPeriod + (iFrame * channels);
+
+        if (iFrame + overlapInFrames >= bestPeriod && overlapInFrames > 0) {
+            const float* pEarlier = ma_speaker_concealer_history(pConcealer, 2*bestPeriod - 1 - iFrame);
+            const float a = (float)(iFrame + overlapInFrames - bestPeriod + 1) / (overlapInFrames + 1);
+            for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+                pOut[iChannel] = pRecent[iChannel] * (1 - a) + pEarlier[iChannel] * a;
+            }
+        } else {
+            ma_copy_memory_64(pOut, pRecent, (ma_uint64)channels * sizeof(float));
+        }
+    }
+
+    pConcealer->periodInFrames = bestPeriod;
+    pConcealer->periodCursor = 0;
+    pConcealer->gapFrames = 0;
+    pConcealer->isConcealing = MA_TRUE;
+    ma_atomic_fetch_add_32(&pConcealer->concealmentCount, 1);
+
+    return MA_TRUE;
+}
+
+static void ma_speaker_concealer_synthesize(ma_speaker_concealer* pConcealer, float* pFrame)
+{
+    const ma_uint32 channels = pConcealer->channels;
+    const float* pPeriodFrame = pConcealer->pPeriod + (pConcealer->periodCursor * channels);
+
+    float a = 1;
+    if (pConcealer->gapFrames > pConcealer->holdInFrames) {
+        a = 1 - ma_min(1.0f, (float)(pConcealer->gapFrames - pConcealer->holdInFrames) / pConcealer->fadeInFrames);
+    }
+
+    /* Uniform noise in [-1, 1] has a variance of 1/3. The noise itself fades out over the end of the longest gap. */
+    float noiseAmplitude = sqrtf(ma_max(pConcealer->noiseFloor, 0.0f) * 3);
+    if (pConcealer->gapFrames + pConcealer->fadeInFrames > pConcealer->maxGapInFrames) {
+        noiseAmplitude *= (float)(pConcealer->maxGapInFrames - pConcealer->gapFrames) / pConcealer->fadeInFrames;
+    }
+
+    for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+        const float noise = (a < 1) ? ma_lcg_rand_range_f32(&pConcealer->lcg, -noiseAmplitude, noiseAmplitude) : 0;
+        pFrame[iChannel] = pPeriodFrame[iChannel] * a + noise * (1 - a);
+    }
+
+    pConcealer->periodCursor = (pConcealer->periodCursor + 1) % pConcealer->periodInFrames;
+    pConcealer->gapFrames += 1;
+}
+
+/*
+Runs over the ring part of the output: the first framesFromRing frames came from the ring and the rest are silence.
+Returns how many leading frames now hold audio, which is frameCount when the gap was concealed.
+*/
+static ma_uint32 ma_speaker_concealer_process(ma_speaker_concealer* pConcealer, void* pOutput, ma_format format, ma_uint32 framesFromRing, ma_uint32 frameCount)
+{
+    float chunk[1024];
+    const ma_uint32 channels = pConcealer->channels;
+    const ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(format, channels);
+    const ma_uint32 chunkSizeInFrames = ma_countof(chunk) / channels;
+    ma_uint32 framesAudible = framesFromRing;
+    ma_uint64 concealedFrames = 0;
+
+    for (ma_uint32 framesProcessed = 0; framesProcessed < frameCount; ) {
+        const ma_uint32 framesInChunk = ma_min(frameCount - framesProcessed, chunkSizeInFrames);
+        void* pChunkOut = ma_offset_ptr(pOutput, framesProcessed * bytesPerFrame);
+
+        ma_bool32 isChunkModified = MA_FALSE;
+
+        ma_pcm_convert(chunk, ma_format_f32, pChunkOut, format, (ma_uint64)framesInChunk * channels, ma_dither_mode_none);
+
+        for (ma_uint32 iFrame = 0; iFrame < framesInChunk; ++iFrame) {
+            float* pFrame = chunk + (iFrame * channels);
+            const ma_bool32 isFromRing = (framesProcessed + iFrame < framesFromRing);
+
+            if (isFromRing) {
+                pConcealer->isGapUnconcealable = MA_FALSE;
+
+                if (pConcealer->isConcealing) {
+                    pConcealer->isConcealing = MA_FALSE;
+                    pConcealer->spliceRemaining = pConcealer->spliceInFrames;
+                }
+
+                if (pConcealer->spliceRemaining > 0) {
+                    float synthesized[MA_MAX_CHANNELS];
+                    const float a = (float)(pConcealer->spliceInFrames - pConcealer->spliceRemaining + 1) / (pConcealer->spliceInFrames + 1);
+
+                    ma_speaker_concealer_synthesize(pConcealer, synthesized);
+                    for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+                        pFrame[iChannel] = pFrame[iChannel] * a + synthesized[iChannel] * (1 - a);
+                    }
+
+                    pConcealer->spliceRemaining -= 1;
+                    isChunkModified = MA_TRUE;
+                }
+            } else {
+                if (!pConcealer->isConcealing && !pConcealer->isGapUnconcealable) {
+                    pConcealer->isGapUnconcealable = !ma_speaker_concealer_begin(pConcealer);
+                    pConcealer->spliceRemaining = 0;
+                }
+
+                /* A stream that has simply ended is not concealed forever. */
+                if (pConcealer->isConcealing && pConcealer->gapFrames >= pConcealer->maxGapInFrames) {
+                    pConcealer->isConcealing = MA_FALSE;
+                    pConcealer->isGapUnconcealable = MA_TRUE;
+                }
+
+                if (!pConcealer->isConcealing) {
+                    break;
+                }
+
+                ma_speaker_concealer_synthesize(pConcealer, pFrame);
+                concealedFrames += 1;
+                isChunkModified = MA_TRUE;
+                framesAudible = framesProcessed + iFrame + 1;
+            }
+
+            ma_speaker_concealer_push(pConcealer, pFrame, isFromRing);
+        }
+
+        /* Untouched ring audio is left as it was rather than round-tripped through f32. */
+        if (isChunkModified) {
+            ma_pcm_convert(pChunkOut, format, chunk, ma_format_f32, (ma_uint64)framesInChunk * channels, ma_dither_mode_none);
+        }
+
+        if (pConcealer->isGapUnconcealable && framesProcessed + framesInChunk > framesFromRing) {
+            break;
+        }
+
+        framesProcessed += framesInChunk;
+    }
+
+    if (concealedFrames > 0) {
+        ma_atomic_fetch_add_64(&pConcealer->concealedFrames, concealedFrames);
+    }
+
+    return framesAudible;
+}
+
+static void ma_speaker_mix_voices(ma_speaker* pSpeaker, void* pOutput, ma_uint32 frameCount)
+{
+    /* The status counter is only advanced at the end of the callback, so it is the index of this callback's first frame. */
+    const ma_uint64 callbackFrame = ma_atomic_load_explicit_64(&pSpeaker->status.deviceFrames, ma_atomic_memory_order_relaxed);
+
+    for (ma_uint32 iVoice = 0; iVoice < MA_SPEAKER_MAX_VOICES; ++iVoice) {
+        ma_speaker_voice* pVoice = &pSpeaker->voices[iVoice];
+        if (ma_atomic_load_explicit_32(&pVoice->state, ma_atomic_memory_order_acquire) != ma_speaker_voice_state_playing) {
+            continue;
+        }
+
+        ma_uint32 offsetInFrames = 0;
+        if (pVoice->isScheduled && pVoice->cursor == 0) {
+            if (pVoice->startFrame >= callbackFrame + frameCount) {
+                continue;
+            }
+
+            if (pVoice->startFrame < callbackFrame) {
+                const ma_uint64 latenessInFrames = callbackFrame - pVoice->startFrame;
+                if (latenessInFrames > ma_atomic_load_64(&pSpeaker->maxLatenessInFrames)) {
+                    ma_atomic_store_64(&pSpeaker->maxLatenessInFrames, latenessInFrames);
+                }
+                ma_atomic_fetch_add_64(&pSpeaker->scheduledLateCount, 1);
+
+                ma_uint32 expected = ma_speaker_voice_state_playing;
+                ma_atomic_compare_exchange_strong_32(&pVoice->state, &expected, ma_speaker_voice_state_finished);
+                continue;
+            }
+
+            offsetInFrames = (ma_uint32)(pVoice->startFrame - callbackFrame);
+
+            /* How far ahead of its deadline the buffer arrived, measured from the start of the callback that needed it. */
+            if (offsetInFrames < ma_atomic_load_64(&pSpeaker->minLeadInFrames)) {
+                ma_atomic_store_64(&pSpeaker->minLeadInFrames, offsetInFrames);
+            }
+            ma_atomic_fetch_add_64(&pSpeaker->scheduledStartedCount, 1);
+        }
+
+        const ma_uint32 framesToMix = (ma_uint32)ma_min(frameCount - offsetInFrames, pVoice->frameCount - pVoice->cursor);
+        ma_mix_pcm_frames_in_format(ma_offset_ptr(pOutput, offsetInFrames * pSpeaker->bytesPerFrame), ma_offset_ptr(pVoice->pFrames, pVoice->cursor * pSpeaker->bytesPerFrame), framesToMix, pSpeaker->format, pSpeaker->channels, pVoice->volume);
+        pVoice->cursor += framesToMix;
+
+        if (pVoice->cursor == pVoice->frameCount) {
+            /* A failed exchange means the owner force-stopped the voice in the meantime. */
+            ma_uint32 expected = ma_speaker_voice_state_playing;
+            ma_atomic_compare_exchange_strong_32(&pVoice->state, &expected, ma_speaker_voice_state_finished);
+        }
+    }
+}
+
+static ma_result ma_filter_stage_validate(const ma_filter_stage_config* pConfig, ma_uint32 sampleRate)
+{
+    if (!(pConfig->frequency > 0 && pConfig->frequency < sampleRate * 0.5)) {
+        return MA_INVALID_ARGS;
+    }
+
+    switch (pConfig->type)
+    {
+        case ma_filter_type_lowpass:
+            return (pConfig->order >= 1 && pConfig->order <= MA_MAX_FILTER_ORDER) ? MA_SUCCESS : MA_INVALID_ARGS;
+
+        /* ma_hpf's first order section does not attenuate DC, so odd high-pass orders are rejected. */
+        case ma_filter_type_highpass:
+        case ma_filter_type_bandpass:
+            return (pConfig->order >= 2 && pConfig->order <= MA_MAX_FILTER_ORDER && (pConfig->order & 1) == 0) ? MA_SUCCESS : MA_INVALID_ARGS;
+
+        case ma_filter_type_notch:
+        case ma_filter_type_peak:
+        case ma_filter_type_low_shelf:
+        case ma_filter_type_high_shelf:
+            return (pConfig->q > 0) ? MA_SUCCESS : MA_INVALID_ARGS;
+
+        default:
+            return MA_INVALID_ARGS;
+    }
+}
+
+static ma_result ma_filter_stage_get_heap_size(const ma_filter_stage_config* pConfig, ma_uint32 channels, ma_uint32 sampleRate, size_t* pHeapSizeInBytes)
+{
+    switch (pConfig->type)
+    {
+        case ma_filter_type_highpass:
+        {
+            const ma_hpf_config config = ma_hpf_config_init(ma_format_f32, channels, sampleRate, pConfig->frequency, pConfig->order);
+            return ma_hpf_get_heap_size(&config, pHeapSizeInBytes);
+        }
+
+        case ma_filter_type_lowpass:
+        {
+            const ma_lpf_config config = ma_lpf_config_init(ma_format_f32, channels, sampleRate, pConfig->frequency, pConfig->order);
+            return ma_lpf_get_heap_size(&config, pHeapSizeInBytes);
+        }
+
+        case ma_filter_type_bandpass:
+        {
+            const ma_bpf_config config = ma_bpf_config_init(ma_format_f32, channels, sampleRate, pConfig->frequency, pConfig->order);
+            return ma_bpf_get_heap_size(&config, pHeapSizeInBytes);
+        }
+
+        case ma_filter_type_notch:
+        {
+            const ma_notch2_config config = ma_notch2_config_init(ma_format_f32, channels, sampleRate, pConfig->q, pConfig->frequency);
+            return ma_notch2_get_heap_size(&config, pHeapSizeInBytes);
+        }
+
+        case ma_filter_type_peak:
+        {
+            const ma_peak2_config config = ma_peak2_config_init(ma_format_f32, channels, sampleRate, pConfig->gainDB, pConfig->q, pConfig->frequency);
+            return ma_peak2_get_heap_size(&config, pHeapSizeInBytes);
+        }
+
+        case ma_filter_type_low_shelf:
+        {
+            const ma_loshelf2_config config = ma_loshelf2_config_init(ma_format_f32, channels, sampleRate, pConfig->gainDB, pConfig->q, pConfig->frequency);
+            return ma_loshelf2_get_heap_size(&config, pHeapSizeInBytes);
+        }
+
+        case ma_filter_type_high_shelf:
+        {
+            const ma_hishelf2_config config = ma_hishelf2_config_init(ma_format_f32, channels, sampleRate, pConfig->gainDB, pConfig->q, pConfig->frequency);
+            return ma_hishelf2_get_heap_size(&config, pHeapSizeInBytes);
+        }
+
+        default:
+            return MA_INVALID_ARGS;
+    }
+}
+
+static ma_result ma_filter_stage_init_preallocated(const ma_filter_stage_config* pConfig, ma_uint32 channels, ma_uint32 sampleRate, void* pHeap, ma_filter_stage* pStage)
+{
+    pStage->config = *pConfig;
+
+    switch (pConfig->type)
+    {
+        case ma_filter_type_highpass:
+        {
+            const ma_hpf_config config = ma_hpf_config_init(ma_format_f32, channels, sampleRate, pConfig->frequency, pConfig->order);
+            return ma_hpf_init_preallocated(&config, pHeap, &pStage->filter.hpf);
+        }
+
+        case ma_filter_type_lowpass:
+        {
+            const ma_lpf_config config = ma_lpf_config_init(ma_format_f32, channels, sampleRate, pConfig->frequency, pConfig->order);
+            return ma_lpf_init_preallocated(&config, pHeap, &pStage->filter.lpf);
+        }
+
+        case ma_filter_type_bandpass:
+        {
+            const ma_bpf_config config = ma_bpf_config_init(ma_format_f32, channels, sampleRate, pConfig->frequency, pConfig->order);
+            return ma_bpf_init_preallocated(&config, pHeap, &pStage->filter.bpf);
+        }
+
+        case ma_filter_type_notch:
+        {
+            const ma_notch2_config config = ma_notch2_config_init(ma_format_f32, channels, sampleRate, pConfig->q, pConfig->frequency);
+            return ma_notch2_init_preallocated(&config, pHeap, &pStage->filter.notch);
+        }
+
+        case ma_filter_type_peak:
+        {
+            const ma_peak2_config config = ma_peak2_config_init(ma_format_f32, channels, sampleRate, pConfig->gainDB, pConfig->q, pConfig->frequency);
+            return ma_peak2_init_preallocated(&config, pHeap, &pStage->filter.peak);
+        }
+
+        case ma_filter_type_low_shelf:
+        {
+            const ma_loshelf2_config config = ma_loshelf2_config_init(ma_format_f32, channels, sampleRate, pConfig->gainDB, pConfig->q, pConfig->frequency);
+            return ma_loshelf2_init_preallocated(&config, pHeap, &pStage->filter.lowShelf);
+        }
+
+        case ma_filter_type_high_shelf:
+        {
+            const ma_hishelf2_config config = ma_hishelf2_config_init(ma_format_f32, channels, sampleRate, pConfig->gainDB, pConfig->q, pConfig->frequency);
+            return ma_hishelf2_init_preallocated(&config, pHeap, &pStage->filter.highShelf);
+        }
+
+        default:
+            return MA_INVALID_ARGS;
+    }
+}
+
+/* Called from the data callback. The new parameters were validated when they were posted. */
+static void ma_filter_stage_reinit(const ma_filter_stage_config* pConfig, ma_uint32 channels, ma_uint32 sampleRate, ma_filter_stage* pStage)
+{
+    pStage->config = *pConfig;
+
+    switch (pConfig->type)
+    {
+        case ma_filter_type_highpass:
+        {
+            const ma_hpf_config config = ma_hpf_config_init(ma_format_f32, channels, sampleRate, pConfig->frequency, pConfig->order);
+            ma_hpf_reinit(&config, &pStage->filter.hpf);
+        } break;
+
+        case ma_filter_type_lowpass:
+        {
+            const ma_lpf_config config = ma_lpf_config_init(ma_format_f32, channels, sampleRate, pConfig->frequency, pConfig->order);
+            ma_lpf_reinit(&config, &pStage->filter.lpf);
+        } break;
+
+        case ma_filter_type_bandpass:
+        {
+            const ma_bpf_config config = ma_bpf_config_init(ma_format_f32, channels, sampleRate, pConfig->frequency, pConfig->order);
+            ma_bpf_reinit(&config, &pStage->filter.bpf);
+        } break;
+
+        case ma_filter_type_notch:
+        {
+            const ma_notch2_config config = ma_notch2_config_init(ma_format_f32, channels, sampleRate, pConfig->q, pConfig->frequency);
+            ma_notch2_reinit(&config, &pStage->filter.notch);
+        } break;
+
+        case ma_filter_type_peak:
+        {
+            const ma_peak2_config config = ma_peak2_config_init(ma_format_f32, channels, sampleRate, pConfig->gainDB, pConfig->q, pConfig->frequency);
+            ma_peak2_reinit(&config, &pStage->filter.peak);
+        } break;
+
+        case ma_filter_type_low_shelf:
+        {
+            const ma_loshelf2_config config = ma_loshelf2_config_init(ma_format_f32, channels, sampleRate, pConfig->gainDB, pConfig->q, pConfig->frequency);
+            ma_loshelf2_reinit(&config, &pStage->filter.lowShelf);
+        } break;
+
+        case ma_filter_type_high_shelf:
+        {
+            const ma_hishelf2_config config = ma_hishelf2_config_init(ma_format_f32, channels, sampleRate, pConfig->gainDB, pConfig->q, pConfig->frequency);
+            ma_hishelf2_reinit(&config, &pStage->filter.highShelf);
+        } break;
+
+        default: break;
+    }
+}
+
+static void ma_filter_stage_process(ma_filter_stage* pStage, float* pFrames, ma_uint32 frameCount)
+{
+    switch (pStage->config.type)
+    {
+        case ma_filter_type_highpass:   ma_hpf_process_pcm_frames(&pStage->filter.hpf, pFrames, pFrames, frameCount); break;
+        case ma_filter_type_lowpass:    ma_lpf_process_pcm_frames(&pStage->filter.lpf, pFrames, pFrames, frameCount); break;
+        case ma_filter_type_bandpass:   ma_bpf_process_pcm_frames(&pStage->filter.bpf, pFrames, pFrames, frameCount); break;
+        case ma_filter_type_notch:      ma_notch2_process_pcm_frames(&pStage->filter.notch, pFrames, pFrames, frameCount); break;
+        case ma_filter_type_peak:       ma_peak2_process_pcm_frames(&pStage->filter.peak, pFrames, pFrames, frameCount); break;
+        case ma_filter_type_low_shelf:  ma_loshelf2_process_pcm_frames(&pStage->filter.lowShelf, pFrames, pFrames, frameCount); break;
+        case ma_filter_type_high_shelf: ma_hishelf2_process_pcm_frames(&pStage->filter.highShelf, pFrames, pFrames, frameCount); break;
+        default: break;
+    }
+}
+
+static ma_result ma_filter_chain_create(const ma_filter_stage_config* pStages, ma_uint32 stageCount, ma_uint32 channels, ma_uint32 sampleRate, const ma_allocation_callbacks* pAllocationCallbacks, ma_filter_chain** ppChain)
+{
+    *ppChain = NULL;
+
+    if (stageCount > MA_FILTER_CHAIN_MAX_STAGES || (pStages == NULL && stageCount > 0)) {
+        return MA_INVALID_ARGS;
+    }
+
+    size_t heapOffsets[MA_FILTER_CHAIN_MAX_STAGES];
+    size_t heapSizeInBytes = ma_align(sizeof(ma_filter_chain), MA_SIMD_ALIGNMENT);
+
+    for (ma_uint32 iStage = 0; iStage < stageCount; ++iStage) {
+        ma_result result = ma_filter_stage_validate(&pStages[iStage], sampleRate);
+        if (result != MA_SUCCESS) {
+            return result;
+        }
+
+        size_t stageHeapSizeInBytes;
+        result = ma_filter_stage_get_heap_size(&pStages[iStage], channels, sampleRate, &stageHeapSizeInBytes);
+        if (result != MA_SUCCESS) {
+            return result;
+        }
+
+        heapOffsets[iStage] = heapSizeInBytes;
+        heapSizeInBytes += ma_align(stageHeapSizeInBytes, MA_SIMD_ALIGNMENT);
+    }
+
+    ma_filter_chain* pChain = (ma_filter_chain*)ma_aligned_malloc(heapSizeInBytes, MA_SIMD_ALIGNMENT, pAllocationCallbacks);
+    if (pChain == NULL) {
+        return MA_OUT_OF_MEMORY;
+    }
+
+    ma_zero_memory_64(pChain, (ma_uint64)sizeof(*pChain));
+    pChain->channels = channels;
+    pChain->sampleRate = sampleRate;
+    pChain->stageCount = stageCount;
+
+    for (ma_uint32 iStage = 0; iStage < stageCount; ++iStage) {
+        const ma_result result = ma_filter_stage_init_preallocated(&pStages[iStage], channels, sampleRate, ma_offset_ptr(pChain, heapOffsets[iStage]), &pChain->stages[iStage]);
+        if (result != MA_SUCCESS) {
+            ma_aligned_free(pChain, pAllocationCallbacks);
+            return result;
+        }
+    }
+
+    *ppChain = pChain;
+    return MA_SUCCESS;
+}
+
+/* Callers serialize through the owning instance's filterLock, which makes this the queue's only producer. */
+static ma_result ma_filter_chain_post_update(ma_filter_chain* pChain, ma_uint32 stageIndex, const ma_filter_stage_config* pConfig)
+{
+    if (stageIndex >= pChain->stageCount) {
+        return MA_INVALID_ARGS;
+    }
+
+    /* Reinitializing keeps the filter's state, which is only possible while its shape stays the same. */
+    const ma_filter_stage_config* pCurrent = &pChain->stages[stageIndex].config;
+    if (pConfig->type != pCurrent->type || pConfig->order != pCurrent->order) {
+        return MA_INVALID_OPERATION;
+    }
+
+    const ma_result result = ma_filter_stage_validate(pConfig, pChain->sampleRate);
+    if (result != MA_SUCCESS) {
+        return result;
+    }
+
+    const ma_uint32 writeIndex = ma_atomic_load_32(&pChain->updateWriteIndex);
+    if (writeIndex - ma_atomic_load_32(&pChain->updateReadIndex) >= MA_FILTER_CHAIN_UPDATE_QUEUE_SIZE) {
+        return MA_BUSY;
+    }
+
+    ma_filter_stage_update* pUpdate = &pChain->updates[writeIndex % MA_FILTER_CHAIN_UPDATE_QUEUE_SIZE];
+    pUpdate->stageIndex = stageIndex;
+    pUpdate->config = *pConfig;
+    ma_atomic_store_explicit_32(&pChain->updateWriteIndex, writeIndex + 1, ma_atomic_memory_order_release);
+
+    return MA_SUCCESS;
+}
+
+/* Runs the chain in place over frames in any format; anything other than f32 goes through a stack scratch buffer. */
+static void ma_filter_chain_process(ma_filter_chain* pChain, void* pFrames, ma_format format, ma_uint32 frameCount)
+{
+    ma_uint32 readIndex = ma_atomic_load_32(&pChain->updateReadIndex);
+    const ma_uint32 writeIndex = ma_atomic_load_explicit_32(&pChain->updateWriteIndex, ma_atomic_memory_order_acquire);
+    if (readIndex != writeIndex) {
+        for (; readIndex != writeIndex; ++readIndex) {
+            const ma_filter_stage_update* pUpdate = &pChain->updates[readIndex % MA_FILTER_CHAIN_UPDATE_QUEUE_SIZE];
+            ma_filter_stage_reinit(&pUpdate->config, pChain->channels, pChain->sampleRate, &pChain->stages[pUpdate->stageIndex]);
+        }
+
+        ma_atomic_store_explicit_32(&pChain->updateReadIndex, readIndex, ma_atomic_memory_order_release);
+    }
+
+    if (format == ma_format_f32) {
+        for (ma_uint32 iStage = 0; iStage < pChain->stageCount; ++iStage) {
+            ma_filter_stage_process(&pChain->stages[iStage], (float*)pFrames, frameCount);
+        }
+
+        return;
+    }
+
+    float converted[1024];
+    const ma_uint32 channels = pChain->channels;
+    const ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(format, channels);
+    const ma_uint32 chunkSizeInFrames = ma_countof(converted) / channels;
+    ma_uint32 framesFiltered = 0;
+
+    while (framesFiltered < frameCount) {
+        const ma_uint32 framesToFilter = ma_min(frameCount - framesFiltered, chunkSizeInFrames);
+        void* pChunk = ma_offset_ptr(pFrames, framesFiltered * bytesPerFrame);
+
+        ma_pcm_convert(converted, ma_format_f32, pChunk, format, (ma_uint64)framesToFilter * channels, ma_dither_mode_none);
+        for (ma_uint32 iStage = 0; iStage < pChain->stageCount; ++iStage) {
+            ma_filter_stage_process(&pChain->stages[iStage], converted, framesToFilter);
+        }
+        ma_pcm_convert(pChunk, format, converted, ma_format_f32, (ma_uint64)framesToFilter * channels, ma_dither_mode_none);
+
+        framesFiltered += framesToFilter;
+    }
+}
+
+static void ma_level_meter_init(ma_level_meter* pMeter, ma_uint32 channels, ma_uint32 sampleRate)
+{
+    ma_zero_memory_64(pMeter, (ma_uint64)sizeof(*pMeter));
+    ma_atomic_store_32(&pMeter->channelCount, ma_min(channels, MA_LEVEL_METER_MAX_CHANNELS));
+    ma_atomic_store_f32(&pMeter->decayDbPerSecond, 20);
+    ma_atomic_store_f32(&pMeter->holdTimeInSeconds, 1.5f);
+    ma_atomic_store_f32(&pMeter->rmsWindowInSeconds, 0.3f);
+    pMeter->sampleRate = sampleRate;
+}
+
+static ma_result ma_level_meter_set_ballistics(ma_level_meter* pMeter, float decayDbPerSecond, ma_uint32 holdTimeInMilliseconds, ma_uint32 rmsWindowInMilliseconds)
+{
+    if (decayDbPerSecond < 0) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_atomic_store_f32(&pMeter->decayDbPerSecond, decayDbPerSecond);
+    ma_atomic_store_f32(&pMeter->holdTimeInSeconds, holdTimeInMilliseconds / 1000.0f);
+    ma_atomic_store_f32(&pMeter->rmsWindowInSeconds, ma_max(rmsWindowInMilliseconds, 1) / 1000.0f);
+
+    return MA_SUCCESS;
+}
+
+/* Accumulates per-channel peak, sum of squares and clip count over interleaved f32 frames. */
+static void ma_measure_levels_f32(const float* pSamples, ma_uint32 channels, ma_uint32 frameCount, float* pPeak, float* pSumOfSquares, ma_uint32* pClipCount)
+{
+    const ma_uint32 meteredChannels = ma_min(channels, MA_LEVEL_METER_MAX_CHANNELS);
+    ma_uint32 iFrame = 0;
+
+    /* With 1, 2 or 4 channels each vector lane always carries the same channel. */
+    if (channels == 1 || channels == 2 || channels == 4) {
+        const ma_uint32 sampleCount = frameCount * channels;
+        ma_uint32 i = 0;
+        float lanePeak[4] = { 0, 0, 0, 0 };
+        float laneSum[4] = { 0, 0, 0, 0 };
+        ma_uint32 laneClips[4] = { 0, 0, 0, 0 };
+
+#if defined(MA_SUPPORT_SSE2)
+        if (ma_has_sse2()) {
+            const __m128 signMask = _mm_set1_ps(-0.0f);
+            const __m128 clipThreshold = _mm_set1_ps(MA_LEVEL_METER_CLIP_THRESHOLD);
+            __m128 peak = _mm_setzero_ps();
+            __m128 sum = _mm_setzero_ps();
+            __m128i clips = _mm_setzero_si128();
+
+            for (; i + 4 <= sampleCount; i += 4) {
+                const __m128 x = _mm_andnot_ps(signMask, _mm_loadu_ps(pSamples + i));
+                peak = _mm_max_ps(peak, x);
+                sum = _mm_add_ps(sum, _mm_mul_ps(x, x));
+                clips = _mm_sub_epi32(clips, _mm_castps_si128(_mm_cmpge_ps(x, clipThreshold)));
+            }
+
+            _mm_storeu_ps(lanePeak, peak);
+            _mm_storeu_ps(laneSum, sum);
+            _mm_storeu_si128((__m128i*)laneClips, clips);
+        }
+#elif defined(MA_SUPPORT_NEON)
+        if (ma_has_neon()) {
+            const float32x4_t clipThreshold = vdupq_n_f32(MA_LEVEL_METER_CLIP_THRESHOLD);
+            float32x4_t peak = vdupq_n_f32(0);
+            float32x4_t sum = vdupq_n_f32(0);
+            uint32x4_t clips = vdupq_n_u32(0);
+
+            for (; i + 4 <= sampleCount; i += 4) {
+                const float32x4_t x = vabsq_f32(vld1q_f32(pSamples + i));
+                peak = vmaxq_f32(peak, x);
+                sum = vmlaq_f32(sum, x, x);
+                clips = vsubq_u32(clips, vcgeq_f32(x, clipThreshold));
+            }
+
+            vst1q_f32(lanePeak, peak);
+            vst1q_f32(laneSum, sum);
+            vst1q_u32(laneClips, clips);
+        }
+#endif
+
+        for (ma_uint32 iLane = 0; iLane < 4; ++iLane) {
+            const ma_uint32 iChannel = iLane % channels;
+            pPeak[iChannel] = ma_max(pPeak[iChannel], lanePeak[iLane]);
+            pSumOfSquares[iChannel] += laneSum[iLane];
+            pClipCount[iChannel] += laneClips[iLane];
+        }
+
+        iFrame = i / channels;
+    }
+
+    for (; iFrame < frameCount; ++iFrame) {
+        for (ma_uint32 iChannel = 0; iChannel < meteredChannels; ++iChannel) {
+            const float x = ma_abs(pSamples[iFrame*channels + iChannel]);
+            pPeak[iChannel] = ma_max(pPeak[iChannel], x);
+            pSumOfSquares[iChannel] += x * x;
+            pClipCount[iChannel] += (x >= MA_LEVEL_METER_CLIP_THRESHOLD) ? 1 : 0;
+        }
+    }
+}
+
+static void ma_level_meter_process(ma_level_meter* pMeter, const void* pFrames, ma_format format, ma_uint32 channels, ma_uint32 frameCount)
+{
+    float peak[MA_LEVEL_METER_MAX_CHANNELS] = { 0 };
+    float sumOfSquares[MA_LEVEL_METER_MAX_CHANNELS] = { 0 };
+    ma_uint32 clipCount[MA_LEVEL_METER_MAX_CHANNELS] = { 0 };
+    float converted[1024];
+
+    if (format == ma_format_f32) {
+        ma_measure_levels_f32((const float*)pFrames, channels, frameCount, peak, sumOfSquares, clipCount);
+    } else {
+        const ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(format, channels);
+        const ma_uint32 chunkSizeInFrames = ma_countof(converted) / channels;
+        ma_uint32 framesMeasured = 0;
+
+        while (framesMeasured < frameCount) {
+            const ma_uint32 framesToMeasure = ma_min(frameCount - framesMeasured, chunkSizeInFrames);
+            ma_pcm_convert(converted, ma_format_f32, ma_offset_ptr(pFrames, framesMeasured * bytesPerFrame), format, (ma_uint64)framesToMeasure * channels, ma_dither_mode_none);
+            ma_measure_levels_f32(converted, channels, framesToMeasure, peak, sumOfSquares, clipCount);
+            framesMeasured += framesToMeasure;
+        }
+    }
+
+    const float elapsedInSeconds = (float)frameCount / pMeter->sampleRate;
+    const float decay = powf(10, -ma_atomic_load_f32(&pMeter->decayDbPerSecond) * elapsedInSeconds / 20);
+    const float smoothing = 1 - expf(-elapsedInSeconds / ma_atomic_load_f32(&pMeter->rmsWindowInSeconds));
+    const float holdTimeInSeconds = ma_atomic_load_f32(&pMeter->holdTimeInSeconds);
+    const ma_uint32 meteredChannels = ma_min(channels, MA_LEVEL_METER_MAX_CHANNELS);
+
+    for (ma_uint32 iChannel = 0; iChannel < meteredChannels; ++iChannel) {
+        ma_level_meter_channel* pChannel = &pMeter->channels[iChannel];
+
+        pMeter->meanSquare[iChannel] += (sumOfSquares[iChannel] / frameCount - pMeter->meanSquare[iChannel]) * smoothing;
+
+        const float displayPeak = ma_max(peak[iChannel], ma_atomic_load_explicit_f32(&pChannel->peak, ma_atomic_memory_order_relaxed) * decay);
+        float heldPeak = ma_atomic_load_explicit_f32(&pChannel->heldPeak, ma_atomic_memory_order_relaxed);
+        if (peak[iChannel] >= heldPeak) {
+            heldPeak = peak[iChannel];
+            pMeter->holdRemainingInSeconds[iChannel] = holdTimeInSeconds;
+        } else if (pMeter->holdRemainingInSeconds[iChannel] > 0) {
+            pMeter->holdRemainingInSeconds[iChannel] -= elapsedInSeconds;
+        } else {
+            heldPeak = ma_max(heldPeak * decay, displayPeak);
+        }
+
+        ma_atomic_store_explicit_f32(&pChannel->peak, displayPeak, ma_atomic_memory_order_release);
+        ma_atomic_store_explicit_f32(&pChannel->heldPeak, heldPeak, ma_atomic_memory_order_release);
+        ma_atomic_store_explicit_f32(&pChannel->rms, sqrtf(pMeter->meanSquare[iChannel]), ma_atomic_memory_order_release);
+        if (clipCount[iChannel] > 0) {
+            ma_atomic_fetch_add_32(&pChannel->clipCount, clipCount[iChannel]);
+        }
+    }
+}
+
+/*
+Real FFT used by the analysis and echo cancellation stages. A real transform of size N is computed as a complex
+transform of N / 2 points over split real/imaginary arrays, so every radix-2 stage past the first two runs four
+butterflies per vector. Forward transforms are unscaled; inverse transforms are scaled by 1 / N.
+*/
+typedef struct
+{
+    ma_uint32 size;
+    float* pRe;                 /* Complex work buffer of size / 2 points. */
+    float* pIm;
+    float* pStageTwiddleRe;     /* Twiddles for each butterfly stage, stored contiguously per stage. */
+    float* pStageTwiddleIm;
+    float* pSplitTwiddleRe;     /* Twiddles that split the half-size complex transform into the real transform. */
+    float* pSplitTwiddleIm;
+    ma_uint32* pBitReverse;
+} ma_fft;
+
+static size_t ma_fft_get_heap_size(ma_uint32 size)
+{
+    return ma_align((size / 2) * sizeof(float), MA_SIMD_ALIGNMENT) * 7;
+}
+
+/* size must be a power of two of at least 4. */
+static void ma_fft_init_preallocated(ma_uint32 size, void* pHeap, ma_fft* pFFT)
+{
+    const ma_uint32 pointCount = size / 2;
+    const size_t pointSizeInBytes = ma_align(pointCount * sizeof(float), MA_SIMD_ALIGNMENT);
+
+    pFFT->size = size;
+    pFFT->pRe = (float*)pHeap;
+    pFFT->pIm = (float*)ma_offset_ptr(pFFT->pRe, pointSizeInBytes);
+    pFFT->pStageTwiddleRe = (float*)ma_offset_ptr(pFFT->pIm, pointSizeInBytes);
+    pFFT->pStageTwiddleIm = (float*)ma_offset_ptr(pFFT->pStageTwiddleRe, pointSizeInBytes);
+    pFFT->pSplitTwiddleRe = (float*)ma_offset_ptr(pFFT->pStageTwiddleIm, pointSizeInBytes);
+    pFFT->pSplitTwiddleIm = (float*)ma_offset_ptr(pFFT->pSplitTwiddleRe, pointSizeInBytes);
+    pFFT->pBitReverse = (ma_uint32*)ma_offset_ptr(pFFT->pSplitTwiddleIm, pointSizeInBytes);
+
+    for (ma_uint32 halfSize = 1; halfSize < pointCount; halfSize *= 2) {
+        for (ma_uint32 j = 0; j < halfSize; ++j) {
+            pFFT->pStageTwiddleRe[halfSize - 1 + j] = (float)cos(-MA_PI_D * j / halfSize);
+            pFFT->pStageTwiddleIm[halfSize - 1 + j] = (float)sin(-MA_PI_D * j / halfSize);
+        }
+    }
+
+    ma_uint32 bitCount = 0;
+    while ((1u << bitCount) < pointCount) {
+        bitCount += 1;
+    }
+
+    for (ma_uint32 i = 0; i < pointCount; ++i) {
+        ma_uint32 reversed = 0;
+        for (ma_uint32 iBit = 0; iBit < bitCount; ++iBit) {
+            reversed |= ((i >> iBit) & 1) << (bitCount - 1 - iBit);
+        }
+
+        pFFT->pBitReverse[i] = reversed;
+        pFFT->pSplitTwiddleRe[i] = (float)cos(-MA_TAU_D * i / size);
+        pFFT->pSplitTwiddleIm[i] = (float)sin(-MA_TAU_D * i / size);
+    }
+}
+
+static void ma_fft_butterflies_f32(float* pRe, float* pIm, const float* pTwiddleRe, const float* pTwiddleIm, ma_uint32 halfSize, ma_uint32 pointCount)
+{
+    for (ma_uint32 base = 0; base < pointCount; base += halfSize * 2) {
+        float* pRe0 = pRe + base;
+        float* pIm0 = pIm + base;
+        float* pRe1 = pRe0 + halfSize;
+        float* pIm1 = pIm0 + halfSize;
+        ma_uint32 j = 0;
+
+#if defined(MA_SUPPORT_SSE2)
+        if (ma_has_sse2()) {
+            for (; j + 4 <= halfSize; j += 4) {
+                const __m128 wr = _mm_loadu_ps(pTwiddleRe + j);
+                const __m128 wi = _mm_loadu_ps(pTwiddleIm + j);
+                const __m128 xr = _mm_loadu_ps(pRe1 + j);
+                const __m128 xi = _mm_loadu_ps(pIm1 + j);
+                const __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+                const __m128 ti = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+                const __m128 ur = _mm_loadu_ps(pRe0 + j);
+                const __m128 ui = _mm_loadu_ps(pIm0 + j);
+                _mm_storeu_ps(pRe1 + j, _mm_sub_ps(ur, tr));
+                _mm_storeu_ps(pIm1 + j, _mm_sub_ps(ui, ti));
+                _mm_storeu_ps(pRe0 + j, _mm_add_ps(ur, tr));
+                _mm_storeu_ps(pIm0 + j, _mm_add_ps(ui, ti));
+            }
+        }
+#elif defined(MA_SUPPORT_NEON)
+        if (ma_has_neon()) {
+            for (; j + 4 <= halfSize; j += 4) {
+                const float32x4_t wr = vld1q_f32(pTwiddleRe + j);
+                const float32x4_t wi = vld1q_f32(pTwiddleIm + j);
+                const float32x4_t xr = vld1q_f32(pRe1 + j);
+                const float32x4_t xi = vld1q_f32(pIm1 + j);
+                const float32x4_t tr = vmlsq_f32(vmulq_f32(xr, wr), xi, wi);
+                const float32x4_t ti = vmlaq_f32(vmulq_f32(xr, wi), xi, wr);
+                const float32x4_t ur = vld1q_f32(pRe0 + j);
+                const float32x4_t ui = vld1q_f32(pIm0 + j);
+                vst1q_f32(pRe1 + j, vsubq_f32(ur, tr));
+                vst1q_f32(pIm1 + j, vsubq_f32(ui, ti));
+                vst1q_f32(pRe0 + j, vaddq_f32(ur, tr));
+                vst1q_f32(pIm0 + j, vaddq_f32(ui, ti));
+            }
+        }
+#endif
+
+        for (; j < halfSize; ++j) {
+            const float tr = pRe1[j]*pTwiddleRe[j] - pIm1[j]*pTwiddleIm[j];
+            const float ti = pRe1[j]*pTwiddleIm[j] + pIm1[j]*pTwiddleRe[j];
+            pRe1[j] = pRe0[j] - tr;
+            pIm1[j] = pIm0[j] - ti;
+            pRe0[j] += tr;
+            pIm0[j] += ti;
+        }
+    }
+}
+
+static void ma_fft_run_stages(ma_fft* pFFT)
+{
+    const ma_uint32 pointCount = pFFT->size / 2;
+
+    for (ma_uint32 halfSize = 1; halfSize < pointCount; halfSize *= 2) {
+        ma_fft_butterflies_f32(pFFT->pRe, pFFT->pIm, pFFT->pStageTwiddleRe + (halfSize - 1), pFFT->pStageTwiddleIm + (halfSize - 1), halfSize, pointCount);
+    }
+}
+
+/* size real samples in, size / 2 + 1 bins out. */
+static void ma_fft_forward(ma_fft* pFFT, const float* pInput, float* pOutputRe, float* pOutputIm)
+{
+    const ma_uint32 pointCount = pFFT->size / 2;
+    float* pRe = pFFT->pRe;
+    float* pIm = pFFT->pIm;
+
+    for (ma_uint32 i = 0; i < pointCount; ++i) {
+        const ma_uint32 iSrc = pFFT->pBitReverse[i] * 2;
+        pRe[i] = pInput[iSrc + 0];
+        pIm[i] = pInput[iSrc + 1];
+    }
+
+    ma_fft_run_stages(pFFT);
+
+    pOutputRe[0] = pRe[0] + pIm[0];
+    pOutputIm[0] = 0;
+    pOutputRe[pointCount] = pRe[0] - pIm[0];
+    pOutputIm[pointCount] = 0;
+
+    for (ma_uint32 k = 1; k < pointCount; ++k) {
+        const float ar = pRe[k];
+        const float ai = pIm[k];
+        const float br = pRe[pointCount - k];
+        const float bi = pIm[pointCount - k];
+        const float evenRe = (ar + br) * 0.5f;
+        const float evenIm = (ai - bi) * 0.5f;
+        const float oddRe = (ai + bi) * 0.5f;
+        const float oddIm = (br - ar) * 0.5f;
+        const float wr = pFFT->pSplitTwiddleRe[k];
+        const float wi = pFFT->pSplitTwiddleIm[k];
+
+        pOutputRe[k] = evenRe + (wr*oddRe - wi*oddIm);
+        pOutputIm[k] = evenIm + (wr*oddIm + wi*oddRe);
+    }
+}
+
+/*
+size / 2 + 1 bins in, size real samples out. The bins are recombined into the half-size complex spectrum, which is
+inverted as the conjugate of a forward transform of its conjugate.
+*/
+static void ma_fft_inverse(ma_fft* pFFT, const float* pInputRe, const float* pInputIm, float* pOutput)
+{
+    const ma_uint32 pointCount = pFFT->size / 2;
+    float* pRe = pFFT->pRe;
+    float* pIm = pFFT->pIm;
+
+    for (ma_uint32 k = 0; k < pointCount; ++k) {
+        const float ar = pInputRe[k];
+        const float ai = pInputIm[k];
+        const float br = pInputRe[pointCount - k];
+        const float bi = -pInputIm[pointCount - k];
+        const float sumRe = (ar + br) * 0.5f;
+        const float sumIm = (ai + bi) * 0.5f;
+        const float diffRe = (ar - br) * 0.5f;
+        const float diffIm = (ai - bi) * 0.5f;
+        const float wr = pFFT->pSplitTwiddleRe[k];
+        const float wi = pFFT->pSplitTwiddleIm[k];
+        const float oddRe = diffRe*wr + diffIm*wi;
+        const float oddIm = diffIm*wr - diffRe*wi;
+        const ma_uint32 iDst = pFFT->pBitReverse[k];
+
+        pRe[iDst] = sumRe - oddIm;
+        pIm[iDst] = -(sumIm + oddRe);
+    }
+
+    ma_fft_run_stages(pFFT);
+
+    const float scale = 1.0f / pointCount;
+    for (ma_uint32 i = 0; i < pointCount; ++i) {
+        pOutput[i*2 + 0] = pRe[i] * scale;
+        pOutput[i*2 + 1] = -pIm[i] * scale;
+    }
+}
+
+/* Energy and zero-crossing kernels for the capture analysis stages. They operate on a mono f32 block. */
+static float ma_sum_of_squares_f32(const float* pSamples, ma_uint32 sampleCount)
+{
+    ma_uint32 i = 0;
+    float sum = 0;
+
+#if defined(MA_SUPPORT_SSE2)
+    if (ma_has_sse2()) {
+        __m128 acc = _mm_setzero_ps();
+        for (; i + 4 <= sampleCount; i += 4) {
+            __m128 x = _mm_loadu_ps(pSamples + i);
+            acc = _mm_add_ps(acc, _mm_mul_ps(x, x));
+        }
+
+        float lanes[4];
+        _mm_storeu_ps(lanes, acc);
+        sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#elif defined(MA_SUPPORT_NEON)
+    if (ma_has_neon()) {
+        float32x4_t acc = vdupq_n_f32(0);
+        for (; i + 4 <= sampleCount; i += 4) {
+            float32x4_t x = vld1q_f32(pSamples + i);
+            acc = vmlaq_f32(acc, x, x);
+        }
+
+        float lanes[4];
+        vst1q_f32(lanes, acc);
+        sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    for (; i < sampleCount; ++i) {
+        sum += pSamples[i] * pSamples[i];
+    }
+
+    return sum;
+}
+
+static ma_uint32 ma_count_zero_crossings_f32(const float* pSamples, ma_uint32 sampleCount, float* pLastSample)
+{
+    ma_uint32 crossings = 0;
+    ma_uint32 i = 0;
+    ma_uint32 prevSign = (*pLastSample < 0) ? 1 : 0;
+
+#if defined(MA_SUPPORT_SSE2)
+    if (ma_has_sse2()) {
+        static const ma_uint8 bitCounts[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+        for (; i + 4 <= sampleCount; i += 4) {
+            const ma_uint32 signs = (ma_uint32)_mm_movemask_ps(_mm_loadu_ps(pSamples + i));
+            crossings += bitCounts[(signs ^ ((signs << 1) | prevSign)) & 0xF];
+            prevSign = (signs >> 3) & 1;
+        }
+    }
+#endif
+
+    for (; i < sampleCount; ++i) {
+        const ma_uint32 sign = (pSamples[i] < 0) ? 1 : 0;
+        crossings += sign ^ prevSign;
+        prevSign = sign;
+    }
+
+    if (sampleCount > 0) {
+        *pLastSample = pSamples[sampleCount - 1];
+    }
+
+    return crossings;
+}
+
+/* Averages the channels of up to 1024 frames into a mono f32 block, converting from the capture format as needed. */
+static void ma_downmix_to_mono_f32(const void* pFrames, ma_format format, ma_uint32 channels, ma_uint32 frameCount, float* pMono)
+{
+    if (format == ma_format_f32 && channels == 1) {
+        ma_copy_memory_64(pMono, pFrames, (ma_uint64)frameCount * sizeof(float));
+        return;
+    }
+
+    float converted[1024];
+    const ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(format, channels);
+    const ma_uint32 chunkSizeInFrames = ma_countof(converted) / channels;
+    const float scale = 1.0f / channels;
+    ma_uint32 framesMixed = 0;
+
+    while (framesMixed < frameCount) {
+        const ma_uint32 framesToMix = ma_min(frameCount - framesMixed, chunkSizeInFrames);
+        const float* pSrc = (const float*)ma_offset_ptr(pFrames, framesMixed * bytesPerFrame);
+
+        if (format != ma_format_f32) {
+            ma_pcm_convert(converted, ma_format_f32, pSrc, format, (ma_uint64)framesToMix * channels, ma_dither_mode_none);
+            pSrc = converted;
+        }
+
+        for (ma_uint32 iFrame = 0; iFrame < framesToMix; ++iFrame) {
+            float sum = 0;
+            for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+                sum += pSrc[iFrame*channels + iChannel];
+            }
+
+            pMono[framesMixed + iFrame] = sum * scale;
+        }
+
+        framesMixed += framesToMix;
+    }
+}
+
+static void ma_microphone_vad_end_frame(ma_microphone* pMicrophone, ma_microphone_vad* pVad)
+{
+    const ma_microphone_vad_config* pConfig = &pVad->config;
+    const float energyDb = 10 * log10f((pVad->sumOfSquares / pVad->frameSizeInFrames) + 1e-12f);
+    const float zeroCrossingRate = (float)pVad->zeroCrossings / pVad->frameSizeInFrames;
+
+    if (!pVad->hasNoiseFloor) {
+        pVad->noiseFloorDb = energyDb;
+        pVad->hasNoiseFloor = MA_TRUE;
+    }
+
+    const ma_bool32 isSpeechFrame = energyDb > pConfig->minEnergyDb && (energyDb > pVad->noiseFloorDb + pConfig->thresholdDb || (energyDb > pVad->noiseFloorDb + pConfig->thresholdDb*0.5f && zeroCrossingRate > pConfig->zeroCrossingRate));
+
+    /* The noise floor follows quiet frames quickly, other non-speech frames slowly and creeps up during speech so it cannot lock. */
+    if (energyDb < pVad->noiseFloorDb) {
+        pVad->noiseFloorDb += (energyDb - pVad->noiseFloorDb) * 0.5f;
+    } else if (!isSpeechFrame) {
+        pVad->noiseFloorDb += (energyDb - pVad->noiseFloorDb) * 0.05f;
+    } else {
+        pVad->noiseFloorDb += 0.01f;
+    }
+
+    if (isSpeechFrame) {
+        if (!pVad->isSpeech) {
+            pVad->isSpeech = MA_TRUE;
+            pVad->isPreRollPending = MA_TRUE;
+            ma_atomic_fetch_add_32(&pMicrophone->vadState.segmentCount, 1);
+        }
+
+        pVad->hangoverRemaining = pVad->hangoverInAnalysisFrames;
+    } else if (pVad->isSpeech) {
+        if (pVad->hangoverRemaining > 0) {
+            pVad->hangoverRemaining -= 1;
+        } else {
+            pVad->isSpeech = MA_FALSE;
+        }
+    }
+
+    if (pVad->isSpeech) {
+        ma_atomic_fetch_add_64(&pMicrophone->vadState.speechFrames, pVad->frameSizeInFrames);
+    }
+
+    ma_atomic_store_explicit_32(&pMicrophone->vadState.isSpeech, pVad->isSpeech, ma_atomic_memory_order_release);
+    ma_atomic_store_explicit_f32(&pMicrophone->vadState.energyDb, energyDb, ma_atomic_memory_order_release);
+    ma_atomic_store_explicit_f32(&pMicrophone->vadState.noiseFloorDb, pVad->noiseFloorDb, ma_atomic_memory_order_release);
+    ma_atomic_store_explicit_f32(&pMicrophone->vadState.zeroCrossingRate, zeroCrossingRate, ma_atomic_memory_order_release);
+
+    pVad->frameCursor = 0;
+    pVad->sumOfSquares = 0;
+    pVad->zeroCrossings = 0;
+}
+
+static void ma_microphone_vad_push_pre_roll(ma_microphone_vad* pVad, const void* pFrames, ma_uint32 frameCount, ma_uint32 bytesPerFrame)
+{
+    if (pVad->preRollSizeInFrames == 0) {
+        return;
+    }
+
+    /* Only the most recent pre-roll worth of frames can survive. */
+    if (frameCount > pVad->preRollSizeInFrames) {
+        pFrames = ma_offset_ptr(pFrames, (frameCount - pVad->preRollSizeInFrames) * bytesPerFrame);
+        frameCount = pVad->preRollSizeInFrames;
+    }
+
+    const ma_uint32 framesToEnd = ma_min(frameCount, pVad->preRollSizeInFrames - pVad->preRollWritePos);
+    ma_copy_memory_64(ma_offset_ptr(pVad->pPreRoll, pVad->preRollWritePos * bytesPerFrame), pFrames, (ma_uint64)framesToEnd * bytesPerFrame);
+    ma_copy_memory_64(pVad->pPreRoll, ma_offset_ptr(pFrames, framesToEnd * bytesPerFrame), (ma_uint64)(frameCount - framesToEnd) * bytesPerFrame);
+
+    pVad->preRollWritePos = (pVad->preRollWritePos + frameCount) % pVad->preRollSizeInFrames;
+    pVad->preRollFrameCount = ma_min(pVad->preRollFrameCount + frameCount, pVad->preRollSizeInFrames);
+}
+
+static ma_uint32 ma_microphone_vad_flush_pre_roll(ma_microphone* pMicrophone, ma_microphone_vad* pVad)
+{
+    const ma_uint32 bytesPerFrame = pMicrophone->bytesPerFrame;
+    const ma_uint32 readPos = (pVad->preRollWritePos + pVad->preRollSizeInFrames - pVad->preRollFrameCount) % ma_max(pVad->preRollSizeInFrames, 1);
+    const ma_uint32 framesToEnd = ma_min(pVad->preRollFrameCount, pVad->preRollSizeInFrames - readPos);
+
+    ma_uint32 framesWritten = ma_pcm_rb_write_frames(&pMicrophone->ringBuffer, ma_offset_ptr(pVad->pPreRoll, readPos * bytesPerFrame), framesToEnd);
+    if (framesWritten == framesToEnd) {
+        framesWritten += ma_pcm_rb_write_frames(&pMicrophone->ringBuffer, pVad->pPreRoll, pVad->preRollFrameCount - framesToEnd);
+    }
+
+    pVad->preRollFrameCount = 0;
+    pVad->isPreRollPending = MA_FALSE;
+
+    return framesWritten;
+}
+
+/*
+Runs the detector over the callback's input. Analysis frames can straddle callbacks, so the input is split at frame
+boundaries; in gated mode each piece is then routed by the decision in effect after its analysis.
+*/
+static void ma_microphone_vad_process(ma_microphone* pMicrophone, ma_microphone_vad* pVad, const void* pInput, ma_uint32 frameCount, ma_uint32* pFramesWritten, ma_uint32* pFramesDropped)
+{
+    const ma_uint32 bytesPerFrame = pMicrophone->bytesPerFrame;
+    float mono[1024];
+    ma_uint32 framesProcessed = 0;
+
+    *pFramesWritten = 0;
+    *pFramesDropped = 0;
+
+    if (!pVad->config.gated) {
+        *pFramesWritten = ma_pcm_rb_write_frames(&pMicrophone->ringBuffer, pInput, frameCount);
+        *pFramesDropped = frameCount - *pFramesWritten;
+    }
+
+    while (framesProcessed < frameCount) {
+        const ma_uint32 framesToProcess = ma_min(ma_min(frameCount - framesProcessed, (ma_uint32)ma_countof(mono)), pVad->frameSizeInFrames - pVad->frameCursor);
+        const void* pPiece = ma_offset_ptr(pInput, framesProcessed * bytesPerFrame);
+
+        ma_downmix_to_mono_f32(pPiece, pMicrophone->format, pMicrophone->channels, framesToProcess, mono);
+        pVad->sumOfSquares += ma_sum_of_squares_f32(mono, framesToProcess);
+        pVad->zeroCrossings += ma_count_zero_crossings_f32(mono, framesToProcess, &pVad->lastSample);
+        pVad->frameCursor += framesToProcess;
+
+        if (pVad->frameCursor == pVad->frameSizeInFrames) {
+            ma_microphone_vad_end_frame(pMicrophone, pVad);
+        }
+
+        if (pVad->config.gated) {
+            if (pVad->isSpeech) {
+                if (pVad->isPreRollPending) {
+                    *pFramesWritten += ma_microphone_vad_flush_pre_roll(pMicrophone, pVad);
+                }
+
+                const ma_uint32 framesWritten = ma_pcm_rb_write_frames(&pMicrophone->ringBuffer, pPiece, framesToProcess);
+                *pFramesWritten += framesWritten;
+                *pFramesDropped += framesToProcess - framesWritten;
+            } else {
+                ma_microphone_vad_push_pre_roll(pVad, pPiece, framesToProcess, bytesPerFrame);
+            }
+        }
+
+        framesProcessed += framesToProcess;
+    }
+}
+
+/* Levels every analysis block, then lets ma_gainer ramp towards the resulting gain over that block. */
+static void ma_microphone_agc_process(ma_microphone* pMicrophone, ma_microphone_agc* pAgc, void* pFrames, ma_uint32 frameCount)
+{
+    float converted[1024];
+    float gained[1024];
+    const ma_format format = pMicrophone->format;
+    const ma_uint32 channels = pMicrophone->channels;
+    const ma_uint32 chunkSizeInFrames = ma_min(ma_countof(converted) / channels, pAgc->blockSizeInFrames);
+    ma_uint32 framesProcessed = 0;
+
+    while (framesProcessed < frameCount) {
+        const ma_uint32 framesToProcess = ma_min(frameCount - framesProcessed, chunkSizeInFrames);
+        void* pChunk = ma_offset_ptr(pFrames, framesProcessed * pMicrophone->bytesPerFrame);
+        const float* pSamples = (const float*)pChunk;
+
+        if (format != ma_format_f32) {
+            ma_pcm_convert(converted, ma_format_f32, pChunk, format, (ma_uint64)framesToProcess * channels, ma_dither_mode_none);
+            pSamples = converted;
+        }
+
+        const float levelDb = 10 * log10f(ma_sum_of_squares_f32(pSamples, framesToProcess * channels) / (framesToProcess * channels) + 1e-12f);
+        const float coefficient = (levelDb > pAgc->envelopeDb) ? pAgc->attackCoefficient : pAgc->releaseCoefficient;
+        pAgc->envelopeDb = levelDb + (pAgc->envelopeDb - levelDb) * coefficient;
+
+        ma_bool32 isGated = MA_FALSE;
+        if (pAgc->config.gateEnabled) {
+            if (pAgc->envelopeDb >= pAgc->config.gateThresholdDb) {
+                pAgc->isGateOpen = MA_TRUE;
+                pAgc->gateHoldRemaining = pAgc->gateHoldInBlocks;
+            } else if (pAgc->gateHoldRemaining > 0) {
+                pAgc->gateHoldRemaining -= 1;
+            } else {
+                pAgc->isGateOpen = MA_FALSE;
+            }
+
+            isGated = pAgc->envelopeDb < pAgc->config.gateThresholdDb;
+        }
+
+        /* Below the gate threshold the gain is held so that the AGC does not pump up the noise floor. */
+        if (!isGated) {
+            pAgc->gainDb = ma_clamp(pAgc->config.targetLevelDb - pAgc->envelopeDb, pAgc->config.minGainDb, pAgc->config.maxGainDb);
+        }
+
+        const float appliedGainDb = pAgc->gainDb + (pAgc->isGateOpen ? 0 : pAgc->config.gateRangeDb);
+        ma_gainer_set_gain(&pAgc->gainer, ma_volume_db_to_linear(appliedGainDb));
+        ma_gainer_process_pcm_frames(&pAgc->gainer, gained, pSamples, framesToProcess);
+        ma_pcm_convert(pChunk, format, gained, ma_format_f32, (ma_uint64)framesToProcess * channels, ma_dither_mode_none);
+
+        ma_atomic_store_explicit_f32(&pMicrophone->agcState.levelDb, pAgc->envelopeDb, ma_atomic_memory_order_release);
+        ma_atomic_store_explicit_f32(&pMicrophone->agcState.gainDb, appliedGainDb, ma_atomic_memory_order_release);
+        ma_atomic_store_explicit_32(&pMicrophone->agcState.isGateOpen, pAgc->isGateOpen, ma_atomic_memory_order_release);
+
+        framesProcessed += framesToProcess;
+    }
+}
+
+/*
+Echo canceller. A partitioned-block frequency-domain adaptive filter (overlap-save, NLMS step per bin) predicts the
+echo of the speaker output in the microphone signal and subtracts it. Both data callbacks only downmix into mono f32
+rings and count frames; the filtering runs on a worker that writes the cleaned signal into the microphone's ring.
+
+Alignment works on absolute frame indices. Each capture callback measures which reference frame was leaving the
+speaker when its last frame was captured, from the frame counters and the devices' buffer latencies, and publishes
+the offset between the two streams. The worker pairs near frame n with reference frame n + offset and only follows a
+new measurement when it moves by more than a block, so callback jitter does not disturb the converged filter.
+*/
+typedef struct
+{
+    ma_uint32 blockSizeInFrames;            /* Power of two. Also the partition size. */
+    ma_uint32 filterLengthInMilliseconds;   /* Echo tail the filter covers. */
+    float stepSize;                         /* Normalized step size, between 0 and 1. */
+    float doubleTalkThreshold;              /* Adaptation pauses while the near-end peak exceeds this times the recent reference peak. 0 disables it. */
+} ma_echo_canceller_config;
+
+struct ma_echo_canceller
+{
+    ma_microphone* pMicrophone;
+    ma_speaker* pSpeaker;
+    ma_echo_canceller_config config;
+    ma_thread thread;
+    ma_fft fft;
+    ma_pcm_rb nearRing;
+    ma_pcm_rb farRing;
+    ma_uint32 blockSizeInFrames;
+    ma_uint32 partitionCount;
+    ma_uint32 binCount;
+    ma_uint32 binStride;
+    ma_uint32 latencyInFrames;
+    ma_uint32 pollIntervalInMilliseconds;
+    ma_uint32 partitionHead;
+    ma_uint32 constraintIndex;
+    ma_uint64 nearCursor;                   /* Absolute index of the next near frame the worker consumes. */
+    ma_uint64 farRingIndex;                 /* Absolute index of the oldest frame in the reference ring. */
+    ma_int64 appliedOffset;
+    ma_bool32 hasOffset;
+    float nearEnergy;
+    float errorEnergy;
+    float* pFarFrame;                       /* Previous and current reference block. */
+    float* pNear;
+    float* pTime;
+    float* pFarSpectraRe;                   /* One spectrum per partition, newest at partitionHead. */
+    float* pFarSpectraIm;
+    float* pWeightsRe;
+    float* pWeightsIm;
+    float* pEchoRe;
+    float* pEchoIm;
+    float* pErrorRe;
+    float* pErrorIm;
+    float* pFarPower;
+    float* pFarPeaks;
+    float* pOutput;
+    void* pOutputFrames;
+    MA_ATOMIC(8, ma_uint64) farFramesWritten;
+    MA_ATOMIC(8, ma_uint64) nearFramesWritten;
+    MA_ATOMIC(8, ma_uint64) measuredOffset;     /* ma_int64 stored as its two's complement. */
+    MA_ATOMIC(8, ma_uint64) blocksProcessed;
+    MA_ATOMIC(8, ma_uint64) blocksAdapted;
+    MA_ATOMIC(8, ma_uint64) publishedOffset;
+    MA_ATOMIC(4, ma_uint32) realignmentCount;
+    MA_ATOMIC(4, float) erleDb;
+    MA_ATOMIC(4, ma_bool32) isRunning;
+};
+
+/* Called from the speaker's data callback with exactly what was rendered. */
+static void ma_echo_canceller_push_playback(ma_echo_canceller* pEchoCanceller, const void* pFrames, ma_format format, ma_uint32 channels, ma_uint32 frameCount)
+{
+    float mono[1024];
+    const ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(format, channels);
+    ma_uint32 framesPushed = 0;
+    ma_uint32 framesWritten = 0;
+
+    while (framesPushed < frameCount) {
+        const ma_uint32 framesToPush = ma_min(frameCount - framesPushed, (ma_uint32)ma_countof(mono));
+        ma_downmix_to_mono_f32(ma_offset_ptr(pFrames, framesPushed * bytesPerFrame), format, channels, framesToPush, mono);
+        framesWritten += ma_pcm_rb_write_frames(&pEchoCanceller->farRing, mono, framesToPush);
+        framesPushed += framesToPush;
+    }
+
+    ma_atomic_fetch_add_64(&pEchoCanceller->farFramesWritten, framesWritten);
+}
+
+/* Called from the microphone's data callback. Returns the number of frames dropped because the worker fell behind. */
+static ma_uint32 ma_echo_canceller_push_capture(ma_echo_canceller* pEchoCanceller, const void* pFrames, ma_format format, ma_uint32 channels, ma_uint32 frameCount)
+{
+    float mono[1024];
+    const ma_uint32 bytesPerFrame = ma_get_bytes_per_frame(format, channels);
+    ma_uint32 framesPushed = 0;
+    ma_uint32 framesWritten = 0;
+
+    while (framesPushed < frameCount) {
+        const ma_uint32 framesToPush = ma_min(frameCount - framesPushed, (ma_uint32)ma_countof(mono));
+        ma_downmix_to_mono_f32(ma_offset_ptr(pFrames, framesPushed * bytesPerFrame), format, channels, framesToPush, mono);
+        framesWritten += ma_pcm_rb_write_frames(&pEchoCanceller->nearRing, mono, framesToPush);
+        framesPushed += framesToPush;
+    }
+
+    const ma_uint64 nearFramesWritten = ma_atomic_fetch_add_64(&pEchoCanceller->nearFramesWritten, framesWritten) + framesWritten;
+    const ma_int64 offset = (ma_int64)ma_atomic_load_64(&pEchoCanceller->farFramesWritten) - pEchoCanceller->latencyInFrames - (ma_int64)nearFramesWritten;
+    ma_atomic_store_explicit_64(&pEchoCanceller->measuredOffset, (ma_uint64)offset, ma_atomic_memory_order_release);
+
+    return frameCount - framesWritten;
+}
+
+/*
+Shared-memory capture ring. The capture callback writes straight into a named POSIX shared-memory segment that any
+process on the host can map and read without copies or a broker. Layout, all little-endian native types:
+
+    offset 0    ma_shared_ring_header           (128 bytes)
+    offset 128  ma_shared_ring_reader[maxReaders] (64 bytes each)
+    headerSizeInBytes
+                capacityInFrames frames in the microphone's format, interleaved
+
+The writer never waits for readers. Frame n lives at (n & (capacityInFrames - 1)). Before copying a block the writer
+raises reserveIndex to the end of the block, and after copying it raises writeIndex to match. Frames [r, writeIndex)
+can be read in place, and are intact if r + capacityInFrames >= reserveIndex once the reader is done with them; a
+reader that finds otherwise has been lapped and skips ahead. Readers claim a slot by swapping their process ID into an
+empty one and publish their cursor there, so the writer and other tools can see who is attached and how far behind
+they are. Slots left behind by processes that have exited are reclaimed on the next open.
+*/
+#define MA_SHARED_RING_MAGIC    0x5253414D  /* "MASR" */
+#define MA_SHARED_RING_VERSION  1
+
+typedef struct
+{
+    MA_ATOMIC(4, ma_uint32) magic;
+    ma_uint32 version;
+    ma_uint32 headerSizeInBytes;            /* Offset of the first frame from the start of the segment. */
+    ma_uint32 format;                       /* ma_format */
+    ma_uint32 channels;
+    ma_uint32 sampleRate;
+    ma_uint32 bytesPerFrame;
+    ma_uint32 capacityInFrames;             /* Power of two. */
+    ma_uint32 maxReaders;
+    MA_ATOMIC(4, ma_uint32) isWriterClosed; /* Set when the microphone stops sharing; no more frames will arrive. */
+    ma_uint8 padding0[24];
+    MA_ATOMIC(8, ma_uint64) writeIndex;     /* Frames published since the segment was created. */
+    MA_ATOMIC(8, ma_uint64) reserveIndex;   /* Frames the writer may be overwriting right now end here. */
+    ma_uint8 padding1[48];
+} ma_shared_ring_header;
+
+typedef struct
+{
+    MA_ATOMIC(4, ma_uint32) processId;      /* 0 while the slot is free. */
+    ma_uint32 reserved;
+    MA_ATOMIC(8, ma_uint64) readIndex;
+    MA_ATOMIC(8, ma_uint64) droppedFrames;  /* Frames skipped because the writer lapped this reader. */
+    ma_uint8 padding[40];
+} ma_shared_ring_reader;
+
+struct ma_shared_ring
+{
+    ma_shared_ring_header* pHeader;
+    ma_shared_ring_reader* pReader;         /* NULL for the writer. */
+    ma_uint8* pFrames;
+    size_t segmentSizeInBytes;
+    ma_microphone* pMicrophone;             /* NULL for readers. */
+    ma_uint64 readIndex;                    /* Reader's private cursor; mirrored into pReader->readIndex on commit. */
+    ma_uint32 acquiredFrameCount;
+    char name[256];
+};
+
+static void ma_shared_ring_write(ma_shared_ring* pRing, const void* pFrames, ma_uint32 frameCount)
+{
+    ma_shared_ring_header* pHeader = pRing->pHeader;
+    const ma_uint32 capacity = pHeader->capacityInFrames;
+    const ma_uint32 bytesPerFrame = pHeader->bytesPerFrame;
+
+    /* Readers need part of the ring to stay stable, so oversized blocks go in quarters of the ring at a time. */
+    while (frameCount > 0) {
+        const ma_uint32 framesToWrite = ma_min(frameCount, capacity / 4);
+        const ma_uint64 writeIndex = ma_atomic_load_explicit_64(&pHeader->writeIndex, ma_atomic_memory_order_relaxed);
+        const ma_uint32 offset = (ma_uint32)(writeIndex & (capacity - 1));
+        const ma_uint32 framesToEnd = ma_min(framesToWrite, capacity - offset);
+
+        ma_atomic_store_explicit_64(&pHeader->reserveIndex, writeIndex + framesToWrite, ma_atomic_memory_order_relaxed);
+        ma_atomic_thread_fence(ma_atomic_memory_order_seq_cst);
+
+        MA_COPY_MEMORY(pRing->pFrames + (size_t)offset * bytesPerFrame, pFrames, (size_t)framesToEnd * bytesPerFrame);
+        MA_COPY_MEMORY(pRing->pFrames, ma_offset_ptr(pFrames, framesToEnd * bytesPerFrame), (size_t)(framesToWrite - framesToEnd) * bytesPerFrame);
+
+        ma_atomic_store_explicit_64(&pHeader->writeIndex, writeIndex + framesToWrite, ma_atomic_memory_order_release);
+
+        pFrames = ma_offset_ptr(pFrames, framesToWrite * bytesPerFrame);
+        frameCount -= framesToWrite;
+    }
+}
+
+/* Everything the capture callback does with a block of input: ring (through the VAD or echo canceller when enabled), taps, shared ring and meter. */
+static void ma_microphone_process_input(ma_microphone* pMicrophone, const void* pInput, ma_uint32 frameCount, ma_uint32* pFramesWritten, ma_uint32* pFramesDropped)
+{
+    /* When the ring is full the remainder is dropped to avoid blocking the callback. */
+    ma_uint32 framesProcessed;
+    ma_uint32 framesDropped;
+
+    /* With echo cancellation the worker commits the cleaned frames, so the VAD cannot gate what goes into the ring. */
+    ma_echo_canceller* pEchoCanceller = (ma_echo_canceller*)ma_atomic_load_ptr(&pMicrophone->pEchoCanceller);
+    ma_microphone_vad* pVad = (ma_microphone_vad*)ma_atomic_load_ptr(&pMicrophone->pVad);
+    if (pEchoCanceller != NULL) {
+        framesDropped = ma_echo_canceller_push_capture(pEchoCanceller, pInput, pMicrophone->format, pMicrophone->channels, frameCount);
+        framesProcessed = 0;
+    } else if (pVad != NULL) {
+        ma_microphone_vad_process(pMicrophone, pVad, pInput, frameCount, &framesProcessed, &framesDropped);
+    } else {
+        framesProcessed = ma_pcm_rb_write_frames(&pMicrophone->ringBuffer, pInput, frameCount);
+        framesDropped = frameCount - framesProcessed;
+    }
+
+    for (ma_uint32 iTap = 0; iTap < MA_MICROPHONE_MAX_TAPS; ++iTap) {
+        ma_microphone_tap* pTap = (ma_microphone_tap*)ma_atomic_load_ptr(&pMicrophone->pTaps[iTap]);
+        if (pTap == NULL) {
+            continue;
+        }
+
+        const ma_uint32 framesTapped = ma_pcm_rb_write_frames(&pTap->ringBuffer, pInput, frameCount);
+        if (framesTapped < frameCount) {
+            ma_atomic_fetch_add_64(&pTap->droppedFrames, frameCount - framesTapped);
+        }
+    }
+
+    ma_shared_ring* pSharedRing = (ma_shared_ring*)ma_atomic_load_ptr(&pMicrophone->pSharedRing);
+    if (pSharedRing != NULL) {
+        ma_shared_ring_write(pSharedRing, pInput, frameCount);
+    }
+
+    ma_level_meter_process(&pMicrophone->meter, pInput, pMicrophone->format, pMicrophone->channels, frameCount);
+
+    *pFramesWritten += framesProcessed;
+    *pFramesDropped += framesDropped;
+}
+
+static void ma_microphone_data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
+{
+    (void)pOutput;
+
+    ma_microphone* pMicrophone = (ma_microphone*)pDevice->pUserData;
+    if (pMicrophone == NULL || pInput == NULL || frameCount == 0) {
+        return;
+    }
+
+    ma_atomic_fetch_add_32(&pMicrophone->callbackSequence, 1);
+    MA_RT_AUDIT_ENTER_CALLBACK();
+
+    if (ma_atomic_load_32(&pMicrophone->needsThreadSetup) && ma_atomic_exchange_32(&pMicrophone->needsThreadSetup, MA_FALSE)) {
+        ma_apply_callback_thread_config(&pMicrophone->threadConfig, &pMicrophone->threadReport);
+    }
+
+    ma_uint32 framesWritten = 0;
+    ma_uint32 framesDropped = 0;
+
+    ma_filter_chain* pFilters = (ma_filter_chain*)ma_atomic_load_ptr(&pMicrophone->pFilters);
+    ma_microphone_agc* pAgc = (ma_microphone_agc*)ma_atomic_load_ptr(&pMicrophone->pAgc);
+    if (pFilters == NULL && pAgc == NULL) {
+        ma_microphone_process_input(pMicrophone, pInput, frameCount, &framesWritten, &framesDropped);
+    } else {
+        /* The device's buffer is read-only, so filters and gain run over a copy one chunk at a time. */
+        float processed[1024];
+        const ma_uint32 chunkSizeInFrames = sizeof(processed) / pMicrophone->bytesPerFrame;
+        ma_uint32 framesProcessed = 0;
+
+        while (framesProcessed < frameCount) {
+            const ma_uint32 framesToProcess = ma_min(frameCount - framesProcessed, chunkSizeInFrames);
+
+            ma_copy_memory_64(processed, ma_offset_ptr(pInput, framesProcessed * pMicrophone->bytesPerFrame), (ma_uint64)framesToProcess * pMicrophone->bytesPerFrame);
+
+            if (pFilters != NULL) {
+                ma_filter_chain_process(pFilters, processed, pMicrophone->format, framesToProcess);
+            }
+
+            if (pAgc != NULL) {
+                ma_microphone_agc_process(pMicrophone, pAgc, processed, framesToProcess);
+            }
+
+            ma_microphone_process_input(pMicrophone, processed, framesToProcess, &framesWritten, &framesDropped);
+
+            framesProcessed += framesToProcess;
+        }
+    }
+
+    /* While the echo canceller is attached its worker owns the ring and reports its own writes. */
+    if (framesWritten > 0 || ma_atomic_load_ptr(&pMicrophone->pEchoCanceller) == NULL) {
+        ma_stream_status_on_write(&pMicrophone->status, &pMicrophone->ringBuffer, framesWritten);
+    }
+    ma_stream_status_on_callback(&pMicrophone->status, frameCount, framesDropped, MA_TRUE);
+    ma_readiness_event_update(&pMicrophone->readiness, &pMicrophone->ringBuffer, MA_TRUE);
+
+    MA_RT_AUDIT_LEAVE_CALLBACK();
+    ma_atomic_fetch_add_32(&pMicrophone->callbackSequence, 1);
+}
+
+static void ma_speaker_data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
+{
+    (void)pInput;
+
+    ma_speaker* pSpeaker = (ma_speaker*)pDevice->pUserData;
+    if (pSpeaker == NULL || pOutput == NULL || frameCount == 0) {
+        return;
+    }
+
+    ma_atomic_fetch_add_32(&pSpeaker->callbackSequence, 1);
+    MA_RT_AUDIT_ENTER_CALLBACK();
+
+    if (ma_atomic_load_32(&pSpeaker->needsThreadSetup) && ma_atomic_exchange_32(&pSpeaker->needsThreadSetup, MA_FALSE)) {
+        ma_apply_callback_thread_config(&pSpeaker->threadConfig, &pSpeaker->threadReport);
+    }
+
+    ma_uint8* pOutputBytes = (ma_uint8*)pOutput;
+    const ma_uint32 bytesPerFrame = pSpeaker->bytesPerFrame;
+    ma_uint32 framesProcessed = 0;
+    ma_uint32 underrunFrames = 0;
+
+    ma_bool32 isBuffering = ma_atomic_load_32(&pSpeaker->isBuffering);
+    if (isBuffering && ma_pcm_rb_available_read(&pSpeaker->ringBuffer) >= ma_atomic_load_32(&pSpeaker->prefillInFrames)) {
+        isBuffering = MA_FALSE;
+        ma_atomic_store_32(&pSpeaker->isBuffering, MA_FALSE);
+        ma_stream_status_set_state(&pSpeaker->status, ma_stream_state_started);
+    }
+
+    if (isBuffering) {
+        /* Holding back while the ring fills is not an underrun. */
+        ma_silence_pcm_frames(pOutput, frameCount, pSpeaker->format, pSpeaker->channels);
+    } else {
+        while (framesProcessed < frameCount) {
+            ma_uint32 framesToRead = frameCount - framesProcessed;
+            void* pReadPtr = NULL;
+
+            if (ma_pcm_rb_acquire_read(&pSpeaker->ringBuffer, &framesToRead, &pReadPtr) != MA_SUCCESS || framesToRead == 0) {
+                ma_silence_pcm_frames(pOutputBytes + (framesProcessed * bytesPerFrame), frameCount - framesProcessed, pSpeaker->format, pSpeaker->channels);
+                break;
+            }
+
+            ma_copy_memory_64(pOutputBytes + (framesProcessed * bytesPerFrame), pReadPtr, (ma_uint64)framesToRead * bytesPerFrame);
+            ma_pcm_rb_commit_read(&pSpeaker->ringBuffer, framesToRead);
+            framesProcessed += framesToRead;
+        }
+
+        underrunFrames = frameCount - framesProcessed;
+        if (underrunFrames > 0 && ma_atomic_load_32(&pSpeaker->pauseWhenDrained) && ma_atomic_load_32(&pSpeaker->prefillInFrames) > 0) {
+            ma_atomic_store_32(&pSpeaker->isBuffering, MA_TRUE);
+            ma_atomic_fetch_add_32(&pSpeaker->rebufferCount, 1);
+            ma_stream_status_set_state(&pSpeaker->status, ma_stream_state_buffering);
+        }
+    }
+
+    if (ma_atomic_load_32(&pSpeaker->isAwaitingFirstFrame)) {
+        if (framesProcessed > 0) {
+            ma_atomic_store_64(&pSpeaker->startupLatencyInFrames, pSpeaker->framesBeforeFirstFrame);
+            ma_atomic_store_64(&pSpeaker->startupLatencyInNanoseconds, ma_get_monotonic_time_in_nanoseconds() - ma_atomic_load_64(&pSpeaker->startTimeInNanoseconds));
+            ma_atomic_store_explicit_32(&pSpeaker->isAwaitingFirstFrame, MA_FALSE, ma_atomic_memory_order_release);
+        } else {
+            pSpeaker->framesBeforeFirstFrame += frameCount;
+        }
+    }
+
+    ma_uint32 framesAudible = framesProcessed;
+    if (pSpeaker->pConcealer != NULL) {
+        /* Silence held back for a prefill, or left by a flush, is intentional rather than a gap to fill. */
+        if (isBuffering || (ma_atomic_load_32(&pSpeaker->pConcealer->isResetPending) && ma_atomic_exchange_32(&pSpeaker->pConcealer->isResetPending, MA_FALSE))) {
+            ma_speaker_concealer_reset(pSpeaker->pConcealer);
+        }
+
+        if (!isBuffering) {
+            framesAudible = ma_speaker_concealer_process(pSpeaker->pConcealer, pOutput, pSpeaker->format, framesProcessed, frameCount);
+        }
+    }
+
+    const ma_uint32 fadeLengthInFrames = ma_atomic_load_32(&pSpeaker->fadeLengthInFrames);
+    if (fadeLengthInFrames > 0) {
+        ma_speaker_apply_ring_fades(pSpeaker, pOutput, framesAudible, frameCount, fadeLengthInFrames);
+    }
+
+    ma_speaker_mix_voices(pSpeaker, pOutput, frameCount);
+
+    ma_filter_chain* pFilters = (ma_filter_chain*)ma_atomic_load_ptr(&pSpeaker->pFilters);
+    if (pFilters != NULL) {
+        ma_filter_chain_process(pFilters, pOutput, pSpeaker->format, frameCount);
+    }
+
+    const ma_uint32 fadeOutRequest = ma_atomic_load_explicit_32(&pSpeaker->fadeOutRequest, ma_atomic_memory_order_acquire);
+    if (fadeOutRequest == ma_speaker_fade_request_done) {
+        ma_silence_pcm_frames(pOutput, frameCount, pSpeaker->format, pSpeaker->channels);
+    } else if (fadeOutRequest != ma_speaker_fade_request_none) {
+        ma_speaker_apply_fade_out(pSpeaker, pOutput, frameCount, ma_max(fadeLengthInFrames, 1), fadeOutRequest);
+
+        /* The concealer's history was taken at full level before the fade, so it must not be replayed after it. */
+        if (pSpeaker->pConcealer != NULL && ma_atomic_load_32(&pSpeaker->fadeOutRequest) != fadeOutRequest) {
+            ma_speaker_concealer_reset(pSpeaker->pConcealer);
+        }
+    }
+
+    ma_echo_canceller* pEchoCanceller = (ma_echo_canceller*)ma_atomic_load_ptr(&pSpeaker->pEchoCanceller);
+    if (pEchoCanceller != NULL) {
+        ma_echo_canceller_push_playback(pEchoCanceller, pOutput, pSpeaker->format, pSpeaker->channels, frameCount);
+    }
+
+    ma_level_meter_process(&pSpeaker->meter, pOutput, pSpeaker->format, pSpeaker->channels, frameCount);
+
+    ma_stream_status_on_read(&pSpeaker->status, &pSpeaker->ringBuffer, framesProcessed);
+    ma_stream_status_on_callback(&pSpeaker->status, frameCount, underrunFrames, MA_FALSE);
+    ma_readiness_event_update(&pSpeaker->readiness, &pSpeaker->ringBuffer, MA_FALSE);
+
+    MA_RT_AUDIT_LEAVE_CALLBACK();
+    ma_atomic_fetch_add_32(&pSpeaker->callbackSequence, 1);
+}
+
+static ma_result ma_microphone_init(ma_microphone* pMicrophone, const ma_microphone_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, void* pReservedRingStorage, ma_uint32 reservedRingSizeInFrames)
+{
+    if (pMicrophone == NULL || pConfig == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_zero_memory_64(pMicrophone, (ma_uint64)sizeof(*pMicrophone));
+    pMicrophone->allocationCallbacks = *pAllocationCallbacks;
+    pMicrophone->threadConfig = pConfig->thread;
+    pMicrophone->readiness.fd = -1;
+    pMicrophone->readiness.writeFd = -1;
+    ma_atomic_store_32(&pMicrophone->needsThreadSetup, MA_TRUE);
+    ma_atomic_store_32(&pMicrophone->agcState.isGateOpen, MA_TRUE);
+
+    ma_result result = ma_init_context_for_platform(&pMicrophone->allocationCallbacks, &pConfig->thread, pConfig->isHeadless, &pMicrophone->context);
+    if (result != MA_SUCCESS) {
+        return result;
+    }
+
+    ma_device_config config = ma_device_config_init(ma_device_type_capture);
+    config.dataCallback = ma_microphone_data_callback;
+    config.pUserData = pMicrophone;
+    config.capture.format = (pConfig->format == ma_format_unknown) ? ma_format_f32 : pConfig->format;
+    config.capture.channels = (pConfig->channels == 0) ? 1 : pConfig->channels;
+    config.sampleRate = pConfig->sampleRate;
+
+    result = ma_device_init(&pMicrophone->context, &config, &pMicrophone->device);
+    if (result != MA_SUCCESS) {
+        ma_context_uninit(&pMicrophone->context);
+        return result;
+    }
+
+    /* The data callback receives frames in the client format, so that is what the ring stores. */
+    pMicrophone->format = (pMicrophone->device.capture.format != ma_format_unknown) ? pMicrophone->device.capture.format : config.capture.format;
+    pMicrophone->channels = (pMicrophone->device.capture.channels != 0) ? pMicrophone->device.capture.channels : config.capture.channels;
+    pMicrophone->sampleRate = (pMicrophone->device.sampleRate != 0) ? pMicrophone->device.sampleRate : ((pConfig->sampleRate != 0) ? pConfig->sampleRate : 48000);
+    pMicrophone->bytesPerFrame = ma_get_bytes_per_frame(pMicrophone->format, pMicrophone->channels);
+
+    ma_uint32 bufferSizeInFrames = pConfig->bufferSizeInFrames;
+    if (bufferSizeInFrames == 0) {
+        bufferSizeInFrames = ma_calculate_default_buffer_size(pMicrophone->sampleRate, pMicrophone->device.capture.internalPeriodSizeInFrames);
+    }
+
+    pMicrophone->bufferSizeInFrames = bufferSizeInFrames;
+
+    void* pRingStorage = pConfig->pPreallocatedBuffer;
+    if (pRingStorage == NULL && bufferSizeInFrames <= reservedRingSizeInFrames) {
+        pRingStorage = pReservedRingStorage;
+    }
+
+    result = ma_pcm_rb_init(pMicrophone->format, pMicrophone->channels, bufferSizeInFrames, pRingStorage, &pMicrophone->allocationCallbacks, &pMicrophone->ringBuffer);
+    if (result != MA_SUCCESS) {
+        ma_device_uninit(&pMicrophone->device);
+        ma_context_uninit(&pMicrophone->context);
+        return result;
+    }
+
+    if (pConfig->filterCount > 0) {
+        result = ma_filter_chain_create(pConfig->pFilters, pConfig->filterCount, pMicrophone->channels, pMicrophone->sampleRate, &pMicrophone->allocationCallbacks, &pMicrophone->pFilters);
+        if (result != MA_SUCCESS) {
+            ma_pcm_rb_uninit(&pMicrophone->ringBuffer);
+            ma_device_uninit(&pMicrophone->device);
+            ma_context_uninit(&pMicrophone->context);
+            return result;
+        }
+    }
+
+    ma_stream_status_init(&pMicrophone->status, bufferSizeInFrames);
+    ma_level_meter_init(&pMicrophone->meter, pMicrophone->channels, pMicrophone->sampleRate);
+
+    return MA_SUCCESS;
+}
+
+static void ma_microphone_uninit(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return;
+    }
+
+    if (pMicrophone->isStarted) {
+        ma_device_stop(&pMicrophone->device);
+        pMicrophone->isStarted = MA_FALSE;
+    }
+
+    ma_device_uninit(&pMicrophone->device);
+
+    if (pMicrophone->pFilters != NULL) {
+        ma_aligned_free(pMicrophone->pFilters, &pMicrophone->allocationCallbacks);
+    }
+
+    if (pMicrophone->pVad != NULL) {
+        ma_aligned_free(pMicrophone->pVad, &pMicrophone->allocationCallbacks);
+    }
+
+    if (pMicrophone->pAgc != NULL) {
+        ma_aligned_free(pMicrophone->pAgc, &pMicrophone->allocationCallbacks);
+    }
+
+    ma_readiness_event_close(&pMicrophone->readiness);
+    ma_pcm_rb_uninit(&pMicrophone->ringBuffer);
+    ma_context_uninit(&pMicrophone->context);
+}
+
+static ma_result ma_speaker_init(ma_speaker* pSpeaker, const ma_speaker_config* pConfig, const ma_allocation_callbacks* pAllocationCallbacks, void* pReservedRingStorage, ma_uint32 reservedRingSizeInFrames)
+{
+    if (pSpeaker == NULL || pConfig == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_zero_memory_64(pSpeaker, (ma_uint64)sizeof(*pSpeaker));
+    pSpeaker->allocationCallbacks = *pAllocationCallbacks;
+    pSpeaker->threadConfig = pConfig->thread;
+    pSpeaker->readiness.fd = -1;
+    pSpeaker->readiness.writeFd = -1;
+    ma_atomic_store_32(&pSpeaker->needsThreadSetup, MA_TRUE);
+
+    ma_result result = ma_init_context_for_platform(&pSpeaker->allocationCallbacks, &pConfig->thread, pConfig->isHeadless, &pSpeaker->context);
+    if (result != MA_SUCCESS) {
+        return result;
+    }
+
+    ma_device_config config = ma_device_config_init(ma_device_type_playback);
+    config.dataCallback = ma_speaker_data_callback;
+    config.pUserData = pSpeaker;
+    config.playback.format = (pConfig->format == ma_format_unknown) ? ma_format_f32 : pConfig->format;
+    config.playback.channels = (pConfig->channels == 0) ? 2 : pConfig->channels;
+    config.sampleRate = pConfig->sampleRate;
+
+    result = ma_device_init(&pSpeaker->context, &config, &pSpeaker->device);
+    if (result != MA_SUCCESS) {
+        ma_context_uninit(&pSpeaker->context);
+        return result;
+    }
+
+    /* The data callback is asked for frames in the client format, so that is what the ring stores. */
+    pSpeaker->format = (pSpeaker->device.playback.format != ma_format_unknown) ? pSpeaker->device.playback.format : config.playback.format;
+    pSpeaker->channels = (pSpeaker->device.playback.channels != 0) ? pSpeaker->device.playback.channels : config.playback.channels;
+    pSpeaker->sampleRate = (pSpeaker->device.sampleRate != 0) ? pSpeaker->device.sampleRate : ((pConfig->sampleRate != 0) ? pConfig->sampleRate : 48000);
+    pSpeaker->bytesPerFrame = ma_get_bytes_per_frame(pSpeaker->format, pSpeaker->channels);
+
+    ma_uint32 bufferSizeInFrames = pConfig->bufferSizeInFrames;
+    if (bufferSizeInFrames == 0) {
+        bufferSizeInFrames = ma_calculate_default_buffer_size(pSpeaker->sampleRate, pSpeaker->device.playback.internalPeriodSizeInFrames);
+    }
+
+    pSpeaker->bufferSizeInFrames = bufferSizeInFrames;
+
+    void* pRingStorage = pConfig->pPreallocatedBuffer;
+    if (pRingStorage == NULL && bufferSizeInFrames <= reservedRingSizeInFrames) {
+        pRingStorage = pReservedRingStorage;
+    }
+
+    result = ma_pcm_rb_init(pSpeaker->format, pSpeaker->channels, bufferSizeInFrames, pRingStorage, &pSpeaker->allocationCallbacks, &pSpeaker->ringBuffer);
+    if (result != MA_SUCCESS) {
+        ma_device_uninit(&pSpeaker->device);
+        ma_context_uninit(&pSpeaker->context);
+        return result;
+    }
+
+    if (pConfig->filterCount > 0) {
+        result = ma_filter_chain_create(pConfig->pFilters, pConfig->filterCount, pSpeaker->channels, pSpeaker->sampleRate, &pSpeaker->allocationCallbacks, &pSpeaker->pFilters);
+        if (result != MA_SUCCESS) {
+            ma_pcm_rb_uninit(&pSpeaker->ringBuffer);
+            ma_device_uninit(&pSpeaker->device);
+            ma_context_uninit(&pSpeaker->context);
+            return result;
+        }
+    }
+
+    if (pConfig->concealUnderruns) {
+        result = ma_speaker_concealer_create(pSpeaker->channels, pSpeaker->sampleRate, &pSpeaker->allocationCallbacks, &pSpeaker->pConcealer);
+        if (result != MA_SUCCESS) {
+            if (pSpeaker->pFilters != NULL) {
+                ma_aligned_free(pSpeaker->pFilters, &pSpeaker->allocationCallbacks);
+            }
+            ma_pcm_rb_uninit(&pSpeaker->ringBuffer);
+            ma_device_uninit(&pSpeaker->device);
+            ma_context_uninit(&pSpeaker->context);
+            return result;
+        }
+
+        ma_speaker_concealer_reset(pSpeaker->pConcealer);
+    }
+
+    ma_stream_status_init(&pSpeaker->status, bufferSizeInFrames);
+    ma_level_meter_init(&pSpeaker->meter, pSpeaker->channels, pSpeaker->sampleRate);
+
+    ma_atomic_store_32(&pSpeaker->prefillInFrames, ma_min(pConfig->prefillInFrames, bufferSizeInFrames));
+    ma_atomic_store_32(&pSpeaker->pauseWhenDrained, pConfig->pauseWhenDrained);
+    ma_atomic_store_64(&pSpeaker->minLeadInFrames, ~(ma_uint64)0);
+    ma_atomic_store_32(&pSpeaker->fadeLengthInFrames, (ma_uint32)(((ma_uint64)pConfig->fadeLengthInMilliseconds * pSpeaker->sampleRate) / 1000));
+    pSpeaker->outputGain = 1;
+
+    return MA_SUCCESS;
+}
+
+static void ma_speaker_uninit(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return;
+    }
+
+    if (pSpeaker->isStarted) {
+        ma_device_stop(&pSpeaker->device);
+        pSpeaker->isStarted = MA_FALSE;
+    }
+
+    ma_pcm_rb_uninit(&pSpeaker->ringBuffer);
+    ma_device_uninit(&pSpeaker->device);
+
+    /* Scheduled buffers are copies owned by the speaker itself. */
+    for (ma_uint32 iVoice = 0; iVoice < MA_SPEAKER_MAX_VOICES; ++iVoice) {
+        ma_speaker_voice* pVoice = &pSpeaker->voices[iVoice];
+        if (ma_atomic_load_32(&pVoice->state) != ma_speaker_voice_state_free && pVoice->pOwner == pSpeaker) {
+            ma_free((void*)pVoice->pFrames, &pSpeaker->allocationCallbacks);
+            ma_atomic_store_32(&pVoice->state, ma_speaker_voice_state_free);
+        }
+    }
+
+    if (pSpeaker->pFilters != NULL) {
+        ma_aligned_free(pSpeaker->pFilters, &pSpeaker->allocationCallbacks);
+    }
+    if (pSpeaker->pConcealer != NULL) {
+        ma_aligned_free(pSpeaker->pConcealer, &pSpeaker->allocationCallbacks);
+    }
+    ma_readiness_event_close(&pSpeaker->readiness);
+    ma_context_uninit(&pSpeaker->context);
+}
+
+MA_WRAPPER_API ma_filter_stage_config ma_filter_stage_config_init(ma_filter_type type, double frequency)
+{
+    ma_filter_stage_config config;
+    ma_zero_memory_64(&config, (ma_uint64)sizeof(config));
+
+    config.type = type;
+    config.order = 2;
+    config.frequency = frequency;
+    config.q = 0.707;
+    config.gainDB = 0;
+
+    return config;
+}
+
+MA_WRAPPER_API ma_microphone_config ma_microphone_config_init(ma_uint32 sampleRate, ma_uint32 channels, ma_format format, ma_uint32 bufferSizeInFrames)
+{
+    ma_microphone_config config;
+    ma_zero_memory_64(&config, (ma_uint64)sizeof(config));
+
+    config.sampleRate = sampleRate;
+    config.channels = channels;
+    config.format = format;
+    config.bufferSizeInFrames = bufferSizeInFrames;
+
+    return config;
+}
+
+MA_WRAPPER_API ma_microphone* ma_microphone_create_ex(const ma_microphone_config* pConfig)
+{
+    if (pConfig == NULL) {
+        return NULL;
+    }
+
+    if (pConfig->pPreallocatedBuffer != NULL && pConfig->bufferSizeInFrames == 0) {
+        return NULL;
+    }
+
+    ma_allocation_callbacks allocationCallbacks;
+    if (ma_allocation_callbacks_init_copy(&allocationCallbacks, &pConfig->allocationCallbacks) != MA_SUCCESS) {
+        return NULL;
+    }
+
+    const ma_format format = (pConfig->format == ma_format_unknown) ? ma_format_f32 : pConfig->format;
+    const ma_uint32 channels = (pConfig->channels == 0) ? 1 : pConfig->channels;
+    const ma_uint32 reservedRingSizeInFrames = (pConfig->pPreallocatedBuffer == NULL) ? ma_calculate_reserved_buffer_size(pConfig->sampleRate, pConfig->bufferSizeInFrames) : 0;
+    const size_t heapSizeInBytes = ma_calculate_instance_heap_size(sizeof(ma_microphone), format, channels, reservedRingSizeInFrames);
+
+    ma_microphone* pMicrophone = (ma_microphone*)ma_aligned_malloc(heapSizeInBytes, MA_SIMD_ALIGNMENT, &allocationCallbacks);
+    if (pMicrophone == NULL) {
+        return NULL;
+    }
+
+    void* pReservedRingStorage = ma_offset_ptr(pMicrophone, ma_align(sizeof(ma_microphone), MA_SIMD_ALIGNMENT));
+
+    if (ma_microphone_init(pMicrophone, pConfig, &allocationCallbacks, pReservedRingStorage, reservedRingSizeInFrames) != MA_SUCCESS) {
+        ma_aligned_free(pMicrophone, &allocationCallbacks);
+        return NULL;
+    }
+
+    return pMicrophone;
+}
+
+MA_WRAPPER_API ma_microphone* ma_microphone_create(ma_uint32 sampleRate, ma_uint32 channels, ma_format format, ma_uint32 bufferSizeInFrames)
+{
+    ma_microphone_config config = ma_microphone_config_init(sampleRate, channels, format, bufferSizeInFrames);
+    return ma_microphone_create_ex(&config);
+}
+
+MA_WRAPPER_API void ma_microphone_destroy(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return;
+    }
+
+    ma_allocation_callbacks allocationCallbacks = pMicrophone->allocationCallbacks;
+
+    ma_microphone_uninit(pMicrophone);
+    ma_aligned_free(pMicrophone, &allocationCallbacks);
+}
+
+MA_WRAPPER_API ma_result ma_microphone_start(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    if (pMicrophone->isStarted) {
+        return MA_SUCCESS;
+    }
+
+    /* A restarted backend may run the callback on a new thread, which needs its priority and affinity applied again. */
+    ma_atomic_store_32(&pMicrophone->needsThreadSetup, MA_TRUE);
+
+    ma_result result = ma_device_start(&pMicrophone->device);
+    if (result == MA_SUCCESS) {
+        pMicrophone->isStarted = MA_TRUE;
+        ma_stream_status_set_state(&pMicrophone->status, ma_stream_state_started);
+    }
+
+    return result;
+}
+
+MA_WRAPPER_API ma_result ma_microphone_stop(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    if (!pMicrophone->isStarted) {
+        return MA_SUCCESS;
+    }
+
+    ma_result result = ma_device_stop(&pMicrophone->device);
+    if (result == MA_SUCCESS) {
+        pMicrophone->isStarted = MA_FALSE;
+        ma_stream_status_set_state(&pMicrophone->status, ma_stream_state_stopped);
+    }
+
+    return result;
+}
+
+MA_WRAPPER_API ma_uint32 ma_microphone_read(ma_microphone* pMicrophone, void* pFramesOut, ma_uint32 frameCount)
+{
+    if (pMicrophone == NULL || pFramesOut == NULL || frameCount == 0) {
+        return 0;
+    }
+
+    const ma_uint32 framesReadTotal = ma_pcm_rb_read_frames(&pMicrophone->ringBuffer, pFramesOut, frameCount);
+
+    ma_stream_status_on_read(&pMicrophone->status, &pMicrophone->ringBuffer, framesReadTotal);
+
+    return framesReadTotal;
+}
+
+MA_WRAPPER_API ma_uint32 ma_microphone_read_planar(ma_microphone* pMicrophone, void** ppFramesOut, ma_uint32 frameCount)
+{
+    if (pMicrophone == NULL || ppFramesOut == NULL || frameCount == 0) {
+        return 0;
+    }
+
+    ma_uint32 framesReadTotal = 0;
+
+    while (framesReadTotal < frameCount) {
+        ma_uint32 framesToRead = frameCount - framesReadTotal;
+        void* pReadPtr = NULL;
+
+        if (ma_pcm_rb_acquire_read(&pMicrophone->ringBuffer, &framesToRead, &pReadPtr) != MA_SUCCESS || framesToRead == 0) {
+            break;
+        }
+
+        ma_deinterleave_pcm_frames_at(pMicrophone->format, pMicrophone->channels, framesToRead, pReadPtr, ppFramesOut, framesReadTotal);
+        ma_pcm_rb_commit_read(&pMicrophone->ringBuffer, framesToRead);
+        framesReadTotal += framesToRead;
+    }
+
+    ma_stream_status_on_read(&pMicrophone->status, &pMicrophone->ringBuffer, framesReadTotal);
+
+    return framesReadTotal;
+}
+
+MA_WRAPPER_API ma_uint32 ma_microphone_available_frames(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return 0;
+    }
+
+    return ma_pcm_rb_available_read(&pMicrophone->ringBuffer);
+}
+
+MA_WRAPPER_API ma_uint64 ma_microphone_read_batch(ma_microphone_read_batch_item* pItems, ma_uint32 itemCount)
+{
+    if (pItems == NULL) {
+        return 0;
+    }
+
+    ma_uint64 framesReadTotal = 0;
+
+    for (ma_uint32 iItem = 0; iItem < itemCount; ++iItem) {
+        pItems[iItem].framesRead = ma_microphone_read(pItems[iItem].pMicrophone, pItems[iItem].pFramesOut, pItems[iItem].frameCount);
+        framesReadTotal += pItems[iItem].framesRead;
+    }
+
+    return framesReadTotal;
+}
+
+MA_WRAPPER_API void ma_microphone_available_frames_batch(ma_microphone** ppMicrophones, ma_uint32* pAvailableFrames, ma_uint32 count)
+{
+    if (ppMicrophones == NULL || pAvailableFrames == NULL) {
+        return;
+    }
+
+    for (ma_uint32 i = 0; i < count; ++i) {
+        pAvailableFrames[i] = ma_microphone_available_frames(ppMicrophones[i]);
+    }
+}
+
+MA_WRAPPER_API const ma_stream_status* ma_microphone_get_status(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return NULL;
+    }
+
+    return &pMicrophone->status;
+}
+
+MA_WRAPPER_API const ma_level_meter* ma_microphone_get_meter(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return NULL;
+    }
+
+    return &pMicrophone->meter;
+}
+
+MA_WRAPPER_API ma_result ma_microphone_set_meter_ballistics(ma_microphone* pMicrophone, float decayDbPerSecond, ma_uint32 holdTimeInMilliseconds, ma_uint32 rmsWindowInMilliseconds)
+{
+    if (pMicrophone == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    return ma_level_meter_set_ballistics(&pMicrophone->meter, decayDbPerSecond, holdTimeInMilliseconds, rmsWindowInMilliseconds);
+}
+
+/* Replaces the whole chain, resetting filter state. Passing no stages removes it. */
+MA_WRAPPER_API ma_result ma_microphone_set_filters(ma_microphone* pMicrophone, const ma_filter_stage_config* pStages, ma_uint32 stageCount)
+{
+    if (pMicrophone == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_filter_chain* pChain = NULL;
+    if (stageCount > 0) {
+        const ma_result result = ma_filter_chain_create(pStages, stageCount, pMicrophone->channels, pMicrophone->sampleRate, &pMicrophone->allocationCallbacks, &pChain);
+        if (result != MA_SUCCESS) {
+            return result;
+        }
+    }
+
+    ma_spinlock_lock(&pMicrophone->filterLock);
+    ma_filter_chain* pOldChain = (ma_filter_chain*)ma_atomic_exchange_ptr(&pMicrophone->pFilters, pChain);
+    ma_spinlock_unlock(&pMicrophone->filterLock);
+
+    ma_microphone_wait_for_callback(pMicrophone);
+
+    if (pOldChain != NULL) {
+        ma_aligned_free(pOldChain, &pMicrophone->allocationCallbacks);
+    }
+
+    return MA_SUCCESS;
+}
+
+/*
+Changes one stage's parameters without touching its state. The type and order must stay the same. The change is
+applied at the start of the next callback; MA_BUSY means too many changes are still waiting for the callback.
+*/
+MA_WRAPPER_API ma_result ma_microphone_update_filter(ma_microphone* pMicrophone, ma_uint32 stageIndex, const ma_filter_stage_config* pConfig)
+{
+    if (pMicrophone == NULL || pConfig == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_spinlock_lock(&pMicrophone->filterLock);
+
+    ma_result result = MA_INVALID_OPERATION;
+    ma_filter_chain* pChain = (ma_filter_chain*)ma_atomic_load_ptr(&pMicrophone->pFilters);
+    if (pChain != NULL) {
+        result = ma_filter_chain_post_update(pChain, stageIndex, pConfig);
+    }
+
+    ma_spinlock_unlock(&pMicrophone->filterLock);
+
+    return result;
+}
+
+MA_WRAPPER_API ma_microphone_vad_config ma_microphone_vad_config_init(void)
+{
+    ma_microphone_vad_config config;
+    ma_zero_memory_64(&config, (ma_uint64)sizeof(config));
+
+    config.thresholdDb = 9;
+    config.minEnergyDb = -60;
+    config.zeroCrossingRate = 0.25f;
+    config.frameSizeInMilliseconds = 10;
+    config.hangoverInMilliseconds = 300;
+    config.preRollInMilliseconds = 200;
+    config.gated = MA_FALSE;
+
+    return config;
+}
+
+/* Replaces the detector published to the callback and frees the previous one once the callback can no longer see it. */
+static void ma_microphone_set_vad(ma_microphone* pMicrophone, ma_microphone_vad* pVad)
+{
+    ma_microphone_vad* pOldVad = (ma_microphone_vad*)ma_atomic_exchange_ptr(&pMicrophone->pVad, pVad);
+    ma_microphone_wait_for_callback(pMicrophone);
+
+    if (pOldVad != NULL) {
+        ma_aligned_free(pOldVad, &pMicrophone->allocationCallbacks);
+    }
+}
+
+MA_WRAPPER_API ma_result ma_microphone_enable_vad(ma_microphone* pMicrophone, const ma_microphone_vad_config* pConfig)
+{
+    if (pMicrophone == NULL || pConfig == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    const ma_uint32 frameSizeInFrames = ma_max(pMicrophone->sampleRate * ma_max(pConfig->frameSizeInMilliseconds, 1) / 1000, 1);
+    const ma_uint32 preRollSizeInFrames = pConfig->gated ? (ma_uint32)((ma_uint64)pMicrophone->sampleRate * pConfig->preRollInMilliseconds / 1000) : 0;
+
+    const size_t heapSizeInBytes = ma_calculate_instance_heap_size(sizeof(ma_microphone_vad), pMicrophone->format, pMicrophone->channels, preRollSizeInFrames);
+    ma_microphone_vad* pVad = (ma_microphone_vad*)ma_aligned_malloc(heapSizeInBytes, MA_SIMD_ALIGNMENT, &pMicrophone->allocationCallbacks);
+    if (pVad == NULL) {
+        return MA_OUT_OF_MEMORY;
+    }
+
+    ma_zero_memory_64(pVad, (ma_uint64)sizeof(*pVad));
+    pVad->config = *pConfig;
+    pVad->frameSizeInFrames = frameSizeInFrames;
+    pVad->hangoverInAnalysisFrames = pConfig->hangoverInMilliseconds / ma_max(pConfig->frameSizeInMilliseconds, 1);
+    pVad->pPreRoll = ma_offset_ptr(pVad, ma_align(sizeof(ma_microphone_vad), MA_SIMD_ALIGNMENT));
+    pVad->preRollSizeInFrames = preRollSizeInFrames;
+
+    ma_atomic_store_32(&pMicrophone->vadState.isSpeech, MA_FALSE);
+    ma_microphone_set_vad(pMicrophone, pVad);
+
+    return MA_SUCCESS;
+}
+
+MA_WRAPPER_API void ma_microphone_disable_vad(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return;
+    }
+
+    ma_microphone_set_vad(pMicrophone, NULL);
+    ma_atomic_store_32(&pMicrophone->vadState.isSpeech, MA_FALSE);
+}
+
+MA_WRAPPER_API const ma_microphone_vad_state* ma_microphone_get_vad_state(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return NULL;
+    }
+
+    return &pMicrophone->vadState;
+}
+
+MA_WRAPPER_API ma_microphone_agc_config ma_microphone_agc_config_init(void)
+{
+    ma_microphone_agc_config config;
+    ma_zero_memory_64(&config, (ma_uint64)sizeof(config));
+
+    config.targetLevelDb = -18;
+    config.maxGainDb = 30;
+    config.minGainDb = -20;
+    config.attackInMilliseconds = 20;
+    config.releaseInMilliseconds = 400;
+    config.smoothingInMilliseconds = 10;
+    config.gateEnabled = MA_FALSE;
+    config.gateThresholdDb = -55;
+    config.gateHoldInMilliseconds = 150;
+    config.gateRangeDb = -80;
+
+    return config;
+}
+
+static void ma_microphone_set_agc(ma_microphone* pMicrophone, ma_microphone_agc* pAgc)
+{
+    ma_microphone_agc* pOldAgc = (ma_microphone_agc*)ma_atomic_exchange_ptr(&pMicrophone->pAgc, pAgc);
+    ma_microphone_wait_for_callback(pMicrophone);
+
+    if (pOldAgc != NULL) {
+        ma_aligned_free(pOldAgc, &pMicrophone->allocationCallbacks);
+    }
+}
+
+MA_WRAPPER_API ma_result ma_microphone_enable_agc(ma_microphone* pMicrophone, const ma_microphone_agc_config* pConfig)
+{
+    if (pMicrophone == NULL || pConfig == NULL || pConfig->minGainDb > pConfig->maxGainDb) {
+        return MA_INVALID_ARGS;
+    }
+
+    const ma_uint32 blockSizeInFrames = ma_max(pMicrophone->sampleRate / 400, 1);
+    const ma_gainer_config gainerConfig = ma_gainer_config_init(pMicrophone->channels, ma_max(pMicrophone->sampleRate * pConfig->smoothingInMilliseconds / 1000, 1));
+
+    size_t gainerHeapSizeInBytes;
+    ma_result result = ma_gainer_get_heap_size(&gainerConfig, &gainerHeapSizeInBytes);
+    if (result != MA_SUCCESS) {
+        return result;
+    }
+
+    ma_microphone_agc* pAgc = (ma_microphone_agc*)ma_aligned_malloc(ma_align(sizeof(ma_microphone_agc), MA_SIMD_ALIGNMENT) + gainerHeapSizeInBytes, MA_SIMD_ALIGNMENT, &pMicrophone->allocationCallbacks);
+    if (pAgc == NULL) {
+        return MA_OUT_OF_MEMORY;
+    }
+
+    ma_zero_memory_64(pAgc, (ma_uint64)sizeof(*pAgc));
+
+    result = ma_gainer_init_preallocated(&gainerConfig, ma_offset_ptr(pAgc, ma_align(sizeof(ma_microphone_agc), MA_SIMD_ALIGNMENT)), &pAgc->gainer);
+    if (result != MA_SUCCESS) {
+        ma_aligned_free(pAgc, &pMicrophone->allocationCallbacks);
+        return result;
+    }
+
+    /* One-pole coefficients per analysis block. The envelope starts on target so the initial gain is unity. */
+    const float blockTimeInMilliseconds = blockSizeInFrames * 1000.0f / pMicrophone->sampleRate;
+    pAgc->config = *pConfig;
+    pAgc->blockSizeInFrames = blockSizeInFrames;
+    pAgc->attackCoefficient = expf(-blockTimeInMilliseconds / ma_max(pConfig->attackInMilliseconds, 1));
+    pAgc->releaseCoefficient = expf(-blockTimeInMilliseconds / ma_max(pConfig->releaseInMilliseconds, 1));
+    pAgc->gateHoldInBlocks = (ma_uint32)(pConfig->gateHoldInMilliseconds / blockTimeInMilliseconds);
+    pAgc->isGateOpen = MA_TRUE;
+    pAgc->envelopeDb = pConfig->targetLevelDb;
+    pAgc->gainDb = 0;
+
+    /* Published before the first block is analyzed, so the state never reads as gated while the gate is open. */
+    ma_atomic_store_f32(&pMicrophone->agcState.levelDb, pAgc->envelopeDb);
+    ma_atomic_store_f32(&pMicrophone->agcState.gainDb, 0);
+    ma_atomic_store_32(&pMicrophone->agcState.isGateOpen, MA_TRUE);
+
+    ma_microphone_set_agc(pMicrophone, pAgc);
+
+    return MA_SUCCESS;
+}
+
+MA_WRAPPER_API void ma_microphone_disable_agc(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return;
+    }
+
+    ma_microphone_set_agc(pMicrophone, NULL);
+    ma_atomic_store_f32(&pMicrophone->agcState.gainDb, 0);
+    ma_atomic_store_32(&pMicrophone->agcState.isGateOpen, MA_TRUE);
+}
+
+MA_WRAPPER_API const ma_microphone_agc_state* ma_microphone_get_agc_state(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return NULL;
+    }
+
+    return &pMicrophone->agcState;
+}
+
+MA_WRAPPER_API ma_format ma_microphone_get_format(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return ma_format_unknown;
+    }
+
+    return pMicrophone->format;
+}
+
+MA_WRAPPER_API ma_uint32 ma_microphone_get_channels(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return 0;
+    }
+
+    return pMicrophone->channels;
+}
+
+MA_WRAPPER_API ma_uint32 ma_microphone_get_sample_rate(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return 0;
+    }
+
+    return pMicrophone->sampleRate;
+}
+
+/* Returns MA_UNAVAILABLE until the first data callback has applied the thread configuration. */
+MA_WRAPPER_API ma_result ma_microphone_get_thread_report(ma_microphone* pMicrophone, ma_callback_thread_report* pReport)
+{
+    if (pMicrophone == NULL || pReport == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    if (!ma_atomic_load_explicit_32(&pMicrophone->threadReport.isApplied, ma_atomic_memory_order_acquire)) {
+        return MA_UNAVAILABLE;
+    }
+
+    *pReport = pMicrophone->threadReport;
+
+    return MA_SUCCESS;
+}
+
+MA_WRAPPER_API ma_speaker_config ma_speaker_config_init(ma_uint32 sampleRate, ma_uint32 channels, ma_format format, ma_uint32 bufferSizeInFrames)
+{
+    ma_speaker_config config;
+    ma_zero_memory_64(&config, (ma_uint64)sizeof(config));
+
+    config.sampleRate = sampleRate;
+    config.channels = channels;
+    config.format = format;
+    config.bufferSizeInFrames = bufferSizeInFrames;
+
+    return config;
+}
+
+MA_WRAPPER_API ma_speaker* ma_speaker_create_ex(const ma_speaker_config* pConfig)
+{
+    if (pConfig == NULL) {
+        return NULL;
+    }
+
+    if (pConfig->pPreallocatedBuffer != NULL && pConfig->bufferSizeInFrames == 0) {
+        return NULL;
+    }
+
+    ma_allocation_callbacks allocationCallbacks;
+    if (ma_allocation_callbacks_init_copy(&allocationCallbacks, &pConfig->allocationCallbacks) != MA_SUCCESS) {
+        return NULL;
+    }
+
+    const ma_format format = (pConfig->format == ma_format_unknown) ? ma_format_f32 : pConfig->format;
+    const ma_uint32 channels = (pConfig->channels == 0) ? 2 : pConfig->channels;
+    const ma_uint32 reservedRingSizeInFrames = (pConfig->pPreallocatedBuffer == NULL) ? ma_calculate_reserved_buffer_size(pConfig->sampleRate, pConfig->bufferSizeInFrames) : 0;
+    const size_t heapSizeInBytes = ma_calculate_instance_heap_size(sizeof(ma_speaker), format, channels, reservedRingSizeInFrames);
+
+    ma_speaker* pSpeaker = (ma_speaker*)ma_aligned_malloc(heapSizeInBytes, MA_SIMD_ALIGNMENT, &allocationCallbacks);
+    if (pSpeaker == NULL) {
+        return NULL;
+    }
+
+    void* pReservedRingStorage = ma_offset_ptr(pSpeaker, ma_align(sizeof(ma_speaker), MA_SIMD_ALIGNMENT));
+
+    if (ma_speaker_init(pSpeaker, pConfig, &allocationCallbacks, pReservedRingStorage, reservedRingSizeInFrames) != MA_SUCCESS) {
+        ma_aligned_free(pSpeaker, &allocationCallbacks);
+        return NULL;
+    }
+
+    return pSpeaker;
+}
+
+MA_WRAPPER_API ma_speaker* ma_speaker_create(ma_uint32 sampleRate, ma_uint32 channels, ma_format format, ma_uint32 bufferSizeInFrames)
+{
+    ma_speaker_config config = ma_speaker_config_init(sampleRate, channels, format, bufferSizeInFrames);
+    return ma_speaker_create_ex(&config);
+}
+
+MA_WRAPPER_API void ma_speaker_destroy(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return;
+    }
+
+    ma_allocation_callbacks allocationCallbacks = pSpeaker->allocationCallbacks;
+
+    ma_speaker_uninit(pSpeaker);
+    ma_aligned_free(pSpeaker, &allocationCallbacks);
+}
+
+/*
+Hands a fade-out to the data callback and blocks until it has been rendered. Gives up after a generous multiple of the
+fade length so a device that has stopped delivering callbacks cannot hang the caller.
+*/
+static void ma_speaker_wait_for_fade_out(ma_speaker* pSpeaker, ma_speaker_fade_request request)
+{
+    const ma_uint32 expected = (request == ma_speaker_fade_request_stop) ? ma_speaker_fade_request_done : ma_speaker_fade_request_none;
+    const ma_uint32 timeoutInMilliseconds = 200 + (ma_uint32)(((ma_uint64)ma_atomic_load_32(&pSpeaker->fadeLengthInFrames) * 4000) / pSpeaker->sampleRate);
+
+    ma_atomic_store_explicit_32(&pSpeaker->fadeOutRequest, request, ma_atomic_memory_order_release);
+
+    for (ma_uint32 iWait = 0; iWait < timeoutInMilliseconds; ++iWait) {
+        if (ma_atomic_load_explicit_32(&pSpeaker->fadeOutRequest, ma_atomic_memory_order_acquire) == expected) {
+            return;
+        }
+
+        ma_sleep(1);
+    }
+}
+
+MA_WRAPPER_API ma_result ma_speaker_start(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    if (pSpeaker->isStarted) {
+        return MA_SUCCESS;
+    }
+
+    /* The device is stopped, so the callback state can be reset here. With a prefill the device is only armed. */
+    const ma_bool32 isPrefilling = (ma_atomic_load_32(&pSpeaker->prefillInFrames) > 0);
+    ma_atomic_store_32(&pSpeaker->isBuffering, isPrefilling);
+    ma_atomic_store_32(&pSpeaker->isAwaitingFirstFrame, MA_TRUE);
+    ma_atomic_store_32(&pSpeaker->needsThreadSetup, MA_TRUE);
+    ma_atomic_store_64(&pSpeaker->startupLatencyInNanoseconds, 0);
+    ma_atomic_store_64(&pSpeaker->startupLatencyInFrames, 0);
+    pSpeaker->framesBeforeFirstFrame = 0;
+    ma_atomic_store_32(&pSpeaker->fadeOutRequest, ma_speaker_fade_request_none);
+    pSpeaker->ringGain = 0;
+    pSpeaker->tailGain = 0;
+    pSpeaker->outputGain = 1;
+    if (pSpeaker->pConcealer != NULL) {
+        ma_speaker_concealer_reset(pSpeaker->pConcealer);
+    }
+    ma_stream_status_set_state(&pSpeaker->status, isPrefilling ? ma_stream_state_buffering : ma_stream_state_started);
+    ma_atomic_store_64(&pSpeaker->startTimeInNanoseconds, ma_get_monotonic_time_in_nanoseconds());
+
+    ma_result result = ma_device_start(&pSpeaker->device);
+    if (result == MA_SUCCESS) {
+        pSpeaker->isStarted = MA_TRUE;
+    } else {
+        ma_stream_status_set_state(&pSpeaker->status, ma_stream_state_stopped);
+    }
+
+    return result;
+}
+
+MA_WRAPPER_API ma_result ma_speaker_stop(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    if (!pSpeaker->isStarted) {
+        return MA_SUCCESS;
+    }
+
+    if (ma_atomic_load_32(&pSpeaker->fadeLengthInFrames) > 0) {
+        ma_speaker_wait_for_fade_out(pSpeaker, ma_speaker_fade_request_stop);
+    }
+
+    ma_result result = ma_device_stop(&pSpeaker->device);
+    if (result == MA_SUCCESS) {
+        pSpeaker->isStarted = MA_FALSE;
+        ma_stream_status_set_state(&pSpeaker->status, ma_stream_state_stopped);
+    }
+
+    return result;
+}
+
+MA_WRAPPER_API ma_uint32 ma_speaker_write(ma_speaker* pSpeaker, const void* pFrames, ma_uint32 frameCount)
+{
+    if (pSpeaker == NULL || pFrames == NULL || frameCount == 0) {
+        return 0;
+    }
+
+    if (ma_speaker_claim_producer(pSpeaker) != MA_SUCCESS) {
+        return 0;
+    }
+
+    const ma_uint32 framesWrittenTotal = ma_pcm_rb_write_frames(&pSpeaker->ringBuffer, pFrames, frameCount);
+
+    ma_stream_status_on_write(&pSpeaker->status, &pSpeaker->ringBuffer, framesWrittenTotal);
+    ma_speaker_release_producer(pSpeaker);
+
+    return framesWrittenTotal;
+}
+
+MA_WRAPPER_API ma_uint32 ma_speaker_write_planar(ma_speaker* pSpeaker, const void** ppFrames, ma_uint32 frameCount)
+{
+    if (pSpeaker == NULL || ppFrames == NULL || frameCount == 0) {
+        return 0;
+    }
+
+    if (ma_speaker_claim_producer(pSpeaker) != MA_SUCCESS) {
+        return 0;
+    }
+
+    ma_uint32 framesWrittenTotal = 0;
+
+    while (framesWrittenTotal < frameCount) {
+        ma_uint32 framesToWrite = frameCount - framesWrittenTotal;
+        void* pWritePtr = NULL;
+
+        if (ma_pcm_rb_acquire_write(&pSpeaker->ringBuffer, &framesToWrite, &pWritePtr) != MA_SUCCESS || framesToWrite == 0) {
+            break;
+        }
+
+        ma_interleave_pcm_frames_at(pSpeaker->format, pSpeaker->channels, framesToWrite, ppFrames, framesWrittenTotal, pWritePtr);
+        ma_pcm_rb_commit_write(&pSpeaker->ringBuffer, framesToWrite);
+        framesWrittenTotal += framesToWrite;
+    }
+
+    ma_stream_status_on_write(&pSpeaker->status, &pSpeaker->ringBuffer, framesWrittenTotal);
+    ma_speaker_release_producer(pSpeaker);
+
+    return framesWrittenTotal;
+}
+
+MA_WRAPPER_API ma_uint32 ma_speaker_available_frames(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return 0;
+    }
+
+    return ma_pcm_rb_available_write(&pSpeaker->ringBuffer);
+}
+
+MA_WRAPPER_API ma_uint64 ma_speaker_write_batch(ma_speaker_write_batch_item* pItems, ma_uint32 itemCount)
+{
+    if (pItems == NULL) {
+        return 0;
+    }
+
+    ma_uint64 framesWrittenTotal = 0;
+
+    for (ma_uint32 iItem = 0; iItem < itemCount; ++iItem) {
+        pItems[iItem].framesWritten = ma_speaker_write(pItems[iItem].pSpeaker, pItems[iItem].pFrames, pItems[iItem].frameCount);
+        framesWrittenTotal += pItems[iItem].framesWritten;
+    }
+
+    return framesWrittenTotal;
+}
+
+MA_WRAPPER_API void ma_speaker_available_frames_batch(ma_speaker** ppSpeakers, ma_uint32* pAvailableFrames, ma_uint32 count)
+{
+    if (ppSpeakers == NULL || pAvailableFrames == NULL) {
+        return;
+    }
+
+    for (ma_uint32 i = 0; i < count; ++i) {
+        pAvailableFrames[i] = ma_speaker_available_frames(ppSpeakers[i]);
+    }
+}
+
+MA_WRAPPER_API const ma_stream_status* ma_speaker_get_status(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return NULL;
+    }
+
+    return &pSpeaker->status;
+}
+
+MA_WRAPPER_API const ma_level_meter* ma_speaker_get_meter(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return NULL;
+    }
+
+    return &pSpeaker->meter;
+}
+
+MA_WRAPPER_API ma_result ma_speaker_set_meter_ballistics(ma_speaker* pSpeaker, float decayDbPerSecond, ma_uint32 holdTimeInMilliseconds, ma_uint32 rmsWindowInMilliseconds)
+{
+    if (pSpeaker == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    return ma_level_meter_set_ballistics(&pSpeaker->meter, decayDbPerSecond, holdTimeInMilliseconds, rmsWindowInMilliseconds);
+}
+
+/* Replaces the whole chain, resetting filter state. Passing no stages removes it. */
+MA_WRAPPER_API ma_result ma_speaker_set_filters(ma_speaker* pSpeaker, const ma_filter_stage_config* pStages, ma_uint32 stageCount)
+{
+    if (pSpeaker == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_filter_chain* pChain = NULL;
+    if (stageCount > 0) {
+        const ma_result result = ma_filter_chain_create(pStages, stageCount, pSpeaker->channels, pSpeaker->sampleRate, &pSpeaker->allocationCallbacks, &pChain);
+        if (result != MA_SUCCESS) {
+            return result;
+        }
+    }
+
+    ma_spinlock_lock(&pSpeaker->filterLock);
+    ma_filter_chain* pOldChain = (ma_filter_chain*)ma_atomic_exchange_ptr(&pSpeaker->pFilters, pChain);
+    ma_spinlock_unlock(&pSpeaker->filterLock);
+
+    ma_speaker_wait_for_callback(pSpeaker);
+
+    if (pOldChain != NULL) {
+        ma_aligned_free(pOldChain, &pSpeaker->allocationCallbacks);
+    }
+
+    return MA_SUCCESS;
+}
+
+/*
+Changes one stage's parameters without touching its state. The type and order must stay the same. The change is
+applied at the start of the next callback; MA_BUSY means too many changes are still waiting for the callback.
+*/
+MA_WRAPPER_API ma_result ma_speaker_update_filter(ma_speaker* pSpeaker, ma_uint32 stageIndex, const ma_filter_stage_config* pConfig)
+{
+    if (pSpeaker == NULL || pConfig == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_spinlock_lock(&pSpeaker->filterLock);
+
+    ma_result result = MA_INVALID_OPERATION;
+    ma_filter_chain* pChain = (ma_filter_chain*)ma_atomic_load_ptr(&pSpeaker->pFilters);
+    if (pChain != NULL) {
+        result = ma_filter_chain_post_update(pChain, stageIndex, pConfig);
+    }
+
+    ma_spinlock_unlock(&pSpeaker->filterLock);
+
+    return result;
+}
+
+MA_WRAPPER_API ma_format ma_speaker_get_format(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return ma_format_unknown;
+    }
+
+    return pSpeaker->format;
+}
+
+MA_WRAPPER_API ma_uint32 ma_speaker_get_channels(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return 0;
+    }
+
+    return pSpeaker->channels;
+}
+
+MA_WRAPPER_API ma_uint32 ma_speaker_get_sample_rate(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return 0;
+    }
+
+    return pSpeaker->sampleRate;
+}
+
+/* Returns MA_UNAVAILABLE until the first data callback has applied the thread configuration. */
+MA_WRAPPER_API ma_result ma_speaker_get_thread_report(ma_speaker* pSpeaker, ma_callback_thread_report* pReport)
+{
+    if (pSpeaker == NULL || pReport == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    if (!ma_atomic_load_explicit_32(&pSpeaker->threadReport.isApplied, ma_atomic_memory_order_acquire)) {
+        return MA_UNAVAILABLE;
+    }
+
+    *pReport = pSpeaker->threadReport;
+
+    return MA_SUCCESS;
+}
+
+/* Takes effect from the next data callback. A prefill larger than the ring is clamped to the ring size. */
+MA_WRAPPER_API ma_result ma_speaker_set_prefill(ma_speaker* pSpeaker, ma_uint32 prefillInFrames, ma_bool32 pauseWhenDrained)
+{
+    if (pSpeaker == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_atomic_store_32(&pSpeaker->prefillInFrames, ma_min(prefillInFrames, pSpeaker->bufferSizeInFrames));
+    ma_atomic_store_32(&pSpeaker->pauseWhenDrained, pauseWhenDrained);
+
+    return MA_SUCCESS;
+}
+
+/* Takes effect from the next data callback. 0 turns fades off. */
+MA_WRAPPER_API ma_result ma_speaker_set_fade_length(ma_speaker* pSpeaker, ma_uint32 fadeLengthInMilliseconds)
+{
+    if (pSpeaker == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_atomic_store_32(&pSpeaker->fadeLengthInFrames, (ma_uint32)(((ma_uint64)fadeLengthInMilliseconds * pSpeaker->sampleRate) / 1000));
+
+    return MA_SUCCESS;
+}
+
+/* Returns MA_INVALID_OPERATION when the speaker was created without concealUnderruns. */
+MA_WRAPPER_API ma_result ma_speaker_get_concealment_stats(ma_speaker* pSpeaker, ma_speaker_concealment_stats* pStats)
+{
+    if (pSpeaker == NULL || pStats == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    if (pSpeaker->pConcealer == NULL) {
+        return MA_INVALID_OPERATION;
+    }
+
+    pStats->concealedFrames = ma_atomic_load_64(&pSpeaker->pConcealer->concealedFrames);
+    pStats->concealmentCount = ma_atomic_load_32(&pSpeaker->pConcealer->concealmentCount);
+
+    return MA_SUCCESS;
+}
+
+MA_WRAPPER_API ma_result ma_speaker_get_startup_stats(ma_speaker* pSpeaker, ma_speaker_startup_stats* pStats)
+{
+    if (pSpeaker == NULL || pStats == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_zero_memory_64(pStats, (ma_uint64)sizeof(*pStats));
+
+    pStats->hasStarted = !ma_atomic_load_explicit_32(&pSpeaker->isAwaitingFirstFrame, ma_atomic_memory_order_acquire) && pSpeaker->isStarted;
+    if (pStats->hasStarted) {
+        pStats->startupLatencyInNanoseconds = ma_atomic_load_64(&pSpeaker->startupLatencyInNanoseconds);
+        pStats->startupLatencyInFrames = ma_atomic_load_64(&pSpeaker->startupLatencyInFrames);
+    }
+
+    pStats->rebufferCount = ma_atomic_load_32(&pSpeaker->rebufferCount);
+    pStats->isBuffering = pSpeaker->isStarted && ma_atomic_load_32(&pSpeaker->isBuffering);
+
+    return MA_SUCCESS;
+}
+
+/*
+Scheduled playback. A scheduled buffer is copied and mixed over the ring output starting exactly at a device frame
+index, the same counter published as deviceFrames in the status block. A buffer whose start frame has already passed
+when the callback first sees it is dropped rather than played late. Copies are released lazily by later calls.
+*/
+typedef struct
+{
+    ma_uint64 scheduledCount;
+    ma_uint64 startedCount;             /* Inserted at exactly their target frame. */
+    ma_uint64 droppedLateCount;
+    ma_uint64 maxLatenessInFrames;      /* Largest amount by which a dropped buffer had missed its target. */
+    ma_uint64 minLeadInFrames;          /* Smallest margin between a started buffer's target and the start of the callback that inserted it. */
+    ma_uint32 pendingCount;             /* Scheduled buffers waiting for or in playback. */
+} ma_speaker_schedule_stats;
+
+static void ma_speaker_reclaim_scheduled(ma_speaker* pSpeaker)
+{
+    for (ma_uint32 iVoice = 0; iVoice < MA_SPEAKER_MAX_VOICES; ++iVoice) {
+        ma_speaker_voice* pVoice = &pSpeaker->voices[iVoice];
+
+        /* Moving through setup keeps another reclaiming thread and new triggers away while the copy is released. */
+        ma_uint32 expected = ma_speaker_voice_state_finished;
+        if (pVoice->pOwner == pSpeaker && ma_atomic_compare_exchange_strong_32(&pVoice->state, &expected, ma_speaker_voice_state_setup)) {
+            ma_free((void*)pVoice->pFrames, &pSpeaker->allocationCallbacks);
+            pVoice->pOwner = NULL;
+            ma_atomic_store_32(&pVoice->state, ma_speaker_voice_state_free);
+        }
+    }
+}
+
+/* Frames must be in the speaker's format. Returns MA_OUT_OF_RANGE when every voice is in use. */
+MA_WRAPPER_API ma_result ma_speaker_schedule(ma_speaker* pSpeaker, const void* pFrames, ma_uint32 frameCount, ma_uint64 startFrame, float volume)
+{
+    if (pSpeaker == NULL || pFrames == NULL || frameCount == 0) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_speaker_reclaim_scheduled(pSpeaker);
+
+    const size_t sizeInBytes = (size_t)frameCount * pSpeaker->bytesPerFrame;
+    void* pCopy = ma_malloc(sizeInBytes, &pSpeaker->allocationCallbacks);
+    if (pCopy == NULL) {
+        return MA_OUT_OF_MEMORY;
+    }
+
+    ma_copy_memory_64(pCopy, pFrames, sizeInBytes);
+
+    ma_result result = ma_speaker_start_voice_ex(pSpeaker, pCopy, frameCount, volume, pSpeaker, MA_TRUE, startFrame);
+    if (result != MA_SUCCESS) {
+        ma_free(pCopy, &pSpeaker->allocationCallbacks);
+        return result;
+    }
+
+    ma_atomic_fetch_add_64(&pSpeaker->scheduledCount, 1);
+
+    return MA_SUCCESS;
+}
+
+/*
+Returns the device frame index the next data callback will start at and the monotonic time, in nanoseconds, at which
+the previous callback completed. The pair is read consistently against the callback.
+*/
+MA_WRAPPER_API ma_result ma_speaker_get_frame_position(ma_speaker* pSpeaker, ma_uint64* pFrameIndex, ma_uint64* pTimeInNanoseconds)
+{
+    if (pSpeaker == NULL || pFrameIndex == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    for (;;) {
+        const ma_uint32 sequence = ma_atomic_load_explicit_32(&pSpeaker->callbackSequence, ma_atomic_memory_order_acquire);
+        if ((sequence & 1) != 0) {
+            ma_yield();
+            continue;
+        }
+
+        const ma_uint64 frameIndex = ma_atomic_load_explicit_64(&pSpeaker->status.deviceFrames, ma_atomic_memory_order_acquire);
+        const ma_uint64 timeInNanoseconds = ma_atomic_load_explicit_64(&pSpeaker->status.lastCallbackTimeInNanoseconds, ma_atomic_memory_order_acquire);
+
+        if (ma_atomic_load_explicit_32(&pSpeaker->callbackSequence, ma_atomic_memory_order_acquire) == sequence) {
+            *pFrameIndex = frameIndex;
+            if (pTimeInNanoseconds != NULL) {
+                *pTimeInNanoseconds = timeInNanoseconds;
+            }
+
+            return MA_SUCCESS;
+        }
+    }
+}
+
+/*
+Schedules against the monotonic clock used by ma_get_monotonic_time_in_nanoseconds(). The time is mapped to a device
+frame through the most recent callback, so it is only meaningful while the speaker is running.
+*/
+MA_WRAPPER_API ma_result ma_speaker_schedule_at_time(ma_speaker* pSpeaker, const void* pFrames, ma_uint32 frameCount, ma_uint64 startTimeInNanoseconds, float volume)
+{
+    if (pSpeaker == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    if (!pSpeaker->isStarted) {
+        return MA_INVALID_OPERATION;
+    }
+
+    ma_uint64 frameIndex;
+    ma_uint64 timeInNanoseconds;
+    ma_speaker_get_frame_position(pSpeaker, &frameIndex, &timeInNanoseconds);
+
+    /* Times before the reference map to a past frame, which the callback then drops as late. */
+    ma_uint64 startFrame;
+    if (startTimeInNanoseconds >= timeInNanoseconds) {
+        startFrame = frameIndex + (ma_uint64)(((double)(startTimeInNanoseconds - timeInNanoseconds) * pSpeaker->sampleRate / 1000000000.0) + 0.5);
+    } else {
+        const ma_uint64 framesBefore = (ma_uint64)(((double)(timeInNanoseconds - startTimeInNanoseconds) * pSpeaker->sampleRate / 1000000000.0) + 0.5);
+        startFrame = (framesBefore < frameIndex) ? frameIndex - framesBefore : 0;
+    }
+
+    return ma_speaker_schedule(pSpeaker, pFrames, frameCount, startFrame, volume);
+}
+
+/* Drops every scheduled buffer, including one already playing. */
+MA_WRAPPER_API void ma_speaker_cancel_scheduled(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return;
+    }
+
+    for (ma_uint32 iVoice = 0; iVoice < MA_SPEAKER_MAX_VOICES; ++iVoice) {
+        ma_speaker_voice* pVoice = &pSpeaker->voices[iVoice];
+        ma_uint32 expected = ma_speaker_voice_state_playing;
+        if (pVoice->pOwner == pSpeaker) {
+            ma_atomic_compare_exchange_strong_32(&pVoice->state, &expected, ma_speaker_voice_state_finished);
+        }
+    }
+
+    ma_speaker_wait_for_callback(pSpeaker);
+    ma_speaker_reclaim_scheduled(pSpeaker);
+}
+
+MA_WRAPPER_API ma_result ma_speaker_get_schedule_stats(ma_speaker* pSpeaker, ma_speaker_schedule_stats* pStats)
+{
+    if (pSpeaker == NULL || pStats == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_zero_memory_64(pStats, (ma_uint64)sizeof(*pStats));
+
+    pStats->scheduledCount = ma_atomic_load_64(&pSpeaker->scheduledCount);
+    pStats->startedCount = ma_atomic_load_64(&pSpeaker->scheduledStartedCount);
+    pStats->droppedLateCount = ma_atomic_load_64(&pSpeaker->scheduledLateCount);
+    pStats->maxLatenessInFrames = ma_atomic_load_64(&pSpeaker->maxLatenessInFrames);
+    pStats->minLeadInFrames = (pStats->startedCount > 0) ? ma_atomic_load_64(&pSpeaker->minLeadInFrames) : 0;
+
+    for (ma_uint32 iVoice = 0; iVoice < MA_SPEAKER_MAX_VOICES; ++iVoice) {
+        const ma_speaker_voice* pVoice = &pSpeaker->voices[iVoice];
+        pStats->pendingCount += (pVoice->pOwner == pSpeaker && ma_atomic_load_32(&pVoice->state) == ma_speaker_voice_state_playing);
+    }
+
+    return MA_SUCCESS;
+}
+
+MA_WRAPPER_API void ma_speaker_flush(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return;
+    }
+
+    /*
+    While running with fades, the callback fades out and then discards the ring itself. If it does not get there in
+    time it may be stalled mid-read, so the ring is left alone and the request stays pending for the callback to
+    complete when it runs again.
+    */
+    if (pSpeaker->isStarted && ma_atomic_load_32(&pSpeaker->fadeLengthInFrames) > 0) {
+        ma_speaker_wait_for_fade_out(pSpeaker, ma_speaker_fade_request_flush);
+        return;
+    }
+
+    ma_uint32 discardedFrames = ma_pcm_rb_available_read(&pSpeaker->ringBuffer);
+    ma_pcm_rb_reset(&pSpeaker->ringBuffer);
+    ma_stream_status_on_read(&pSpeaker->status, &pSpeaker->ringBuffer, discardedFrames);
+
+    if (pSpeaker->pConcealer != NULL) {
+        ma_atomic_store_32(&pSpeaker->pConcealer->isResetPending, MA_TRUE);
+    }
+}
+
+MA_WRAPPER_API void ma_microphone_flush(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return;
+    }
+
+    ma_uint32 discardedFrames = ma_pcm_rb_available_read(&pMicrophone->ringBuffer);
+    ma_pcm_rb_reset(&pMicrophone->ringBuffer);
+    ma_stream_status_on_read(&pMicrophone->status, &pMicrophone->ringBuffer, discardedFrames);
+}
+
+/*
+Returns a file descriptor for poll/epoll that becomes readable once at least watermarkInFrames frames can be read. The
+signal is edge-like: after it fires, call ma_microphone_acknowledge_readiness() and then read. Acknowledging while the
+watermark is still met fires again straight away, so nothing is lost between the two. Not supported on Windows.
+*/
+MA_WRAPPER_API ma_result ma_microphone_enable_readiness_fd(ma_microphone* pMicrophone, ma_uint32 watermarkInFrames, int* pFd)
+{
+    if (pMicrophone == NULL || pFd == NULL || watermarkInFrames == 0 || watermarkInFrames > pMicrophone->bufferSizeInFrames) {
+        return MA_INVALID_ARGS;
+    }
+
+    if (pMicrophone->readiness.fd < 0) {
+        ma_result result = ma_readiness_event_open(&pMicrophone->readiness);
+        if (result != MA_SUCCESS) {
+            return result;
+        }
+    }
+
+    ma_atomic_store_32(&pMicrophone->readiness.isSignaled, MA_FALSE);
+    ma_atomic_store_explicit_32(&pMicrophone->readiness.watermarkInFrames, watermarkInFrames, ma_atomic_memory_order_release);
+    ma_readiness_event_update(&pMicrophone->readiness, &pMicrophone->ringBuffer, MA_TRUE);
+
+    *pFd = pMicrophone->readiness.fd;
+    return MA_SUCCESS;
+}
+
+/*
+Closes the fd once the data callback, the only thread that posts to it, has let go. Must not run concurrently with
+ma_microphone_acknowledge_readiness().
+*/
+MA_WRAPPER_API void ma_microphone_disable_readiness_fd(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL || pMicrophone->readiness.fd < 0) {
+        return;
+    }
+
+    ma_atomic_store_32(&pMicrophone->readiness.watermarkInFrames, 0);
+    ma_microphone_wait_for_callback(pMicrophone);
+    ma_readiness_event_close(&pMicrophone->readiness);
+}
+
+MA_WRAPPER_API void ma_microphone_acknowledge_readiness(ma_microphone* pMicrophone)
+{
+    if (pMicrophone == NULL) {
+        return;
+    }
+
+    ma_readiness_event_acknowledge(&pMicrophone->readiness, &pMicrophone->ringBuffer, MA_TRUE);
+}
+
+/*
+Returns a file descriptor for poll/epoll that becomes readable once fewer than watermarkInFrames frames are queued for
+playback. After it fires, call ma_speaker_acknowledge_readiness() and then write. Acknowledging while the queue is still
+below the watermark fires again straight away, so nothing is lost between the two. Not supported on Windows.
+*/
+MA_WRAPPER_API ma_result ma_speaker_enable_readiness_fd(ma_speaker* pSpeaker, ma_uint32 watermarkInFrames, int* pFd)
+{
+    if (pSpeaker == NULL || pFd == NULL || watermarkInFrames == 0 || watermarkInFrames > pSpeaker->bufferSizeInFrames) {
+        return MA_INVALID_ARGS;
+    }
+
+    if (pSpeaker->readiness.fd < 0) {
+        ma_result result = ma_readiness_event_open(&pSpeaker->readiness);
+        if (result != MA_SUCCESS) {
+            return result;
+        }
+    }
+
+    ma_atomic_store_32(&pSpeaker->readiness.isSignaled, MA_FALSE);
+    ma_atomic_store_explicit_32(&pSpeaker->readiness.watermarkInFrames, watermarkInFrames, ma_atomic_memory_order_release);
+    ma_readiness_event_update(&pSpeaker->readiness, &pSpeaker->ringBuffer, MA_FALSE);
+
+    *pFd = pSpeaker->readiness.fd;
+    return MA_SUCCESS;
+}
+
+/*
+Closes the fd once the data callback, the only thread that posts to it, has let go. Must not run concurrently with
+ma_speaker_acknowledge_readiness().
+*/
+MA_WRAPPER_API void ma_speaker_disable_readiness_fd(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL || pSpeaker->readiness.fd < 0) {
+        return;
+    }
+
+    ma_atomic_store_32(&pSpeaker->readiness.watermarkInFrames, 0);
+    ma_speaker_wait_for_callback(pSpeaker);
+    ma_readiness_event_close(&pSpeaker->readiness);
+}
+
+MA_WRAPPER_API void ma_speaker_acknowledge_readiness(ma_speaker* pSpeaker)
+{
+    if (pSpeaker == NULL) {
+        return;
+    }
+
+    ma_readiness_event_acknowledge(&pSpeaker->readiness, &pSpeaker->ringBuffer, MA_FALSE);
+}
+
+/*
+Native WAV recorder. Drains a dedicated capture tap on its own thread and writes through dr_wav in large write-behind
+batches so recording never involves the managed side.
+*/
+typedef struct
+{
+    ma_uint64 framesWritten;
+    ma_uint64 bytesWritten;
+    ma_uint64 droppedFrames;
+    ma_uint64 ioStallTimeInNanoseconds;     /* Total time spent blocked in file writes. */
+    ma_uint64 maxIoStallInNanoseconds;      /* Longest single write. */
+} ma_microphone_recorder_stats;
+
+typedef struct
+{
+    ma_microphone* pMicrophone;
+    ma_microphone_tap tap;
+    ma_dr_wav wav;
+    FILE* pFile;
+    ma_thread thread;
+    void* pBatch;
+    ma_uint32 batchSizeInFrames;
+    ma_uint32 batchFrameCount;
+    ma_uint32 pollIntervalInMilliseconds;
+    MA_ATOMIC(4, ma_bool32) isRunning;
+    MA_ATOMIC(8, ma_uint64) framesWritten;
+    MA_ATOMIC(8, ma_uint64) bytesWritten;
+    MA_ATOMIC(8, ma_uint64) ioStallTimeInNanoseconds;
+    MA_ATOMIC(8, ma_uint64) maxIoStallInNanoseconds;
+} ma_microphone_recorder;
+
+static size_t ma_microphone_recorder__on_write(void* pUserData, const void* pData, size_t bytesToWrite)
+{
+    ma_microphone_recorder* pRecorder = (ma_microphone_recorder*)pUserData;
+
+    const ma_uint64 timeBeg = ma_get_monotonic_time_in_nanoseconds();
+    const size_t bytesWritten = fwrite(pData, 1, bytesToWrite, pRecorder->pFile);
+    const ma_uint64 stall = ma_get_monotonic_time_in_nanoseconds() - timeBeg;
+
+    ma_atomic_fetch_add_64(&pRecorder->bytesWritten, bytesWritten);
+    ma_atomic_fetch_add_64(&pRecorder->ioStallTimeInNanoseconds, stall);
+    if (stall > ma_atomic_load_64(&pRecorder->maxIoStallInNanoseconds)) {
+        ma_atomic_store_64(&pRecorder->maxIoStallInNanoseconds, stall);
+    }
+
+    return bytesWritten;
+}
+
+static ma_bool32 ma_microphone_recorder__on_seek(void* pUserData, int offset, ma_dr_wav_seek_origin origin)
+{
+    ma_microphone_recorder* pRecorder = (ma_microphone_recorder*)pUserData;
+    return fseek(pRecorder->pFile, offset, (origin == MA_DR_WAV_SEEK_CUR) ? SEEK_CUR : ((origin == MA_DR_WAV_SEEK_END) ? SEEK_END : SEEK_SET)) == 0;
+}
+
+static void ma_microphone_recorder_flush_batch(ma_microphone_recorder* pRecorder)
+{
+    if (pRecorder->batchFrameCount == 0) {
+        return;
+    }
+
+    const ma_uint64 framesWritten = ma_dr_wav_write_pcm_frames(&pRecorder->wav, pRecorder->batchFrameCount, pRecorder->pBatch);
+    ma_atomic_fetch_add_64(&pRecorder->framesWritten, framesWritten);
+    pRecorder->batchFrameCount = 0;
+}
+
+/* Moves everything currently in the tap into the batch, writing the batch out each time it fills. */
+static void ma_microphone_recorder_drain(ma_microphone_recorder* pRecorder)
+{
+    const ma_uint32 bytesPerFrame = pRecorder->pMicrophone->bytesPerFrame;
+
+    for (;;) {
+        const ma_uint32 framesRead = ma_pcm_rb_read_frames(&pRecorder->tap.ringBuffer, ma_offset_ptr(pRecorder->pBatch, pRecorder->batchFrameCount * bytesPerFrame), pRecorder->batchSizeInFrames - pRecorder->batchFrameCount);
+        pRecorder->batchFrameCount += framesRead;
+
+        if (pRecorder->batchFrameCount < pRecorder->batchSizeInFrames) {
+            break;
+        }
+
+        ma_microphone_recorder_flush_batch(pRecorder);
+    }
+}
+
+static ma_thread_result MA_THREADCALL ma_microphone_recorder_thread(void* pUserData)
+{
+    ma_microphone_recorder* pRecorder = (ma_microphone_recorder*)pUserData;
+
+    while (ma_atomic_load_32(&pRecorder->isRunning)) {
+        ma_microphone_recorder_drain(pRecorder);
+        ma_sleep(pRecorder->pollIntervalInMilliseconds);
+    }
+
+    return (ma_thread_result)0;
+}
+
+/* Recording starts immediately. The recorder must be destroyed before its microphone. */
+MA_WRAPPER_API ma_microphone_recorder* ma_microphone_recorder_create(ma_microphone* pMicrophone, const char* pFilePath, ma_bool32 useRF64, ma_uint32 bufferSizeInFrames, ma_uint32 batchSizeInFrames)
+{
+    if (pMicrophone == NULL || pFilePath == NULL) {
+        return NULL;
+    }
+
+    /* Defaults favour large writes: a one second batch behind a two second tap. */
+    if (batchSizeInFrames == 0) {
+        batchSizeInFrames = pMicrophone->sampleRate;
+    }
+
+    if (bufferSizeInFrames == 0) {
+        bufferSizeInFrames = ma_max(pMicrophone->sampleRate * 2, batchSizeInFrames * 2);
+    }
+
+    const size_t heapSizeInBytes = ma_calculate_instance_heap_size(sizeof(ma_microphone_recorder), pMicrophone->format, pMicrophone->channels, batchSizeInFrames);
+    ma_microphone_recorder* pRecorder = (ma_microphone_recorder*)ma_aligned_malloc(heapSizeInBytes, MA_SIMD_ALIGNMENT, &pMicrophone->allocationCallbacks);
+    if (pRecorder == NULL) {
+        return NULL;
+    }
+
+    ma_zero_memory_64(pRecorder, (ma_uint64)sizeof(*pRecorder));
+    pRecorder->pMicrophone = pMicrophone;
+    pRecorder->pBatch = ma_offset_ptr(pRecorder, ma_align(sizeof(ma_microphone_recorder), MA_SIMD_ALIGNMENT));
+    pRecorder->batchSizeInFrames = batchSizeInFrames;
+    pRecorder->pollIntervalInMilliseconds = (ma_uint32)ma_clamp(((ma_uint64)batchSizeInFrames * 1000 / pMicrophone->sampleRate) / 4, 5, 50);
+
+    if (ma_fopen(&pRecorder->pFile, pFilePath, "wb") != MA_SUCCESS) {
+        ma_aligned_free(pRecorder, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    ma_dr_wav_data_format wavFormat;
+    wavFormat.container = useRF64 ? ma_dr_wav_container_rf64 : ma_dr_wav_container_riff;
+    wavFormat.format = (pMicrophone->format == ma_format_f32) ? MA_DR_WAVE_FORMAT_IEEE_FLOAT : MA_DR_WAVE_FORMAT_PCM;
+    wavFormat.channels = pMicrophone->channels;
+    wavFormat.sampleRate = pMicrophone->sampleRate;
+    wavFormat.bitsPerSample = ma_get_bytes_per_sample(pMicrophone->format) * 8;
+
+    if (!ma_dr_wav_init_write(&pRecorder->wav, &wavFormat, ma_microphone_recorder__on_write, ma_microphone_recorder__on_seek, pRecorder, &pMicrophone->allocationCallbacks)) {
+        fclose(pRecorder->pFile);
+        ma_aligned_free(pRecorder, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    if (ma_microphone_tap_init(pMicrophone, bufferSizeInFrames, &pRecorder->tap) != MA_SUCCESS) {
+        ma_dr_wav_uninit(&pRecorder->wav);
+        fclose(pRecorder->pFile);
+        ma_aligned_free(pRecorder, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    ma_atomic_store_32(&pRecorder->isRunning, MA_TRUE);
+
+    if (ma_thread_create(&pRecorder->thread, ma_thread_priority_normal, 0, ma_microphone_recorder_thread, pRecorder, &pMicrophone->allocationCallbacks) != MA_SUCCESS) {
+        ma_microphone_tap_uninit(&pRecorder->tap);
+        ma_dr_wav_uninit(&pRecorder->wav);
+        fclose(pRecorder->pFile);
+        ma_aligned_free(pRecorder, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    if (ma_microphone_attach_tap(pMicrophone, &pRecorder->tap) != MA_SUCCESS) {
+        ma_atomic_store_32(&pRecorder->isRunning, MA_FALSE);
+        ma_thread_wait(&pRecorder->thread);
+        ma_microphone_tap_uninit(&pRecorder->tap);
+        ma_dr_wav_uninit(&pRecorder->wav);
+        fclose(pRecorder->pFile);
+        ma_aligned_free(pRecorder, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    return pRecorder;
+}
+
+/* Stops recording, writes out everything that was captured up to this point and finalizes the file. */
+MA_WRAPPER_API void ma_microphone_recorder_destroy(ma_microphone_recorder* pRecorder)
+{
+    if (pRecorder == NULL) {
+        return;
+    }
+
+    ma_microphone* pMicrophone = pRecorder->pMicrophone;
+
+    ma_microphone_detach_tap(pMicrophone, &pRecorder->tap);
+
+    ma_atomic_store_32(&pRecorder->isRunning, MA_FALSE);
+    ma_thread_wait(&pRecorder->thread);
+
+    ma_microphone_recorder_drain(pRecorder);
+    ma_microphone_recorder_flush_batch(pRecorder);
+
+    ma_dr_wav_uninit(&pRecorder->wav);
+    fclose(pRecorder->pFile);
+    ma_microphone_tap_uninit(&pRecorder->tap);
+    ma_aligned_free(pRecorder, &pMicrophone->allocationCallbacks);
+}
+
+MA_WRAPPER_API ma_result ma_microphone_recorder_get_stats(ma_microphone_recorder* pRecorder, ma_microphone_recorder_stats* pStats)
+{
+    if (pRecorder == NULL || pStats == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    pStats->framesWritten = ma_atomic_load_64(&pRecorder->framesWritten);
+    pStats->bytesWritten = ma_atomic_load_64(&pRecorder->bytesWritten);
+    pStats->droppedFrames = ma_atomic_load_64(&pRecorder->tap.droppedFrames);
+    pStats->ioStallTimeInNanoseconds = ma_atomic_load_64(&pRecorder->ioStallTimeInNanoseconds);
+    pStats->maxIoStallInNanoseconds = ma_atomic_load_64(&pRecorder->maxIoStallInNanoseconds);
+
+    return MA_SUCCESS;
+}
+
+/*
+Decoded playback source. A prefetch thread decodes with ma_decoder straight into the speaker's format and keeps the
+ring topped up from two staging buffers: while one is being pushed into the ring the other is already decoded, so
+neither side ever waits on the other. The source owns the write side of the speaker's ring while it exists.
+*/
+typedef struct
+{
+    ma_speaker* pSpeaker;
+    ma_decoder decoder;
+    ma_thread thread;
+    void* pStaging[2];
+    ma_uint32 stagingFrameCount[2];
+    ma_uint32 stagingCursor[2];
+    ma_uint32 stagingSizeInFrames;
+    ma_uint32 pollIntervalInMilliseconds;
+    ma_bool32 isLooping;
+    ma_bool32 isDecoderAtEnd;
+    MA_ATOMIC(4, ma_bool32) isRunning;
+    MA_ATOMIC(4, ma_bool32) isAtEnd;            /* Everything has been decoded and queued. */
+    MA_ATOMIC(8, ma_uint64) framesQueued;
+} ma_speaker_source;
+
+static void ma_speaker_source_decode(ma_speaker_source* pSource, ma_uint32 iStaging)
+{
+    const ma_uint32 bytesPerFrame = pSource->pSpeaker->bytesPerFrame;
+    ma_uint32 framesDecoded = 0;
+    ma_bool32 hasRewound = MA_FALSE;
+
+    while (framesDecoded < pSource->stagingSizeInFrames) {
+        ma_uint64 framesRead = 0;
+        ma_decoder_read_pcm_frames(&pSource->decoder, ma_offset_ptr(pSource->pStaging[iStaging], framesDecoded * bytesPerFrame), pSource->stagingSizeInFrames - framesDecoded, &framesRead);
+        framesDecoded += (ma_uint32)framesRead;
+
+        if (framesDecoded == pSource->stagingSizeInFrames) {
+            break;
+        }
+
+        /* Short read means the end of the stream. A stream that is still empty straight after rewinding must not loop forever. */
+        if (!pSource->isLooping || (hasRewound && framesRead == 0) || ma_decoder_seek_to_pcm_frame(&pSource->decoder, 0) != MA_SUCCESS) {
+            pSource->isDecoderAtEnd = MA_TRUE;
+            break;
+        }
+
+        hasRewound = MA_TRUE;
+    }
+
+    pSource->stagingFrameCount[iStaging] = framesDecoded;
+    pSource->stagingCursor[iStaging] = 0;
+}
+
+static ma_thread_result MA_THREADCALL ma_speaker_source_thread(void* pUserData)
+{
+    ma_speaker_source* pSource = (ma_speaker_source*)pUserData;
+    ma_speaker* pSpeaker = pSource->pSpeaker;
+    ma_uint32 iFront = 0;
+
+    while (ma_atomic_load_32(&pSource->isRunning)) {
+        const ma_uint32 iBack = iFront ^ 1;
+
+        if (pSource->stagingCursor[iFront] == pSource->stagingFrameCount[iFront] && pSource->stagingFrameCount[iBack] > 0) {
+            pSource->stagingFrameCount[iFront] = 0;
+            pSource->stagingCursor[iFront] = 0;
+            iFront = iBack;
+            continue;
+        }
+
+        if (pSource->stagingFrameCount[iBack] == 0 && !pSource->isDecoderAtEnd) {
+            ma_speaker_source_decode(pSource, iBack);
+        }
+
+        const ma_uint32 framesPending = pSource->stagingFrameCount[iFront] - pSource->stagingCursor[iFront];
+        if (framesPending == 0) {
+            if (pSource->isDecoderAtEnd && pSource->stagingFrameCount[iBack] == 0) {
+                ma_atomic_store_32(&pSource->isAtEnd, MA_TRUE);
+                break;
+            }
+
+            continue;
+        }
+
+        const ma_uint32 framesWritten = ma_pcm_rb_write_frames(&pSpeaker->ringBuffer, ma_offset_ptr(pSource->pStaging[iFront], pSource->stagingCursor[iFront] * pSpeaker->bytesPerFrame), framesPending);
+        pSource->stagingCursor[iFront] += framesWritten;
+
+        if (framesWritten > 0) {
+            ma_stream_status_on_write(&pSpeaker->status, &pSpeaker->ringBuffer, framesWritten);
+            ma_atomic_fetch_add_64(&pSource->framesQueued, framesWritten);
+        }
+
+        if (framesWritten < framesPending) {
+            ma_sleep(pSource->pollIntervalInMilliseconds);
+        }
+    }
+
+    return (ma_thread_result)0;
+}
+
+static ma_speaker_source* ma_speaker_source_create(ma_speaker* pSpeaker, const char* pFilePath, const void* pData, size_t dataSize, ma_bool32 loop)
+{
+    if (pSpeaker == NULL) {
+        return NULL;
+    }
+
+    const ma_uint32 stagingSizeInFrames = ma_max(pSpeaker->bufferSizeInFrames / 2, 256);
+    const size_t stagingSizeInBytes = ma_align((size_t)stagingSizeInFrames * pSpeaker->bytesPerFrame, MA_SIMD_ALIGNMENT);
+
+    /* Memory sources are copied into the same block so the caller's buffer does not need to stay pinned. */
+    const size_t heapSizeInBytes = ma_align(sizeof(ma_speaker_source), MA_SIMD_ALIGNMENT) + (stagingSizeInBytes * 2) + dataSize;
+    ma_speaker_source* pSource = (ma_speaker_source*)ma_aligned_malloc(heapSizeInBytes, MA_SIMD_ALIGNMENT, &pSpeaker->allocationCallbacks);
+    if (pSource == NULL) {
+        return NULL;
+    }
+
+    ma_zero_memory_64(pSource, (ma_uint64)sizeof(*pSource));
+    pSource->pSpeaker = pSpeaker;
+    pSource->pStaging[0] = ma_offset_ptr(pSource, ma_align(sizeof(ma_speaker_source), MA_SIMD_ALIGNMENT));
+    pSource->pStaging[1] = ma_offset_ptr(pSource->pStaging[0], stagingSizeInBytes);
+    pSource->stagingSizeInFrames = stagingSizeInFrames;
+    pSource->pollIntervalInMilliseconds = (ma_uint32)ma_clamp(((ma_uint64)pSpeaker->bufferSizeInFrames * 1000 / pSpeaker->sampleRate) / 4, 1, 20);
+    pSource->isLooping = loop;
+
+    ma_decoder_config decoderConfig = ma_decoder_config_init(pSpeaker->format, pSpeaker->channels, pSpeaker->sampleRate);
+    decoderConfig.allocationCallbacks = pSpeaker->allocationCallbacks;
+
+    ma_result result;
+    if (pFilePath != NULL) {
+        result = ma_decoder_init_file(pFilePath, &decoderConfig, &pSource->decoder);
+    } else {
+        void* pDataCopy = ma_offset_ptr(pSource->pStaging[1], stagingSizeInBytes);
+        ma_copy_memory_64(pDataCopy, pData, (ma_uint64)dataSize);
+        result = ma_decoder_init_memory(pDataCopy, dataSize, &decoderConfig, &pSource->decoder);
+    }
+
+    if (result != MA_SUCCESS) {
+        ma_aligned_free(pSource, &pSpeaker->allocationCallbacks);
+        return NULL;
+    }
+
+    if (ma_speaker_claim_producer(pSpeaker) != MA_SUCCESS) {
+        ma_decoder_uninit(&pSource->decoder);
+        ma_aligned_free(pSource, &pSpeaker->allocationCallbacks);
+        return NULL;
+    }
+
+    /* Prime the first buffer so playback can begin as soon as the thread pushes it. */
+    ma_speaker_source_decode(pSource, 0);
+
+    ma_atomic_store_32(&pSource->isRunning, MA_TRUE);
+
+    if (ma_thread_create(&pSource->thread, ma_thread_priority_normal, 0, ma_speaker_source_thread, pSource, &pSpeaker->allocationCallbacks) != MA_SUCCESS) {
+        ma_speaker_release_producer(pSpeaker);
+        ma_decoder_uninit(&pSource->decoder);
+        ma_aligned_free(pSource, &pSpeaker->allocationCallbacks);
+        return NULL;
+    }
+
+    return pSource;
+}
+
+/* Queuing starts immediately. The source must be destroyed before its speaker. */
+MA_WRAPPER_API ma_speaker_source* ma_speaker_source_create_from_file(ma_speaker* pSpeaker, const char* pFilePath, ma_bool32 loop)
+{
+    if (pFilePath == NULL) {
+        return NULL;
+    }
+
+    return ma_speaker_source_create(pSpeaker, pFilePath, NULL, 0, loop);
+}
+
+MA_WRAPPER_API ma_speaker_source* ma_speaker_source_create_from_memory(ma_speaker* pSpeaker, const void* pData, size_t dataSize, ma_bool32 loop)
+{
+    if (pData == NULL || dataSize == 0) {
+        return NULL;
+    }
+
+    return ma_speaker_source_create(pSpeaker, NULL, pData, dataSize, loop);
+}
+
+/* Stops queuing and hands the write side of the ring back to ma_speaker_write(). Frames already queued still play. */
+MA_WRAPPER_API void ma_speaker_source_destroy(ma_speaker_source* pSource)
+{
+    if (pSource == NULL) {
+        return;
+    }
+
+    ma_speaker* pSpeaker = pSource->pSpeaker;
+
+    ma_atomic_store_32(&pSource->isRunning, MA_FALSE);
+    ma_thread_wait(&pSource->thread);
+
+    ma_speaker_release_producer(pSpeaker);
+    ma_decoder_uninit(&pSource->decoder);
+    ma_aligned_free(pSource, &pSpeaker->allocationCallbacks);
+}
+
+MA_WRAPPER_API ma_bool32 ma_speaker_source_is_at_end(ma_speaker_source* pSource)
+{
+    if (pSource == NULL) {
+        return MA_TRUE;
+    }
+
+    return ma_atomic_load_32(&pSource->isAtEnd);
+}
+
+MA_WRAPPER_API ma_uint64 ma_speaker_source_get_frames_queued(ma_speaker_source* pSource)
+{
+    if (pSource == NULL) {
+        return 0;
+    }
+
+    return ma_atomic_load_64(&pSource->framesQueued);
+}
+
+/*
+Decoded clip cache. Clips are decoded once into the speaker's format and kept as ma_audio_buffers under a memory
+budget with LRU eviction. Triggering a cached clip only claims a speaker voice, so it involves no decoding or copying
+and is heard from the next device period. Clips that are currently playing are never evicted.
+*/
+typedef struct ma_clip_cache ma_clip_cache;
+typedef struct ma_clip_cache_entry ma_clip_cache_entry;
+
+struct ma_clip_cache_entry
+{
+    ma_uint64 key;
+    ma_audio_buffer buffer;
+    void* pFrames;
+    size_t sizeInBytes;
+    ma_uint32 voiceCount;           /* Voices currently playing this clip. Guarded by the cache lock. */
+    ma_clip_cache_entry* pPrev;     /* Towards the most recently used end. */
+    ma_clip_cache_entry* pNext;
+};
+
+typedef struct
+{
+    ma_uint64 hitCount;
+    ma_uint64 missCount;
+    ma_uint64 evictionCount;
+    ma_uint64 sizeInBytes;
+    ma_uint32 clipCount;
+} ma_clip_cache_stats;
+
+struct ma_clip_cache
+{
+    ma_speaker* pSpeaker;
+    ma_mutex lock;
+    size_t budgetInBytes;
+    ma_clip_cache_entry* pHead;     /* Most recently used. */
+    ma_clip_cache_entry* pTail;     /* Least recently used. */
+    ma_clip_cache_stats stats;
+};
+
+static ma_uint64 ma_clip_cache_hash(const void* pData, size_t dataSize)
+{
+    /* FNV-1a */
+    const ma_uint8* pBytes = (const ma_uint8*)pData;
+    ma_uint64 hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < dataSize; ++i) {
+        hash ^= pBytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static void ma_clip_cache_unlink(ma_clip_cache* pCache, ma_clip_cache_entry* pEntry)
+{
+    if (pEntry->pPrev != NULL) {
+        pEntry->pPrev->pNext = pEntry->pNext;
+    } else {
+        pCache->pHead = pEntry->pNext;
+    }
+
+    if (pEntry->pNext != NULL) {
+        pEntry->pNext->pPrev = pEntry->pPrev;
+    } else {
+        pCache->pTail = pEntry->pPrev;
+    }
+
+    pEntry->pPrev = NULL;
+    pEntry->pNext = NULL;
+}
+
+static void ma_clip_cache_link_head(ma_clip_cache* pCache, ma_clip_cache_entry* pEntry)
+{
+    pEntry->pPrev = NULL;
+    pEntry->pNext = pCache->pHead;
+
+    if (pCache->pHead != NULL) {
+        pCache->pHead->pPrev = pEntry;
+    } else {
+        pCache->pTail = pEntry;
+    }
+
+    pCache->pHead = pEntry;
+}
+
+static void ma_clip_cache_free_entry(ma_clip_cache* pCache, ma_clip_cache_entry* pEntry)
+{
+    ma_audio_buffer_uninit(&pEntry->buffer);
+    ma_free(pEntry->pFrames, &pCache->pSpeaker->allocationCallbacks);
+    ma_free(pEntry, &pCache->pSpeaker->allocationCallbacks);
+}
+
+/* Returns finished voices belonging to this cache to the speaker. Must be called with the lock held. */
+static void ma_clip_cache_reclaim_voices(ma_clip_cache* pCache)
+{
+    ma_speaker* pSpeaker = pCache->pSpeaker;
+
+    for (ma_uint32 iVoice = 0; iVoice < MA_SPEAKER_MAX_VOICES; ++iVoice) {
+        ma_speaker_voice* pVoice = &pSpeaker->voices[iVoice];
+        if (ma_atomic_load_32(&pVoice->state) != ma_speaker_voice_state_finished) {
+            continue;
+        }
+
+        for (ma_clip_cache_entry* pEntry = pCache->pHead; pEntry != NULL; pEntry = pEntry->pNext) {
+            if (pVoice->pOwner == pEntry) {
+                pEntry->voiceCount -= 1;
+                ma_atomic_store_32(&pVoice->state, ma_speaker_voice_state_free);
+                break;
+            }
+        }
+    }
+}
+
+static void ma_clip_cache_evict(ma_clip_cache* pCache, size_t incomingSizeInBytes)
+{
+    ma_clip_cache_entry* pEntry = pCache->pTail;
+
+    while (pEntry != NULL && pCache->stats.sizeInBytes + incomingSizeInBytes > pCache->budgetInBytes) {
+        ma_clip_cache_entry* pPrev = pEntry->pPrev;
+
+        if (pEntry->voiceCount == 0) {
+            ma_clip_cache_unlink(pCache, pEntry);
+            pCache->stats.sizeInBytes -= pEntry->sizeInBytes;
+            pCache->stats.clipCount -= 1;
+            pCache->stats.evictionCount += 1;
+            ma_clip_cache_free_entry(pCache, pEntry);
+        }
+
+        pEntry = pPrev;
+    }
+}
+
+/* Must be called with the lock held. Promotes the entry to most recently used. */
+static ma_clip_cache_entry* ma_clip_cache_find(ma_clip_cache* pCache, ma_uint64 key)
+{
+    for (ma_clip_cache_entry* pEntry = pCache->pHead; pEntry != NULL; pEntry = pEntry->pNext) {
+        if (pEntry->key == key) {
+            if (pEntry != pCache->pHead) {
+                ma_clip_cache_unlink(pCache, pEntry);
+                ma_clip_cache_link_head(pCache, pEntry);
+            }
+
+            return pEntry;
+        }
+    }
+
+    return NULL;
+}
+
+/* Must be called with the lock held. Decodes either a file or an encoded memory block and inserts it under key. */
+static ma_result ma_clip_cache_insert(ma_clip_cache* pCache, ma_uint64 key, const char* pFilePath, const void* pData, size_t dataSize, ma_clip_cache_entry** ppEntry)
+{
+    ma_speaker* pSpeaker = pCache->pSpeaker;
+
+    ma_decoder_config decoderConfig = ma_decoder_config_init(pSpeaker->format, pSpeaker->channels, pSpeaker->sampleRate);
+    decoderConfig.allocationCallbacks = pSpeaker->allocationCallbacks;
+
+    ma_uint64 frameCount = 0;
+    void* pFrames = NULL;
+    ma_result result;
+
+    if (pFilePath != NULL) {
+        result = ma_decode_file(pFilePath, &decoderConfig, &frameCount, &pFrames);
+    } else {
+        result = ma_decode_memory(pData, dataSize, &decoderConfig, &frameCount, &pFrames);
+    }
+
+    if (result != MA_SUCCESS) {
+        return result;
+    }
+
+    ma_clip_cache_entry* pEntry = (ma_clip_cache_entry*)ma_malloc(sizeof(*pEntry), &pSpeaker->allocationCallbacks);
+    if (pEntry == NULL) {
+        ma_free(pFrames, &pSpeaker->allocationCallbacks);
+        return MA_OUT_OF_MEMORY;
+    }
+
+    ma_zero_memory_64(pEntry, (ma_uint64)sizeof(*pEntry));
+    pEntry->key = key;
+    pEntry->pFrames = pFrames;
+    pEntry->sizeInBytes = (size_t)(frameCount * pSpeaker->bytesPerFrame);
+
+    ma_audio_buffer_config bufferConfig = ma_audio_buffer_config_init(pSpeaker->format, pSpeaker->channels, frameCount, pFrames, &pSpeaker->allocationCallbacks);
+    result = ma_audio_buffer_init(&bufferConfig, &pEntry->buffer);
+    if (result != MA_SUCCESS) {
+        ma_free(pFrames, &pSpeaker->allocationCallbacks);
+        ma_free(pEntry, &pSpeaker->allocationCallbacks);
+        return result;
+    }
+
+    ma_clip_cache_evict(pCache, pEntry->sizeInBytes);
+    ma_clip_cache_link_head(pCache, pEntry);
+    pCache->stats.sizeInBytes += pEntry->sizeInBytes;
+    pCache->stats.clipCount += 1;
+
+    *ppEntry = pEntry;
+    return MA_SUCCESS;
+}
+
+static ma_result ma_clip_cache_acquire(ma_clip_cache* pCache, ma_uint64 key, const char* pFilePath, const void* pData, size_t dataSize, ma_clip_cache_entry** ppEntry)
+{
+    ma_clip_cache_reclaim_voices(pCache);
+
+    *ppEntry = ma_clip_cache_find(pCache, key);
+    if (*ppEntry != NULL) {
+        pCache->stats.hitCount += 1;
+        return MA_SUCCESS;
+    }
+
+    if (pFilePath == NULL && pData == NULL) {
+        return MA_DOES_NOT_EXIST;
+    }
+
+    pCache->stats.missCount += 1;
+    return ma_clip_cache_insert(pCache, key, pFilePath, pData, dataSize, ppEntry);
+}
+
+static ma_result ma_clip_cache_play(ma_clip_cache* pCache, ma_clip_cache_entry* pEntry, float volume)
+{
+    ma_result result = ma_speaker_start_voice(pCache->pSpeaker, pEntry->buffer.ref.pData, pEntry->buffer.ref.sizeInFrames, volume, pEntry);
+    if (result == MA_SUCCESS) {
+        pEntry->voiceCount += 1;
+    }
+
+    return result;
+}
+
+MA_WRAPPER_API ma_clip_cache* ma_clip_cache_create(ma_speaker* pSpeaker, size_t budgetInBytes)
+{
+    if (pSpeaker == NULL) {
+        return NULL;
+    }
+
+    ma_clip_cache* pCache = (ma_clip_cache*)ma_malloc(sizeof(*pCache), &pSpeaker->allocationCallbacks);
+    if (pCache == NULL) {
+        return NULL;
+    }
+
+    ma_zero_memory_64(pCache, (ma_uint64)sizeof(*pCache));
+    pCache->pSpeaker = pSpeaker;
+    pCache->budgetInBytes = budgetInBytes;
+
+    if (ma_mutex_init(&pCache->lock) != MA_SUCCESS) {
+        ma_free(pCache, &pSpeaker->allocationCallbacks);
+        return NULL;
+    }
+
+    return pCache;
+}
+
+/* Stops any clip from this cache that is still playing. The cache must be destroyed before its speaker. */
+MA_WRAPPER_API void ma_clip_cache_destroy(ma_clip_cache* pCache)
+{
+    if (pCache == NULL) {
+        return;
+    }
+
+    ma_speaker* pSpeaker = pCache->pSpeaker;
+
+    ma_mutex_lock(&pCache->lock);
+    {
+        /*
+        Our voices are pulled back to setup rather than straight to free, so no trigger can claim and rewrite a slot
+        the callback may still be mixing. They are only released once the callback has been waited out.
+        */
+        ma_bool32 isVoiceClaimed[MA_SPEAKER_MAX_VOICES];
+
+        for (ma_uint32 iVoice = 0; iVoice < MA_SPEAKER_MAX_VOICES; ++iVoice) {
+            ma_speaker_voice* pVoice = &pSpeaker->voices[iVoice];
+            ma_uint32 state = ma_atomic_load_explicit_32(&pVoice->state, ma_atomic_memory_order_acquire);
+
+            isVoiceClaimed[iVoice] = MA_FALSE;
+
+            /* pOwner is only stable once the voice is past setup. */
+            while (state == ma_speaker_voice_state_playing || state == ma_speaker_voice_state_finished) {
+                ma_bool32 isOwned = MA_FALSE;
+                for (ma_clip_cache_entry* pEntry = pCache->pHead; pEntry != NULL; pEntry = pEntry->pNext) {
+                    if (pVoice->pOwner == pEntry) {
+                        isOwned = MA_TRUE;
+                        break;
+                    }
+                }
+
+                if (!isOwned) {
+                    break;
+                }
+
+                /* On failure the callback has just finished the voice; state is reloaded and the claim retried. */
+                if (ma_atomic_compare_exchange_strong_32(&pVoice->state, &state, ma_speaker_voice_state_setup)) {
+                    isVoiceClaimed[iVoice] = MA_TRUE;
+                    break;
+                }
+            }
+        }
+
+        ma_speaker_wait_for_callback(pSpeaker);
+
+        for (ma_uint32 iVoice = 0; iVoice < MA_SPEAKER_MAX_VOICES; ++iVoice) {
+            if (isVoiceClaimed[iVoice]) {
+                pSpeaker->voices[iVoice].pOwner = NULL;
+                ma_atomic_store_32(&pSpeaker->voices[iVoice].state, ma_speaker_voice_state_free);
+            }
+        }
+
+        ma_clip_cache_entry* pEntry = pCache->pHead;
+        while (pEntry != NULL) {
+            ma_clip_cache_entry* pNext = pEntry->pNext;
+            ma_clip_cache_free_entry(pCache, pEntry);
+            pEntry = pNext;
+        }
+    }
+    ma_mutex_unlock(&pCache->lock);
+
+    ma_mutex_uninit(&pCache->lock);
+    ma_free(pCache, &pSpeaker->allocationCallbacks);
+}
+
+MA_WRAPPER_API ma_uint64 ma_clip_cache_key_from_path(const char* pFilePath)
+{
+    if (pFilePath == NULL) {
+        return 0;
+    }
+
+    return ma_clip_cache_hash(pFilePath, strlen(pFilePath));
+}
+
+MA_WRAPPER_API ma_uint64 ma_clip_cache_key_from_memory(const void* pData, size_t dataSize)
+{
+    if (pData == NULL) {
+        return 0;
+    }
+
+    return ma_clip_cache_hash(pData, dataSize);
+}
+
+/* Decodes the clip ahead of time so the first trigger is already a hit. pKey may be NULL. */
+MA_WRAPPER_API ma_result ma_clip_cache_load_file(ma_clip_cache* pCache, const char* pFilePath, ma_uint64* pKey)
+{
+    if (pCache == NULL || pFilePath == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    const ma_uint64 key = ma_clip_cache_key_from_path(pFilePath);
+    ma_clip_cache_entry* pEntry;
+
+    ma_mutex_lock(&pCache->lock);
+    ma_result result = ma_clip_cache_acquire(pCache, key, pFilePath, NULL, 0, &pEntry);
+    ma_mutex_unlock(&pCache->lock);
+
+    if (result == MA_SUCCESS && pKey != NULL) {
+        *pKey = key;
+    }
+
+    return result;
+}
+
+MA_WRAPPER_API ma_result ma_clip_cache_load_memory(ma_clip_cache* pCache, const void* pData, size_t dataSize, ma_uint64* pKey)
+{
+    if (pCache == NULL || pData == NULL || dataSize == 0) {
+        return MA_INVALID_ARGS;
+    }
+
+    const ma_uint64 key = ma_clip_cache_key_from_memory(pData, dataSize);
+    ma_clip_cache_entry* pEntry;
+
+    ma_mutex_lock(&pCache->lock);
+    ma_result result = ma_clip_cache_acquire(pCache, key, NULL, pData, dataSize, &pEntry);
+    ma_mutex_unlock(&pCache->lock);
+
+    if (result == MA_SUCCESS && pKey != NULL) {
+        *pKey = key;
+    }
+
+    return result;
+}
+
+/* Plays a clip that is already cached. Returns MA_DOES_NOT_EXIST if it has been evicted or was never loaded. */
+MA_WRAPPER_API ma_result ma_clip_cache_trigger(ma_clip_cache* pCache, ma_uint64 key, float volume)
+{
+    if (pCache == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_clip_cache_entry* pEntry;
+
+    ma_mutex_lock(&pCache->lock);
+    ma_result result = ma_clip_cache_acquire(pCache, key, NULL, NULL, 0, &pEntry);
+    if (result == MA_SUCCESS) {
+        result = ma_clip_cache_play(pCache, pEntry, volume);
+    }
+    ma_mutex_unlock(&pCache->lock);
+
+    return result;
+}
+
+MA_WRAPPER_API ma_result ma_clip_cache_trigger_file(ma_clip_cache* pCache, const char* pFilePath, float volume)
+{
+    if (pCache == NULL || pFilePath == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_clip_cache_entry* pEntry;
+
+    ma_mutex_lock(&pCache->lock);
+    ma_result result = ma_clip_cache_acquire(pCache, ma_clip_cache_key_from_path(pFilePath), pFilePath, NULL, 0, &pEntry);
+    if (result == MA_SUCCESS) {
+        result = ma_clip_cache_play(pCache, pEntry, volume);
+    }
+    ma_mutex_unlock(&pCache->lock);
+
+    return result;
+}
+
+MA_WRAPPER_API ma_result ma_clip_cache_trigger_memory(ma_clip_cache* pCache, const void* pData, size_t dataSize, float volume)
+{
+    if (pCache == NULL || pData == NULL || dataSize == 0) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_clip_cache_entry* pEntry;
+
+    ma_mutex_lock(&pCache->lock);
+    ma_result result = ma_clip_cache_acquire(pCache, ma_clip_cache_key_from_memory(pData, dataSize), NULL, pData, dataSize, &pEntry);
+    if (result == MA_SUCCESS) {
+        result = ma_clip_cache_play(pCache, pEntry, volume);
+    }
+    ma_mutex_unlock(&pCache->lock);
+
+    return result;
+}
+
+MA_WRAPPER_API ma_result ma_clip_cache_get_stats(ma_clip_cache* pCache, ma_clip_cache_stats* pStats)
+{
+    if (pCache == NULL || pStats == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_mutex_lock(&pCache->lock);
+    *pStats = pCache->stats;
+    ma_mutex_unlock(&pCache->lock);
+
+    return MA_SUCCESS;
+}
+
+/*
+Spectrum analyser. A worker thread drains its own capture tap, downmixes to mono and runs a Hann-windowed real FFT
+every hop. Magnitude frames go into a ring of binCount floats per frame that is only ever written by the worker:
+frame n lives in slot n % frameCapacity and becomes visible when frameCount moves past n. Readers keep their own
+cursor, so any number of them can follow the ring without coordinating with the worker or with each other.
+*/
+typedef struct
+{
+    ma_microphone* pMicrophone;
+    ma_microphone_tap tap;
+    ma_thread thread;
+    ma_fft fft;
+    ma_uint32 fftSize;
+    ma_uint32 hopSizeInFrames;
+    ma_uint32 binCount;
+    ma_uint32 frameCapacity;
+    ma_uint32 pollIntervalInMilliseconds;
+    ma_uint32 historyFrameCount;
+    float windowScale;
+    float* pWindow;
+    float* pHistory;
+    float* pWindowed;
+    float* pBinsRe;
+    float* pBinsIm;
+    float* pMagnitudes;
+    void* pCapture;             /* Frames read from the tap, still in the microphone's format. */
+    MA_ATOMIC(8, ma_uint64) frameCount;
+    MA_ATOMIC(4, ma_bool32) isRunning;
+} ma_microphone_analyzer;
+
+/* Transforms the history into the next magnitude slot. */
+static void ma_microphone_analyzer_transform(ma_microphone_analyzer* pAnalyzer, float* pMagnitudes)
+{
+    for (ma_uint32 i = 0; i < pAnalyzer->fftSize; ++i) {
+        pAnalyzer->pWindowed[i] = pAnalyzer->pHistory[i] * pAnalyzer->pWindow[i];
+    }
+
+    ma_fft_forward(&pAnalyzer->fft, pAnalyzer->pWindowed, pAnalyzer->pBinsRe, pAnalyzer->pBinsIm);
+
+    /* A full-scale sine reads 1 in its bin; DC and Nyquist have no mirrored half so they take half the scale. */
+    const float scale = pAnalyzer->windowScale;
+    for (ma_uint32 k = 0; k < pAnalyzer->binCount; ++k) {
+        const float re = pAnalyzer->pBinsRe[k];
+        const float im = pAnalyzer->pBinsIm[k];
+        pMagnitudes[k] = sqrtf(re*re + im*im) * scale;
+    }
+
+    pMagnitudes[0] *= 0.5f;
+    pMagnitudes[pAnalyzer->binCount - 1] *= 0.5f;
+}
+
+static void ma_microphone_analyzer_drain(ma_microphone_analyzer* pAnalyzer)
+{
+    ma_microphone* pMicrophone = pAnalyzer->pMicrophone;
+
+    for (;;) {
+        const ma_uint32 framesToRead = pAnalyzer->fftSize - pAnalyzer->historyFrameCount;
+        const ma_uint32 framesRead = ma_pcm_rb_read_frames(&pAnalyzer->tap.ringBuffer, pAnalyzer->pCapture, framesToRead);
+        if (framesRead == 0) {
+            break;
+        }
+
+        ma_downmix_to_mono_f32(pAnalyzer->pCapture, pMicrophone->format, pMicrophone->channels, framesRead, pAnalyzer->pHistory + pAnalyzer->historyFrameCount);
+        pAnalyzer->historyFrameCount += framesRead;
+
+        if (pAnalyzer->historyFrameCount < pAnalyzer->fftSize) {
+            break;
+        }
+
+        const ma_uint64 frameIndex = ma_atomic_load_64(&pAnalyzer->frameCount);
+        ma_microphone_analyzer_transform(pAnalyzer, pAnalyzer->pMagnitudes + (size_t)(frameIndex % pAnalyzer->frameCapacity) * pAnalyzer->binCount);
+        ma_atomic_store_explicit_64(&pAnalyzer->frameCount, frameIndex + 1, ma_atomic_memory_order_release);
+
+        pAnalyzer->historyFrameCount = pAnalyzer->fftSize - pAnalyzer->hopSizeInFrames;
+        MA_MOVE_MEMORY(pAnalyzer->pHistory, pAnalyzer->pHistory + pAnalyzer->hopSizeInFrames, pAnalyzer->historyFrameCount * sizeof(float));
+    }
+}
+
+static ma_thread_result MA_THREADCALL ma_microphone_analyzer_thread(void* pUserData)
+{
+    ma_microphone_analyzer* pAnalyzer = (ma_microphone_analyzer*)pUserData;
+
+    while (ma_atomic_load_32(&pAnalyzer->isRunning)) {
+        ma_microphone_analyzer_drain(pAnalyzer);
+        ma_sleep(pAnalyzer->pollIntervalInMilliseconds);
+    }
+
+    return (ma_thread_result)0;
+}
+
+/*
+fftSize must be a power of two between 16 and 65536; 0 selects 1024. hopSizeInFrames defaults to half the FFT size
+(50% overlap) and frameCapacity to 64 magnitude frames. Each frame holds fftSize / 2 + 1 linear magnitudes.
+*/
+MA_WRAPPER_API ma_microphone_analyzer* ma_microphone_analyzer_create(ma_microphone* pMicrophone, ma_uint32 fftSize, ma_uint32 hopSizeInFrames, ma_uint32 frameCapacity)
+{
+    if (pMicrophone == NULL) {
+        return NULL;
+    }
+
+    if (fftSize == 0) {
+        fftSize = 1024;
+    }
+
+    if (hopSizeInFrames == 0) {
+        hopSizeInFrames = fftSize / 2;
+    }
+
+    if (frameCapacity == 0) {
+        frameCapacity = 64;
+    }
+
+    if (fftSize < 16 || fftSize > 65536 || (fftSize & (fftSize - 1)) != 0 || hopSizeInFrames > fftSize || frameCapacity < 2) {
+        return NULL;
+    }
+
+    const ma_uint32 binCount = fftSize / 2 + 1;
+    const size_t windowSizeInBytes = ma_align(fftSize * sizeof(float), MA_SIMD_ALIGNMENT);
+    const size_t binsSizeInBytes = ma_align(binCount * sizeof(float), MA_SIMD_ALIGNMENT);
+    const size_t magnitudesSizeInBytes = ma_align((size_t)frameCapacity * binCount * sizeof(float), MA_SIMD_ALIGNMENT);
+
+    /* Window, history and windowed input, two bin arrays, the FFT tables, then the magnitude ring and capture scratch. */
+    const size_t heapSizeInBytes = ma_align(sizeof(ma_microphone_analyzer), MA_SIMD_ALIGNMENT) + (windowSizeInBytes * 3) + (binsSizeInBytes * 2) + ma_fft_get_heap_size(fftSize) + magnitudesSizeInBytes + ((size_t)fftSize * pMicrophone->bytesPerFrame);
+    ma_microphone_analyzer* pAnalyzer = (ma_microphone_analyzer*)ma_aligned_malloc(heapSizeInBytes, MA_SIMD_ALIGNMENT, &pMicrophone->allocationCallbacks);
+    if (pAnalyzer == NULL) {
+        return NULL;
+    }
+
+    ma_zero_memory_64(pAnalyzer, (ma_uint64)sizeof(*pAnalyzer));
+    pAnalyzer->pMicrophone = pMicrophone;
+    pAnalyzer->fftSize = fftSize;
+    pAnalyzer->hopSizeInFrames = hopSizeInFrames;
+    pAnalyzer->binCount = binCount;
+    pAnalyzer->frameCapacity = frameCapacity;
+    pAnalyzer->pollIntervalInMilliseconds = (ma_uint32)ma_clamp(((ma_uint64)hopSizeInFrames * 1000 / pMicrophone->sampleRate) / 2, 1, 20);
+
+    pAnalyzer->pWindow = (float*)ma_offset_ptr(pAnalyzer, ma_align(sizeof(ma_microphone_analyzer), MA_SIMD_ALIGNMENT));
+    pAnalyzer->pHistory = (float*)ma_offset_ptr(pAnalyzer->pWindow, windowSizeInBytes);
+    pAnalyzer->pWindowed = (float*)ma_offset_ptr(pAnalyzer->pHistory, windowSizeInBytes);
+    pAnalyzer->pBinsRe = (float*)ma_offset_ptr(pAnalyzer->pWindowed, windowSizeInBytes);
+    pAnalyzer->pBinsIm = (float*)ma_offset_ptr(pAnalyzer->pBinsRe, binsSizeInBytes);
+    ma_fft_init_preallocated(fftSize, ma_offset_ptr(pAnalyzer->pBinsIm, binsSizeInBytes), &pAnalyzer->fft);
+    pAnalyzer->pMagnitudes = (float*)ma_offset_ptr(pAnalyzer->pBinsIm, binsSizeInBytes + ma_fft_get_heap_size(fftSize));
+    pAnalyzer->pCapture = ma_offset_ptr(pAnalyzer->pMagnitudes, magnitudesSizeInBytes);
+
+    float windowSum = 0;
+    for (ma_uint32 i = 0; i < fftSize; ++i) {
+        pAnalyzer->pWindow[i] = 0.5f - 0.5f * (float)cos(MA_TAU_D * i / fftSize);
+        windowSum += pAnalyzer->pWindow[i];
+    }
+
+    pAnalyzer->windowScale = 2 / windowSum;
+
+    if (ma_microphone_tap_init(pMicrophone, ma_max(fftSize * 4, pMicrophone->sampleRate / 4), &pAnalyzer->tap) != MA_SUCCESS) {
+        ma_aligned_free(pAnalyzer, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    ma_atomic_store_32(&pAnalyzer->isRunning, MA_TRUE);
+
+    if (ma_thread_create(&pAnalyzer->thread, ma_thread_priority_normal, 0, ma_microphone_analyzer_thread, pAnalyzer, &pMicrophone->allocationCallbacks) != MA_SUCCESS) {
+        ma_microphone_tap_uninit(&pAnalyzer->tap);
+        ma_aligned_free(pAnalyzer, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    if (ma_microphone_attach_tap(pMicrophone, &pAnalyzer->tap) != MA_SUCCESS) {
+        ma_atomic_store_32(&pAnalyzer->isRunning, MA_FALSE);
+        ma_thread_wait(&pAnalyzer->thread);
+        ma_microphone_tap_uninit(&pAnalyzer->tap);
+        ma_aligned_free(pAnalyzer, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    return pAnalyzer;
+}
+
+/* Must be called before the microphone is destroyed. */
+MA_WRAPPER_API void ma_microphone_analyzer_destroy(ma_microphone_analyzer* pAnalyzer)
+{
+    if (pAnalyzer == NULL) {
+        return;
+    }
+
+    ma_microphone* pMicrophone = pAnalyzer->pMicrophone;
+
+    ma_microphone_detach_tap(pMicrophone, &pAnalyzer->tap);
+
+    ma_atomic_store_32(&pAnalyzer->isRunning, MA_FALSE);
+    ma_thread_wait(&pAnalyzer->thread);
+
+    ma_microphone_tap_uninit(&pAnalyzer->tap);
+    ma_aligned_free(pAnalyzer, &pMicrophone->allocationCallbacks);
+}
+
+MA_WRAPPER_API ma_uint32 ma_microphone_analyzer_get_bin_count(ma_microphone_analyzer* pAnalyzer)
+{
+    if (pAnalyzer == NULL) {
+        return 0;
+    }
+
+    return pAnalyzer->binCount;
+}
+
+/* Total number of magnitude frames published so far. */
+MA_WRAPPER_API ma_uint64 ma_microphone_analyzer_get_frame_count(ma_microphone_analyzer* pAnalyzer)
+{
+    if (pAnalyzer == NULL) {
+        return 0;
+    }
+
+    return ma_atomic_load_64(&pAnalyzer->frameCount);
+}
+
+MA_WRAPPER_API ma_uint64 ma_microphone_analyzer_get_dropped_frames(ma_microphone_analyzer* pAnalyzer)
+{
+    if (pAnalyzer == NULL) {
+        return 0;
+    }
+
+    return ma_atomic_load_64(&pAnalyzer->tap.droppedFrames);
+}
+
+/*
+Copies up to maxFrameCount magnitude frames starting at *pCursor into pMagnitudesOut (binCount floats each) and
+advances the cursor. Start with a cursor of 0. A reader that fell more than a ring's worth behind skips ahead to the
+oldest frame still intact; *pCursor - (previous cursor) - (return value) tells how many frames were skipped.
+*/
+MA_WRAPPER_API ma_uint32 ma_microphone_analyzer_read(ma_microphone_analyzer* pAnalyzer, ma_uint64* pCursor, float* pMagnitudesOut, ma_uint32 maxFrameCount)
+{
+    if (pAnalyzer == NULL || pCursor == NULL || pMagnitudesOut == NULL) {
+        return 0;
+    }
+
+    const ma_uint32 binCount = pAnalyzer->binCount;
+    const ma_uint32 frameCapacity = pAnalyzer->frameCapacity;
+
+    /* The slot of the frame being produced right now is off limits, so one ring slot less than the capacity is readable. */
+    const ma_uint64 frameCount = ma_atomic_load_explicit_64(&pAnalyzer->frameCount, ma_atomic_memory_order_acquire);
+    ma_uint64 cursor = *pCursor;
+    if (frameCount >= frameCapacity && cursor < frameCount - frameCapacity + 1) {
+        cursor = frameCount - frameCapacity + 1;
+    }
+
+    ma_uint32 framesCopied = (ma_uint32)ma_min(frameCount - ma_min(cursor, frameCount), maxFrameCount);
+    for (ma_uint32 i = 0; i < framesCopied; ++i) {
+        ma_copy_memory_64(pMagnitudesOut + (size_t)i * binCount, pAnalyzer->pMagnitudes + (size_t)((cursor + i) % frameCapacity) * binCount, (ma_uint64)binCount * sizeof(float));
+    }
+
+    /*
+    Anything the worker started overwriting while we copied is torn and gets dropped from the front. The fence keeps the
+    copies above from being satisfied after the count is re-read.
+    */
+    ma_atomic_thread_fence(ma_atomic_memory_order_acquire);
+    const ma_uint64 frameCountAfter = ma_atomic_load_explicit_64(&pAnalyzer->frameCount, ma_atomic_memory_order_relaxed);
+    if (frameCountAfter >= frameCapacity && cursor < frameCountAfter - frameCapacity + 1) {
+        const ma_uint32 framesTorn = (ma_uint32)ma_min(frameCountAfter - frameCapacity + 1 - cursor, framesCopied);
+        MA_MOVE_MEMORY(pMagnitudesOut, pMagnitudesOut + (size_t)framesTorn * binCount, (size_t)(framesCopied - framesTorn) * binCount * sizeof(float));
+        framesCopied -= framesTorn;
+        cursor += framesTorn;
+    }
+
+    *pCursor = cursor + framesCopied;
+
+    return framesCopied;
+}
+
+/* Copies the most recent magnitude frame. Returns MA_NO_DATA_AVAILABLE until the first frame has been published. */
+MA_WRAPPER_API ma_result ma_microphone_analyzer_get_latest(ma_microphone_analyzer* pAnalyzer, float* pMagnitudesOut, ma_uint64* pFrameIndex)
+{
+    if (pAnalyzer == NULL || pMagnitudesOut == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    for (;;) {
+        const ma_uint64 frameCount = ma_atomic_load_64(&pAnalyzer->frameCount);
+        if (frameCount == 0) {
+            return MA_NO_DATA_AVAILABLE;
+        }
+
+        ma_uint64 cursor = frameCount - 1;
+        if (ma_microphone_analyzer_read(pAnalyzer, &cursor, pMagnitudesOut, 1) == 1) {
+            if (pFrameIndex != NULL) {
+                *pFrameIndex = frameCount - 1;
+            }
+
+            return MA_SUCCESS;
+        }
+    }
+}
+
+/*
+Converting reader. Owns a capture tap at the device's native format and converts on the reading thread with
+ma_data_converter (format, channel mixing and resampling in one pass), so the data callback never converts anything.
+Each read feeds the converter straight from the tap's ring memory in blocks as large as the contiguous span allows.
+*/
+typedef struct
+{
+    ma_microphone* pMicrophone;
+    ma_microphone_tap tap;
+    ma_data_converter converter;
+    ma_format format;
+    ma_uint32 channels;
+    ma_uint32 sampleRate;
+    MA_ATOMIC(8, ma_uint64) framesRead;
+} ma_microphone_reader;
+
+/*
+Any of format, channels and sampleRate may be 0 to keep the microphone's own. bufferSizeInFrames is the tap capacity in
+microphone frames and defaults to one second.
+*/
+MA_WRAPPER_API ma_microphone_reader* ma_microphone_reader_create(ma_microphone* pMicrophone, ma_format format, ma_uint32 channels, ma_uint32 sampleRate, ma_uint32 bufferSizeInFrames)
+{
+    if (pMicrophone == NULL || channels > MA_MAX_CHANNELS) {
+        return NULL;
+    }
+
+    ma_microphone_reader* pReader = (ma_microphone_reader*)ma_aligned_malloc(sizeof(ma_microphone_reader), MA_SIMD_ALIGNMENT, &pMicrophone->allocationCallbacks);
+    if (pReader == NULL) {
+        return NULL;
+    }
+
+    ma_zero_memory_64(pReader, (ma_uint64)sizeof(*pReader));
+    pReader->pMicrophone = pMicrophone;
+    pReader->format = (format == ma_format_unknown) ? pMicrophone->format : format;
+    pReader->channels = (channels == 0) ? pMicrophone->channels : channels;
+    pReader->sampleRate = (sampleRate == 0) ? pMicrophone->sampleRate : sampleRate;
+
+    ma_data_converter_config converterConfig = ma_data_converter_config_init(pMicrophone->format, pReader->format, pMicrophone->channels, pReader->channels, pMicrophone->sampleRate, pReader->sampleRate);
+    if (ma_data_converter_init(&converterConfig, &pMicrophone->allocationCallbacks, &pReader->converter) != MA_SUCCESS) {
+        ma_aligned_free(pReader, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    if (ma_microphone_tap_init(pMicrophone, (bufferSizeInFrames == 0) ? pMicrophone->sampleRate : bufferSizeInFrames, &pReader->tap) != MA_SUCCESS) {
+        ma_data_converter_uninit(&pReader->converter, &pMicrophone->allocationCallbacks);
+        ma_aligned_free(pReader, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    if (ma_microphone_attach_tap(pMicrophone, &pReader->tap) != MA_SUCCESS) {
+        ma_microphone_tap_uninit(&pReader->tap);
+        ma_data_converter_uninit(&pReader->converter, &pMicrophone->allocationCallbacks);
+        ma_aligned_free(pReader, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    return pReader;
+}
+
+/* Must be called before the microphone is destroyed. */
+MA_WRAPPER_API void ma_microphone_reader_destroy(ma_microphone_reader* pReader)
+{
+    if (pReader == NULL) {
+        return;
+    }
+
+    ma_microphone* pMicrophone = pReader->pMicrophone;
+
+    ma_microphone_detach_tap(pMicrophone, &pReader->tap);
+    ma_microphone_tap_uninit(&pReader->tap);
+    ma_data_converter_uninit(&pReader->converter, &pMicrophone->allocationCallbacks);
+    ma_aligned_free(pReader, &pMicrophone->allocationCallbacks);
+}
+
+/* Reads up to frameCount converted frames without blocking. Only one thread may read a given reader at a time. */
+MA_WRAPPER_API ma_uint32 ma_microphone_reader_read(ma_microphone_reader* pReader, void* pFramesOut, ma_uint32 frameCount)
+{
+    if (pReader == NULL || pFramesOut == NULL || frameCount == 0) {
+        return 0;
+    }
+
+    const ma_uint32 bytesPerFrameOut = ma_get_bytes_per_frame(pReader->format, pReader->channels);
+    ma_uint32 framesReadTotal = 0;
+
+    while (framesReadTotal < frameCount) {
+        ma_uint32 framesAvailable = ma_pcm_rb_available_read(&pReader->tap.ringBuffer);
+        void* pReadPtr = NULL;
+
+        /* An empty acquire still lets the converter flush output it is holding back. */
+        if (framesAvailable > 0 && ma_pcm_rb_acquire_read(&pReader->tap.ringBuffer, &framesAvailable, &pReadPtr) != MA_SUCCESS) {
+            break;
+        }
+
+        ma_uint64 framesIn = framesAvailable;
+        ma_uint64 framesOut = frameCount - framesReadTotal;
+        const ma_result result = ma_data_converter_process_pcm_frames(&pReader->converter, pReadPtr, &framesIn, ma_offset_ptr(pFramesOut, framesReadTotal * bytesPerFrameOut), &framesOut);
+
+        if (framesAvailable > 0) {
+            ma_pcm_rb_commit_read(&pReader->tap.ringBuffer, (ma_uint32)framesIn);
+        }
+
+        framesReadTotal += (ma_uint32)framesOut;
+
+        if (result != MA_SUCCESS || (framesIn == 0 && framesOut == 0)) {
+            break;
+        }
+    }
+
+    ma_atomic_fetch_add_64(&pReader->framesRead, framesReadTotal);
+
+    return framesReadTotal;
+}
+
+/* Converted frames that can be read right now, estimated from what is waiting in the tap. */
+MA_WRAPPER_API ma_uint32 ma_microphone_reader_available_frames(ma_microphone_reader* pReader)
+{
+    if (pReader == NULL) {
+        return 0;
+    }
+
+    ma_uint64 framesOut = 0;
+    if (ma_data_converter_get_expected_output_frame_count(&pReader->converter, ma_pcm_rb_available_read(&pReader->tap.ringBuffer), &framesOut) != MA_SUCCESS) {
+        return 0;
+    }
+
+    return (ma_uint32)ma_min(framesOut, 0xFFFFFFFF);
+}
+
+/* Microphone frames the tap had to drop because this reader fell behind. */
+MA_WRAPPER_API ma_uint64 ma_microphone_reader_get_dropped_frames(ma_microphone_reader* pReader)
+{
+    if (pReader == NULL) {
+        return 0;
+    }
+
+    return ma_atomic_load_64(&pReader->tap.droppedFrames);
+}
+
+MA_WRAPPER_API ma_uint64 ma_microphone_reader_get_frames_read(ma_microphone_reader* pReader)
+{
+    if (pReader == NULL) {
+        return 0;
+    }
+
+    return ma_atomic_load_64(&pReader->framesRead);
+}
+
+MA_WRAPPER_API ma_format ma_microphone_reader_get_format(ma_microphone_reader* pReader)
+{
+    if (pReader == NULL) {
+        return ma_format_unknown;
+    }
+
+    return pReader->format;
+}
+
+MA_WRAPPER_API ma_uint32 ma_microphone_reader_get_channels(ma_microphone_reader* pReader)
+{
+    if (pReader == NULL) {
+        return 0;
+    }
+
+    return pReader->channels;
+}
+
+MA_WRAPPER_API ma_uint32 ma_microphone_reader_get_sample_rate(ma_microphone_reader* pReader)
+{
+    if (pReader == NULL) {
+        return 0;
+    }
+
+    return pReader->sampleRate;
+}
+
+#ifndef MA_BEAMFORMER_MAX_BEAMS
+#define MA_BEAMFORMER_MAX_BEAMS 4
+#endif
+
+#define MA_BEAMFORMER_FRACTIONAL_TAPS       8
+#define MA_BEAMFORMER_BLOCK_SIZE_IN_FRAMES  1024
+
+/* Azimuth is measured from +x towards +y, elevation from the xy plane towards +z. */
+typedef struct
+{
+    float azimuthInDegrees;
+    float elevationInDegrees;
+} ma_beam_direction;
+
+/*
+Delay-and-sum beamformer. Like the converting reader it owns a tap and does its work on the reading thread. Every
+microphone channel is delayed so that a plane wave from the beam's direction lines up across the array, then the
+channels are averaged. Delays are an integer offset into a planar history plus a short windowed-sinc fractional
+filter, and each beam is accumulated as one FIR per microphone.
+*/
+typedef struct
+{
+    ma_microphone* pMicrophone;
+    ma_microphone_tap tap;
+    ma_uint32 micCount;
+    ma_uint32 beamCount;
+    ma_uint32 historyInFrames;          /* Longest integer delay plus the fractional filter length. */
+    float speedOfSound;
+    ma_vec3f* pPositions;
+    void* pCapture;                     /* One block in the microphone's format. */
+    float* pCaptureF32;                 /* The same block converted, for formats other than f32. */
+    float* pPlanar;                     /* Per microphone: historyInFrames + one block. */
+    float* pBeams;                      /* Per beam: one block. */
+    float* pTaps;                       /* [beam][mic][tap], already scaled by 1 / micCount. */
+    ma_uint32* pIntegerDelays;          /* [beam][mic] */
+    ma_beam_direction directions[MA_BEAMFORMER_MAX_BEAMS];
+    ma_beam_direction pendingDirections[MA_BEAMFORMER_MAX_BEAMS];
+    ma_spinlock steerLock;
+    MA_ATOMIC(4, ma_bool32) isSteerPending;
+    MA_ATOMIC(8, ma_uint64) framesRead;
+} ma_microphone_beamformer;
+
+/* pAcc[i] += sum over k of pTaps[k] * pSrc[i - k]. Four outputs are kept in a register across all taps. */
+static void ma_fir_mac_f32(float* pAcc, const float* pSrc, const float* pTaps, ma_uint32 tapCount, ma_uint32 count)
+{
+    ma_uint32 i = 0;
+
+#if defined(MA_SUPPORT_SSE2)
+    if (ma_has_sse2()) {
+        for (; i + 4 <= count; i += 4) {
+            __m128 acc = _mm_loadu_ps(pAcc + i);
+            for (ma_uint32 k = 0; k < tapCount; ++k) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(pTaps[k]), _mm_loadu_ps(pSrc + i - k)));
+            }
+            _mm_storeu_ps(pAcc + i, acc);
+        }
+    }
+#elif defined(MA_SUPPORT_NEON)
+    if (ma_has_neon()) {
+        for (; i + 4 <= count; i += 4) {
+            float32x4_t acc = vld1q_f32(pAcc + i);
+            for (ma_uint32 k = 0; k < tapCount; ++k) {
+                acc = vmlaq_n_f32(acc, vld1q_f32(pSrc + i - k), pTaps[k]);
+            }
+            vst1q_f32(pAcc + i, acc);
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        float sum = pAcc[i];
+        for (ma_uint32 k = 0; k < tapCount; ++k) {
+            sum += pTaps[k] * pSrc[(ma_int32)i - (ma_int32)k];
+        }
+        pAcc[i] = sum;
+    }
+}
+
+static void ma_microphone_beamformer_steer_beam(ma_microphone_beamformer* pBeamformer, ma_uint32 beamIndex)
+{
+    const float azimuth = pBeamformer->directions[beamIndex].azimuthInDegrees * (float)(MA_PI / 180.0);
+    const float elevation = pBeamformer->directions[beamIndex].elevationInDegrees * (float)(MA_PI / 180.0);
+    const float ux = cosf(elevation) * cosf(azimuth);
+    const float uy = cosf(elevation) * sinf(azimuth);
+    const float uz = sinf(elevation);
+    const float samplesPerMetre = pBeamformer->pMicrophone->sampleRate / pBeamformer->speedOfSound;
+    const ma_uint32 micCount = pBeamformer->micCount;
+
+    /* Microphones further along the direction hear the wave first and get the longest delay. */
+    float minLead = 0;
+    for (ma_uint32 iMic = 0; iMic < micCount; ++iMic) {
+        const ma_vec3f p = pBeamformer->pPositions[iMic];
+        const float lead = (p.x*ux + p.y*uy + p.z*uz) * samplesPerMetre;
+        minLead = (iMic == 0) ? lead : ma_min(minLead, lead);
+    }
+
+    for (ma_uint32 iMic = 0; iMic < micCount; ++iMic) {
+        const ma_vec3f p = pBeamformer->pPositions[iMic];
+        const float delay = ((p.x*ux + p.y*uy + p.z*uz) * samplesPerMetre) - minLead;
+        const ma_uint32 integerDelay = (ma_uint32)delay;
+        const float fraction = delay - integerDelay;
+        float* pTaps = pBeamformer->pTaps + ((beamIndex * micCount) + iMic) * MA_BEAMFORMER_FRACTIONAL_TAPS;
+        float sum = 0;
+
+        /* Hann-windowed sinc centred on (taps / 2 - 1) + fraction, normalized to unity gain at DC. */
+        for (ma_uint32 k = 0; k < MA_BEAMFORMER_FRACTIONAL_TAPS; ++k) {
+            const float t = (float)k - (MA_BEAMFORMER_FRACTIONAL_TAPS/2 - 1) - fraction;
+            const float sinc = (t == 0) ? 1.0f : sinf((float)MA_PI * t) / ((float)MA_PI * t);
+            const float window = 0.5f + 0.5f * cosf((float)MA_PI * t / (MA_BEAMFORMER_FRACTIONAL_TAPS/2));
+            pTaps[k] = sinc * window;
+            sum += pTaps[k];
+        }
+
+        for (ma_uint32 k = 0; k < MA_BEAMFORMER_FRACTIONAL_TAPS; ++k) {
+            pTaps[k] /= sum * micCount;
+        }
+
+        pBeamformer->pIntegerDelays[(beamIndex * micCount) + iMic] = ma_min(integerDelay, pBeamformer->historyInFrames - MA_BEAMFORMER_FRACTIONAL_TAPS);
+    }
+}
+
+/*
+pMicPositions holds one position in metres per microphone channel. speedOfSound may be 0 for 343 m/s and
+bufferSizeInFrames, the tap capacity, 0 for one second. Beams are read as interleaved f32 frames of beamCount channels.
+*/
+MA_WRAPPER_API ma_microphone_beamformer* ma_microphone_beamformer_create(ma_microphone* pMicrophone, const ma_vec3f* pMicPositions, const ma_beam_direction* pBeams, ma_uint32 beamCount, float speedOfSound, ma_uint32 bufferSizeInFrames)
+{
+    if (pMicrophone == NULL || pMicPositions == NULL || pBeams == NULL || beamCount == 0 || beamCount > MA_BEAMFORMER_MAX_BEAMS) {
+        return NULL;
+    }
+
+    const ma_uint32 micCount = pMicrophone->channels;
+    if (speedOfSound <= 0) {
+        speedOfSound = 343;
+    }
+
+    /* The longest delay any direction can need is the array's aperture. */
+    float aperture = 0;
+    for (ma_uint32 i = 0; i < micCount; ++i) {
+        for (ma_uint32 j = i + 1; j < micCount; ++j) {
+            const float dx = pMicPositions[i].x - pMicPositions[j].x;
+            const float dy = pMicPositions[i].y - pMicPositions[j].y;
+            const float dz = pMicPositions[i].z - pMicPositions[j].z;
+            aperture = ma_max(aperture, sqrtf(dx*dx + dy*dy + dz*dz));
+        }
+    }
+
+    const ma_uint32 historyInFrames = (ma_uint32)ceilf(aperture * pMicrophone->sampleRate / speedOfSound) + MA_BEAMFORMER_FRACTIONAL_TAPS;
+    const ma_uint32 blockSize = MA_BEAMFORMER_BLOCK_SIZE_IN_FRAMES;
+    const size_t headerSizeInBytes = ma_align(sizeof(ma_microphone_beamformer), MA_SIMD_ALIGNMENT);
+    const size_t positionsSizeInBytes = ma_align(micCount * sizeof(ma_vec3f), MA_SIMD_ALIGNMENT);
+    const size_t captureSizeInBytes = ma_align((size_t)blockSize * pMicrophone->bytesPerFrame, MA_SIMD_ALIGNMENT);
+    const size_t captureF32SizeInBytes = ma_align((size_t)blockSize * micCount * sizeof(float), MA_SIMD_ALIGNMENT);
+    const size_t planarSizeInBytes = ma_align((size_t)micCount * (historyInFrames + blockSize) * sizeof(float), MA_SIMD_ALIGNMENT);
+    const size_t beamsSizeInBytes = ma_align((size_t)beamCount * blockSize * sizeof(float), MA_SIMD_ALIGNMENT);
+    const size_t tapsSizeInBytes = ma_align((size_t)beamCount * micCount * MA_BEAMFORMER_FRACTIONAL_TAPS * sizeof(float), MA_SIMD_ALIGNMENT);
+    const size_t delaysSizeInBytes = ma_align((size_t)beamCount * micCount * sizeof(ma_uint32), MA_SIMD_ALIGNMENT);
+
+    ma_microphone_beamformer* pBeamformer = (ma_microphone_beamformer*)ma_aligned_malloc(headerSizeInBytes + positionsSizeInBytes + captureSizeInBytes + captureF32SizeInBytes + planarSizeInBytes + beamsSizeInBytes + tapsSizeInBytes + delaysSizeInBytes, MA_SIMD_ALIGNMENT, &pMicrophone->allocationCallbacks);
+    if (pBeamformer == NULL) {
+        return NULL;
+    }
+
+    ma_zero_memory_64(pBeamformer, (ma_uint64)headerSizeInBytes + positionsSizeInBytes + captureSizeInBytes + captureF32SizeInBytes + planarSizeInBytes);
+    pBeamformer->pMicrophone = pMicrophone;
+    pBeamformer->micCount = micCount;
+    pBeamformer->beamCount = beamCount;
+    pBeamformer->historyInFrames = historyInFrames;
+    pBeamformer->speedOfSound = speedOfSound;
+    pBeamformer->pPositions = (ma_vec3f*)ma_offset_ptr(pBeamformer, headerSizeInBytes);
+    pBeamformer->pCapture = ma_offset_ptr(pBeamformer->pPositions, positionsSizeInBytes);
+    pBeamformer->pCaptureF32 = (float*)ma_offset_ptr(pBeamformer->pCapture, captureSizeInBytes);
+    pBeamformer->pPlanar = (float*)ma_offset_ptr(pBeamformer->pCaptureF32, captureF32SizeInBytes);
+    pBeamformer->pBeams = (float*)ma_offset_ptr(pBeamformer->pPlanar, planarSizeInBytes);
+    pBeamformer->pTaps = (float*)ma_offset_ptr(pBeamformer->pBeams, beamsSizeInBytes);
+    pBeamformer->pIntegerDelays = (ma_uint32*)ma_offset_ptr(pBeamformer->pTaps, tapsSizeInBytes);
+
+    ma_copy_memory_64(pBeamformer->pPositions, pMicPositions, (ma_uint64)micCount * sizeof(ma_vec3f));
+
+    for (ma_uint32 iBeam = 0; iBeam < beamCount; ++iBeam) {
+        pBeamformer->directions[iBeam] = pBeams[iBeam];
+        pBeamformer->pendingDirections[iBeam] = pBeams[iBeam];
+        ma_microphone_beamformer_steer_beam(pBeamformer, iBeam);
+    }
+
+    if (ma_microphone_tap_init(pMicrophone, (bufferSizeInFrames == 0) ? pMicrophone->sampleRate : bufferSizeInFrames, &pBeamformer->tap) != MA_SUCCESS) {
+        ma_aligned_free(pBeamformer, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    if (ma_microphone_attach_tap(pMicrophone, &pBeamformer->tap) != MA_SUCCESS) {
+        ma_microphone_tap_uninit(&pBeamformer->tap);
+        ma_aligned_free(pBeamformer, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    return pBeamformer;
+}
+
+/* Must be called before the microphone is destroyed. */
+MA_WRAPPER_API void ma_microphone_beamformer_destroy(ma_microphone_beamformer* pBeamformer)
+{
+    if (pBeamformer == NULL) {
+        return;
+    }
+
+    ma_microphone* pMicrophone = pBeamformer->pMicrophone;
+
+    ma_microphone_detach_tap(pMicrophone, &pBeamformer->tap);
+    ma_microphone_tap_uninit(&pBeamformer->tap);
+    ma_aligned_free(pBeamformer, &pMicrophone->allocationCallbacks);
+}
+
+/* Safe from any thread. The reading thread picks the new direction up at its next block. */
+MA_WRAPPER_API ma_result ma_microphone_beamformer_steer(ma_microphone_beamformer* pBeamformer, ma_uint32 beamIndex, ma_beam_direction direction)
+{
+    if (pBeamformer == NULL || beamIndex >= pBeamformer->beamCount) {
+        return MA_INVALID_ARGS;
+    }
+
+    ma_spinlock_lock(&pBeamformer->steerLock);
+    {
+        pBeamformer->pendingDirections[beamIndex] = direction;
+        ma_atomic_store_32(&pBeamformer->isSteerPending, MA_TRUE);
+    }
+    ma_spinlock_unlock(&pBeamformer->steerLock);
+
+    return MA_SUCCESS;
+}
+
+/* Reads up to frameCount frames of beamCount interleaved f32 beams without blocking. One reading thread at a time. */
+MA_WRAPPER_API ma_uint32 ma_microphone_beamformer_read(ma_microphone_beamformer* pBeamformer, float* pFramesOut, ma_uint32 frameCount)
+{
+    if (pBeamformer == NULL || pFramesOut == NULL || frameCount == 0) {
+        return 0;
+    }
+
+    if (ma_atomic_load_32(&pBeamformer->isSteerPending)) {
+        ma_spinlock_lock(&pBeamformer->steerLock);
+        {
+            for (ma_uint32 iBeam = 0; iBeam < pBeamformer->beamCount; ++iBeam) {
+                pBeamformer->directions[iBeam] = pBeamformer->pendingDirections[iBeam];
+            }
+            ma_atomic_store_32(&pBeamformer->isSteerPending, MA_FALSE);
+        }
+        ma_spinlock_unlock(&pBeamformer->steerLock);
+
+        for (ma_uint32 iBeam = 0; iBeam < pBeamformer->beamCount; ++iBeam) {
+            ma_microphone_beamformer_steer_beam(pBeamformer, iBeam);
+        }
+    }
+
+    const ma_microphone* pMicrophone = pBeamformer->pMicrophone;
+    const ma_uint32 micCount = pBeamformer->micCount;
+    const ma_uint32 beamCount = pBeamformer->beamCount;
+    const ma_uint32 historyInFrames = pBeamformer->historyInFrames;
+    const ma_uint32 planarStride = historyInFrames + MA_BEAMFORMER_BLOCK_SIZE_IN_FRAMES;
+    ma_uint32 framesReadTotal = 0;
+
+    while (framesReadTotal < frameCount) {
+        const ma_uint32 framesToRead = ma_min(frameCount - framesReadTotal, MA_BEAMFORMER_BLOCK_SIZE_IN_FRAMES);
+        const ma_uint32 framesRead = ma_pcm_rb_read_frames(&pBeamformer->tap.ringBuffer, pBeamformer->pCapture, framesToRead);
+        if (framesRead == 0) {
+            break;
+        }
+
+        const float* pCaptureF32 = (const float*)pBeamformer->pCapture;
+        if (pMicrophone->format != ma_format_f32) {
+            ma_pcm_convert(pBeamformer->pCaptureF32, ma_format_f32, pBeamformer->pCapture, pMicrophone->format, (ma_uint64)framesRead * micCount, ma_dither_mode_none);
+            pCaptureF32 = pBeamformer->pCaptureF32;
+        }
+
+        void* ppPlanar[MA_MAX_CHANNELS];
+        for (ma_uint32 iMic = 0; iMic < micCount; ++iMic) {
+            ppPlanar[iMic] = pBeamformer->pPlanar + (iMic * planarStride);
+        }
+
+        ma_deinterleave_pcm_frames_at(ma_format_f32, micCount, framesRead, pCaptureF32, ppPlanar, historyInFrames);
+
+        const void* ppBeams[MA_BEAMFORMER_MAX_BEAMS];
+        for (ma_uint32 iBeam = 0; iBeam < beamCount; ++iBeam) {
+            float* pBeam = pBeamformer->pBeams + (iBeam * MA_BEAMFORMER_BLOCK_SIZE_IN_FRAMES);
+            ma_zero_memory_64(pBeam, (ma_uint64)framesRead * sizeof(float));
+
+            for (ma_uint32 iMic = 0; iMic < micCount; ++iMic) {
+                const ma_uint32 iDelay = (iBeam * micCount) + iMic;
+                const float* pSrc = (const float*)ppPlanar[iMic] + historyInFrames - pBeamformer->pIntegerDelays[iDelay];
+                ma_fir_mac_f32(pBeam, pSrc, pBeamformer->pTaps + (iDelay * MA_BEAMFORMER_FRACTIONAL_TAPS), MA_BEAMFORMER_FRACTIONAL_TAPS, framesRead);
+            }
+
+            ppBeams[iBeam] = pBeam;
+        }
+
+        ma_interleave_pcm_frames_at(ma_format_f32, beamCount, framesRead, ppBeams, 0, pFramesOut + ((size_t)framesReadTotal * beamCount));
+
+        for (ma_uint32 iMic = 0; iMic < micCount; ++iMic) {
+            MA_MOVE_MEMORY(ppPlanar[iMic], (float*)ppPlanar[iMic] + framesRead, historyInFrames * sizeof(float));
+        }
+
+        framesReadTotal += framesRead;
+    }
+
+    ma_atomic_fetch_add_64(&pBeamformer->framesRead, framesReadTotal);
+
+    return framesReadTotal;
+}
+
+MA_WRAPPER_API ma_uint32 ma_microphone_beamformer_available_frames(ma_microphone_beamformer* pBeamformer)
+{
+    if (pBeamformer == NULL) {
+        return 0;
+    }
+
+    return ma_pcm_rb_available_read(&pBeamformer->tap.ringBuffer);
+}
+
+MA_WRAPPER_API ma_uint64 ma_microphone_beamformer_get_dropped_frames(ma_microphone_beamformer* pBeamformer)
+{
+    if (pBeamformer == NULL) {
+        return 0;
+    }
+
+    return ma_atomic_load_64(&pBeamformer->tap.droppedFrames);
+}
+
+MA_WRAPPER_API ma_uint32 ma_microphone_beamformer_get_beam_count(ma_microphone_beamformer* pBeamformer)
+{
+    if (pBeamformer == NULL) {
+        return 0;
+    }
+
+    return pBeamformer->beamCount;
+}
+
+/* pAcc += pA * pB over split complex arrays. */
+static void ma_complex_mac_f32(float* pAccRe, float* pAccIm, const float* pARe, const float* pAIm, const float* pBRe, const float* pBIm, ma_uint32 count)
+{
+    ma_uint32 i = 0;
+
+#if defined(MA_SUPPORT_SSE2)
+    if (ma_has_sse2()) {
+        for (; i + 4 <= count; i += 4) {
+            const __m128 ar = _mm_loadu_ps(pARe + i);
+            const __m128 ai = _mm_loadu_ps(pAIm + i);
+            const __m128 br = _mm_loadu_ps(pBRe + i);
+            const __m128 bi = _mm_loadu_ps(pBIm + i);
+            _mm_storeu_ps(pAccRe + i, _mm_add_ps(_mm_loadu_ps(pAccRe + i), _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi))));
+            _mm_storeu_ps(pAccIm + i, _mm_add_ps(_mm_loadu_ps(pAccIm + i), _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))));
+        }
+    }
+#elif defined(MA_SUPPORT_NEON)
+    if (ma_has_neon()) {
+        for (; i + 4 <= count; i += 4) {
+            const float32x4_t ar = vld1q_f32(pARe + i);
+            const float32x4_t ai = vld1q_f32(pAIm + i);
+            const float32x4_t br = vld1q_f32(pBRe + i);
+            const float32x4_t bi = vld1q_f32(pBIm + i);
+            vst1q_f32(pAccRe + i, vmlsq_f32(vmlaq_f32(vld1q_f32(pAccRe + i), ar, br), ai, bi));
+            vst1q_f32(pAccIm + i, vmlaq_f32(vmlaq_f32(vld1q_f32(pAccIm + i), ar, bi), ai, br));
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        pAccRe[i] += pARe[i]*pBRe[i] - pAIm[i]*pBIm[i];
+        pAccIm[i] += pARe[i]*pBIm[i] + pAIm[i]*pBRe[i];
+    }
+}
+
+/* pAcc += conj(pA) * pB over split complex arrays. */
+static void ma_complex_conj_mac_f32(float* pAccRe, float* pAccIm, const float* pARe, const float* pAIm, const float* pBRe, const float* pBIm, ma_uint32 count)
+{
+    ma_uint32 i = 0;
+
+#if defined(MA_SUPPORT_SSE2)
+    if (ma_has_sse2()) {
+        for (; i + 4 <= count; i += 4) {
+            const __m128 ar = _mm_loadu_ps(pARe + i);
+            const __m128 ai = _mm_loadu_ps(pAIm + i);
+            const __m128 br = _mm_loadu_ps(pBRe + i);
+            const __m128 bi = _mm_loadu_ps(pBIm + i);
+            _mm_storeu_ps(pAccRe + i, _mm_add_ps(_mm_loadu_ps(pAccRe + i), _mm_add_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi))));
+            _mm_storeu_ps(pAccIm + i, _mm_add_ps(_mm_loadu_ps(pAccIm + i), _mm_sub_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))));
+        }
+    }
+#elif defined(MA_SUPPORT_NEON)
+    if (ma_has_neon()) {
+        for (; i + 4 <= count; i += 4) {
+            const float32x4_t ar = vld1q_f32(pARe + i);
+            const float32x4_t ai = vld1q_f32(pAIm + i);
+            const float32x4_t br = vld1q_f32(pBRe + i);
+            const float32x4_t bi = vld1q_f32(pBIm + i);
+            vst1q_f32(pAccRe + i, vmlaq_f32(vmlaq_f32(vld1q_f32(pAccRe + i), ar, br), ai, bi));
+            vst1q_f32(pAccIm + i, vmlsq_f32(vmlaq_f32(vld1q_f32(pAccIm + i), ar, bi), ai, br));
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        pAccRe[i] += pARe[i]*pBRe[i] + pAIm[i]*pBIm[i];
+        pAccIm[i] += pARe[i]*pBIm[i] - pAIm[i]*pBRe[i];
+    }
+}
+
+/* Cancels the echo in pEchoCanceller->pNear against the reference block in the second half of pFarFrame, in place. */
+static void ma_echo_canceller_filter_block(ma_echo_canceller* pEchoCanceller)
+{
+    const ma_uint32 blockSize = pEchoCanceller->blockSizeInFrames;
+    const ma_uint32 partitionCount = pEchoCanceller->partitionCount;
+    const ma_uint32 binCount = pEchoCanceller->binCount;
+    const ma_uint32 binStride = pEchoCanceller->binStride;
+    float* pTime = pEchoCanceller->pTime;
+
+    /* The newest reference spectrum replaces the oldest partition. */
+    pEchoCanceller->partitionHead = (pEchoCanceller->partitionHead + partitionCount - 1) % partitionCount;
+    float* pFarRe = pEchoCanceller->pFarSpectraRe + (size_t)pEchoCanceller->partitionHead * binStride;
+    float* pFarIm = pEchoCanceller->pFarSpectraIm + (size_t)pEchoCanceller->partitionHead * binStride;
+    ma_fft_forward(&pEchoCanceller->fft, pEchoCanceller->pFarFrame, pFarRe, pFarIm);
+
+    for (ma_uint32 k = 0; k < binCount; ++k) {
+        pEchoCanceller->pFarPower[k] = 0.9f * pEchoCanceller->pFarPower[k] + 0.1f * (pFarRe[k]*pFarRe[k] + pFarIm[k]*pFarIm[k]);
+    }
+
+    ma_zero_memory_64(pEchoCanceller->pEchoRe, (ma_uint64)binStride * sizeof(float));
+    ma_zero_memory_64(pEchoCanceller->pEchoIm, (ma_uint64)binStride * sizeof(float));
+
+    for (ma_uint32 iPartition = 0; iPartition < partitionCount; ++iPartition) {
+        const size_t iSpectrum = (size_t)((pEchoCanceller->partitionHead + iPartition) % partitionCount) * binStride;
+        const size_t iWeights = (size_t)iPartition * binStride;
+        ma_complex_mac_f32(pEchoCanceller->pEchoRe, pEchoCanceller->pEchoIm, pEchoCanceller->pWeightsRe + iWeights, pEchoCanceller->pWeightsIm + iWeights, pEchoCanceller->pFarSpectraRe + iSpectrum, pEchoCanceller->pFarSpectraIm + iSpectrum, binCount);
+    }
+
+    ma_fft_inverse(&pEchoCanceller->fft, pEchoCanceller->pEchoRe, pEchoCanceller->pEchoIm, pTime);
+
+    /* Overlap-save: only the second half of the circular convolution is valid. */
+    float nearEnergy = 0;
+    float errorEnergy = 0;
+    float nearPeak = 0;
+    float farPeak = 0;
+    float farEnergy = 0;
+    for (ma_uint32 i = 0; i < blockSize; ++i) {
+        const float near = pEchoCanceller->pNear[i];
+        const float error = near - pTime[blockSize + i];
+        const float far = pEchoCanceller->pFarFrame[blockSize + i];
+
+        nearEnergy += near * near;
+        errorEnergy += error * error;
+        farEnergy += far * far;
+        nearPeak = ma_max(nearPeak, ma_abs(near));
+        farPeak = ma_max(farPeak, ma_abs(far));
+
+        pEchoCanceller->pNear[i] = error;
+    }
+
+    pEchoCanceller->pFarPeaks[pEchoCanceller->partitionHead] = farPeak;
+
+    ma_bool32 isDoubleTalk = MA_FALSE;
+    if (pEchoCanceller->config.doubleTalkThreshold > 0) {
+        float recentFarPeak = 0;
+        for (ma_uint32 iPartition = 0; iPartition < partitionCount; ++iPartition) {
+            recentFarPeak = ma_max(recentFarPeak, pEchoCanceller->pFarPeaks[iPartition]);
+        }
+
+        isDoubleTalk = nearPeak > pEchoCanceller->config.doubleTalkThreshold * recentFarPeak;
+    }
+
+    /* Nothing to learn from a silent reference (about -70 dBFS) or while the near end is talking. */
+    if (farEnergy > blockSize * 1e-7f && !isDoubleTalk) {
+        ma_zero_memory_64(pTime, (ma_uint64)blockSize * sizeof(float));
+        ma_copy_memory_64(pTime + blockSize, pEchoCanceller->pNear, (ma_uint64)blockSize * sizeof(float));
+        ma_fft_forward(&pEchoCanceller->fft, pTime, pEchoCanceller->pErrorRe, pEchoCanceller->pErrorIm);
+
+        /* Normalizing by the reference power across all partitions keeps the step stable for any filter length. */
+        const float regularization = (float)pEchoCanceller->fft.size * 1e-6f;
+        for (ma_uint32 k = 0; k < binCount; ++k) {
+            const float gain = pEchoCanceller->config.stepSize / (partitionCount * pEchoCanceller->pFarPower[k] + regularization);
+            pEchoCanceller->pErrorRe[k] *= gain;
+            pEchoCanceller->pErrorIm[k] *= gain;
+        }
+
+        for (ma_uint32 iPartition = 0; iPartition < partitionCount; ++iPartition) {
+            const size_t iSpectrum = (size_t)((pEchoCanceller->partitionHead + iPartition) % partitionCount) * binStride;
+            const size_t iWeights = (size_t)iPartition * binStride;
+            ma_complex_conj_mac_f32(pEchoCanceller->pWeightsRe + iWeights, pEchoCanceller->pWeightsIm + iWeights, pEchoCanceller->pFarSpectraRe + iSpectrum, pEchoCanceller->pFarSpectraIm + iSpectrum, pEchoCanceller->pErrorRe, pEchoCanceller->pErrorIm, binCount);
+        }
+
+        /* The gradient constraint is applied to one partition per block in turn, which keeps its cost to two transforms. */
+        const size_t iConstrained = (size_t)pEchoCanceller->constraintIndex * binStride;
+        ma_fft_inverse(&pEchoCanceller->fft, pEchoCanceller->pWeightsRe + iConstrained, pEchoCanceller->pWeightsIm + iConstrained, pTime);
+        ma_zero_memory_64(pTime + blockSize, (ma_uint64)blockSize * sizeof(float));
+        ma_fft_forward(&pEchoCanceller->fft, pTime, pEchoCanceller->pWeightsRe + iConstrained, pEchoCanceller->pWeightsIm + iConstrained);
+        pEchoCanceller->constraintIndex = (pEchoCanceller->constraintIndex + 1) % partitionCount;
+
+        ma_atomic_fetch_add_64(&pEchoCanceller->blocksAdapted, 1);
+    }
+
+    if (farEnergy > blockSize * 1e-7f) {
+        pEchoCanceller->nearEnergy = 0.95f * pEchoCanceller->nearEnergy + 0.05f * nearEnergy;
+        pEchoCanceller->errorEnergy = 0.95f * pEchoCanceller->errorEnergy + 0.05f * errorEnergy;
+        ma_atomic_store_f32(&pEchoCanceller->erleDb, 10 * log10f((pEchoCanceller->nearEnergy + 1e-10f) / (pEchoCanceller->errorEnergy + 1e-10f)));
+    }
+
+    /* The current reference block becomes the first half of the next frame. */
+    ma_copy_memory_64(pEchoCanceller->pFarFrame, pEchoCanceller->pFarFrame + blockSize, (ma_uint64)blockSize * sizeof(float));
+}
+
+/* Processes one block if enough input is queued. Returns MA_FALSE when the worker should wait. */
+static ma_bool32 ma_echo_canceller_process_block(ma_echo_canceller* pEchoCanceller)
+{
+    ma_microphone* pMicrophone = pEchoCanceller->pMicrophone;
+    const ma_uint32 blockSize = pEchoCanceller->blockSizeInFrames;
+    const ma_uint32 nearFramesAvailable = ma_pcm_rb_available_read(&pEchoCanceller->nearRing);
+    ma_uint32 farFramesAvailable = ma_pcm_rb_available_read(&pEchoCanceller->farRing);
+
+    if (nearFramesAvailable < blockSize) {
+        /* Without capture the reference keeps arriving; only hold on to what a pending capture block could still need. */
+        const ma_uint32 farFramesToKeep = ma_pcm_rb_get_subbuffer_size(&pEchoCanceller->farRing) / 4;
+        if (farFramesAvailable > farFramesToKeep * 2) {
+            ma_pcm_rb_seek_read(&pEchoCanceller->farRing, farFramesAvailable - farFramesToKeep);
+            pEchoCanceller->farRingIndex += farFramesAvailable - farFramesToKeep;
+        }
+
+        return MA_FALSE;
+    }
+
+    const ma_int64 measuredOffset = (ma_int64)ma_atomic_load_explicit_64(&pEchoCanceller->measuredOffset, ma_atomic_memory_order_acquire);
+    if (!pEchoCanceller->hasOffset || measuredOffset > pEchoCanceller->appliedOffset + blockSize || measuredOffset < pEchoCanceller->appliedOffset - (ma_int64)blockSize) {
+        if (pEchoCanceller->hasOffset) {
+            ma_atomic_fetch_add_32(&pEchoCanceller->realignmentCount, 1);
+        }
+
+        pEchoCanceller->appliedOffset = measuredOffset;
+        pEchoCanceller->hasOffset = MA_TRUE;
+        ma_atomic_store_64(&pEchoCanceller->publishedOffset, (ma_uint64)measuredOffset);
+    }
+
+    /* Reference frames older than this block's first pairing can never be used again. */
+    const ma_int64 target = (ma_int64)pEchoCanceller->nearCursor + pEchoCanceller->appliedOffset;
+    if ((ma_int64)pEchoCanceller->farRingIndex < target) {
+        const ma_uint32 framesToSkip = (ma_uint32)ma_min((ma_uint64)(target - (ma_int64)pEchoCanceller->farRingIndex), farFramesAvailable);
+        ma_pcm_rb_seek_read(&pEchoCanceller->farRing, framesToSkip);
+        pEchoCanceller->farRingIndex += framesToSkip;
+        farFramesAvailable -= framesToSkip;
+    }
+
+    /* Positions before the ring's oldest frame have already been used or never existed; they pair with silence. */
+    const ma_int64 firstFromRing = ma_max(target, (ma_int64)pEchoCanceller->farRingIndex);
+    const ma_uint32 framesFromRing = (firstFromRing < target + blockSize) ? (ma_uint32)(target + blockSize - firstFromRing) : 0;
+
+    /* A stalled speaker must not stall capture: after a few blocks of backlog the missing reference is treated as silence. */
+    if (framesFromRing > farFramesAvailable && nearFramesAvailable < blockSize * 4) {
+        return MA_FALSE;
+    }
+
+    float* pFar = pEchoCanceller->pFarFrame + blockSize;
+    ma_zero_memory_64(pFar, (ma_uint64)blockSize * sizeof(float));
+
+    const ma_uint32 framesRead = ma_pcm_rb_read_frames(&pEchoCanceller->farRing, pFar + (firstFromRing - target), ma_min(framesFromRing, farFramesAvailable));
+    pEchoCanceller->farRingIndex += framesRead;
+
+    ma_pcm_rb_read_frames(&pEchoCanceller->nearRing, pEchoCanceller->pNear, blockSize);
+    pEchoCanceller->nearCursor += blockSize;
+
+    ma_echo_canceller_filter_block(pEchoCanceller);
+
+    /* The canceller works in mono; every channel of the microphone receives the cleaned signal. */
+    const ma_uint32 channels = pMicrophone->channels;
+    for (ma_uint32 iFrame = 0; iFrame < blockSize; ++iFrame) {
+        for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+            pEchoCanceller->pOutput[iFrame*channels + iChannel] = pEchoCanceller->pNear[iFrame];
+        }
+    }
+
+    ma_pcm_convert(pEchoCanceller->pOutputFrames, pMicrophone->format, pEchoCanceller->pOutput, ma_format_f32, (ma_uint64)blockSize * channels, ma_dither_mode_none);
+
+    const ma_uint32 framesWritten = ma_pcm_rb_write_frames(&pMicrophone->ringBuffer, pEchoCanceller->pOutputFrames, blockSize);
+    ma_stream_status_on_write(&pMicrophone->status, &pMicrophone->ringBuffer, framesWritten);
+    if (framesWritten < blockSize) {
+        ma_atomic_fetch_add_64(&pMicrophone->status.xrunFrames, blockSize - framesWritten);
+    }
+
+    ma_atomic_fetch_add_64(&pEchoCanceller->blocksProcessed, 1);
+
+    return MA_TRUE;
+}
+
+static ma_thread_result MA_THREADCALL ma_echo_canceller_thread(void* pUserData)
+{
+    ma_echo_canceller* pEchoCanceller = (ma_echo_canceller*)pUserData;
+
+    while (ma_atomic_load_32(&pEchoCanceller->isRunning)) {
+        if (!ma_echo_canceller_process_block(pEchoCanceller)) {
+            ma_sleep(pEchoCanceller->pollIntervalInMilliseconds);
+        }
+    }
+
+    return (ma_thread_result)0;
+}
+
+MA_WRAPPER_API ma_echo_canceller_config ma_echo_canceller_config_init(void)
+{
+    ma_echo_canceller_config config;
+    ma_zero_memory_64(&config, (ma_uint64)sizeof(config));
+
+    config.blockSizeInFrames = 256;
+    config.filterLengthInMilliseconds = 200;
+    config.stepSize = 0.5f;
+    config.doubleTalkThreshold = 0.5f;
+
+    return config;
+}
+
+/*
+Cancels the echo of pSpeaker's output in pMicrophone's signal. Both must run at the same sample rate. While the
+canceller exists, ma_microphone_read() returns the cleaned signal (mono, copied to every channel) and VAD gating is
+bypassed. It must be destroyed before either instance.
+*/
+MA_WRAPPER_API ma_echo_canceller* ma_echo_canceller_create(ma_microphone* pMicrophone, ma_speaker* pSpeaker, const ma_echo_canceller_config* pConfig)
+{
+    if (pMicrophone == NULL || pSpeaker == NULL || pConfig == NULL || pMicrophone->sampleRate != pSpeaker->sampleRate) {
+        return NULL;
+    }
+
+    const ma_uint32 blockSize = pConfig->blockSizeInFrames;
+    if (blockSize < 16 || blockSize > 8192 || (blockSize & (blockSize - 1)) != 0 || !(pConfig->stepSize > 0 && pConfig->stepSize <= 1)) {
+        return NULL;
+    }
+
+    if (ma_atomic_load_ptr(&pMicrophone->pEchoCanceller) != NULL || ma_atomic_load_ptr(&pSpeaker->pEchoCanceller) != NULL) {
+        return NULL;
+    }
+
+    const ma_uint32 filterLengthInFrames = (ma_uint32)((ma_uint64)pMicrophone->sampleRate * pConfig->filterLengthInMilliseconds / 1000);
+    const ma_uint32 partitionCount = ma_clamp((filterLengthInFrames + blockSize - 1) / blockSize, 1, 256);
+    const ma_uint32 binCount = blockSize + 1;
+    const ma_uint32 binStride = ma_align(binCount, MA_SIMD_ALIGNMENT / sizeof(float));
+    const size_t binsSizeInBytes = (size_t)binStride * sizeof(float);
+    const size_t spectraSizeInBytes = binsSizeInBytes * partitionCount;
+    const size_t blockSizeInBytes = ma_align(blockSize * sizeof(float), MA_SIMD_ALIGNMENT);
+    const size_t outputSizeInBytes = ma_align((size_t)blockSize * pMicrophone->channels * sizeof(float), MA_SIMD_ALIGNMENT);
+
+    /* Time-domain buffers, spectra and weights for every partition, five bin arrays, the FFT and the output staging. */
+    const size_t heapSizeInBytes = ma_align(sizeof(ma_echo_canceller), MA_SIMD_ALIGNMENT) + (blockSizeInBytes * 5) + (spectraSizeInBytes * 4) + (binsSizeInBytes * 5) + ma_align(partitionCount * sizeof(float), MA_SIMD_ALIGNMENT) + ma_fft_get_heap_size(blockSize * 2) + (outputSizeInBytes * 2);
+    ma_echo_canceller* pEchoCanceller = (ma_echo_canceller*)ma_aligned_malloc(heapSizeInBytes, MA_SIMD_ALIGNMENT, &pMicrophone->allocationCallbacks);
+    if (pEchoCanceller == NULL) {
+        return NULL;
+    }
+
+    ma_zero_memory_64(pEchoCanceller, (ma_uint64)heapSizeInBytes);
+    pEchoCanceller->pMicrophone = pMicrophone;
+    pEchoCanceller->pSpeaker = pSpeaker;
+    pEchoCanceller->config = *pConfig;
+    pEchoCanceller->blockSizeInFrames = blockSize;
+    pEchoCanceller->partitionCount = partitionCount;
+    pEchoCanceller->binCount = binCount;
+    pEchoCanceller->binStride = binStride;
+    pEchoCanceller->pollIntervalInMilliseconds = (ma_uint32)ma_clamp(((ma_uint64)blockSize * 1000 / pMicrophone->sampleRate) / 2, 1, 10);
+
+    /*
+    The reference leaving the speaker lags what the callback rendered by the playback buffer, and captured audio reaches
+    the callback one capture buffer late. One block of margin keeps the direct path inside the causal part of the filter.
+    */
+    pEchoCanceller->latencyInFrames = (pSpeaker->device.playback.internalPeriodSizeInFrames * pSpeaker->device.playback.internalPeriods) + pMicrophone->device.capture.internalPeriodSizeInFrames + blockSize;
+
+    pEchoCanceller->pFarFrame = (float*)ma_offset_ptr(pEchoCanceller, ma_align(sizeof(ma_echo_canceller), MA_SIMD_ALIGNMENT));
+    pEchoCanceller->pTime = (float*)ma_offset_ptr(pEchoCanceller->pFarFrame, blockSizeInBytes * 2);
+    pEchoCanceller->pNear = (float*)ma_offset_ptr(pEchoCanceller->pTime, blockSizeInBytes * 2);
+    pEchoCanceller->pFarSpectraRe = (float*)ma_offset_ptr(pEchoCanceller->pNear, blockSizeInBytes);
+    pEchoCanceller->pFarSpectraIm = (float*)ma_offset_ptr(pEchoCanceller->pFarSpectraRe, spectraSizeInBytes);
+    pEchoCanceller->pWeightsRe = (float*)ma_offset_ptr(pEchoCanceller->pFarSpectraIm, spectraSizeInBytes);
+    pEchoCanceller->pWeightsIm = (float*)ma_offset_ptr(pEchoCanceller->pWeightsRe, spectraSizeInBytes);
+    pEchoCanceller->pEchoRe = (float*)ma_offset_ptr(pEchoCanceller->pWeightsIm, spectraSizeInBytes);
+    pEchoCanceller->pEchoIm = (float*)ma_offset_ptr(pEchoCanceller->pEchoRe, binsSizeInBytes);
+    pEchoCanceller->pErrorRe = (float*)ma_offset_ptr(pEchoCanceller->pEchoIm, binsSizeInBytes);
+    pEchoCanceller->pErrorIm = (float*)ma_offset_ptr(pEchoCanceller->pErrorRe, binsSizeInBytes);
+    pEchoCanceller->pFarPower = (float*)ma_offset_ptr(pEchoCanceller->pErrorIm, binsSizeInBytes);
+    pEchoCanceller->pFarPeaks = (float*)ma_offset_ptr(pEchoCanceller->pFarPower, binsSizeInBytes);
+    pEchoCanceller->pOutput = (float*)ma_offset_ptr(pEchoCanceller->pFarPeaks, ma_align(partitionCount * sizeof(float), MA_SIMD_ALIGNMENT));
+    pEchoCanceller->pOutputFrames = ma_offset_ptr(pEchoCanceller->pOutput, outputSizeInBytes);
+    ma_fft_init_preallocated(blockSize * 2, ma_offset_ptr(pEchoCanceller->pOutputFrames, outputSizeInBytes), &pEchoCanceller->fft);
+
+    /* Half a second of slack on either side, and never less than the filter plus the device latency. */
+    const ma_uint32 ringSizeInFrames = ma_max(pMicrophone->sampleRate / 2, (partitionCount + 4) * blockSize + pEchoCanceller->latencyInFrames);
+    if (ma_pcm_rb_init(ma_format_f32, 1, ringSizeInFrames, NULL, &pMicrophone->allocationCallbacks, &pEchoCanceller->nearRing) != MA_SUCCESS) {
+        ma_aligned_free(pEchoCanceller, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    if (ma_pcm_rb_init(ma_format_f32, 1, ringSizeInFrames, NULL, &pMicrophone->allocationCallbacks, &pEchoCanceller->farRing) != MA_SUCCESS) {
+        ma_pcm_rb_uninit(&pEchoCanceller->nearRing);
+        ma_aligned_free(pEchoCanceller, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    ma_atomic_store_32(&pEchoCanceller->isRunning, MA_TRUE);
+
+    if (ma_thread_create(&pEchoCanceller->thread, ma_thread_priority_normal, 0, ma_echo_canceller_thread, pEchoCanceller, &pMicrophone->allocationCallbacks) != MA_SUCCESS) {
+        ma_pcm_rb_uninit(&pEchoCanceller->farRing);
+        ma_pcm_rb_uninit(&pEchoCanceller->nearRing);
+        ma_aligned_free(pEchoCanceller, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    /* The reference is published first so that the first capture block already has something to pair with. */
+    ma_atomic_exchange_ptr(&pSpeaker->pEchoCanceller, pEchoCanceller);
+    ma_atomic_exchange_ptr(&pMicrophone->pEchoCanceller, pEchoCanceller);
+
+    return pEchoCanceller;
+}
+
+MA_WRAPPER_API void ma_echo_canceller_destroy(ma_echo_canceller* pEchoCanceller)
+{
+    if (pEchoCanceller == NULL) {
+        return;
+    }
+
+    ma_microphone* pMicrophone = pEchoCanceller->pMicrophone;
+    ma_speaker* pSpeaker = pEchoCanceller->pSpeaker;
+
+    /*
+    The worker goes first: it writes the microphone's ring, and once the canceller is unpublished the capture callback
+    writes that ring directly. Until the worker has exited the callback keeps feeding the canceller's own rings instead.
+    */
+    ma_atomic_store_32(&pEchoCanceller->isRunning, MA_FALSE);
+    ma_thread_wait(&pEchoCanceller->thread);
+
+    ma_atomic_exchange_ptr(&pMicrophone->pEchoCanceller, NULL);
+    ma_atomic_exchange_ptr(&pSpeaker->pEchoCanceller, NULL);
+    ma_microphone_wait_for_callback(pMicrophone);
+    ma_speaker_wait_for_callback(pSpeaker);
+
+    ma_pcm_rb_uninit(&pEchoCanceller->farRing);
+    ma_pcm_rb_uninit(&pEchoCanceller->nearRing);
+    ma_aligned_free(pEchoCanceller, &pMicrophone->allocationCallbacks);
+}
+
+typedef struct
+{
+    ma_uint64 blocksProcessed;
+    ma_uint64 blocksAdapted;
+    ma_int64 referenceOffsetInFrames;   /* Reference index minus capture index the worker currently pairs on. */
+    ma_uint32 realignmentCount;
+    float erleDb;                       /* Echo return loss enhancement, smoothed over blocks with an active reference. */
+} ma_echo_canceller_stats;
+
+MA_WRAPPER_API ma_result ma_echo_canceller_get_stats(ma_echo_canceller* pEchoCanceller, ma_echo_canceller_stats* pStats)
+{
+    if (pEchoCanceller == NULL || pStats == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    pStats->blocksProcessed = ma_atomic_load_64(&pEchoCanceller->blocksProcessed);
+    pStats->blocksAdapted = ma_atomic_load_64(&pEchoCanceller->blocksAdapted);
+    pStats->referenceOffsetInFrames = (ma_int64)ma_atomic_load_64(&pEchoCanceller->publishedOffset);
+    pStats->realignmentCount = ma_atomic_load_32(&pEchoCanceller->realignmentCount);
+    pStats->erleDb = ma_atomic_load_f32(&pEchoCanceller->erleDb);
+
+    return MA_SUCCESS;
+}
+
+/*
+Compact sample codecs. G.711 (mu-law, A-law) stores one byte per sample and is stateless, so a block is any number of
+frames. IMA-ADPCM stores four bits per sample in the Microsoft block layout used by WAV files: per channel a four byte
+header holding the first sample and the step index, then groups of eight samples per channel, four bytes each, low
+nibble first. An ADPCM block therefore holds 8n + 1 frames. All codecs work on s16 internally.
+*/
+typedef enum
+{
+    ma_codec_ulaw = 0,
+    ma_codec_alaw,
+    ma_codec_ima_adpcm
+} ma_codec;
+
+static const ma_int16 ma_g711_ulaw_to_s16[256] = {
+    -32124, -31100, -30076, -29052, -28028, -27004, -25980, -24956,
+    -23932, -22908, -21884, -20860, -19836, -18812, -17788, -16764,
+    -15996, -15484, -14972, -14460, -13948, -13436, -12924, -12412,
+    -11900, -11388, -10876, -10364,  -9852,  -9340,  -8828,  -8316,
+     -7932,  -7676,  -7420,  -7164,  -6908,  -6652,  -6396,  -6140,
+     -5884,  -5628,  -5372,  -5116,  -4860,  -4604,  -4348,  -4092,
+     -3900,  -3772,  -3644,  -3516,  -3388,  -3260,  -3132,  -3004,
+     -2876,  -2748,  -2620,  -2492,  -2364,  -2236,  -2108,  -1980,
+     -1884,  -1820,  -1756,  -1692,  -1628,  -1564,  -1500,  -1436,
+     -1372,  -1308,  -1244,  -1180,  -1116,  -1052,   -988,   -924,
+      -876,   -844,   -812,   -780,   -748,   -716,   -684,   -652,
+      -620,   -588,   -556,   -524,   -492,   -460,   -428,   -396,
+      -372,   -356,   -340,   -324,   -308,   -292,   -276,   -260,
+      -244,   -228,   -212,   -196,   -180,   -164,   -148,   -132,
+      -120,   -112,   -104,    -96,    -88,    -80,    -72,    -64,
+       -56,    -48,    -40,    -32,    -24,    -16,     -8,      0,
+     32124,  31100,  30076,  29052,  28028,  27004,  25980,  24956,
+     23932,  22908,  21884,  20860,  19836,  18812,  17788,  16764,
+     15996,  15484,  14972,  14460,  13948,  13436,  12924,  12412,
+     11900,  11388,  10876,  10364,   9852,   9340,   8828,   8316,
+      7932,   7676,   7420,   7164,   6908,   6652,   6396,   6140,
+      5884,   5628,   5372,   5116,   4860,   4604,   4348,   4092,
+      3900,   3772,   3644,   3516,   3388,   3260,   3132,   3004,
+      2876,   2748,   2620,   2492,   2364,   2236,   2108,   1980,
+      1884,   1820,   1756,   1692,   1628,   1564,   1500,   1436,
+      1372,   1308,   1244,   1180,   1116,   1052,    988,    924,
+       876,    844,    812,    780,    748,    716,    684,    652,
+       620,    588,    556,    524,    492,    460,    428,    396,
+       372,    356,    340,    324,    308,    292,    276,    260,
+       244,    228,    212,    196,    180,    164,    148,    132,
+       120,    112,    104,     96,     88,     80,     72,     64,
+        56,     48,     40,     32,     24,     16,      8,      0
+};
+
+static const ma_int16 ma_g711_alaw_to_s16[256] = {
+     -5504,  -5248,  -6016,  -5760,  -4480,  -4224,  -4992,  -4736,
+     -7552,  -7296,  -8064,  -7808,  -6528,  -6272,  -7040,  -6784,
+     -2752,  -2624,  -3008,  -2880,  -2240,  -2112,  -2496,  -2368,
+     -3776,  -3648,  -4032,  -3904,  -3264,  -3136,  -3520,  -3392,
+    -22016, -20992, -24064, -23040, -17920, -16896, -19968, -18944,
+    -30208, -29184, -32256, -31232, -26112, -25088, -28160, -27136,
+    -11008, -10496, -12032, -11520,  -8960,  -8448,  -9984,  -9472,
+    -15104, -14592, -16128, -15616, -13056, -12544, -14080, -13568,
+      -344,   -328,   -376,   -360,   -280,   -264,   -312,   -296,
+      -472,   -456,   -504,   -488,   -408,   -392,   -440,   -424,
+       -88,    -72,   -120,   -104,    -24,     -8,    -56,    -40,
+      -216,   -200,   -248,   -232,   -152,   -136,   -184,   -168,
+     -1376,  -1312,  -1504,  -1440,  -1120,  -1056,  -1248,  -1184,
+     -1888,  -1824,  -2016,  -1952,  -1632,  -1568,  -1760,  -1696,
+      -688,   -656,   -752,   -720,   -560,   -528,   -624,   -592,
+      -944,   -912,  -1008,   -976,   -816,   -784,   -880,   -848,
+      5504,   5248,   6016,   5760,   4480,   4224,   4992,   4736,
+      7552,   7296,   8064,   7808,   6528,   6272,   7040,   6784,
+      2752,   2624,   3008,   2880,   2240,   2112,   2496,   2368,
+      3776,   3648,   4032,   3904,   3264,   3136,   3520,   3392,
+     22016,  20992,  24064,  23040,  17920,  16896,  19968,  18944,
+     30208,  29184,  32256,  31232,  26112,  25088,  28160,  27136,
+     11008,  10496,  12032,  11520,   8960,   8448,   9984,   9472,
+     15104,  14592,  16128,  15616,  13056,  12544,  14080,  13568,
+       344,    328,    376,    360,    280,    264,    312,    296,
+       472,    456,    504,    488,    408,    392,    440,    424,
+        88,     72,    120,    104,     24,      8,     56,     40,
+       216,    200,    248,    232,    152,    136,    184,    168,
+      1376,   1312,   1504,   1440,   1120,   1056,   1248,   1184,
+      1888,   1824,   2016,   1952,   1632,   1568,   1760,   1696,
+       688,    656,    752,    720,    560,    528,    624,    592,
+       944,    912,   1008,    976,    816,    784,    880,    848
+};
+
+static const ma_int32 ma_ima_adpcm_index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static const ma_int32 ma_ima_adpcm_step_table[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+/* Number of significant bits in a value below 256, without branches so the encode loops vectorize. */
+static MA_INLINE ma_int32 ma_g711_segment(ma_int32 x)
+{
+    return (x >= 1) + (x >= 2) + (x >= 4) + (x >= 8) + (x >= 16) + (x >= 32) + (x >= 64) + (x >= 128);
+}
+
+static void ma_g711_encode_ulaw(const ma_int16* pSamples, ma_uint64 sampleCount, ma_uint8* pOut)
+{
+    for (ma_uint64 i = 0; i < sampleCount; ++i) {
+        ma_int32 x = pSamples[i] >> 2;
+        const ma_int32 mask = (x < 0) ? 0x7F : 0xFF;
+        x = ma_min(ma_abs(x), 8158) + 0x21;
+
+        const ma_int32 segment = ma_g711_segment(x >> 6);
+        pOut[i] = (ma_uint8)(((segment << 4) | ((x >> (segment + 1)) & 0x0F)) ^ mask);
+    }
+}
+
+static void ma_g711_encode_alaw(const ma_int16* pSamples, ma_uint64 sampleCount, ma_uint8* pOut)
+{
+    for (ma_uint64 i = 0; i < sampleCount; ++i) {
+        ma_int32 x = pSamples[i] >> 3;
+        const ma_int32 mask = (x >= 0) ? 0xD5 : 0x55;
+        x = (x >= 0) ? x : (-x - 1);
+
+        /* The 13-bit magnitude always fits in seven segments, so no clipping is needed. */
+        const ma_int32 segment = ma_g711_segment(x >> 5);
+        const ma_int32 mantissa = (segment < 2) ? (x >> 1) : (x >> segment);
+        pOut[i] = (ma_uint8)(((segment << 4) | (mantissa & 0x0F)) ^ mask);
+    }
+}
+
+static void ma_g711_decode(const ma_int16* pTable, const ma_uint8* pIn, ma_uint64 sampleCount, ma_int16* pSamples)
+{
+    for (ma_uint64 i = 0; i < sampleCount; ++i) {
+        pSamples[i] = pTable[pIn[i]];
+    }
+}
+
+typedef struct
+{
+    ma_int32 predictor;
+    ma_int32 stepIndex;
+} ma_ima_adpcm_channel;
+
+/* Advances the decoder state by one nibble. The encoder runs this too so both sides stay in lockstep. */
+static MA_INLINE ma_int32 ma_ima_adpcm_step(ma_ima_adpcm_channel* pChannel, ma_uint32 nibble)
+{
+    const ma_int32 step = ma_ima_adpcm_step_table[pChannel->stepIndex];
+    ma_int32 diff = step >> 3;
+    if (nibble & 1) diff += step >> 2;
+    if (nibble & 2) diff += step >> 1;
+    if (nibble & 4) diff += step;
+    if (nibble & 8) diff = -diff;
+
+    pChannel->predictor = ma_clamp(pChannel->predictor + diff, -32768, 32767);
+    pChannel->stepIndex = ma_clamp(pChannel->stepIndex + ma_ima_adpcm_index_table[nibble], 0, 88);
+
+    return pChannel->predictor;
+}
+
+static MA_INLINE ma_uint32 ma_ima_adpcm_encode_sample(ma_ima_adpcm_channel* pChannel, ma_int32 sample)
+{
+    ma_int32 step = ma_ima_adpcm_step_table[pChannel->stepIndex];
+    ma_int32 diff = sample - pChannel->predictor;
+    ma_uint32 nibble = 0;
+
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+
+    if (diff >= step) { nibble |= 4; diff -= step; }
+    step >>= 1;
+    if (diff >= step) { nibble |= 2; diff -= step; }
+    step >>= 1;
+    if (diff >= step) { nibble |= 1; }
+
+    ma_ima_adpcm_step(pChannel, nibble);
+
+    return nibble;
+}
+
+static void ma_ima_adpcm_encode_header(const ma_int16* pFrame, ma_uint32 channels, ma_ima_adpcm_channel* pChannels, ma_uint8* pOut)
+{
+    for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+        pChannels[iChannel].predictor = pFrame[iChannel];
+
+        pOut[iChannel*4 + 0] = (ma_uint8)((ma_uint16)pFrame[iChannel] & 0xFF);
+        pOut[iChannel*4 + 1] = (ma_uint8)((ma_uint16)pFrame[iChannel] >> 8);
+        pOut[iChannel*4 + 2] = (ma_uint8)pChannels[iChannel].stepIndex;
+        pOut[iChannel*4 + 3] = 0;
+    }
+}
+
+static void ma_ima_adpcm_encode_groups(const ma_int16* pFrames, ma_uint32 channels, ma_uint32 groupCount, ma_ima_adpcm_channel* pChannels, ma_uint8* pOut)
+{
+    for (ma_uint32 iGroup = 0; iGroup < groupCount; ++iGroup) {
+        const ma_int16* pGroup = pFrames + (size_t)iGroup * 8 * channels;
+
+        for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+            for (ma_uint32 iByte = 0; iByte < 4; ++iByte) {
+                const ma_uint32 nibble0 = ma_ima_adpcm_encode_sample(&pChannels[iChannel], pGroup[(iByte*2 + 0)*channels + iChannel]);
+                const ma_uint32 nibble1 = ma_ima_adpcm_encode_sample(&pChannels[iChannel], pGroup[(iByte*2 + 1)*channels + iChannel]);
+                *pOut++ = (ma_uint8)(nibble0 | (nibble1 << 4));
+            }
+        }
+    }
+}
+
+static void ma_ima_adpcm_decode_header(const ma_uint8* pIn, ma_uint32 channels, ma_ima_adpcm_channel* pChannels, ma_int16* pFrame)
+{
+    for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+        pChannels[iChannel].predictor = (ma_int16)(pIn[iChannel*4 + 0] | (pIn[iChannel*4 + 1] << 8));
+        pChannels[iChannel].stepIndex = ma_min(pIn[iChannel*4 + 2], 88);
+        pFrame[iChannel] = (ma_int16)pChannels[iChannel].predictor;
+    }
+}
+
+static void ma_ima_adpcm_decode_groups(const ma_uint8* pIn, ma_uint32 channels, ma_uint32 groupCount, ma_ima_adpcm_channel* pChannels, ma_int16* pFrames)
+{
+    for (ma_uint32 iGroup = 0; iGroup < groupCount; ++iGroup) {
+        ma_int16* pGroup = pFrames + (size_t)iGroup * 8 * channels;
+
+        for (ma_uint32 iChannel = 0; iChannel < channels; ++iChannel) {
+            for (ma_uint32 iByte = 0; iByte < 4; ++iByte) {
+                const ma_uint8 byte = *pIn++;
+                pGroup[(iByte*2 + 0)*channels + iChannel] = (ma_int16)ma_ima_adpcm_step(&pChannels[iChannel], byte & 0x0F);
+                pGroup[(iByte*2 + 1)*channels + iChannel] = (ma_int16)ma_ima_adpcm_step(&pChannels[iChannel], byte >> 4);
+            }
+        }
+    }
+}
+
+/* Returns the size of one encoded block, or 0 if the codec cannot hold that many frames per block. */
+MA_WRAPPER_API ma_uint32 ma_codec_get_block_size_in_bytes(ma_codec codec, ma_uint32 channels, ma_uint32 framesPerBlock)
+{
+    if (channels == 0 || channels > MA_MAX_CHANNELS || framesPerBlock == 0) {
+        return 0;
+    }
+
+    switch (codec)
+    {
+        case ma_codec_ulaw:
+        case ma_codec_alaw:
+        {
+            return (framesPerBlock <= 0xFFFFFFFF / channels) ? framesPerBlock * channels : 0;
+        }
+
+        case ma_codec_ima_adpcm:
+        {
+            if (((framesPerBlock - 1) & 7) != 0 || (framesPerBlock - 1) / 2 > 0xFFFFFFFF / channels - 4) {
+                return 0;
+            }
+
+            return channels * 4 + ((framesPerBlock - 1) / 2) * channels;
+        }
+
+        default: return 0;
+    }
+}
+
+/*
+Streams one block through the codec. The PCM side is pulled from (encode) or pushed to (decode) a callback in chunks so
+arbitrarily long blocks never need to be held as PCM in full.
+*/
+typedef ma_uint32 (* ma_codec_pcm_proc)(void* pUserData, ma_int16* pFrames, ma_uint32 frameCount);
+
+#define MA_CODEC_CHUNK_SIZE_IN_SAMPLES  4096
+
+static ma_bool32 ma_codec_encode_block(ma_codec codec, ma_uint32 channels, ma_uint32 framesPerBlock, ma_codec_pcm_proc onRead, void* pUserData, ma_ima_adpcm_channel* pChannels, ma_uint8* pOut)
+{
+    ma_int16 samples[MA_CODEC_CHUNK_SIZE_IN_SAMPLES];
+    const ma_uint32 chunkSizeInFrames = (MA_CODEC_CHUNK_SIZE_IN_SAMPLES / channels) & ~7U;
+    ma_uint32 framesRemaining = framesPerBlock;
+
+    if (codec == ma_codec_ima_adpcm) {
+        if (onRead(pUserData, samples, 1) != 1) {
+            return MA_FALSE;
+        }
+
+        ma_ima_adpcm_encode_header(samples, channels, pChannels, pOut);
+        pOut += channels * 4;
+        framesRemaining -= 1;
+    }
+
+    while (framesRemaining > 0) {
+        const ma_uint32 framesToRead = ma_min(framesRemaining, chunkSizeInFrames);
+        if (onRead(pUserData, samples, framesToRead) != framesToRead) {
+            return MA_FALSE;
+        }
+
+        if (codec == ma_codec_ulaw) {
+            ma_g711_encode_ulaw(samples, (ma_uint64)framesToRead * channels, pOut);
+            pOut += framesToRead * channels;
+        } else if (codec == ma_codec_alaw) {
+            ma_g711_encode_alaw(samples, (ma_uint64)framesToRead * channels, pOut);
+            pOut += framesToRead * channels;
+        } else {
+            ma_ima_adpcm_encode_groups(samples, channels, framesToRead / 8, pChannels, pOut);
+            pOut += (framesToRead / 2) * channels;
+        }
+
+        framesRemaining -= framesToRead;
+    }
+
+    return MA_TRUE;
+}
+
+static ma_bool32 ma_codec_decode_block(ma_codec codec, ma_uint32 channels, ma_uint32 framesPerBlock, const ma_uint8* pIn, ma_codec_pcm_proc onWrite, void* pUserData)
+{
+    ma_int16 samples[MA_CODEC_CHUNK_SIZE_IN_SAMPLES];
+    ma_ima_adpcm_channel adpcm[MA_MAX_CHANNELS];
+    const ma_uint32 chunkSizeInFrames = (MA_CODEC_CHUNK_SIZE_IN_SAMPLES / channels) & ~7U;
+    ma_uint32 framesRemaining = framesPerBlock;
+
+    if (codec == ma_codec_ima_adpcm) {
+        ma_ima_adpcm_decode_header(pIn, channels, adpcm, samples);
+        if (onWrite(pUserData, samples, 1) != 1) {
+            return MA_FALSE;
+        }
+
+        pIn += channels * 4;
+        framesRemaining -= 1;
+    }
+
+    while (framesRemaining > 0) {
+        const ma_uint32 framesToWrite = ma_min(framesRemaining, chunkSizeInFrames);
+
+        if (codec == ma_codec_ulaw) {
+            ma_g711_decode(ma_g711_ulaw_to_s16, pIn, (ma_uint64)framesToWrite * channels, samples);
+            pIn += framesToWrite * channels;
+        } else if (codec == ma_codec_alaw) {
+            ma_g711_decode(ma_g711_alaw_to_s16, pIn, (ma_uint64)framesToWrite * channels, samples);
+            pIn += framesToWrite * channels;
+        } else {
+            ma_ima_adpcm_decode_groups(pIn, channels, framesToWrite / 8, adpcm, samples);
+            pIn += (framesToWrite / 2) * channels;
+        }
+
+        if (onWrite(pUserData, samples, framesToWrite) != framesToWrite) {
+            return MA_FALSE;
+        }
+
+        framesRemaining -= framesToWrite;
+    }
+
+    return MA_TRUE;
+}
+
+typedef struct
+{
+    const ma_int16* pFrames;
+    ma_int16* pFramesOut;
+    ma_uint32 channels;
+} ma_codec_buffer_cursor;
+
+static ma_uint32 ma_codec_buffer_on_read(void* pUserData, ma_int16* pFrames, ma_uint32 frameCount)
+{
+    ma_codec_buffer_cursor* pCursor = (ma_codec_buffer_cursor*)pUserData;
+    const size_t sampleCount = (size_t)frameCount * pCursor->channels;
+
+    MA_COPY_MEMORY(pFrames, pCursor->pFrames, sampleCount * sizeof(ma_int16));
+    pCursor->pFrames += sampleCount;
+
+    return frameCount;
+}
+
+static ma_uint32 ma_codec_buffer_on_write(void* pUserData, ma_int16* pFrames, ma_uint32 frameCount)
+{
+    ma_codec_buffer_cursor* pCursor = (ma_codec_buffer_cursor*)pUserData;
+    const size_t sampleCount = (size_t)frameCount * pCursor->channels;
+
+    MA_COPY_MEMORY(pCursor->pFramesOut, pFrames, sampleCount * sizeof(ma_int16));
+    pCursor->pFramesOut += sampleCount;
+
+    return frameCount;
+}
+
+/* Encodes blockCount * framesPerBlock interleaved s16 frames. Returns the number of blocks written to pBlocksOut. */
+MA_WRAPPER_API ma_uint32 ma_codec_encode_s16(ma_codec codec, ma_uint32 channels, ma_uint32 framesPerBlock, const ma_int16* pFrames, ma_uint32 blockCount, void* pBlocksOut)
+{
+    const ma_uint32 blockSizeInBytes = ma_codec_get_block_size_in_bytes(codec, channels, framesPerBlock);
+    if (blockSizeInBytes == 0 || pFrames == NULL || pBlocksOut == NULL) {
+        return 0;
+    }
+
+    ma_ima_adpcm_channel adpcm[MA_MAX_CHANNELS];
+    ma_zero_memory_64(adpcm, (ma_uint64)sizeof(adpcm[0]) * channels);
+
+    ma_codec_buffer_cursor cursor;
+    cursor.pFrames = pFrames;
+    cursor.pFramesOut = NULL;
+    cursor.channels = channels;
+
+    for (ma_uint32 iBlock = 0; iBlock < blockCount; ++iBlock) {
+        ma_codec_encode_block(codec, channels, framesPerBlock, ma_codec_buffer_on_read, &cursor, adpcm, (ma_uint8*)pBlocksOut + (size_t)iBlock * blockSizeInBytes);
+    }
+
+    return blockCount;
+}
+
+/* Decodes blockCount blocks into interleaved s16 frames. Returns the number of blocks decoded. */
+MA_WRAPPER_API ma_uint32 ma_codec_decode_s16(ma_codec codec, ma_uint32 channels, ma_uint32 framesPerBlock, const void* pBlocks, ma_uint32 blockCount, ma_int16* pFramesOut)
+{
+    const ma_uint32 blockSizeInBytes = ma_codec_get_block_size_in_bytes(codec, channels, framesPerBlock);
+    if (blockSizeInBytes == 0 || pBlocks == NULL || pFramesOut == NULL) {
+        return 0;
+    }
+
+    ma_codec_buffer_cursor cursor;
+    cursor.pFrames = NULL;
+    cursor.pFramesOut = pFramesOut;
+    cursor.channels = channels;
+
+    for (ma_uint32 iBlock = 0; iBlock < blockCount; ++iBlock) {
+        ma_codec_decode_block(codec, channels, framesPerBlock, (const ma_uint8*)pBlocks + (size_t)iBlock * blockSizeInBytes, ma_codec_buffer_on_write, &cursor);
+    }
+
+    return blockCount;
+}
+
+static ma_uint32 ma_microphone_codec_on_read(void* pUserData, ma_int16* pFrames, ma_uint32 frameCount)
+{
+    ma_microphone* pMicrophone = (ma_microphone*)pUserData;
+    ma_uint32 framesReadTotal = 0;
+
+    while (framesReadTotal < frameCount) {
+        ma_uint32 framesToRead = frameCount - framesReadTotal;
+        void* pReadPtr = NULL;
+
+        if (ma_pcm_rb_acquire_read(&pMicrophone->ringBuffer, &framesToRead, &pReadPtr) != MA_SUCCESS || framesToRead == 0) {
+            break;
+        }
+
+        ma_pcm_convert(pFrames + (size_t)framesReadTotal * pMicrophone->channels, ma_format_s16, pReadPtr, pMicrophone->format, (ma_uint64)framesToRead * pMicrophone->channels, ma_dither_mode_none);
+        ma_pcm_rb_commit_read(&pMicrophone->ringBuffer, framesToRead);
+        framesReadTotal += framesToRead;
+    }
+
+    return framesReadTotal;
+}
+
+/*
+Reads whole blocks of captured audio, encoded with the given codec. A block is only taken from the ring once all of its
+frames have been captured, so the call never blocks and never returns a partial block. The ADPCM step index carries
+over between the blocks of one call.
+*/
+MA_WRAPPER_API ma_uint32 ma_microphone_read_encoded(ma_microphone* pMicrophone, ma_codec codec, ma_uint32 framesPerBlock, void* pBlocksOut, ma_uint32 blockCount)
+{
+    if (pMicrophone == NULL || pBlocksOut == NULL) {
+        return 0;
+    }
+
+    const ma_uint32 blockSizeInBytes = ma_codec_get_block_size_in_bytes(codec, pMicrophone->channels, framesPerBlock);
+    if (blockSizeInBytes == 0) {
+        return 0;
+    }
+
+    ma_ima_adpcm_channel adpcm[MA_MAX_CHANNELS];
+    ma_zero_memory_64(adpcm, (ma_uint64)sizeof(adpcm[0]) * pMicrophone->channels);
+
+    ma_uint32 blocksRead = 0;
+    while (blocksRead < blockCount && ma_pcm_rb_available_read(&pMicrophone->ringBuffer) >= framesPerBlock) {
+        ma_codec_encode_block(codec, pMicrophone->channels, framesPerBlock, ma_microphone_codec_on_read, pMicrophone, adpcm, (ma_uint8*)pBlocksOut + (size_t)blocksRead * blockSizeInBytes);
+        blocksRead += 1;
+    }
+
+    ma_stream_status_on_read(&pMicrophone->status, &pMicrophone->ringBuffer, blocksRead * framesPerBlock);
+
+    return blocksRead;
+}
+
+static ma_uint32 ma_speaker_codec_on_write(void* pUserData, ma_int16* pFrames, ma_uint32 frameCount)
+{
+    ma_speaker* pSpeaker = (ma_speaker*)pUserData;
+    ma_uint32 framesWrittenTotal = 0;
+
+    while (framesWrittenTotal < frameCount) {
+        ma_uint32 framesToWrite = frameCount - framesWrittenTotal;
+        void* pWritePtr = NULL;
+
+        if (ma_pcm_rb_acquire_write(&pSpeaker->ringBuffer, &framesToWrite, &pWritePtr) != MA_SUCCESS || framesToWrite == 0) {
+            break;
+        }
+
+        ma_pcm_convert(pWritePtr, pSpeaker->format, pFrames + (size_t)framesWrittenTotal * pSpeaker->channels, ma_format_s16, (ma_uint64)framesToWrite * pSpeaker->channels, ma_dither_mode_none);
+        ma_pcm_rb_commit_write(&pSpeaker->ringBuffer, framesToWrite);
+        framesWrittenTotal += framesToWrite;
+    }
+
+    return framesWrittenTotal;
+}
+
+/* Decodes whole blocks into the speaker's ring. Stops at the first block that does not fit entirely. */
+MA_WRAPPER_API ma_uint32 ma_speaker_write_encoded(ma_speaker* pSpeaker, ma_codec codec, ma_uint32 framesPerBlock, const void* pBlocks, ma_uint32 blockCount)
+{
+    if (pSpeaker == NULL || pBlocks == NULL) {
+        return 0;
+    }
+
+    const ma_uint32 blockSizeInBytes = ma_codec_get_block_size_in_bytes(codec, pSpeaker->channels, framesPerBlock);
+    if (blockSizeInBytes == 0) {
+        return 0;
+    }
+
+    if (ma_speaker_claim_producer(pSpeaker) != MA_SUCCESS) {
+        return 0;
+    }
+
+    ma_uint32 blocksWritten = 0;
+    while (blocksWritten < blockCount && ma_pcm_rb_available_write(&pSpeaker->ringBuffer) >= framesPerBlock) {
+        ma_codec_decode_block(codec, pSpeaker->channels, framesPerBlock, (const ma_uint8*)pBlocks + (size_t)blocksWritten * blockSizeInBytes, ma_speaker_codec_on_write, pSpeaker);
+        blocksWritten += 1;
+    }
+
+    ma_stream_status_on_write(&pSpeaker->status, &pSpeaker->ringBuffer, blocksWritten * framesPerBlock);
+    ma_speaker_release_producer(pSpeaker);
+
+    return blocksWritten;
+}
+
+#if !defined(MA_WRAPPER_NO_NETWORK)
+/*
+RTP over UDP. A sender drains a capture tap on its own thread and sends one packet per fixed number of frames; a
+receiver takes over a speaker's ring as its native producer and plays packets out in sequence order through a small
+jitter buffer. Packets carry a standard 12 byte RTP header (RFC 3550) whose timestamp counts frames at the sender's
+sample rate, so the receiving speaker must run at the same rate and channel count. L16 is sent big-endian as payload
+type 96; mu-law and A-law use their static payload types 0 and 8.
+*/
+typedef enum
+{
+    ma_rtp_payload_l16 = 0,
+    ma_rtp_payload_ulaw,
+    ma_rtp_payload_alaw
+} ma_rtp_payload;
+
+#define MA_RTP_HEADER_SIZE          12
+#define MA_RTP_MAX_PACKET_SIZE      1472    /* Largest UDP payload that avoids IP fragmentation on a 1500 byte MTU. */
+
+#if defined(_WIN32)
+typedef SOCKET ma_socket;
+#define MA_INVALID_SOCKET   INVALID_SOCKET
+#define ma_socket_close     closesocket
+#else
+typedef int ma_socket;
+#define MA_INVALID_SOCKET   -1
+#define ma_socket_close     close
+#endif
+
+static ma_result ma_socket_startup(void)
+{
+#if defined(_WIN32)
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        return MA_ERROR;
+    }
+#endif
+
+    return MA_SUCCESS;
+}
+
+static void ma_socket_shutdown(void)
+{
+#if defined(_WIN32)
+    WSACleanup();
+#endif
+}
+
+static void ma_socket_set_receive_timeout(ma_socket s, ma_uint32 milliseconds)
+{
+#if defined(_WIN32)
+    DWORD timeout = milliseconds;
+#else
+    struct timeval timeout;
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_usec = (milliseconds % 1000) * 1000;
+#endif
+
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+static ma_uint8 ma_rtp_payload_type(ma_rtp_payload payload)
+{
+    switch (payload)
+    {
+        case ma_rtp_payload_ulaw: return 0;
+        case ma_rtp_payload_alaw: return 8;
+        default:                  return 96;
+    }
+}
+
+static ma_uint32 ma_rtp_payload_size(ma_rtp_payload payload, ma_uint32 channels, ma_uint32 framesPerPacket)
+{
+    const ma_uint32 bytesPerSample = (payload == ma_rtp_payload_l16) ? 2 : 1;
+
+    if (payload > ma_rtp_payload_alaw || channels == 0 || framesPerPacket == 0 || framesPerPacket > (MA_RTP_MAX_PACKET_SIZE - MA_RTP_HEADER_SIZE) / (channels * bytesPerSample)) {
+        return 0;
+    }
+
+    return framesPerPacket * channels * bytesPerSample;
+}
+
+static void ma_rtp_encode_payload(ma_rtp_payload payload, const ma_int16* pSamples, ma_uint32 sampleCount, ma_uint8* pOut)
+{
+    if (payload == ma_rtp_payload_ulaw) {
+        ma_g711_encode_ulaw(pSamples, sampleCount, pOut);
+    } else if (payload == ma_rtp_payload_alaw) {
+        ma_g711_encode_alaw(pSamples, sampleCount, pOut);
+    } else {
+        for (ma_uint32 i = 0; i < sampleCount; ++i) {
+            pOut[i*2 + 0] = (ma_uint8)((ma_uint16)pSamples[i] >> 8);
+            pOut[i*2 + 1] = (ma_uint8)((ma_uint16)pSamples[i] & 0xFF);
+        }
+    }
+}
+
+static void ma_rtp_decode_payload(ma_rtp_payload payload, const ma_uint8* pIn, ma_uint32 sampleCount, ma_int16* pSamples)
+{
+    if (payload == ma_rtp_payload_ulaw) {
+        ma_g711_decode(ma_g711_ulaw_to_s16, pIn, sampleCount, pSamples);
+    } else if (payload == ma_rtp_payload_alaw) {
+        ma_g711_decode(ma_g711_alaw_to_s16, pIn, sampleCount, pSamples);
+    } else {
+        for (ma_uint32 i = 0; i < sampleCount; ++i) {
+            pSamples[i] = (ma_int16)((pIn[i*2 + 0] << 8) | pIn[i*2 + 1]);
+        }
+    }
+}
+
+typedef struct
+{
+    ma_uint64 packetsSent;
+    ma_uint64 bytesSent;
+    ma_uint64 sendErrors;
+    ma_uint64 droppedFrames;    /* Captured frames lost because the sender fell behind the tap. */
+} ma_rtp_sender_stats;
+
+typedef struct
+{
+    ma_microphone* pMicrophone;
+    ma_microphone_tap tap;
+    ma_thread thread;
+    ma_socket socket;
+    struct sockaddr_storage address;
+    ma_uint32 addressSize;
+    ma_rtp_payload payload;
+    ma_uint32 framesPerPacket;
+    ma_uint32 payloadSizeInBytes;
+    ma_uint32 pollIntervalInMilliseconds;
+    ma_uint16 sequenceNumber;
+    ma_uint32 timestamp;
+    ma_uint32 ssrc;
+    ma_int16* pSamples;
+    ma_uint8* pPacket;
+    MA_ATOMIC(4, ma_bool32) isRunning;
+    MA_ATOMIC(8, ma_uint64) packetsSent;
+    MA_ATOMIC(8, ma_uint64) bytesSent;
+    MA_ATOMIC(8, ma_uint64) sendErrors;
+} ma_rtp_sender;
+
+static void ma_rtp_sender_send_packet(ma_rtp_sender* pSender)
+{
+    ma_uint8* pHeader = pSender->pPacket;
+    pHeader[0] = 0x80;     /* Version 2, no padding, no extension, no CSRCs. */
+    pHeader[1] = ma_rtp_payload_type(pSender->payload);
+    pHeader[2] = (ma_uint8)(pSender->sequenceNumber >> 8);
+    pHeader[3] = (ma_uint8)(pSender->sequenceNumber & 0xFF);
+    pHeader[4] = (ma_uint8)(pSender->timestamp >> 24);
+    pHeader[5] = (ma_uint8)(pSender->timestamp >> 16);
+    pHeader[6] = (ma_uint8)(pSender->timestamp >> 8);
+    pHeader[7] = (ma_uint8)(pSender->timestamp & 0xFF);
+    pHeader[8] = (ma_uint8)(pSender->ssrc >> 24);
+    pHeader[9] = (ma_uint8)(pSender->ssrc >> 16);
+    pHeader[10] = (ma_uint8)(pSender->ssrc >> 8);
+    pHeader[11] = (ma_uint8)(pSender->ssrc & 0xFF);
+
+    ma_rtp_encode_payload(pSender->payload, pSender->pSamples, pSender->framesPerPacket * pSender->pMicrophone->channels, pHeader + MA_RTP_HEADER_SIZE);
+
+    const int packetSizeInBytes = (int)(MA_RTP_HEADER_SIZE + pSender->payloadSizeInBytes);
+    if (sendto(pSender->socket, (const char*)pSender->pPacket, packetSizeInBytes, 0, (const struct sockaddr*)&pSender->address, pSender->addressSize) == packetSizeInBytes) {
+        ma_atomic_fetch_add_64(&pSender->packetsSent, 1);
+        ma_atomic_fetch_add_64(&pSender->bytesSent, packetSizeInBytes);
+    } else {
+        ma_atomic_fetch_add_64(&pSender->sendErrors, 1);
+    }
+
+    /* A failed send is a lost packet as far as the receiver is concerned, so the sequence and clock still advance. */
+    pSender->sequenceNumber += 1;
+    pSender->timestamp += pSender->framesPerPacket;
+}
+
+static ma_thread_result MA_THREADCALL ma_rtp_sender_thread(void* pUserData)
+{
+    ma_rtp_sender* pSender = (ma_rtp_sender*)pUserData;
+    ma_microphone* pMicrophone = pSender->pMicrophone;
+
+    while (ma_atomic_load_32(&pSender->isRunning)) {
+        if (ma_pcm_rb_available_read(&pSender->tap.ringBuffer) < pSender->framesPerPacket) {
+            ma_sleep(pSender->pollIntervalInMilliseconds);
+            continue;
+        }
+
+        ma_uint32 framesReadTotal = 0;
+        while (framesReadTotal < pSender->framesPerPacket) {
+            ma_uint32 framesToRead = pSender->framesPerPacket - framesReadTotal;
+            void* pReadPtr = NULL;
+
+            if (ma_pcm_rb_acquire_read(&pSender->tap.ringBuffer, &framesToRead, &pReadPtr) != MA_SUCCESS || framesToRead == 0) {
+                break;
+            }
+
+            ma_pcm_convert(pSender->pSamples + (size_t)framesReadTotal * pMicrophone->channels, ma_format_s16, pReadPtr, pMicrophone->format, (ma_uint64)framesToRead * pMicrophone->channels, ma_dither_mode_none);
+            ma_pcm_rb_commit_read(&pSender->tap.ringBuffer, framesToRead);
+            framesReadTotal += framesToRead;
+        }
+
+        ma_rtp_sender_send_packet(pSender);
+    }
+
+    return (ma_thread_result)0;
+}
+
+/*
+Starts sending immediately. pHost may be a name or a numeric IPv4/IPv6 address. One packet carries framesPerPacket
+frames; the whole packet must fit in 1472 bytes. The sender must be destroyed before its microphone.
+*/
+MA_WRAPPER_API ma_rtp_sender* ma_rtp_sender_create(ma_microphone* pMicrophone, const char* pHost, ma_uint16 port, ma_rtp_payload payload, ma_uint32 framesPerPacket)
+{
+    if (pMicrophone == NULL || pHost == NULL || port == 0) {
+        return NULL;
+    }
+
+    const ma_uint32 payloadSizeInBytes = ma_rtp_payload_size(payload, pMicrophone->channels, framesPerPacket);
+    if (payloadSizeInBytes == 0) {
+        return NULL;
+    }
+
+    const size_t samplesSizeInBytes = ma_align((size_t)framesPerPacket * pMicrophone->channels * sizeof(ma_int16), MA_SIMD_ALIGNMENT);
+    const size_t heapSizeInBytes = ma_align(sizeof(ma_rtp_sender), MA_SIMD_ALIGNMENT) + samplesSizeInBytes + MA_RTP_MAX_PACKET_SIZE;
+    ma_rtp_sender* pSender = (ma_rtp_sender*)ma_aligned_malloc(heapSizeInBytes, MA_SIMD_ALIGNMENT, &pMicrophone->allocationCallbacks);
+    if (pSender == NULL) {
+        return NULL;
+    }
+
+    ma_zero_memory_64(pSender, (ma_uint64)sizeof(*pSender));
+    pSender->pMicrophone = pMicrophone;
+    pSender->payload = payload;
+    pSender->framesPerPacket = framesPerPacket;
+    pSender->payloadSizeInBytes = payloadSizeInBytes;
+    pSender->pSamples = (ma_int16*)ma_offset_ptr(pSender, ma_align(sizeof(ma_rtp_sender), MA_SIMD_ALIGNMENT));
+    pSender->pPacket = (ma_uint8*)ma_offset_ptr(pSender->pSamples, samplesSizeInBytes);
+    pSender->pollIntervalInMilliseconds = (ma_uint32)ma_clamp(((ma_uint64)framesPerPacket * 1000 / pMicrophone->sampleRate) / 4, 1, 10);
+    pSender->socket = MA_INVALID_SOCKET;
+
+    /* RFC 3550 wants the initial sequence number, timestamp and SSRC to be unpredictable. */
+    const ma_uint64 seed = ma_get_monotonic_time_in_nanoseconds() ^ (ma_uint64)(size_t)pSender;
+    pSender->ssrc = (ma_uint32)(seed ^ (seed >> 32)) * 2654435761U;
+    pSender->sequenceNumber = (ma_uint16)(pSender->ssrc >> 7);
+    pSender->timestamp = pSender->ssrc * 2246822519U;
+
+    if (ma_socket_startup() != MA_SUCCESS) {
+        ma_aligned_free(pSender, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    char service[8];
+    snprintf(service, sizeof(service), "%u", (unsigned int)port);
+
+    struct addrinfo hints;
+    ma_zero_memory_64(&hints, (ma_uint64)sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+
+    struct addrinfo* pAddresses = NULL;
+    if (getaddrinfo(pHost, service, &hints, &pAddresses) != 0) {
+        ma_socket_shutdown();
+        ma_aligned_free(pSender, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    for (struct addrinfo* pAddress = pAddresses; pAddress != NULL; pAddress = pAddress->ai_next) {
+        pSender->socket = socket(pAddress->ai_family, pAddress->ai_socktype, pAddress->ai_protocol);
+        if (pSender->socket != MA_INVALID_SOCKET) {
+            MA_COPY_MEMORY(&pSender->address, pAddress->ai_addr, pAddress->ai_addrlen);
+            pSender->addressSize = (ma_uint32)pAddress->ai_addrlen;
+            break;
+        }
+    }
+
+    freeaddrinfo(pAddresses);
+
+    if (pSender->socket == MA_INVALID_SOCKET) {
+        ma_socket_shutdown();
+        ma_aligned_free(pSender, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    /* A quarter of a second of capture, but never less than a few packets. */
+    if (ma_microphone_tap_init(pMicrophone, ma_max(pMicrophone->sampleRate / 4, framesPerPacket * 4), &pSender->tap) != MA_SUCCESS) {
+        ma_socket_close(pSender->socket);
+        ma_socket_shutdown();
+        ma_aligned_free(pSender, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    ma_atomic_store_32(&pSender->isRunning, MA_TRUE);
+
+    if (ma_thread_create(&pSender->thread, ma_thread_priority_normal, 0, ma_rtp_sender_thread, pSender, &pMicrophone->allocationCallbacks) != MA_SUCCESS) {
+        ma_microphone_tap_uninit(&pSender->tap);
+        ma_socket_close(pSender->socket);
+        ma_socket_shutdown();
+        ma_aligned_free(pSender, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    if (ma_microphone_attach_tap(pMicrophone, &pSender->tap) != MA_SUCCESS) {
+        ma_atomic_store_32(&pSender->isRunning, MA_FALSE);
+        ma_thread_wait(&pSender->thread);
+        ma_microphone_tap_uninit(&pSender->tap);
+        ma_socket_close(pSender->socket);
+        ma_socket_shutdown();
+        ma_aligned_free(pSender, &pMicrophone->allocationCallbacks);
+        return NULL;
+    }
+
+    return pSender;
+}
+
+MA_WRAPPER_API void ma_rtp_sender_destroy(ma_rtp_sender* pSender)
+{
+    if (pSender == NULL) {
+        return;
+    }
+
+    ma_microphone* pMicrophone = pSender->pMicrophone;
+
+    ma_microphone_detach_tap(pMicrophone, &pSender->tap);
+
+    ma_atomic_store_32(&pSender->isRunning, MA_FALSE);
+    ma_thread_wait(&pSender->thread);
+
+    ma_microphone_tap_uninit(&pSender->tap);
+    ma_socket_close(pSender->socket);
+    ma_socket_shutdown();
+    ma_aligned_free(pSender, &pMicrophone->allocationCallbacks);
+}
+
+MA_WRAPPER_API ma_result ma_rtp_sender_get_stats(ma_rtp_sender* pSender, ma_rtp_sender_stats* pStats)
+{
+    if (pSender == NULL || pStats == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    pStats->packetsSent = ma_atomic_load_64(&pSender->packetsSent);
+    pStats->bytesSent = ma_atomic_load_64(&pSender->bytesSent);
+    pStats->sendErrors = ma_atomic_load_64(&pSender->sendErrors);
+    pStats->droppedFrames = ma_atomic_load_64(&pSender->tap.droppedFrames);
+
+    return MA_SUCCESS;
+}
+
+typedef struct
+{
+    ma_uint64 packetsReceived;
+    ma_uint64 packetsPlayed;
+    ma_uint64 packetsLost;          /* Never arrived before their turn to play; replaced by silence. */
+    ma_uint64 packetsLate;          /* Arrived after their turn and were discarded. */
+    ma_uint64 packetsReordered;     /* Arrived after a packet with a higher sequence number, but in time. */
+    ma_uint64 packetsDuplicated;
+    ma_uint64 packetsInvalid;       /* Wrong version, payload type or size. */
+    ma_uint32 resyncCount;          /* Times the stream jumped too far ahead and the jitter buffer restarted. */
+    ma_uint32 packetsBuffered;
+} ma_rtp_receiver_stats;
+
+typedef struct
+{
+    ma_speaker* pSpeaker;
+    ma_thread thread;
+    ma_socket socket;
+    ma_uint16 port;
+    ma_rtp_payload payload;
+    ma_uint32 framesPerPacket;
+    ma_uint32 payloadSizeInBytes;
+    ma_uint32 jitterInPackets;
+    ma_uint32 slotCount;                /* Power of two, larger than the jitter depth. */
+    ma_uint32 slotSizeInSamples;
+    ma_int16* pSlots;
+    ma_uint16* pSlotSequenceNumbers;
+    ma_bool8* pSlotIsFilled;
+    ma_uint8* pPacket;
+    ma_bool32 hasStarted;               /* Playout begins once the jitter depth has been reached for the first time. */
+    ma_uint16 nextSequenceNumber;
+    ma_uint32 highestOffset;            /* Largest distance ahead of nextSequenceNumber currently buffered, plus one. */
+    ma_uint32 ssrc;
+    ma_bool32 hasSsrc;
+    MA_ATOMIC(4, ma_bool32) isRunning;
+    MA_ATOMIC(4, ma_uint32) packetsBuffered;
+    MA_ATOMIC(4, ma_uint32) resyncCount;
+    MA_ATOMIC(8, ma_uint64) packetsReceived;
+    MA_ATOMIC(8, ma_uint64) packetsPlayed;
+    MA_ATOMIC(8, ma_uint64) packetsLost;
+    MA_ATOMIC(8, ma_uint64) packetsLate;
+    MA_ATOMIC(8, ma_uint64) packetsReordered;
+    MA_ATOMIC(8, ma_uint64) packetsDuplicated;
+    MA_ATOMIC(8, ma_uint64) packetsInvalid;
+} ma_rtp_receiver;
+
+static void ma_rtp_receiver_reset(ma_rtp_receiver* pReceiver, ma_uint16 sequenceNumber)
+{
+    ma_zero_memory_64(pReceiver->pSlotIsFilled, (ma_uint64)pReceiver->slotCount * sizeof(ma_bool8));
+    pReceiver->hasStarted = MA_FALSE;
+    pReceiver->nextSequenceNumber = sequenceNumber;
+    pReceiver->highestOffset = 0;
+    ma_atomic_store_32(&pReceiver->packetsBuffered, 0);
+}
+
+static void ma_rtp_receiver_store(ma_rtp_receiver* pReceiver, ma_uint16 sequenceNumber, const ma_uint8* pPayload)
+{
+    const ma_int16 offset = (ma_int16)(ma_uint16)(sequenceNumber - pReceiver->nextSequenceNumber);
+    if (offset < 0) {
+        ma_atomic_fetch_add_64(&pReceiver->packetsLate, 1);
+        return;
+    }
+
+    /* Too far ahead to have been reordered: the sender skipped or restarted, so pick up from this packet. */
+    if ((ma_uint32)offset >= pReceiver->slotCount) {
+        ma_atomic_fetch_add_32(&pReceiver->resyncCount, 1);
+        ma_rtp_receiver_reset(pReceiver, sequenceNumber);
+        ma_rtp_receiver_store(pReceiver, sequenceNumber, pPayload);
+        return;
+    }
+
+    const ma_uint32 iSlot = sequenceNumber & (pReceiver->slotCount - 1);
+    if (pReceiver->pSlotIsFilled[iSlot] && pReceiver->pSlotSequenceNumbers[iSlot] == sequenceNumber) {
+        ma_atomic_fetch_add_64(&pReceiver->packetsDuplicated, 1);
+        return;
+    }
+
+    if ((ma_uint32)offset + 1 < pReceiver->highestOffset) {
+        ma_atomic_fetch_add_64(&pReceiver->packetsReordered, 1);
+    }
+
+    ma_rtp_decode_payload(pReceiver->payload, pPayload, pReceiver->slotSizeInSamples, pReceiver->pSlots + (size_t)iSlot * pReceiver->slotSizeInSamples);
+    pReceiver->pSlotSequenceNumbers[iSlot] = sequenceNumber;
+    pReceiver->pSlotIsFilled[iSlot] = MA_TRUE;
+    pReceiver->highestOffset = ma_max(pReceiver->highestOffset, (ma_uint32)offset + 1);
+    ma_atomic_fetch_add_32(&pReceiver->packetsBuffered, 1);
+}
+
+static void ma_rtp_receiver_on_packet(ma_rtp_receiver* pReceiver, const ma_uint8* pPacket, ma_uint32 packetSizeInBytes)
+{
+    if (packetSizeInBytes < MA_RTP_HEADER_SIZE || (pPacket[0] >> 6) != 2 || (pPacket[1] & 0x7F) != ma_rtp_payload_type(pReceiver->payload)) {
+        ma_atomic_fetch_add_64(&pReceiver->packetsInvalid, 1);
+        return;
+    }
+
+    /* Skip CSRCs and any header extension, and strip padding. */
+    ma_uint32 headerSizeInBytes = MA_RTP_HEADER_SIZE + (pPacket[0] & 0x0F) * 4;
+    if ((pPacket[0] & 0x10) != 0 && headerSizeInBytes + 4 <= packetSizeInBytes) {
+        headerSizeInBytes += 4 + ((pPacket[headerSizeInBytes + 2] << 8) | pPacket[headerSizeInBytes + 3]) * 4;
+    }
+
+    if ((pPacket[0] & 0x20) != 0 && packetSizeInBytes > headerSizeInBytes) {
+        packetSizeInBytes -= pPacket[packetSizeInBytes - 1];
+    }
+
+    if (headerSizeInBytes > packetSizeInBytes || packetSizeInBytes - headerSizeInBytes != pReceiver->payloadSizeInBytes) {
+        ma_atomic_fetch_add_64(&pReceiver->packetsInvalid, 1);
+        return;
+    }
+
+    ma_atomic_fetch_add_64(&pReceiver->packetsReceived, 1);
+
+    const ma_uint16 sequenceNumber = (ma_uint16)((pPacket[2] << 8) | pPacket[3]);
+    const ma_uint32 ssrc = ((ma_uint32)pPacket[8] << 24) | ((ma_uint32)pPacket[9] << 16) | ((ma_uint32)pPacket[10] << 8) | pPacket[11];
+
+    /* The first packet, or one from a new sender, starts a fresh stream. */
+    if (!pReceiver->hasSsrc || ssrc != pReceiver->ssrc) {
+        if (pReceiver->hasSsrc) {
+            ma_atomic_fetch_add_32(&pReceiver->resyncCount, 1);
+        }
+
+        pReceiver->hasSsrc = MA_TRUE;
+        pReceiver->ssrc = ssrc;
+        ma_rtp_receiver_reset(pReceiver, sequenceNumber);
+    }
+
+    ma_rtp_receiver_store(pReceiver, sequenceNumber, pPacket + headerSizeInBytes);
+}
+
+/* Moves packets into the speaker in sequence order for as long as the ring has room for them. */
+static void ma_rtp_receiver_play_out(ma_rtp_receiver* pReceiver)
+{
+    ma_speaker* pSpeaker = pReceiver->pSpeaker;
+
+    if (!pReceiver->hasStarted) {
+        if (pReceiver->highestOffset < pReceiver->jitterInPackets) {
+            return;
+        }
+
+        pReceiver->hasStarted = MA_TRUE;
+    }
+
+    while (pReceiver->highestOffset > 0 && ma_pcm_rb_available_write(&pSpeaker->ringBuffer) >= pReceiver->framesPerPacket) {
+        const ma_uint32 iSlot = pReceiver->nextSequenceNumber & (pReceiver->slotCount - 1);
+        ma_int16* pSamples = pReceiver->pSlots + (size_t)iSlot * pReceiver->slotSizeInSamples;
+
+        if (pReceiver->pSlotIsFilled[iSlot] && pReceiver->pSlotSequenceNumbers[iSlot] == pReceiver->nextSequenceNumber) {
+            pReceiver->pSlotIsFilled[iSlot] = MA_FALSE;
+            ma_atomic_fetch_sub_32(&pReceiver->packetsBuffered, 1);
+            ma_atomic_fetch_add_64(&pReceiver->packetsPlayed, 1);
+        } else if (pReceiver->highestOffset > pReceiver->jitterInPackets) {
+            /* Enough later packets are waiting that this one would arrive too late to keep the jitter depth. */
+            ma_zero_memory_64(pSamples, (ma_uint64)pReceiver->slotSizeInSamples * sizeof(ma_int16));
+            ma_atomic_fetch_add_64(&pReceiver->packetsLost, 1);
+        } else {
+            break;
+        }
+
+        const ma_uint32 framesWritten = ma_speaker_codec_on_write(pSpeaker, pSamples, pReceiver->framesPerPacket);
+        ma_stream_status_on_write(&pSpeaker->status, &pSpeaker->ringBuffer, framesWritten);
+
+        pReceiver->nextSequenceNumber += 1;
+        pReceiver->highestOffset -= 1;
+    }
+}
+
+static ma_thread_result MA_THREADCALL ma_rtp_receiver_thread(void* pUserData)
+{
+    ma_rtp_receiver* pReceiver = (ma_rtp_receiver*)pUserData;
+
+    while (ma_atomic_load_32(&pReceiver->isRunning)) {
+        const int packetSizeInBytes = (int)recv(pReceiver->socket, (char*)pReceiver->pPacket, MA_RTP_MAX_PACKET_SIZE, 0);
+        if (packetSizeInBytes > 0) {
+            ma_rtp_receiver_on_packet(pReceiver, pReceiver->pPacket, (ma_uint32)packetSizeInBytes);
+        }
+
+        /* Also runs on a receive timeout so packets still go out while the speaker drains a full ring. */
+        ma_rtp_receiver_play_out(pReceiver);
+    }
+
+    return (ma_thread_result)0;
+}
+
+/*
+Listens on port (0 picks a free one; see ma_rtp_receiver_get_port()) on every local IPv4 and IPv6 address, and becomes
+the speaker's native producer. Playback starts once jitterInPackets packets are buffered; a missing packet is
+declared lost, and replaced by silence, once more than that many later packets are waiting. The receiver must be
+destroyed before its speaker.
+*/
+MA_WRAPPER_API ma_rtp_receiver* ma_rtp_receiver_create(ma_speaker* pSpeaker, ma_uint16 port, ma_rtp_payload payload, ma_uint32 framesPerPacket, ma_uint32 jitterInPackets)
+{
+    if (pSpeaker == NULL || jitterInPackets == 0 || jitterInPackets > 1024) {
+        return NULL;
+    }
+
+    const ma_uint32 payloadSizeInBytes = ma_rtp_payload_size(payload, pSpeaker->channels, framesPerPacket);
+    if (payloadSizeInBytes == 0) {
+        return NULL;
+    }
+
+    /* Room for the jitter depth plus as much reordering again. */
+    ma_uint32 slotCount = 4;
+    while (slotCount < jitterInPackets * 2) {
+        slotCount *= 2;
+    }
+
+    const ma_uint32 slotSizeInSamples = framesPerPacket * pSpeaker->channels;
+    const size_t slotsSizeInBytes = ma_align((size_t)slotCount * slotSizeInSamples * sizeof(ma_int16), MA_SIMD_ALIGNMENT);
+    const size_t sequenceNumbersSizeInBytes = ma_align(slotCount * sizeof(ma_uint16), MA_SIMD_ALIGNMENT);
+    const size_t isFilledSizeInBytes = ma_align(slotCount * sizeof(ma_bool8), MA_SIMD_ALIGNMENT);
+    const size_t heapSizeInBytes = ma_align(sizeof(ma_rtp_receiver), MA_SIMD_ALIGNMENT) + slotsSizeInBytes + sequenceNumbersSizeInBytes + isFilledSizeInBytes + MA_RTP_MAX_PACKET_SIZE;
+    ma_rtp_receiver* pReceiver = (ma_rtp_receiver*)ma_aligned_malloc(heapSizeInBytes, MA_SIMD_ALIGNMENT, &pSpeaker->allocationCallbacks);
+    if (pReceiver == NULL) {
+        return NULL;
+    }
+
+    ma_zero_memory_64(pReceiver, (ma_uint64)heapSizeInBytes);
+    pReceiver->pSpeaker = pSpeaker;
+    pReceiver->payload = payload;
+    pReceiver->framesPerPacket = framesPerPacket;
+    pReceiver->payloadSizeInBytes = payloadSizeInBytes;
+    pReceiver->jitterInPackets = jitterInPackets;
+    pReceiver->slotCount = slotCount;
+    pReceiver->slotSizeInSamples = slotSizeInSamples;
+    pReceiver->pSlots = (ma_int16*)ma_offset_ptr(pReceiver, ma_align(sizeof(ma_rtp_receiver), MA_SIMD_ALIGNMENT));
+    pReceiver->pSlotSequenceNumbers = (ma_uint16*)ma_offset_ptr(pReceiver->pSlots, slotsSizeInBytes);
+    pReceiver->pSlotIsFilled = (ma_bool8*)ma_offset_ptr(pReceiver->pSlotSequenceNumbers, sequenceNumbersSizeInBytes);
+    pReceiver->pPacket = (ma_uint8*)ma_offset_ptr(pReceiver->pSlotIsFilled, isFilledSizeInBytes);
+
+    if (ma_socket_startup() != MA_SUCCESS) {
+        ma_aligned_free(pReceiver, &pSpeaker->allocationCallbacks);
+        return NULL;
+    }
+
+    /* A dual-stack IPv6 socket accepts both families; fall back to IPv4 where IPv6 is unavailable. */
+    struct sockaddr_storage address;
+    ma_zero_memory_64(&address, (ma_uint64)sizeof(address));
+    socklen_t addressSize;
+
+    pReceiver->socket = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    if (pReceiver->socket != MA_INVALID_SOCKET) {
+        int v6Only = 0;
+        setsockopt(pReceiver->socket, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&v6Only, sizeof(v6Only));
+
+        struct sockaddr_in6* pAddress6 = (struct sockaddr_in6*)&address;
+        pAddress6->sin6_family = AF_INET6;
+        pAddress6->sin6_addr = in6addr_any;
+        pAddress6->sin6_port = htons(port);
+        addressSize = sizeof(*pAddress6);
+    } else {
+        pReceiver->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+        struct sockaddr_in* pAddress4 = (struct sockaddr_in*)&address;
+        pAddress4->sin_family = AF_INET;
+        pAddress4->sin_addr.s_addr = htonl(INADDR_ANY);
+        pAddress4->sin_port = htons(port);
+        addressSize = sizeof(*pAddress4);
+    }
+
+    if (pReceiver->socket == MA_INVALID_SOCKET || bind(pReceiver->socket, (const struct sockaddr*)&address, addressSize) != 0 || getsockname(pReceiver->socket, (struct sockaddr*)&address, &addressSize) != 0) {
+        if (pReceiver->socket != MA_INVALID_SOCKET) {
+            ma_socket_close(pReceiver->socket);
+        }
+
+        ma_socket_shutdown();
+        ma_aligned_free(pReceiver, &pSpeaker->allocationCallbacks);
+        return NULL;
+    }
+
+    pReceiver->port = ntohs((address.ss_family == AF_INET6) ? ((struct sockaddr_in6*)&address)->sin6_port : ((struct sockaddr_in*)&address)->sin_port);
+
+    /* The timeout bounds how long destruction waits and how long a full speaker ring can hold packets back. */
+    ma_socket_set_receive_timeout(pReceiver->socket, (ma_uint32)ma_clamp(((ma_uint64)framesPerPacket * 1000 / pSpeaker->sampleRate) / 2, 1, 20));
+
+    if (ma_speaker_claim_producer(pSpeaker) != MA_SUCCESS) {
+        ma_socket_close(pReceiver->socket);
+        ma_socket_shutdown();
+        ma_aligned_free(pReceiver, &pSpeaker->allocationCallbacks);
+        return NULL;
+    }
+
+    ma_atomic_store_32(&pReceiver->isRunning, MA_TRUE);
+
+    if (ma_thread_create(&pReceiver->thread, ma_thread_priority_normal, 0, ma_rtp_receiver_thread, pReceiver, &pSpeaker->allocationCallbacks) != MA_SUCCESS) {
+        ma_speaker_release_producer(pSpeaker);
+        ma_socket_close(pReceiver->socket);
+        ma_socket_shutdown();
+        ma_aligned_free(pReceiver, &pSpeaker->allocationCallbacks);
+        return NULL;
+    }
+
+    return pReceiver;
+}
+
+/* Stops receiving and hands the write side of the ring back to ma_speaker_write(). Frames already queued still play. */
+MA_WRAPPER_API void ma_rtp_receiver_destroy(ma_rtp_receiver* pReceiver)
+{
+    if (pReceiver == NULL) {
+        return;
+    }
+
+    ma_speaker* pSpeaker = pReceiver->pSpeaker;
+
+    ma_atomic_store_32(&pReceiver->isRunning, MA_FALSE);
+    ma_thread_wait(&pReceiver->thread);
+
+    ma_speaker_release_producer(pSpeaker);
+    ma_socket_close(pReceiver->socket);
+    ma_socket_shutdown();
+    ma_aligned_free(pReceiver, &pSpeaker->allocationCallbacks);
+}
+
+MA_WRAPPER_API ma_uint16 ma_rtp_receiver_get_port(ma_rtp_receiver* pReceiver)
+{
+    if (pReceiver == NULL) {
+        return 0;
+    }
+
+    return pReceiver->port;
+}
+
+MA_WRAPPER_API ma_result ma_rtp_receiver_get_stats(ma_rtp_receiver* pReceiver, ma_rtp_receiver_stats* pStats)
+{
+    if (pReceiver == NULL || pStats == NULL) {
+        return MA_INVALID_ARGS;
+    }
+
+    pStats->packetsReceived = ma_atomic_load_64(&pReceiver->packetsReceived);
+    pStats->packetsPlayed = ma_atomic_load_64(&pReceiver->packetsPlayed);
+    pStats->packetsLost = ma_atomic_load_64(&pReceiver->packetsLost);
+    pStats->packetsLate = ma_atomic_load_64(&pReceiver->packetsLate);
+    pStats->packetsReordered = ma_atomic_load_64(&pReceiver->packetsReordered);
+    pStats->packetsDuplicated = ma_atomic_load_64(&pReceiver->packetsDuplicated);
+    pStats->packetsInvalid = ma_atomic_load_64(&pReceiver->packetsInvalid);
+    pStats->resyncCount = ma_atomic_load_32(&pReceiver->resyncCount);
+    pStats->packetsBuffered = ma_atomic_load_32(&pReceiver->packetsBuffered);
+
+    return MA_SUCCESS;
+}
+#endif
+
+#if !defined(_WIN32)
+static void ma_shared_ring_make_name(char* pOut, size_t outSize, const char* pName)
+{
+    /* POSIX wants exactly one leading slash. */
+    snprintf(pOut, outSize, "%s%s", (pName[0] == '/') ? "" : "/", pName);
+}
+
+static ma_bool32 ma_process_is_alive(ma_uint32 processId)
+{
+    return kill((pid_t)processId, 0) == 0 || errno != ESRCH;
 }
+#endif
 
-static ma_result ma_microphone_init(ma_microphone* pMicrophone, ma_uint32 sampleRate, ma_uint32 channels, ma_format format, ma_uint32 bufferSizeInFrames)
+/*
+Publishes the microphone's captured frames in a shared-memory segment named pName, holding capacityInFrames frames
+(rounded up to a power of two) for up to maxReaders attached processes. A stale segment of the same name is replaced.
+Only one shared ring per microphone; it must be destroyed before the microphone. Not available on Windows.
+*/
+MA_WRAPPER_API ma_shared_ring* ma_shared_ring_create(ma_microphone* pMicrophone, const char* pName, ma_uint32 capacityInFrames, ma_uint32 maxReaders)
 {
-    if (pMicrophone == NULL) {
-        return MA_INVALID_ARGS;
+#if !defined(_WIN32)
+    if (pMicrophone == NULL || pName == NULL || pName[0] == '\0' || maxReaders == 0 || maxReaders > 1024 || capacityInFrames == 0 || capacityInFrames > 0x40000000) {
+        return NULL;
     }
 
-    ma_zero_memory_64(pMicrophone, (ma_uint64)sizeof(*pMicrophone));
-
-    ma_result result = ma_init_context_for_platform(&pMicrophone->context);
-    if (result != MA_SUCCESS) {
-        return result;
+    if (ma_atomic_load_ptr(&pMicrophone->pSharedRing) != NULL) {
+        return NULL;
     }
 
-    ma_device_config config = ma_device_config_init(ma_device_type_capture);
-    config.dataCallback = ma_microphone_data_callback;
-    config.pUserData = pMicrophone;
-    config.capture.format = (format == ma_format_unknown) ? ma_format_f32 : format;
-    config.capture.channels = (channels == 0) ? 1 : channels;
-    config.sampleRate = sampleRate;
+    ma_uint32 capacity = 1024;
+    while (capacity < capacityInFrames) {
+        capacity *= 2;
+    }
 
-    result = ma_device_init(&pMicrophone->context, &config, &pMicrophone->device);
-    if (result != MA_SUCCESS) {
-        ma_context_uninit(&pMicrophone->context);
-        return result;
+    ma_shared_ring* pRing = (ma_shared_ring*)ma_malloc(sizeof(*pRing), &pMicrophone->allocationCallbacks);
+    if (pRing == NULL) {
+        return NULL;
     }
 
-    pMicrophone->format = (pMicrophone->device.capture.internalFormat != ma_format_unknown) ? pMicrophone->device.capture.internalFormat : config.capture.format;
-    pMicrophone->channels = (pMicrophone->device.capture.internalChannels != 0) ? pMicrophone->device.capture.internalChannels : config.capture.channels;
-    pMicrophone->sampleRate = (pMicrophone->device.sampleRate != 0) ? pMicrophone->device.sampleRate : ((sampleRate != 0) ? sampleRate : 48000);
-    pMicrophone->bytesPerFrame = ma_get_bytes_per_frame(pMicrophone->format, pMicrophone->channels);
+    ma_zero_memory_64(pRing, (ma_uint64)sizeof(*pRing));
+    pRing->pMicrophone = pMicrophone;
+    ma_shared_ring_make_name(pRing->name, sizeof(pRing->name), pName);
 
-    if (bufferSizeInFrames == 0) {
-        bufferSizeInFrames = ma_calculate_default_buffer_size(pMicrophone->sampleRate, pMicrophone->device.capture.internalPeriodSizeInFrames);
+    const size_t headerSizeInBytes = ma_align(sizeof(ma_shared_ring_header) + (size_t)maxReaders * sizeof(ma_shared_ring_reader), 4096);
+    pRing->segmentSizeInBytes = headerSizeInBytes + (size_t)capacity * pMicrophone->bytesPerFrame;
+
+    shm_unlink(pRing->name);
+    const int fd = shm_open(pRing->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        ma_free(pRing, &pMicrophone->allocationCallbacks);
+        return NULL;
     }
 
-    pMicrophone->bufferSizeInFrames = bufferSizeInFrames;
+    void* pSegment = MAP_FAILED;
+    if (ftruncate(fd, (off_t)pRing->segmentSizeInBytes) == 0) {
+        pSegment = mmap(NULL, pRing->segmentSizeInBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
 
-    result = ma_pcm_rb_init(pMicrophone->format, pMicrophone->channels, bufferSizeInFrames, NULL, NULL, &pMicrophone->ringBuffer);
-    if (result != MA_SUCCESS) {
-        ma_device_uninit(&pMicrophone->device);
-        ma_context_uninit(&pMicrophone->context);
-        return result;
+    close(fd);
+
+    if (pSegment == MAP_FAILED) {
+        shm_unlink(pRing->name);
+        ma_free(pRing, &pMicrophone->allocationCallbacks);
+        return NULL;
     }
 
-    return MA_SUCCESS;
+    /* ftruncate() leaves the segment zeroed, so every reader slot starts out free. */
+    pRing->pHeader = (ma_shared_ring_header*)pSegment;
+    pRing->pFrames = (ma_uint8*)ma_offset_ptr(pSegment, headerSizeInBytes);
+    pRing->pHeader->version = MA_SHARED_RING_VERSION;
+    pRing->pHeader->headerSizeInBytes = (ma_uint32)headerSizeInBytes;
+    pRing->pHeader->format = (ma_uint32)pMicrophone->format;
+    pRing->pHeader->channels = pMicrophone->channels;
+    pRing->pHeader->sampleRate = pMicrophone->sampleRate;
+    pRing->pHeader->bytesPerFrame = pMicrophone->bytesPerFrame;
+    pRing->pHeader->capacityInFrames = capacity;
+    pRing->pHeader->maxReaders = maxReaders;
+
+    /* The magic goes in last so a reader racing the setup never accepts a half-written header. */
+    ma_atomic_store_32(&pRing->pHeader->magic, MA_SHARED_RING_MAGIC);
+
+    ma_atomic_exchange_ptr(&pMicrophone->pSharedRing, pRing);
+
+    return pRing;
+#else
+    (void)pMicrophone;
+    (void)pName;
+    (void)capacityInFrames;
+    (void)maxReaders;
+    return NULL;
+#endif
 }
 
-static void ma_microphone_uninit(ma_microphone* pMicrophone)
+/* Stops publishing and removes the name. Attached readers keep their mapping and see ma_shared_ring_is_closed(). */
+MA_WRAPPER_API void ma_shared_ring_destroy(ma_shared_ring* pRing)
 {
-    if (pMicrophone == NULL) {
+#if !defined(_WIN32)
+    if (pRing == NULL || pRing->pMicrophone == NULL) {
         return;
     }
 
-    if (pMicrophone->isStarted) {
-        ma_device_stop(&pMicrophone->device);
-        pMicrophone->isStarted = MA_FALSE;
-    }
+    ma_microphone* pMicrophone = pRing->pMicrophone;
 
-    ma_pcm_rb_uninit(&pMicrophone->ringBuffer);
-    ma_device_uninit(&pMicrophone->device);
-    ma_context_uninit(&pMicrophone->context);
+    ma_atomic_exchange_ptr(&pMicrophone->pSharedRing, NULL);
+    ma_microphone_wait_for_callback(pMicrophone);
+
+    ma_atomic_store_32(&pRing->pHeader->isWriterClosed, MA_TRUE);
+    munmap(pRing->pHeader, pRing->segmentSizeInBytes);
+    shm_unlink(pRing->name);
+    ma_free(pRing, &pMicrophone->allocationCallbacks);
+#else
+    (void)pRing;
+#endif
 }
 
-static ma_result ma_speaker_init(ma_speaker* pSpeaker, ma_uint32 sampleRate, ma_uint32 channels, ma_format format, ma_uint32 bufferSizeInFrames)
+/* Attaches to a ring published by ma_shared_ring_create(), possibly in another process. Reading starts at the newest frame. */
+MA_WRAPPER_API ma_shared_ring* ma_shared_ring_open(const char* pName)
 {
-    if (pSpeaker == NULL) {
-        return MA_INVALID_ARGS;
+#if !defined(_WIN32)
+    if (pName == NULL || pName[0] == '\0') {
+        return NULL;
     }
 
-    ma_zero_memory_64(pSpeaker, (ma_uint64)sizeof(*pSpeaker));
-
-    ma_result result = ma_init_context_for_platform(&pSpeaker->context);
-    if (result != MA_SUCCESS) {
-        return result;
+    ma_shared_ring* pRing = (ma_shared_ring*)ma_malloc(sizeof(*pRing), NULL);
+    if (pRing == NULL) {
+        return NULL;
     }
 
-    ma_device_config config = ma_device_config_init(ma_device_type_playback);
-    config.dataCallback = ma_speaker_data_callback;
-    config.pUserData = pSpeaker;
-    config.playback.format = (format == ma_format_unknown) ? ma_format_f32 : format;
-    config.playback.channels = (channels == 0) ? 2 : channels;
-    config.sampleRate = sampleRate;
+    ma_zero_memory_64(pRing, (ma_uint64)sizeof(*pRing));
+    ma_shared_ring_make_name(pRing->name, sizeof(pRing->name), pName);
 
-    result = ma_device_init(&pSpeaker->context, &config, &pSpeaker->device);
-    if (result != MA_SUCCESS) {
-        ma_context_uninit(&pSpeaker->context);
-        return result;
+    const int fd = shm_open(pRing->name, O_RDWR, 0);
+    if (fd < 0) {
+        ma_free(pRing, NULL);
+        return NULL;
     }
 
-    pSpeaker->format = (pSpeaker->device.playback.internalFormat != ma_format_unknown) ? pSpeaker->device.playback.internalFormat : config.playback.format;
-    pSpeaker->channels = (pSpeaker->device.playback.internalChannels != 0) ? pSpeaker->device.playback.internalChannels : config.playback.channels;
-    pSpeaker->sampleRate = (pSpeaker->device.sampleRate != 0) ? pSpeaker->device.sampleRate : ((sampleRate != 0) ? sampleRate : 48000);
-    pSpeaker->bytesPerFrame = ma_get_bytes_per_frame(pSpeaker->format, pSpeaker->channels);
-
-    if (bufferSizeInFrames == 0) {
-        bufferSizeInFrames = ma_calculate_default_buffer_size(pSpeaker->sampleRate, pSpeaker->device.playback.internalPeriodSizeInFrames);
+    struct stat info;
+    void* pSegment = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(ma_shared_ring_header)) {
+        pRing->segmentSizeInBytes = (size_t)info.st_size;
+        pSegment = mmap(NULL, pRing->segmentSizeInBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     }
 
-    pSpeaker->bufferSizeInFrames = bufferSizeInFrames;
+    close(fd);
 
-    result = ma_pcm_rb_init(pSpeaker->format, pSpeaker->channels, bufferSizeInFrames, NULL, NULL, &pSpeaker->ringBuffer);
-    if (result != MA_SUCCESS) {
-        ma_device_uninit(&pSpeaker->device);
-        ma_context_uninit(&pSpeaker->context);
-        return result;
+    if (pSegment == MAP_FAILED) {
+        ma_free(pRing, NULL);
+        return NULL;
     }
 
-    return MA_SUCCESS;
-}
-
-static void ma_speaker_uninit(ma_speaker* pSpeaker)
-{
-    if (pSpeaker == NULL) {
-        return;
+    ma_shared_ring_header* pHeader = (ma_shared_ring_header*)pSegment;
+    if (ma_atomic_load_32(&pHeader->magic) != MA_SHARED_RING_MAGIC || pHeader->version != MA_SHARED_RING_VERSION || pHeader->capacityInFrames == 0 || (pHeader->capacityInFrames & (pHeader->capacityInFrames - 1)) != 0 ||
+        pHeader->headerSizeInBytes < sizeof(ma_shared_ring_header) + (size_t)pHeader->maxReaders * sizeof(ma_shared_ring_reader) ||
+        pRing->segmentSizeInBytes < pHeader->headerSizeInBytes + (size_t)pHeader->capacityInFrames * pHeader->bytesPerFrame) {
+        munmap(pSegment, pRing->segmentSizeInBytes);
+        ma_free(pRing, NULL);
+        return NULL;
     }
 
-    if (pSpeaker->isStarted) {
-        ma_device_stop(&pSpeaker->device);
-        pSpeaker->isStarted = MA_FALSE;
-    }
+    pRing->pHeader = pHeader;
+    pRing->pFrames = (ma_uint8*)ma_offset_ptr(pSegment, pHeader->headerSizeInBytes);
 
-    ma_pcm_rb_uninit(&pSpeaker->ringBuffer);
-    ma_device_uninit(&pSpeaker->device);
-    ma_context_uninit(&pSpeaker->context);
-}
+    const ma_uint32 processId = (ma_uint32)getpid();
+    ma_shared_ring_reader* pReaders = (ma_shared_ring_reader*)ma_offset_ptr(pSegment, sizeof(ma_shared_ring_header));
+    for (ma_uint32 iReader = 0; iReader < pHeader->maxReaders && pRing->pReader == NULL; ++iReader) {
+        ma_uint32 expected = ma_atomic_load_32(&pReaders[iReader].processId);
+        if (expected != 0 && ma_process_is_alive(expected)) {
+            continue;
+        }
 
-MA_WRAPPER_API ma_microphone* ma_microphone_create(ma_uint32 sampleRate, ma_uint32 channels, ma_format format, ma_uint32 bufferSizeInFrames)
-{
-    ma_microphone* pMicrophone = (ma_microphone*)ma_malloc(sizeof(*pMicrophone), NULL);
-    if (pMicrophone == NULL) {
-        return NULL;
+        if (ma_atomic_compare_exchange_strong_32(&pReaders[iReader].processId, &expected, processId)) {
+            pRing->pReader = &pReaders[iReader];
+        }
     }
 
-    if (ma_microphone_init(pMicrophone, sampleRate, channels, format, bufferSizeInFrames) != MA_SUCCESS) {
-        ma_free(pMicrophone, NULL);
+    if (pRing->pReader == NULL) {
+        munmap(pSegment, pRing->segmentSizeInBytes);
+        ma_free(pRing, NULL);
         return NULL;
     }
 
-    return pMicrophone;
+    pRing->readIndex = ma_atomic_load_explicit_64(&pHeader->writeIndex, ma_atomic_memory_order_acquire);
+    ma_atomic_store_64(&pRing->pReader->readIndex, pRing->readIndex);
+    ma_atomic_store_64(&pRing->pReader->droppedFrames, 0);
+
+    return pRing;
+#else
+    (void)pName;
+    return NULL;
+#endif
 }
 
-MA_WRAPPER_API void ma_microphone_destroy(ma_microphone* pMicrophone)
+MA_WRAPPER_API void ma_shared_ring_close(ma_shared_ring* pRing)
 {
-    if (pMicrophone == NULL) {
+#if !defined(_WIN32)
+    if (pRing == NULL || pRing->pReader == NULL) {
         return;
     }
 
-    ma_microphone_uninit(pMicrophone);
-    ma_free(pMicrophone, NULL);
+    ma_atomic_store_32(&pRing->pReader->processId, 0);
+    munmap(pRing->pHeader, pRing->segmentSizeInBytes);
+    ma_free(pRing, NULL);
+#else
+    (void)pRing;
+#endif
 }
 
-MA_WRAPPER_API ma_result ma_microphone_start(ma_microphone* pMicrophone)
+/*
+Returns a pointer straight into the shared segment for up to *pFrameCount frames. The region ends at the wrap point,
+so it may hold fewer frames than are available. When the writer has lapped the reader, the cursor first jumps to
+half a ring behind the newest frame and the skipped frames are counted as dropped.
+*/
+MA_WRAPPER_API ma_result ma_shared_ring_acquire_read(ma_shared_ring* pRing, ma_uint32* pFrameCount, const void** ppFrames)
 {
-    if (pMicrophone == NULL) {
+    if (pRing == NULL || pRing->pReader == NULL || pFrameCount == NULL || ppFrames == NULL) {
         return MA_INVALID_ARGS;
     }
 
-    if (pMicrophone->isStarted) {
-        return MA_SUCCESS;
-    }
+    ma_shared_ring_header* pHeader = pRing->pHeader;
+    const ma_uint32 capacity = pHeader->capacityInFrames;
+    const ma_uint64 writeIndex = ma_atomic_load_explicit_64(&pHeader->writeIndex, ma_atomic_memory_order_acquire);
 
-    ma_result result = ma_device_start(&pMicrophone->device);
-    if (result == MA_SUCCESS) {
-        pMicrophone->isStarted = MA_TRUE;
+    if (writeIndex - pRing->readIndex > capacity - capacity / 4) {
+        const ma_uint64 newReadIndex = writeIndex - capacity / 2;
+        ma_atomic_fetch_add_64(&pRing->pReader->droppedFrames, newReadIndex - pRing->readIndex);
+        pRing->readIndex = newReadIndex;
     }
 
-    return result;
+    const ma_uint32 offset = (ma_uint32)(pRing->readIndex & (capacity - 1));
+    const ma_uint32 frameCount = (ma_uint32)ma_min(ma_min((ma_uint64)*pFrameCount, writeIndex - pRing->readIndex), (ma_uint64)(capacity - offset));
+
+    *ppFrames = pRing->pFrames + (size_t)offset * pHeader->bytesPerFrame;
+    *pFrameCount = frameCount;
+    pRing->acquiredFrameCount = frameCount;
+
+    return MA_SUCCESS;
 }
 
-MA_WRAPPER_API ma_result ma_microphone_stop(ma_microphone* pMicrophone)
+/*
+Releases frames obtained from ma_shared_ring_acquire_read(). Returns MA_INVALID_DATA if the writer overwrote any of
+them while they were being read; they are still consumed and counted as dropped.
+*/
+MA_WRAPPER_API ma_result ma_shared_ring_commit_read(ma_shared_ring* pRing, ma_uint32 frameCount)
 {
-    if (pMicrophone == NULL) {
+    if (pRing == NULL || pRing->pReader == NULL || frameCount > pRing->acquiredFrameCount) {
         return MA_INVALID_ARGS;
     }
 
-    if (!pMicrophone->isStarted) {
-        return MA_SUCCESS;
-    }
+    ma_atomic_thread_fence(ma_atomic_memory_order_seq_cst);
+    const ma_uint64 reserveIndex = ma_atomic_load_explicit_64(&pRing->pHeader->reserveIndex, ma_atomic_memory_order_relaxed);
+    const ma_bool32 isIntact = pRing->readIndex + pRing->pHeader->capacityInFrames >= reserveIndex;
 
-    ma_result result = ma_device_stop(&pMicrophone->device);
-    if (result == MA_SUCCESS) {
-        pMicrophone->isStarted = MA_FALSE;
+    pRing->readIndex += frameCount;
+    pRing->acquiredFrameCount = 0;
+    ma_atomic_store_64(&pRing->pReader->readIndex, pRing->readIndex);
+
+    if (!isIntact) {
+        ma_atomic_fetch_add_64(&pRing->pReader->droppedFrames, frameCount);
+        return MA_INVALID_DATA;
     }
 
-    return result;
+    return MA_SUCCESS;
 }
 
-MA_WRAPPER_API ma_uint32 ma_microphone_read(ma_microphone* pMicrophone, void* pFramesOut, ma_uint32 frameCount)
+/* Copying read for callers that cannot work in place. Returns the number of intact frames written to pFramesOut. */
+MA_WRAPPER_API ma_uint32 ma_shared_ring_read(ma_shared_ring* pRing, void* pFramesOut, ma_uint32 frameCount)
 {
-    if (pMicrophone == NULL || pFramesOut == NULL || frameCount == 0) {
+    if (pRing == NULL || pRing->pReader == NULL || pFramesOut == NULL) {
         return 0;
     }
 
-    ma_uint8* pDst = (ma_uint8*)pFramesOut;
+    const ma_uint32 bytesPerFrame = pRing->pHeader->bytesPerFrame;
     ma_uint32 framesReadTotal = 0;
 
     while (framesReadTotal < frameCount) {
         ma_uint32 framesToRead = frameCount - framesReadTotal;
-        void* pReadPtr = NULL;
+        const void* pFrames = NULL;
 
-        if (ma_pcm_rb_acquire_read(&pMicrophone->ringBuffer, &framesToRead, &pReadPtr) != MA_SUCCESS || framesToRead == 0) {
+        if (ma_shared_ring_acquire_read(pRing, &framesToRead, &pFrames) != MA_SUCCESS || framesToRead == 0) {
             break;
         }
 
-        ma_copy_memory_64(pDst + (framesReadTotal * pMicrophone->bytesPerFrame), pReadPtr, (ma_uint64)framesToRead * pMicrophone->bytesPerFrame);
-        ma_pcm_rb_commit_read(&pMicrophone->ringBuffer, framesToRead);
-        framesReadTotal += framesToRead;
+        MA_COPY_MEMORY(ma_offset_ptr(pFramesOut, framesReadTotal * bytesPerFrame), pFrames, (size_t)framesToRead * bytesPerFrame);
+
+        /* Torn frames are dropped from the output; the next acquire has already skipped past the writer. */
+        if (ma_shared_ring_commit_read(pRing, framesToRead) == MA_SUCCESS) {
+            framesReadTotal += framesToRead;
+        }
     }
 
     return framesReadTotal;
 }
 
-MA_WRAPPER_API ma_uint32 ma_microphone_available_frames(ma_microphone* pMicrophone)
+MA_WRAPPER_API ma_uint32 ma_shared_ring_available_frames(ma_shared_ring* pRing)
 {
-    if (pMicrophone == NULL) {
+    if (pRing == NULL || pRing->pReader == NULL) {
         return 0;
     }
 
-    return ma_pcm_rb_available_read(&pMicrophone->ringBuffer);
-}
-
-MA_WRAPPER_API ma_format ma_microphone_get_format(ma_microphone* pMicrophone)
-{
-    if (pMicrophone == NULL) {
-        return ma_format_unknown;
-    }
-
-    return pMicrophone->format;
+    const ma_uint64 framesAvailable = ma_atomic_load_64(&pRing->pHeader->writeIndex) - pRing->readIndex;
+    return (ma_uint32)ma_min(framesAvailable, (ma_uint64)pRing->pHeader->capacityInFrames);
 }
 
-MA_WRAPPER_API ma_uint32 ma_microphone_get_channels(ma_microphone* pMicrophone)
+MA_WRAPPER_API ma_uint64 ma_shared_ring_get_dropped_frames(ma_shared_ring* pRing)
 {
-    if (pMicrophone == NULL) {
+    if (pRing == NULL || pRing->pReader == NULL) {
         return 0;
     }
 
-    return pMicrophone->channels;
+    return ma_atomic_load_64(&pRing->pReader->droppedFrames);
 }
 
-MA_WRAPPER_API ma_uint32 ma_microphone_get_sample_rate(ma_microphone* pMicrophone)
+MA_WRAPPER_API ma_bool32 ma_shared_ring_is_closed(ma_shared_ring* pRing)
 {
-    if (pMicrophone == NULL) {
-        return 0;
+    if (pRing == NULL) {
+        return MA_TRUE;
     }
 
-    return pMicrophone->sampleRate;
+    return ma_atomic_load_32(&pRing->pHeader->isWriterClosed);
 }
 
-MA_WRAPPER_API ma_speaker* ma_speaker_create(ma_uint32 sampleRate, ma_uint32 channels, ma_format format, ma_uint32 bufferSizeInFrames)
+/* Number of readers currently attached, from either side. */
+MA_WRAPPER_API ma_uint32 ma_shared_ring_get_reader_count(ma_shared_ring* pRing)
 {
-    ma_speaker* pSpeaker = (ma_speaker*)ma_malloc(sizeof(*pSpeaker), NULL);
-    if (pSpeaker == NULL) {
-        return NULL;
-    }
-
-    if (ma_speaker_init(pSpeaker, sampleRate, channels, format, bufferSizeInFrames) != MA_SUCCESS) {
-        ma_free(pSpeaker, NULL);
-        return NULL;
+    if (pRing == NULL) {
+        return 0;
     }
 
-    return pSpeaker;
-}
+    ma_shared_ring_reader* pReaders = (ma_shared_ring_reader*)ma_offset_ptr(pRing->pHeader, sizeof(ma_shared_ring_header));
+    ma_uint32 readerCount = 0;
 
-MA_WRAPPER_API void ma_speaker_destroy(ma_speaker* pSpeaker)
-{
-    if (pSpeaker == NULL) {
-        return;
+    for (ma_uint32 iReader = 0; iReader < pRing->pHeader->maxReaders; ++iReader) {
+        readerCount += (ma_atomic_load_32(&pReaders[iReader].processId) != 0);
     }
 
-    ma_speaker_uninit(pSpeaker);
-    ma_free(pSpeaker, NULL);
+    return readerCount;
 }
 
-MA_WRAPPER_API ma_result ma_speaker_start(ma_speaker* pSpeaker)
+MA_WRAPPER_API ma_format ma_shared_ring_get_format(ma_shared_ring* pRing)
 {
-    if (pSpeaker == NULL) {
-        return MA_INVALID_ARGS;
-    }
-
-    if (pSpeaker->isStarted) {
-        return MA_SUCCESS;
-    }
-
-    ma_result result = ma_device_start(&pSpeaker->device);
-    if (result == MA_SUCCESS) {
-        pSpeaker->isStarted = MA_TRUE;
+    if (pRing == NULL) {
+        return ma_format_unknown;
     }
 
-    return result;
+    return (ma_format)pRing->pHeader->format;
 }
 
-MA_WRAPPER_API ma_result ma_speaker_stop(ma_speaker* pSpeaker)
+MA_WRAPPER_API ma_uint32 ma_shared_ring_get_channels(ma_shared_ring* pRing)
 {
-    if (pSpeaker == NULL) {
-        return MA_INVALID_ARGS;
-    }
-
-    if (!pSpeaker->isStarted) {
-        return MA_SUCCESS;
-    }
-
-    ma_result result = ma_device_stop(&pSpeaker->device);
-    if (result == MA_SUCCESS) {
-        pSpeaker->isStarted = MA_FALSE;
+    if (pRing == NULL) {
+        return 0;
     }
 
-    return result;
+    return pRing->pHeader->channels;
 }
 
-MA_WRAPPER_API ma_uint32 ma_speaker_write(ma_speaker* pSpeaker, const void* pFrames, ma_uint32 frameCount)
+MA_WRAPPER_API ma_uint32 ma_shared_ring_get_sample_rate(ma_shared_ring* pRing)
 {
-    if (pSpeaker == NULL || pFrames == NULL || frameCount == 0) {
+    if (pRing == NULL) {
         return 0;
     }
 
-    const ma_uint8* pSrc = (const ma_uint8*)pFrames;
-    ma_uint32 framesWrittenTotal = 0;
-
-    while (framesWrittenTotal < frameCount) {
-        ma_uint32 framesToWrite = frameCount - framesWrittenTotal;
-        void* pWritePtr = NULL;
-
-        if (ma_pcm_rb_acquire_write(&pSpeaker->ringBuffer, &framesToWrite, &pWritePtr) != MA_SUCCESS || framesToWrite == 0) {
-            break;
-        }
-
-        ma_copy_memory_64(pWritePtr, pSrc + (framesWrittenTotal * pSpeaker->bytesPerFrame), (ma_uint64)framesToWrite * pSpeaker->bytesPerFrame);
-        ma_pcm_rb_commit_write(&pSpeaker->ringBuffer, framesToWrite);
-        framesWrittenTotal += framesToWrite;
-    }
-
-    return framesWrittenTotal;
+    return pRing->pHeader->sampleRate;
 }
 
-MA_WRAPPER_API ma_uint32 ma_speaker_available_frames(ma_speaker* pSpeaker)
+MA_WRAPPER_API ma_bool32 ma_rt_audit_is_enabled(void)
 {
-    if (pSpeaker == NULL) {
-        return 0;
-    }
-
-    return ma_pcm_rb_available_write(&pSpeaker->ringBuffer);
+#if defined(MA_RT_AUDIT)
+    return MA_TRUE;
+#else
+    return MA_FALSE;
+#endif
 }
 
-MA_WRAPPER_API ma_format ma_speaker_get_format(ma_speaker* pSpeaker)
+/* Pass ma_rt_violation_file_io + 1 as the type, or any larger value, for the total over all types. */
+MA_WRAPPER_API ma_uint64 ma_rt_audit_get_violation_count(ma_uint32 type)
 {
-    if (pSpeaker == NULL) {
-        return ma_format_unknown;
+#if defined(MA_RT_AUDIT)
+    if (type <= ma_rt_violation_file_io) {
+        return ma_atomic_load_64(&g_maRtAuditViolationCounts[type]);
     }
 
-    return pSpeaker->format;
-}
-
-MA_WRAPPER_API ma_uint32 ma_speaker_get_channels(ma_speaker* pSpeaker)
-{
-    if (pSpeaker == NULL) {
-        return 0;
+    ma_uint64 total = 0;
+    for (ma_uint32 iType = 0; iType <= ma_rt_violation_file_io; ++iType) {
+        total += ma_atomic_load_64(&g_maRtAuditViolationCounts[iType]);
     }
 
-    return pSpeaker->channels;
+    return total;
+#else
+    (void)type;
+    return 0;
+#endif
 }
 
-MA_WRAPPER_API ma_uint32 ma_speaker_get_sample_rate(ma_speaker* pSpeaker)
+/* Copies the first recorded violations, up to MA_RT_AUDIT_MAX_RECORDS, and returns how many were copied. */
+MA_WRAPPER_API ma_uint32 ma_rt_audit_get_violations(ma_rt_violation* pViolations, ma_uint32 maxViolations)
 {
-    if (pSpeaker == NULL) {
+#if defined(MA_RT_AUDIT)
+    if (pViolations == NULL) {
         return 0;
     }
 
-    return pSpeaker->sampleRate;
-}
-
-MA_WRAPPER_API void ma_speaker_flush(ma_speaker* pSpeaker)
-{
-    if (pSpeaker == NULL) {
-        return;
-    }
+    const ma_uint32 recordCount = ma_min(ma_min(ma_atomic_load_32(&g_maRtAuditRecordCount), MA_RT_AUDIT_MAX_RECORDS), maxViolations);
+    ma_copy_memory_64(pViolations, g_maRtAuditRecords, (ma_uint64)recordCount * sizeof(ma_rt_violation));
 
-    ma_pcm_rb_reset(&pSpeaker->ringBuffer);
+    return recordCount;
+#else
+    (void)pViolations;
+    (void)maxViolations;
+    return 0;
+#endif
 }
 
-MA_WRAPPER_API void ma_microphone_flush(ma_microphone* pMicrophone)
+/* Not synchronized with callbacks that are recording; reset while the devices are stopped. */
+MA_WRAPPER_API void ma_rt_audit_reset(void)
 {
-    if (pMicrophone == NULL) {
-        return;
+#if defined(MA_RT_AUDIT)
+    for (ma_uint32 iType = 0; iType <= ma_rt_violation_file_io; ++iType) {
+        ma_atomic_store_64(&g_maRtAuditViolationCounts[iType], 0);
     }
 
-    ma_pcm_rb_reset(&pMicrophone->ringBuffer);
+    ma_zero_memory_64(g_maRtAuditRecords, sizeof(g_maRtAuditRecords));
+    ma_atomic_store_32(&g_maRtAuditRecordCount, 0);
+#endif
 }
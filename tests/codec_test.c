@@ -0,0 +1,66 @@
+/*
+G.711 round-trip test. Every s16 value is encoded and decoded again with mu-law and A-law, and must come back with the
+same sign and within the codec's quantization error. Full scale is checked explicitly.
+
+    gcc tests/codec_test.c -o codec_test -lpthread -lm -ldl && ./codec_test
+*/
+#include "../miniaudio.c"
+
+#include <stdio.h>
+
+static int test_failed(const char* pMessage, ma_int32 input, ma_int32 output)
+{
+    printf("FAILED: %s (%d decoded as %d)\n", pMessage, (int)input, (int)output);
+    return 1;
+}
+
+static int test_g711_round_trip(ma_codec codec, const char* pName)
+{
+    static ma_int16 input[65536];
+    static ma_uint8 encoded[65536];
+    static ma_int16 output[65536];
+
+    for (ma_uint32 i = 0; i < 65536; ++i) {
+        input[i] = (ma_int16)((ma_int32)i - 32768);
+    }
+
+    if (ma_codec_encode_s16(codec, 1, 65536, input, 1, encoded) != 1 || ma_codec_decode_s16(codec, 1, 65536, encoded, 1, output) != 1) {
+        return test_failed("could not encode and decode", 0, 0);
+    }
+
+    for (ma_uint32 i = 0; i < 65536; ++i) {
+        const ma_int32 x = input[i];
+        const ma_int32 y = output[i];
+
+        /* Both laws keep the error below 1/16 of the magnitude, plus the step size of the smallest segments. */
+        if (ma_abs(y - x) > ma_abs(x) / 16 + 128) {
+            return test_failed(pName, x, y);
+        }
+
+        if ((x > 256 && y <= 0) || (x < -256 && y >= 0)) {
+            return test_failed(pName, x, y);
+        }
+    }
+
+    /* Full scale used to wrap into the near-zero codes. */
+    const ma_int16 fullScale[4] = { 32767, 32700, -32767, -32768 };
+    for (ma_uint32 i = 0; i < ma_countof(fullScale); ++i) {
+        const ma_int32 y = output[(ma_int32)fullScale[i] + 32768];
+        if (ma_abs(y) < 30000 || (y > 0) != (fullScale[i] > 0)) {
+            return test_failed(pName, fullScale[i], y);
+        }
+    }
+
+    printf("%s round trip OK\n", pName);
+    return 0;
+}
+
+int main(void)
+{
+    if (test_g711_round_trip(ma_codec_ulaw, "mu-law") != 0 || test_g711_round_trip(ma_codec_alaw, "A-law") != 0) {
+        return 1;
+    }
+
+    printf("PASSED\n");
+    return 0;
+}
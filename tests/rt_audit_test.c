@@ -0,0 +1,178 @@
+/*
+Real-time safety audit test. Runs a headless microphone and speaker with every callback-side stage enabled and fails if
+anything on the callback path allocates, locks, sleeps or does file I/O.
+
+    gcc -DMA_RT_AUDIT tests/rt_audit_test.c -o rt_audit_test -lpthread -lm -ldl && ./rt_audit_test
+*/
+#include "../miniaudio.c"
+
+#include <stdio.h>
+
+#define TEST_SAMPLE_RATE    48000
+#define TEST_CHANNELS       2
+#define TEST_PERIOD_IN_MS   10
+#define TEST_ITERATIONS     150
+
+static int test_failed(const char* pMessage)
+{
+    printf("FAILED: %s\n", pMessage);
+    return 1;
+}
+
+static void test_print_violations(void)
+{
+    ma_rt_violation violations[MA_RT_AUDIT_MAX_RECORDS];
+    const ma_uint32 count = ma_rt_audit_get_violations(violations, MA_RT_AUDIT_MAX_RECORDS);
+
+    for (ma_uint32 i = 0; i < count; ++i) {
+        printf("  violation %u: %s (type %d)\n", i, violations[i].pFunction, (int)violations[i].type);
+    #if defined(__GLIBC__) || defined(__APPLE__)
+        backtrace_symbols_fd(violations[i].pBacktrace, (int)violations[i].backtraceSize, 1);
+    #endif
+    }
+}
+
+/* The detector must see what it is meant to catch before a clean run means anything. */
+static int test_detector(void)
+{
+    ma_rt_audit_reset();
+
+    MA_RT_AUDIT_ENTER_CALLBACK();
+    {
+        ma_free(ma_malloc(16, NULL), NULL);
+        ma_sleep(1);
+    }
+    MA_RT_AUDIT_LEAVE_CALLBACK();
+
+    /* Outside a callback nothing is reported. */
+    ma_free(ma_malloc(16, NULL), NULL);
+
+    if (ma_rt_audit_get_violation_count(ma_rt_violation_allocation) != 2) {
+        return test_failed("allocation inside a callback was not reported");
+    }
+
+    if (ma_rt_audit_get_violation_count(ma_rt_violation_sleep) == 0) {
+        return test_failed("sleep inside a callback was not reported");
+    }
+
+    ma_rt_audit_reset();
+    return 0;
+}
+
+static int test_callbacks(void)
+{
+    const ma_filter_stage_config micFilters[2] = {
+        ma_filter_stage_config_init(ma_filter_type_highpass, 80),
+        ma_filter_stage_config_init(ma_filter_type_peak, 1000)
+    };
+    const ma_filter_stage_config speakerFilters[1] = {
+        ma_filter_stage_config_init(ma_filter_type_lowpass, 8000)
+    };
+
+    ma_microphone_config micConfig = ma_microphone_config_init(TEST_SAMPLE_RATE, TEST_CHANNELS, ma_format_f32, 0);
+    micConfig.isHeadless = MA_TRUE;
+    micConfig.pFilters = micFilters;
+    micConfig.filterCount = 2;
+
+    ma_speaker_config speakerConfig = ma_speaker_config_init(TEST_SAMPLE_RATE, TEST_CHANNELS, ma_format_f32, 0);
+    speakerConfig.isHeadless = MA_TRUE;
+    speakerConfig.pFilters = speakerFilters;
+    speakerConfig.filterCount = 1;
+    speakerConfig.prefillInFrames = TEST_SAMPLE_RATE / 50;
+    speakerConfig.fadeLengthInMilliseconds = 5;
+    speakerConfig.concealUnderruns = MA_TRUE;
+
+    ma_microphone* pMicrophone = ma_microphone_create_ex(&micConfig);
+    ma_speaker* pSpeaker = ma_speaker_create_ex(&speakerConfig);
+    if (pMicrophone == NULL || pSpeaker == NULL) {
+        return test_failed("could not create headless devices");
+    }
+
+    ma_microphone_vad_config vadConfig = ma_microphone_vad_config_init();
+    ma_microphone_agc_config agcConfig = ma_microphone_agc_config_init();
+    if (ma_microphone_enable_vad(pMicrophone, &vadConfig) != MA_SUCCESS || ma_microphone_enable_agc(pMicrophone, &agcConfig) != MA_SUCCESS) {
+        return test_failed("could not enable VAD and AGC");
+    }
+
+    ma_microphone_reader* pReader = ma_microphone_reader_create(pMicrophone, ma_format_s16, 1, 16000, 0);
+    if (pReader == NULL) {
+        return test_failed("could not create reader");
+    }
+
+    int micFd;
+    int speakerFd;
+    ma_microphone_enable_readiness_fd(pMicrophone, TEST_SAMPLE_RATE / 100, &micFd);
+    ma_speaker_enable_readiness_fd(pSpeaker, TEST_SAMPLE_RATE / 20, &speakerFd);
+
+    /* Set up everything before the devices start so that only the callbacks run while auditing. */
+    static float frames[TEST_SAMPLE_RATE * TEST_CHANNELS];
+    for (ma_uint32 iFrame = 0; iFrame < TEST_SAMPLE_RATE; ++iFrame) {
+        const float sample = 0.25f * (float)sin(2 * MA_PI * 440 * iFrame / TEST_SAMPLE_RATE);
+        for (ma_uint32 iChannel = 0; iChannel < TEST_CHANNELS; ++iChannel) {
+            frames[iFrame * TEST_CHANNELS + iChannel] = sample;
+        }
+    }
+
+    static ma_int16 readerFrames[16000];
+
+    ma_rt_audit_reset();
+
+    if (ma_microphone_start(pMicrophone) != MA_SUCCESS || ma_speaker_start(pSpeaker) != MA_SUCCESS) {
+        return test_failed("could not start headless devices");
+    }
+
+    for (ma_uint32 iIteration = 0; iIteration < TEST_ITERATIONS; ++iIteration) {
+        /* Starve the speaker now and then so that underrun concealment and fades run too. */
+        if ((iIteration % 40) < 30) {
+            ma_speaker_write(pSpeaker, frames, ma_min(ma_speaker_available_frames(pSpeaker), TEST_SAMPLE_RATE / 50));
+        }
+
+        if (iIteration == TEST_ITERATIONS / 2) {
+            ma_speaker_flush(pSpeaker);
+        }
+
+        ma_microphone_read(pMicrophone, frames, ma_min(ma_microphone_available_frames(pMicrophone), TEST_SAMPLE_RATE / 2));
+        ma_microphone_reader_read(pReader, readerFrames, ma_countof(readerFrames));
+        ma_microphone_acknowledge_readiness(pMicrophone);
+        ma_speaker_acknowledge_readiness(pSpeaker);
+
+        ma_sleep(TEST_PERIOD_IN_MS);
+    }
+
+    ma_speaker_stop(pSpeaker);
+    ma_microphone_stop(pMicrophone);
+
+    const ma_uint64 violationCount = ma_rt_audit_get_violation_count(ma_rt_violation_file_io + 1);
+    const ma_uint64 framesPlayed = ma_atomic_load_64(&ma_speaker_get_status(pSpeaker)->deviceFrames);
+    const ma_uint64 framesCaptured = ma_atomic_load_64(&ma_microphone_get_status(pMicrophone)->deviceFrames);
+
+    ma_microphone_reader_destroy(pReader);
+    ma_microphone_destroy(pMicrophone);
+    ma_speaker_destroy(pSpeaker);
+
+    if (framesPlayed == 0 || framesCaptured == 0) {
+        return test_failed("the headless devices never called back");
+    }
+
+    if (violationCount != 0) {
+        test_print_violations();
+        return test_failed("the data callbacks made real-time unsafe calls");
+    }
+
+    printf("captured %llu and played %llu frames with no violations\n", (unsigned long long)framesCaptured, (unsigned long long)framesPlayed);
+    return 0;
+}
+
+int main(void)
+{
+    if (!ma_rt_audit_is_enabled()) {
+        return test_failed("build with -DMA_RT_AUDIT");
+    }
+
+    if (test_detector() != 0 || test_callbacks() != 0) {
+        return 1;
+    }
+
+    printf("PASSED\n");
+    return 0;
+}
@@ -0,0 +1,212 @@
+/*
+RTP loopback test. A headless microphone feeds a known signal, full scale included, to an RTP sender on 127.0.0.1.
+The test relays the packets to an RTP receiver, checking every header on the way and swapping one pair to exercise
+reordering. The audio the receiver queues on a headless speaker must then match the input. Runs for L16 and mu-law.
+
+    gcc tests/rtp_loopback_test.c -o rtp_loopback_test -lpthread -lm -ldl && ./rtp_loopback_test
+*/
+#include "../miniaudio.c"
+
+#include <stdio.h>
+
+#define TEST_SAMPLE_RATE        8000
+#define TEST_FRAMES_PER_PACKET  160
+#define TEST_PACKET_COUNT       20
+#define TEST_FRAME_COUNT        (TEST_FRAMES_PER_PACKET * TEST_PACKET_COUNT)
+#define TEST_SWAPPED_PACKET     5       /* Forwarded after the packet that follows it. */
+#define TEST_TIMEOUT_IN_MS      2000
+
+static int test_failed(const char* pName, const char* pMessage)
+{
+    printf("FAILED: %s: %s\n", pName, pMessage);
+    return 1;
+}
+
+static void test_generate_input(ma_int16* pSamples)
+{
+    for (ma_uint32 i = 0; i < TEST_FRAME_COUNT; ++i) {
+        const double sample = 32767.0 * sin(2 * MA_PI_D * 440 * i / TEST_SAMPLE_RATE);
+        pSamples[i] = (ma_int16)ma_clamp(sample * 1.25, -32768.0, 32767.0);   /* Overdriven so the peaks sit at full scale. */
+    }
+
+    pSamples[0] = -32768;
+    pSamples[1] = 32767;
+    pSamples[2] = -32767;
+}
+
+static ma_bool32 test_samples_match(ma_rtp_payload payload, ma_int32 x, ma_int32 y)
+{
+    if (payload == ma_rtp_payload_l16) {
+        return x == y;
+    }
+
+    /* G.711 keeps the error below 1/16 of the magnitude plus the smallest step, and full scale must stay full scale. */
+    if (ma_abs(y - x) > ma_abs(x) / 16 + 128) {
+        return MA_FALSE;
+    }
+
+    return ma_abs(x) < 32700 || (ma_abs(y) >= 30000 && (y > 0) == (x > 0));
+}
+
+static ma_uint32 test_read_be32(const ma_uint8* p)
+{
+    return ((ma_uint32)p[0] << 24) | ((ma_uint32)p[1] << 16) | ((ma_uint32)p[2] << 8) | p[3];
+}
+
+static ma_bool32 test_wait_for_packets_sent(ma_rtp_sender* pSender, ma_uint64 packetCount)
+{
+    ma_rtp_sender_stats stats;
+    for (ma_uint32 iWait = 0; iWait < TEST_TIMEOUT_IN_MS; ++iWait) {
+        ma_rtp_sender_get_stats(pSender, &stats);
+        if (stats.packetsSent >= packetCount) {
+            return MA_TRUE;
+        }
+
+        ma_sleep(1);
+    }
+
+    return MA_FALSE;
+}
+
+static int test_loopback(ma_rtp_payload payload, const char* pName)
+{
+    static ma_int16 input[TEST_FRAME_COUNT];
+    static ma_int16 output[TEST_FRAME_COUNT];
+    static ma_uint8 packets[TEST_PACKET_COUNT][MA_RTP_MAX_PACKET_SIZE];
+
+    test_generate_input(input);
+
+    ma_microphone_config microphoneConfig = ma_microphone_config_init(TEST_SAMPLE_RATE, 1, ma_format_s16, TEST_SAMPLE_RATE);
+    microphoneConfig.isHeadless = MA_TRUE;
+    ma_speaker_config speakerConfig = ma_speaker_config_init(TEST_SAMPLE_RATE, 1, ma_format_s16, TEST_SAMPLE_RATE);
+    speakerConfig.isHeadless = MA_TRUE;
+
+    ma_microphone* pMicrophone = ma_microphone_create_ex(&microphoneConfig);
+    ma_speaker* pSpeaker = ma_speaker_create_ex(&speakerConfig);
+    if (pMicrophone == NULL || pSpeaker == NULL) {
+        return test_failed(pName, "could not create the headless devices");
+    }
+
+    ma_rtp_receiver* pReceiver = ma_rtp_receiver_create(pSpeaker, 0, payload, TEST_FRAMES_PER_PACKET, 2);
+    if (pReceiver == NULL) {
+        return test_failed(pName, "could not create the receiver");
+    }
+
+    /* The relay sits between sender and receiver so the headers can be checked and the order changed. */
+    struct sockaddr_in relayAddress;
+    ma_zero_memory_64(&relayAddress, (ma_uint64)sizeof(relayAddress));
+    relayAddress.sin_family = AF_INET;
+    relayAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t relayAddressSize = sizeof(relayAddress);
+
+    ma_socket relay = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (relay == MA_INVALID_SOCKET || bind(relay, (const struct sockaddr*)&relayAddress, relayAddressSize) != 0 || getsockname(relay, (struct sockaddr*)&relayAddress, &relayAddressSize) != 0) {
+        return test_failed(pName, "could not bind the relay socket");
+    }
+
+    ma_socket_set_receive_timeout(relay, TEST_TIMEOUT_IN_MS);
+
+    ma_rtp_sender* pSender = ma_rtp_sender_create(pMicrophone, "127.0.0.1", ntohs(relayAddress.sin_port), payload, TEST_FRAMES_PER_PACKET);
+    if (pSender == NULL) {
+        return test_failed(pName, "could not create the sender");
+    }
+
+    /* One packet's worth of capture at a time so the sender's tap never overflows. */
+    const ma_uint32 packetSizeInBytes = MA_RTP_HEADER_SIZE + ma_rtp_payload_size(payload, 1, TEST_FRAMES_PER_PACKET);
+    for (ma_uint32 iPacket = 0; iPacket < TEST_PACKET_COUNT; ++iPacket) {
+        ma_microphone_data_callback(&pMicrophone->device, NULL, input + iPacket * TEST_FRAMES_PER_PACKET, TEST_FRAMES_PER_PACKET);
+        if (!test_wait_for_packets_sent(pSender, iPacket + 1)) {
+            return test_failed(pName, "the sender did not send");
+        }
+
+        if (recv(relay, (char*)packets[iPacket], MA_RTP_MAX_PACKET_SIZE, 0) != (int)packetSizeInBytes) {
+            return test_failed(pName, "the relay did not receive a whole packet");
+        }
+    }
+
+    ma_rtp_sender_destroy(pSender);
+
+    /* Sequence numbers step by one and timestamps by the packet's frame count, with one SSRC throughout. */
+    for (ma_uint32 iPacket = 0; iPacket < TEST_PACKET_COUNT; ++iPacket) {
+        const ma_uint8* pHeader = packets[iPacket];
+        const ma_uint8* pFirst = packets[0];
+        const ma_uint16 sequenceNumber = (ma_uint16)((pHeader[2] << 8) | pHeader[3]);
+        const ma_uint16 firstSequenceNumber = (ma_uint16)((pFirst[2] << 8) | pFirst[3]);
+
+        if (pHeader[0] != 0x80 || pHeader[1] != ma_rtp_payload_type(payload)) {
+            return test_failed(pName, "wrong version or payload type");
+        }
+
+        if (sequenceNumber != (ma_uint16)(firstSequenceNumber + iPacket)) {
+            return test_failed(pName, "sequence numbers are not consecutive");
+        }
+
+        if (test_read_be32(pHeader + 4) != test_read_be32(pFirst + 4) + iPacket * TEST_FRAMES_PER_PACKET) {
+            return test_failed(pName, "timestamps do not advance by the packet size");
+        }
+
+        if (test_read_be32(pHeader + 8) != test_read_be32(pFirst + 8)) {
+            return test_failed(pName, "the SSRC changed");
+        }
+    }
+
+    struct sockaddr_in receiverAddress = relayAddress;
+    receiverAddress.sin_port = htons(ma_rtp_receiver_get_port(pReceiver));
+
+    for (ma_uint32 iPacket = 0; iPacket < TEST_PACKET_COUNT; ++iPacket) {
+        ma_uint32 iForward = iPacket;
+        if (iPacket == TEST_SWAPPED_PACKET || iPacket == TEST_SWAPPED_PACKET + 1) {
+            iForward = (TEST_SWAPPED_PACKET * 2 + 1) - iPacket;
+        }
+
+        sendto(relay, (const char*)packets[iForward], (int)packetSizeInBytes, 0, (const struct sockaddr*)&receiverAddress, sizeof(receiverAddress));
+    }
+
+    ma_rtp_receiver_stats stats;
+    for (ma_uint32 iWait = 0; iWait < TEST_TIMEOUT_IN_MS; ++iWait) {
+        ma_rtp_receiver_get_stats(pReceiver, &stats);
+        if (stats.packetsPlayed + stats.packetsLost >= TEST_PACKET_COUNT) {
+            break;
+        }
+
+        ma_sleep(1);
+    }
+
+    ma_rtp_receiver_destroy(pReceiver);
+    ma_socket_close(relay);
+
+    if (stats.packetsPlayed != TEST_PACKET_COUNT || stats.packetsLost != 0 || stats.packetsLate != 0 || stats.packetsInvalid != 0 || stats.resyncCount != 0) {
+        return test_failed(pName, "the receiver did not play every packet exactly once");
+    }
+
+    if (stats.packetsReordered != 1) {
+        return test_failed(pName, "the swapped pair was not counted as reordered");
+    }
+
+    if (ma_pcm_rb_read_frames(&pSpeaker->ringBuffer, output, TEST_FRAME_COUNT) != TEST_FRAME_COUNT) {
+        return test_failed(pName, "the speaker did not receive every frame");
+    }
+
+    for (ma_uint32 i = 0; i < TEST_FRAME_COUNT; ++i) {
+        if (!test_samples_match(payload, input[i], output[i])) {
+            printf("FAILED: %s: frame %u sent as %d and played as %d\n", pName, i, (int)input[i], (int)output[i]);
+            return 1;
+        }
+    }
+
+    ma_speaker_destroy(pSpeaker);
+    ma_microphone_destroy(pMicrophone);
+
+    printf("%s loopback OK\n", pName);
+    return 0;
+}
+
+int main(void)
+{
+    if (test_loopback(ma_rtp_payload_l16, "L16") != 0 || test_loopback(ma_rtp_payload_ulaw, "mu-law") != 0) {
+        return 1;
+    }
+
+    printf("PASSED\n");
+    return 0;
+}